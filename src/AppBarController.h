@@ -15,4 +15,5 @@
 #import "TouchBarController.h"
 
 @interface AppBarController : TouchBarController
+- (void)resetAppProfiles:(NSDictionary *)profiles;
 @end
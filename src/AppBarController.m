@@ -12,13 +12,26 @@
  */
 
 #import "AppBarController.h"
+#import "LatencyHistogram.h"
+#import "Log.h"
 
 @interface AppBarController () <NSTouchBarDelegate>
 @end
 
+/*
+ * App profiles map the bundle identifier of the frontmost application to a list
+ * of item identifiers (appProfiles default). The touch bar of every profile is
+ * built once and its items are created up front, so that switching on activation
+ * is a dictionary lookup and a present. Items are created through the shared
+ * item table, so a widget that appears in several profiles is the same object
+ * and keeps its state. Applications without a profile get the main touch bar,
+ * which is the one that the user customizes.
+ */
 @implementation AppBarController
 {
     NSMutableDictionary *_items;
+    NSMutableDictionary<NSString *, NSTouchBar *> *_profiles;
+    NSTouchBar *_profileTouchBar;
 }
 
 - (id)init
@@ -34,6 +47,13 @@
 
 - (void)dealloc
 {
+    [[[NSWorkspace sharedWorkspace] notificationCenter]
+        removeObserver:self
+        name:NSWorkspaceDidActivateApplicationNotification
+        object:nil];
+
+    [_profileTouchBar release];
+    [_profiles release];
     [_items release];
 
     [super dealloc];
@@ -54,6 +74,9 @@
         @"ActiveApp",
         @"NowPlaying",
         @"Todo",
+        @"MetricsFeed",
+        @"ShellCommand",
+        @"SystemMetrics",
         @"Control",
         @"Weather",
         @"Clock",
@@ -64,6 +87,92 @@
     [super awakeFromNib];
 }
 
+- (void)resetAppProfiles:(NSDictionary *)profiles
+{
+    NSMutableDictionary<NSString *, NSTouchBar *> *touchBars = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString *, NSTouchBar *> *result = [NSMutableDictionary dictionary];
+
+    for (NSString *bundleIdentifier in profiles)
+    {
+        NSArray *identifiers = [profiles objectForKey:bundleIdentifier];
+        if (![bundleIdentifier isKindOfClass:[NSString class]] ||
+            ![identifiers isKindOfClass:[NSArray class]])
+            continue;
+
+        /* applications with the same items share a touch bar */
+        NSString *key = [identifiers componentsJoinedByString:@"\n"];
+        NSTouchBar *touchBar = [touchBars objectForKey:key];
+        if (nil == touchBar)
+        {
+            touchBar = [[[NSTouchBar alloc] init] autorelease];
+            touchBar.delegate = self;
+            touchBar.defaultItemIdentifiers = identifiers;
+            for (NSTouchBarItemIdentifier identifier in touchBar.itemIdentifiers)
+                [touchBar itemForIdentifier:identifier];
+            [touchBars setObject:touchBar forKey:key];
+        }
+        [result setObject:touchBar forKey:bundleIdentifier];
+    }
+
+    [_profiles release];
+    _profiles = [result copy];
+
+    [[[NSWorkspace sharedWorkspace] notificationCenter]
+        removeObserver:self
+        name:NSWorkspaceDidActivateApplicationNotification
+        object:nil];
+    if (0 < _profiles.count)
+        [[[NSWorkspace sharedWorkspace] notificationCenter]
+            addObserver:self
+            selector:@selector(didActivateApplication:)
+            name:NSWorkspaceDidActivateApplicationNotification
+            object:nil];
+
+    [self switchToApplication:[[NSWorkspace sharedWorkspace] frontmostApplication]];
+}
+
+- (void)didActivateApplication:(NSNotification *)notification
+{
+    [self switchToApplication:[notification.userInfo objectForKey:NSWorkspaceApplicationKey]];
+}
+
+- (void)switchToApplication:(NSRunningApplication *)app
+{
+    NSString *bundleIdentifier = app.bundleIdentifier;
+    NSTouchBar *touchBar = nil != bundleIdentifier ? [_profiles objectForKey:bundleIdentifier] : nil;
+    if (_profileTouchBar == touchBar)
+        return;
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+
+    BOOL presented = self.presented;
+    if (presented)
+        [self dismiss];
+
+    [_profileTouchBar release];
+    _profileTouchBar = [touchBar retain];
+
+    if (presented)
+        [self present];
+
+    NSTimeInterval elapsed = [NSProcessInfo processInfo].systemUptime - start;
+    LatencyHistogramRecord(LatencyHistogramGet("ProfileSwitch"), elapsed);
+    LOG("%{public}s: %.2fms", nil != touchBar ? bundleIdentifier.UTF8String : "default",
+        elapsed * 1000);
+}
+
+- (NSTouchBar *)activeTouchBar
+{
+    return nil != _profileTouchBar ? _profileTouchBar : self.touchBar;
+}
+
+- (__kindof NSTouchBarItem *)itemForIdentifier:(NSTouchBarItemIdentifier)identifier
+{
+    /* items that only appear in app profiles are not in the main touch bar */
+    NSTouchBarItem *item = [self.touchBar itemForIdentifier:identifier];
+    return nil != item ? item : [_items objectForKey:identifier];
+}
+
 - (NSTouchBarItem *)touchBar:(NSTouchBar *)touchBar
     makeItemForIdentifier:(NSTouchBarItemIdentifier)identifier
 {
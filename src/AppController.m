@@ -13,22 +13,28 @@
 
 #import "AppController.h"
 #import <OctoFeed/OctoFeed.h>
+#import "AppBarController.h"
 #import "ClockWidget.h"
 #import "DockWidget.h"
 #import "FSNotify.h"
+#import "LatencyHistogram.h"
+#import "Log.h"
 #import "LoginItem.h"
+#import "MetadataStore.h"
 #import "NowPlayingWidget.h"
 #import "NSView+TouchBarHitTest.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
+#import "Settings.h"
+#import "StartupTimings.h"
 #import "TodoWidget.h"
 #import "TouchBarController.h"
 #import "WeatherWidget.h"
 
-static const NSTimeInterval IgnoresAccidentalTouchesDuration = 0.3;
-
 @interface AppController () <NSApplicationDelegate, NSWindowDelegate>
 - (void)fsnotify:(const char *)path;
 @property (retain) NSString *standardDefaultAppsFolder;
-@property (assign) IBOutlet TouchBarController *touchBarController;
+@property (assign) IBOutlet AppBarController *touchBarController;
 @property (assign) IBOutlet NSWindow *window;
 @property (assign) IBOutlet NSView *generalView;
 @property (assign) IBOutlet NSView *widgetsView;
@@ -72,6 +78,13 @@ static void AppControllerFSNotify(const char *path, void *data)
         stringByExpandingTildeInPath];
     [defaults setObject:self.standardDefaultAppsFolder forKey:@"defaultAppsFolder"];
     [[NSUserDefaults standardUserDefaults] registerDefaults:defaults];
+    [[Settings sharedInstance] reload];
+    [self resetResourceBudgets];
+    [[RefreshPolicyMonitor sharedInstance] resetProfiles:[[NSUserDefaults standardUserDefaults]
+        dictionaryForKey:@"refreshProfiles"]];
+    [self.touchBarController resetAppProfiles:[[NSUserDefaults standardUserDefaults]
+        dictionaryForKey:@"appProfiles"]];
+    StartupTimingsMark("defaults");
 
     if ([[NSUserDefaults standardUserDefaults] boolForKey:@"automaticUpdates"])
         [[OctoFeed mainBundleFeed] activateWithInstallPolicy:OctoFeedInstallAtActivation];
@@ -89,6 +102,7 @@ static void AppControllerFSNotify(const char *path, void *data)
 
     FSNotifyStop(_stream);
     _stream = FSNotifyStart([defaultAppsFolder UTF8String], AppControllerFSNotify, self);
+    StartupTimingsMark("fsnotify");
 
     [[[NSWorkspace sharedWorkspace] notificationCenter]
         addObserver:self
@@ -126,8 +140,9 @@ static void AppControllerFSNotify(const char *path, void *data)
     [self setContentView:self.generalView];
     if (![[NSUserDefaults standardUserDefaults] boolForKey:@"mainWindowHidden"])
         [self showMainWindow:nil];
+    StartupTimingsMark("window");
 
-    [[self.touchBarController.touchBar itemForIdentifier:@"Clock"]
+    [[self.touchBarController itemForIdentifier:@"Clock"]
         setPressTarget:self
         action:@selector(showMainWindow:)];
     [self settingsChange:nil];
@@ -144,6 +159,24 @@ static void AppControllerFSNotify(const char *path, void *data)
         [alert runModal];
         [NSApp terminate:nil];
     }
+    StartupTimingsMark("touchbar");
+
+    /* runs after the first paint and after the Dock has reconciled its warm start model */
+    [self performSelector:@selector(logStartupTimings) withObject:nil afterDelay:0];
+}
+
+- (void)logStartupTimings
+{
+    StartupTiming timings[32];
+    size_t count = StartupTimingsGet(timings, sizeof timings / sizeof timings[0]);
+    for (size_t i = 0; count > i; i++)
+        LOG("%{public}s %.1fms", timings[i].phase, timings[i].elapsed * 1000);
+
+    /* the warm start exists so that the Dock paints early; report launches where it did not */
+    double budget = [[NSUserDefaults standardUserDefaults] doubleForKey:@"startupDockBudget"];
+    double elapsed = StartupTimingsElapsed("dock snapshot");
+    if (0 < budget && budget < elapsed)
+        LOG("dock snapshot %.1fms exceeds budget %.1fms", elapsed * 1000, budget * 1000);
 }
 
 - (BOOL)applicationShouldHandleReopen:(NSApplication *)sender hasVisibleWindows:(BOOL)flag
@@ -200,7 +233,7 @@ static void AppControllerFSNotify(const char *path, void *data)
 
 - (void)fsnotify:(const char *)path
 {
-    [[self.touchBarController.touchBar itemForIdentifier:@"Dock"] reset];
+    [[self.touchBarController itemForIdentifier:@"Dock"] reset];
 }
 
 - (void)settingsChange:(NSNotification *)notification
@@ -238,7 +271,7 @@ static void AppControllerFSNotify(const char *path, void *data)
     _stream = FSNotifyStart([[[NSUserDefaults standardUserDefaults]
         stringForKey:@"defaultAppsFolder"] UTF8String], AppControllerFSNotify, self);
 
-    [[self.touchBarController.touchBar itemForIdentifier:@"Dock"] reset];
+    [[self.touchBarController itemForIdentifier:@"Dock"] reset];
 }
 
 - (IBAction)resetFromDockAction:(id)sender
@@ -334,7 +367,7 @@ static void AppControllerFSNotify(const char *path, void *data)
 
     [[NSUserDefaults standardUserDefaults]
         setObject:self.standardDefaultAppsFolder forKey:@"defaultAppsFolder"];
-    [[self.touchBarController.touchBar itemForIdentifier:@"Dock"] reset];
+    [[self.touchBarController itemForIdentifier:@"Dock"] reset];
 }
 
 - (IBAction)showAppsFolderAction:(id)sender
@@ -349,8 +382,9 @@ static void AppControllerFSNotify(const char *path, void *data)
 
 - (IBAction)ignoresAccidentalTouchesChange:(id)sender
 {
-    BOOL ignoresAccidentalTouches = [[NSUserDefaults standardUserDefaults]
-        boolForKey:@"ignoresAccidentalTouches"];
+    [[Settings sharedInstance] reload];
+
+    BOOL ignoresAccidentalTouches = GetSettings()->ignoresAccidentalTouches;
     if (ignoresAccidentalTouches)
     {
         if (nil != _keyEventMonitor)
@@ -360,11 +394,10 @@ static void AppControllerFSNotify(const char *path, void *data)
             handler:^(NSEvent *event)
             {
                 //NSLog(@"monitor: %@", event);
-                [NSView enableTouchBarHitTest:nil];
-                [NSView
-                    performSelector:@selector(enableTouchBarHitTest:)
-                    withObject:self
-                    afterDelay:IgnoresAccidentalTouchesDuration];
+                /* auto-repeat is not typing: it would read as a very fast cadence */
+                if (event.isARepeat)
+                    return;
+                [NSView suppressTouchBarHitTestAfterKeyDown:event.timestamp];
             }];
     }
     else
@@ -377,12 +410,13 @@ static void AppControllerFSNotify(const char *path, void *data)
 
 - (IBAction)dockWidgetSettingsChange:(id)sender
 {
-    [[self.touchBarController.touchBar itemForIdentifier:@"Dock"] reset];
+    /* the Dock widget subscribes to the settings fields it cares about */
+    [[Settings sharedInstance] reload];
 }
 
 - (IBAction)clockWidgetSettingsChange:(id)sender
 {
-    ClockWidget *clock = [self.touchBarController.touchBar itemForIdentifier:@"Clock"];
+    ClockWidget *clock = [self.touchBarController itemForIdentifier:@"Clock"];
     clock.formatter.dateFormat =
         [[NSUserDefaults standardUserDefaults] boolForKey:@"shows24HourClock"] ?
             @"H:mm" :
@@ -399,18 +433,18 @@ static void AppControllerFSNotify(const char *path, void *data)
     NSUInteger temperatureUnit =
         [[NSUserDefaults standardUserDefaults] boolForKey:@"weatherShowsFahrenheit"] ? 'F' : 'C';
 
-    ClockWidget *clock = [self.touchBarController.touchBar itemForIdentifier:@"Clock"];
+    ClockWidget *clock = [self.touchBarController itemForIdentifier:@"Clock"];
     clock.temperatureUnit = temperatureUnit;
     [clock resetWeather];
 
-    WeatherWidget *weather = [self.touchBarController.touchBar itemForIdentifier:@"Weather"];
+    WeatherWidget *weather = [self.touchBarController itemForIdentifier:@"Weather"];
     weather.temperatureUnit = temperatureUnit;
     [weather resetWeather];
 }
 
 - (IBAction)nowPlayingWidgetSettingsChange:(id)sender
 {
-    NowPlayingWidget *widget = [self.touchBarController.touchBar itemForIdentifier:@"NowPlaying"];
+    NowPlayingWidget *widget = [self.touchBarController itemForIdentifier:@"NowPlaying"];
     widget.showsActiveAppOnTap = [[NSUserDefaults standardUserDefaults]
         boolForKey:@"showsActiveAppOnTap"];
     widget.showsTodoOnTap = [[NSUserDefaults standardUserDefaults]
@@ -425,12 +459,12 @@ static void AppControllerFSNotify(const char *path, void *data)
         [[NSUserDefaults standardUserDefaults] doubleForKey:@"todoShowsEventsHours"] : 0;
     bool showsReminders = [[NSUserDefaults standardUserDefaults] boolForKey:@"todoShowsReminders"];
 
-    NowPlayingWidget *nowPlaying = [self.touchBarController.touchBar itemForIdentifier:@"NowPlaying"];
+    NowPlayingWidget *nowPlaying = [self.touchBarController itemForIdentifier:@"NowPlaying"];
     nowPlaying.todoShowsEventsInterval = 60 * 60 * showsEventsHours;
     nowPlaying.todoShowsReminders = showsReminders;
     [nowPlaying todoReset];
 
-    TodoWidget *todo = [self.touchBarController.touchBar itemForIdentifier:@"Todo"];
+    TodoWidget *todo = [self.touchBarController itemForIdentifier:@"Todo"];
     todo.showsEventsInterval = 60 * 60 * showsEventsHours;
     todo.showsReminders = showsReminders;
     [todo reset];
@@ -492,6 +526,121 @@ static void AppControllerFSNotify(const char *path, void *data)
         [[OctoFeed mainBundleFeed] deactivate];
 }
 
+- (void)resetResourceBudgets
+{
+    /* heap accounting samples process-wide malloc statistics twice per span; opt-in */
+    ResourceAccountingEnableHeapProbe([[NSUserDefaults standardUserDefaults]
+        boolForKey:@"widgetHeapAccounting"]);
+
+    /* widget name to CPU fraction, e.g. Weather = 0.001 */
+    NSDictionary *budgets = [[NSUserDefaults standardUserDefaults]
+        dictionaryForKey:@"widgetCpuBudgets"];
+    for (NSString *name in budgets)
+    {
+        id budget = [budgets objectForKey:name];
+        if ([budget respondsToSelector:@selector(doubleValue)])
+            ResourceAccountSetBudget(ResourceAccountGet(name.UTF8String), [budget doubleValue]);
+    }
+}
+
+- (IBAction)widgetUsageAction:(id)sender
+{
+    /* resource usage table, blank line, refresh policy table */
+    size_t usageSize = ResourceAccountingFormat(0, 0);
+    size_t size = usageSize + 1 + RefreshPolicyFormat(0, 0) + 1;
+    char *buf = malloc(size);
+    if (0 == buf)
+        return;
+    size_t n = ResourceAccountingFormat(buf, usageSize + 1);
+    if (usageSize < n)
+        n = usageSize;
+    buf[n] = '\n';
+    RefreshPolicyFormat(buf + n + 1, size - n - 1);
+    NSString *report = [NSString stringWithUTF8String:buf];
+    free(buf);
+
+    MetadataIndexStats metadataStats = [[MetadataStore sharedInstance] statistics];
+    uint64_t lookups = metadataStats.hits + metadataStats.misses;
+    report = [report stringByAppendingFormat:
+        @"\nMetadata index: %llu lookups, %.1f%% hits, %llu invalidations, %llu evictions, "
+        "%zu/%zu entries\n",
+        (unsigned long long)lookups,
+        0 != lookups ? 100.0 * metadataStats.hits / lookups : 0.0,
+        (unsigned long long)metadataStats.invalidations,
+        (unsigned long long)metadataStats.evictions,
+        metadataStats.count, metadataStats.maxCount];
+
+    [self
+        showReport:report
+        messageText:@"Widget Resource Usage"
+        informativeText:@"Wakeups, CPU time and heap growth of widget callbacks "
+            "since EnergyBar started (heap growth only with widgetHeapAccounting). Div is the factor by which a widget over its CPU budget "
+            "has its refresh rate reduced. The second table estimates the wakeups of the running "
+            "timers under each power profile; the last line summarizes the file metadata index."
+        fileName:@"EnergyBar Widget Usage.txt"];
+}
+
+- (IBAction)inputLatencyAction:(id)sender
+{
+    size_t size = LatencyHistogramFormat(0, 0) + 1;
+    char *buf = malloc(size);
+    if (0 == buf)
+        return;
+    LatencyHistogramFormat(buf, size);
+    NSString *report = [NSString stringWithUTF8String:buf];
+    free(buf);
+
+    [self
+        showReport:report
+        messageText:@"Input Latency"
+        informativeText:@"Time from a touch to its effect (app activation, brightness or "
+            "volume change, media key, folder presented) and of app profile switches "
+            "since EnergyBar started. "
+            "Percentiles are accurate to within about 3%."
+        fileName:@"EnergyBar Input Latency.txt"];
+}
+
+- (void)showReport:(NSString *)report
+    messageText:(NSString *)messageText
+    informativeText:(NSString *)informativeText
+    fileName:(NSString *)fileName
+{
+    NSScrollView *scrollView = [[[NSScrollView alloc]
+        initWithFrame:NSMakeRect(0, 0, 600, 200)] autorelease];
+    scrollView.hasVerticalScroller = YES;
+    scrollView.borderType = NSBezelBorder;
+    NSTextView *textView = [[[NSTextView alloc]
+        initWithFrame:NSMakeRect(0, 0, scrollView.contentSize.width, scrollView.contentSize.height)]
+        autorelease];
+    textView.editable = NO;
+    textView.font = [NSFont userFixedPitchFontOfSize:[NSFont smallSystemFontSize]];
+    textView.string = nil != report ? report : @"";
+    scrollView.documentView = textView;
+
+    NSAlert *alert = [[[NSAlert alloc] init] autorelease];
+    alert.messageText = messageText;
+    alert.informativeText = informativeText;
+    alert.accessoryView = scrollView;
+    [alert addButtonWithTitle:@"OK"];
+    [alert addButtonWithTitle:@"Save…"];
+    [alert beginSheetModalForWindow:self.window completionHandler:^(NSModalResponse resp)
+    {
+        if (NSAlertSecondButtonReturn != resp)
+            return;
+
+        NSSavePanel *panel = [NSSavePanel savePanel];
+        panel.nameFieldStringValue = fileName;
+        [panel beginSheetModalForWindow:self.window completionHandler:^(NSModalResponse result)
+        {
+            if (NSModalResponseOK != result)
+                return;
+
+            if (![report writeToURL:panel.URL atomically:YES encoding:NSUTF8StringEncoding error:0])
+                NSBeep();
+        }];
+    }];
+}
+
 - (IBAction)versionAction:(id)sender
 {
     self.versionButton.hidden = YES;
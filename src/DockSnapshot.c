@@ -0,0 +1,394 @@
+/**
+ * @file DockSnapshot.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "DockSnapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DockSnapshotMagic               0x53444245  /* 'EBDS' */
+#define DockSnapshotVersion             2
+#define DockSnapshotMaxSize             (4 * 1024 * 1024)
+#define DockSnapshotMaxIconSize         256
+#define DockSnapshotNone                UINT32_MAX
+
+/*
+ * Layout: header, entries[count], pixels[pixelCount], strings[stringsSize].
+ * Strings are NUL-terminated and referenced by offset into the string table;
+ * icons are referenced by offset into the pixel table (in pixels).
+ */
+struct DockSnapshotHeader
+{
+    uint32_t magic, version;
+    uint32_t count, stringsSize;
+    uint32_t root;
+    uint32_t pixelCount;
+};
+
+struct DockSnapshotEntry
+{
+    uint32_t path;
+    uint8_t group, flags;
+    uint16_t reserved;
+    uint32_t iconKey, icon;             /* DockSnapshotNone if there is no icon */
+    uint16_t iconWidth, iconHeight;
+};
+
+struct DockSnapshot
+{
+    void *base;
+    size_t size;
+    const struct DockSnapshotHeader *header;
+    const struct DockSnapshotEntry *entries;
+    const uint32_t *pixels;
+    const char *strings;
+};
+
+struct DockSnapshotBuilder
+{
+    struct DockSnapshotEntry *entries;
+    size_t count, capacity;
+    char *strings;
+    size_t stringsSize, stringsCapacity;
+    uint32_t *pixels;
+    size_t pixelCount, pixelCapacity;
+    uint32_t root;
+    void *data;
+    size_t dataSize;
+};
+
+DockSnapshot *DockSnapshotOpen(const char *path)
+{
+    DockSnapshot *res = 0;
+    int fd = -1;
+    struct stat st;
+    void *base = MAP_FAILED;
+    DockSnapshot *snapshot = 0;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        goto exit;
+
+    if (-1 == fstat(fd, &st) ||
+        (off_t)sizeof(struct DockSnapshotHeader) > st.st_size ||
+        DockSnapshotMaxSize < st.st_size)
+        goto exit;
+
+    base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == base)
+        goto exit;
+
+    /* validate everything once, so that item access needs no further checks */
+    const struct DockSnapshotHeader *header = base;
+    size_t size = (size_t)st.st_size;
+    size_t entriesSize = (size_t)header->count * sizeof(struct DockSnapshotEntry);
+    size_t pixelsSize = (size_t)header->pixelCount * sizeof(uint32_t);
+    if (DockSnapshotMagic != header->magic ||
+        DockSnapshotVersion != header->version ||
+        0 == header->stringsSize ||
+        size != sizeof *header + entriesSize + pixelsSize + header->stringsSize)
+        goto exit;
+
+    const struct DockSnapshotEntry *entries = (const void *)(header + 1);
+    const uint32_t *pixels = (const void *)(entries + header->count);
+    const char *strings = (const char *)(pixels + header->pixelCount);
+    if ('\0' != strings[header->stringsSize - 1] ||
+        header->stringsSize <= header->root)
+        goto exit;
+    for (uint32_t i = 0; header->count > i; i++)
+    {
+        const struct DockSnapshotEntry *entry = &entries[i];
+        if (header->stringsSize <= entry->path)
+            goto exit;
+        if (DockSnapshotNone != entry->icon &&
+            (header->stringsSize <= entry->iconKey ||
+            0 == entry->iconWidth || DockSnapshotMaxIconSize < entry->iconWidth ||
+            0 == entry->iconHeight || DockSnapshotMaxIconSize < entry->iconHeight ||
+            header->pixelCount < entry->icon ||
+            header->pixelCount - entry->icon < (uint32_t)entry->iconWidth * entry->iconHeight))
+            goto exit;
+    }
+
+    snapshot = malloc(sizeof *snapshot);
+    if (0 == snapshot)
+        goto exit;
+
+    snapshot->base = base;
+    snapshot->size = size;
+    snapshot->header = header;
+    snapshot->entries = entries;
+    snapshot->pixels = pixels;
+    snapshot->strings = strings;
+
+    res = snapshot;
+
+exit:
+    if (0 == res && MAP_FAILED != base)
+        munmap(base, (size_t)st.st_size);
+
+    if (-1 != fd)
+        close(fd);
+
+    return res;
+}
+
+void DockSnapshotClose(DockSnapshot *snapshot)
+{
+    if (0 == snapshot)
+        return;
+
+    munmap(snapshot->base, snapshot->size);
+    free(snapshot);
+}
+
+const char *DockSnapshotRoot(DockSnapshot *snapshot)
+{
+    return snapshot->strings + snapshot->header->root;
+}
+
+size_t DockSnapshotCount(DockSnapshot *snapshot)
+{
+    return snapshot->header->count;
+}
+
+bool DockSnapshotItemAtIndex(DockSnapshot *snapshot, size_t index, DockSnapshotItem *item)
+{
+    if (snapshot->header->count <= index)
+        return false;
+
+    const struct DockSnapshotEntry *entry = snapshot->entries + index;
+    item->path = snapshot->strings + entry->path;
+    item->group = entry->group;
+    item->flags = entry->flags;
+    if (DockSnapshotNone != entry->icon)
+    {
+        item->iconKey = snapshot->strings + entry->iconKey;
+        item->iconPixels = snapshot->pixels + entry->icon;
+        item->iconWidth = entry->iconWidth;
+        item->iconHeight = entry->iconHeight;
+    }
+    else
+    {
+        item->iconKey = 0;
+        item->iconPixels = 0;
+        item->iconWidth = item->iconHeight = 0;
+    }
+
+    return true;
+}
+
+const void *DockSnapshotData(DockSnapshot *snapshot, size_t *psize)
+{
+    *psize = snapshot->size;
+    return snapshot->base;
+}
+
+static bool DockSnapshotBuilderAddString(DockSnapshotBuilder *builder, const char *str, uint32_t *poffset)
+{
+    size_t len = strlen(str) + 1;
+    if (builder->stringsSize + len > builder->stringsCapacity)
+    {
+        size_t capacity = 0 != builder->stringsCapacity ? builder->stringsCapacity : 1024;
+        while (builder->stringsSize + len > capacity)
+            capacity *= 2;
+        char *strings = realloc(builder->strings, capacity);
+        if (0 == strings)
+            return false;
+        builder->strings = strings;
+        builder->stringsCapacity = capacity;
+    }
+
+    memcpy(builder->strings + builder->stringsSize, str, len);
+    *poffset = (uint32_t)builder->stringsSize;
+    builder->stringsSize += len;
+
+    return true;
+}
+
+DockSnapshotBuilder *DockSnapshotBuilderCreate(const char *root)
+{
+    DockSnapshotBuilder *builder = calloc(1, sizeof *builder);
+    if (0 == builder)
+        return 0;
+
+    if (!DockSnapshotBuilderAddString(builder, 0 != root ? root : "", &builder->root))
+    {
+        DockSnapshotBuilderDelete(builder);
+        return 0;
+    }
+
+    return builder;
+}
+
+void DockSnapshotBuilderDelete(DockSnapshotBuilder *builder)
+{
+    if (0 == builder)
+        return;
+
+    free(builder->entries);
+    free(builder->strings);
+    free(builder->pixels);
+    free(builder->data);
+    free(builder);
+}
+
+bool DockSnapshotBuilderAdd(DockSnapshotBuilder *builder, const char *path, uint8_t group, uint8_t flags)
+{
+    if (0 == path)
+        return false;
+
+    if (builder->count >= builder->capacity)
+    {
+        size_t capacity = 0 != builder->capacity ? builder->capacity * 2 : 16;
+        struct DockSnapshotEntry *entries = realloc(builder->entries, capacity * sizeof *entries);
+        if (0 == entries)
+            return false;
+        builder->entries = entries;
+        builder->capacity = capacity;
+    }
+
+    struct DockSnapshotEntry *entry = builder->entries + builder->count;
+    if (!DockSnapshotBuilderAddString(builder, path, &entry->path))
+        return false;
+    entry->group = group;
+    entry->flags = flags;
+    entry->reserved = 0;
+    entry->iconKey = entry->icon = DockSnapshotNone;
+    entry->iconWidth = entry->iconHeight = 0;
+    builder->count++;
+
+    free(builder->data);
+    builder->data = 0;
+
+    return true;
+}
+
+bool DockSnapshotBuilderSetIcon(DockSnapshotBuilder *builder, size_t index,
+    const char *key, const uint32_t *pixels, unsigned width, unsigned height)
+{
+    if (builder->count <= index || 0 == key || 0 == pixels ||
+        0 == width || DockSnapshotMaxIconSize < width ||
+        0 == height || DockSnapshotMaxIconSize < height)
+        return false;
+
+    size_t count = (size_t)width * height;
+    if (builder->pixelCount + count > builder->pixelCapacity)
+    {
+        size_t capacity = 0 != builder->pixelCapacity ? builder->pixelCapacity : 64 * 64;
+        while (builder->pixelCount + count > capacity)
+            capacity *= 2;
+        uint32_t *newPixels = realloc(builder->pixels, capacity * sizeof *newPixels);
+        if (0 == newPixels)
+            return false;
+        builder->pixels = newPixels;
+        builder->pixelCapacity = capacity;
+    }
+
+    struct DockSnapshotEntry *entry = builder->entries + index;
+    if (!DockSnapshotBuilderAddString(builder, key, &entry->iconKey))
+        return false;
+    memcpy(builder->pixels + builder->pixelCount, pixels, count * sizeof *pixels);
+    entry->icon = (uint32_t)builder->pixelCount;
+    entry->iconWidth = (uint16_t)width;
+    entry->iconHeight = (uint16_t)height;
+    builder->pixelCount += count;
+
+    free(builder->data);
+    builder->data = 0;
+
+    return true;
+}
+
+const void *DockSnapshotBuilderData(DockSnapshotBuilder *builder, size_t *psize)
+{
+    if (0 == builder->data)
+    {
+        size_t entriesSize = builder->count * sizeof *builder->entries;
+        size_t pixelsSize = builder->pixelCount * sizeof *builder->pixels;
+        size_t size = sizeof(struct DockSnapshotHeader) + entriesSize + pixelsSize + builder->stringsSize;
+        if (DockSnapshotMaxSize < size)
+            return 0;
+
+        char *data = calloc(1, size);
+        if (0 == data)
+            return 0;
+
+        struct DockSnapshotHeader *header = (void *)data;
+        header->magic = DockSnapshotMagic;
+        header->version = DockSnapshotVersion;
+        header->count = (uint32_t)builder->count;
+        header->stringsSize = (uint32_t)builder->stringsSize;
+        header->root = builder->root;
+        header->pixelCount = (uint32_t)builder->pixelCount;
+        memcpy(header + 1, builder->entries, entriesSize);
+        if (0 != pixelsSize)
+            memcpy(data + sizeof *header + entriesSize, builder->pixels, pixelsSize);
+        memcpy(data + sizeof *header + entriesSize + pixelsSize, builder->strings, builder->stringsSize);
+
+        builder->data = data;
+        builder->dataSize = size;
+    }
+
+    *psize = builder->dataSize;
+    return builder->data;
+}
+
+bool DockSnapshotWrite(const char *path, const void *data, size_t size)
+{
+    bool res = false;
+    char *tmppath = 0;
+    int fd = -1;
+
+    size_t len = strlen(path);
+    tmppath = malloc(len + sizeof ".tmp");
+    if (0 == tmppath)
+        goto exit;
+    memcpy(tmppath, path, len);
+    memcpy(tmppath + len, ".tmp", sizeof ".tmp");
+
+    fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == fd)
+        goto exit;
+
+    for (size_t offset = 0; size > offset;)
+    {
+        ssize_t bytes = write(fd, (const char *)data + offset, size - offset);
+        if (-1 == bytes)
+            goto exit;
+        offset += (size_t)bytes;
+    }
+
+    close(fd);
+    fd = -1;
+
+    /* readers map the old file or the new one, never a partial write */
+    if (-1 == rename(tmppath, path))
+        goto exit;
+
+    res = true;
+
+exit:
+    if (-1 != fd)
+        close(fd);
+
+    if (!res && 0 != tmppath)
+        unlink(tmppath);
+
+    free(tmppath);
+
+    return res;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file DockSnapshot.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef DOCKSNAPSHOT_H_INCLUDED
+#define DOCKSNAPSHOT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A compact binary snapshot of the Dock model: the folder it was built from
+ * and its ordered items (resolved path, group, flags, icon). It is written
+ * whenever the model changes and mapped read-only at launch, so that the Dock
+ * can paint before the folder is enumerated, its aliases resolved and its
+ * icons drawn.
+ *
+ * The group and flags are opaque to this module. An icon is 32-bit pixels
+ * (stride is width pixels) with the key it was cached under when the snapshot
+ * was built; items may have no icon.
+ */
+typedef struct DockSnapshot DockSnapshot;
+typedef struct DockSnapshotBuilder DockSnapshotBuilder;
+
+typedef struct
+{
+    const char *path;
+    uint8_t group, flags;
+    const char *iconKey;                /* 0 if there is no icon */
+    const uint32_t *iconPixels;
+    unsigned iconWidth, iconHeight;
+} DockSnapshotItem;
+
+DockSnapshot *DockSnapshotOpen(const char *path);
+void DockSnapshotClose(DockSnapshot *snapshot);
+const char *DockSnapshotRoot(DockSnapshot *snapshot);
+size_t DockSnapshotCount(DockSnapshot *snapshot);
+bool DockSnapshotItemAtIndex(DockSnapshot *snapshot, size_t index, DockSnapshotItem *item);
+const void *DockSnapshotData(DockSnapshot *snapshot, size_t *psize);
+
+DockSnapshotBuilder *DockSnapshotBuilderCreate(const char *root);
+void DockSnapshotBuilderDelete(DockSnapshotBuilder *builder);
+bool DockSnapshotBuilderAdd(DockSnapshotBuilder *builder, const char *path, uint8_t group, uint8_t flags);
+bool DockSnapshotBuilderSetIcon(DockSnapshotBuilder *builder, size_t index,
+    const char *key, const uint32_t *pixels, unsigned width, unsigned height);
+const void *DockSnapshotBuilderData(DockSnapshotBuilder *builder, size_t *psize);
+
+bool DockSnapshotWrite(const char *path, const void *data, size_t size);
+
+#endif
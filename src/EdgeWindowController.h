@@ -15,6 +15,17 @@
 
 @class EdgeWindowController;
 
+@interface EdgeWindowDragSession : NSObject
++ (id)sessionWithDraggingInfo:(id<NSDraggingInfo>)info;
+@property (readonly) NSArray *urls;
+@property (readonly) NSMutableDictionary *cache;    /* per target metadata kept by the delegate */
+@property (assign) id lastTarget;
+@property (assign) NSUInteger lastGeneration;
+@property (assign) NSDragOperation lastOperation;
+@property (assign) NSDragOperation lastResult;
+@property (assign) BOOL hasLastResult;
+@end
+
 @protocol EdgeWindowControllerDelegate <NSObject>
 @optional
 - (void)edgeWindowController:(EdgeWindowController *)controller
@@ -31,4 +42,5 @@
 @interface EdgeWindowController : NSWindowController
 + (id)controller;
 @property (assign) id<EdgeWindowControllerDelegate> delegate;
+@property (readonly) EdgeWindowDragSession *dragSession;
 @end
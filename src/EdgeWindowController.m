@@ -12,17 +12,49 @@
  */
 
 #import "EdgeWindowController.h"
+#import "RefreshPolicy.h"
 
 static const CGFloat ScreenWidthInTouchBarUnits = 1252;     /* don't ask! */
 static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
+static const NSTimeInterval EdgeWindowHoverInterval = 0.05;
+
+@interface EdgeWindowDragSession ()
+@property (retain) NSArray *urls;
+@property (retain) NSMutableDictionary *cache;
+@end
+
+@implementation EdgeWindowDragSession
++ (id)sessionWithDraggingInfo:(id<NSDraggingInfo>)info
+{
+    EdgeWindowDragSession *session = [[[EdgeWindowDragSession alloc] init] autorelease];
+    if ([info.draggingPasteboard.types containsObject:NSFilesPromisePboardType])
+        session.urls = [NSArray array];
+    else
+        session.urls = [info.draggingPasteboard
+            readObjectsForClasses:[NSArray arrayWithObject:[NSURL class]]
+            options:nil];
+    session.cache = [NSMutableDictionary dictionary];
+    return session;
+}
+
+- (void)dealloc
+{
+    self.urls = nil;
+    self.cache = nil;
+
+    [super dealloc];
+}
+@end
 
 @interface EdgeWindowController () <NSWindowDelegate>
+@property (retain) EdgeWindowDragSession *dragSession;
 @end
 
 @implementation EdgeWindowController
 {
     NSTrackingRectTag _trackTag;
     NSTimer *_trackTimer;
+    BOOL _trackInside;                  /* clicks; needs no timer */
     BOOL _trackSentHover;
 }
 
@@ -84,13 +116,19 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
     [[NSNotificationCenter defaultCenter]
         removeObserver:self];
 
-    [_trackTimer invalidate];
-    [_trackTimer release];
-    _trackTimer = nil;
+    if (nil != _trackTimer)
+    {
+        [_trackTimer invalidate];
+        [_trackTimer release];
+        _trackTimer = nil;
+        RefreshPolicyTimerClear("Hover");
+    }
 
     if (0 != _trackTag)
         [self.window.contentView removeTrackingRect:_trackTag];
 
+    self.dragSession = nil;
+
     [self.window close];
     self.window = nil;
 
@@ -135,16 +173,23 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 
 - (void)mouseEntered:(NSEvent *)event
 {
+    _trackInside = YES;
+
     if ([self.delegate respondsToSelector:@selector(edgeWindowController:mouseHoverAtPoint:)])
     {
+        /* hover polls the mouse location; profiles that save power turn it off, not clicks */
+        if (!RefreshPolicyEnabled(RefreshFeatureHover))
+            return;
+
         [_trackTimer invalidate];
         [_trackTimer release];
         _trackTimer = [[NSTimer
-            scheduledTimerWithTimeInterval:0.05
+            scheduledTimerWithTimeInterval:RefreshPolicyInterval(EdgeWindowHoverInterval)
             target:self
             selector:@selector(mouseUpdated:)
             userInfo:nil
             repeats:YES] retain];
+        RefreshPolicyTimerSet("Hover", EdgeWindowHoverInterval, RefreshFeatureHover, true);
     }
 }
 
@@ -163,6 +208,8 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 
 - (void)mouseExited:(NSEvent *)event
 {
+    _trackInside = NO;
+
     if ([self.delegate respondsToSelector:@selector(edgeWindowController:mouseHoverAtPoint:)])
     {
         if (nil == _trackTimer)
@@ -171,6 +218,7 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
         [_trackTimer invalidate];
         [_trackTimer release];
         _trackTimer = nil;
+        RefreshPolicyTimerClear("Hover");
 
         _trackSentHover = NO;
         NSPoint point = NSMakePoint(NAN, NAN);
@@ -182,7 +230,7 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 {
     if ([self.delegate respondsToSelector:@selector(edgeWindowController:mouseClickAtPoint:)])
     {
-        if (nil == _trackTimer)
+        if (!_trackInside)
             return;
 
         NSPoint point = [self convertBaseToTouchBar:[event locationInWindow]];
@@ -197,9 +245,15 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 
 - (NSDragOperation)draggingEntered:(id<NSDraggingInfo>)sender
 {
-    [_trackTimer invalidate];
-    [_trackTimer release];
-    _trackTimer = nil;
+    _trackInside = NO;
+
+    if (nil != _trackTimer)
+    {
+        [_trackTimer invalidate];
+        [_trackTimer release];
+        _trackTimer = nil;
+        RefreshPolicyTimerClear("Hover");
+    }
 
     if (_trackSentHover)
     {
@@ -208,6 +262,9 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
         [self.delegate edgeWindowController:self mouseHoverAtPoint:point];
     }
 
+    /* decode the pasteboard once per drag; periodic updates reuse the session */
+    self.dragSession = [EdgeWindowDragSession sessionWithDraggingInfo:sender];
+
     return [self draggingUpdated:sender];
 }
 
@@ -215,17 +272,12 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 {
     if ([self.delegate respondsToSelector:@selector(edgeWindowController:dragURLs:atPoint:operation:)])
     {
-        NSArray *urls;
-        if ([sender.draggingPasteboard.types containsObject:NSFilesPromisePboardType])
-            urls = [NSArray array];
-        else
-            urls = [sender.draggingPasteboard
-                readObjectsForClasses:[NSArray arrayWithObject:[NSURL class]]
-                options:nil];
+        if (nil == self.dragSession)
+            self.dragSession = [EdgeWindowDragSession sessionWithDraggingInfo:sender];
         NSPoint point = [self convertBaseToTouchBar:sender.draggingLocation];
         return [self.delegate
             edgeWindowController:self
-            dragURLs:urls
+            dragURLs:self.dragSession.urls
             atPoint:point
             operation:sender.draggingSourceOperationMask];
     }
@@ -240,6 +292,8 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
 
 - (void)draggingExited:(id<NSDraggingInfo>)sender
 {
+    self.dragSession = nil;
+
     if ([self.delegate respondsToSelector:@selector(edgeWindowController:dragURLs:atPoint:operation:)])
         [self.delegate
             edgeWindowController:self
@@ -260,6 +314,8 @@ static const CGFloat TouchBarWidthInTouchBarUnits = 1085;
             pdestination = &destination;
             urls = [NSArray array];
         }
+        else if (nil != self.dragSession)
+            urls = self.dragSession.urls;
         else
             urls = [sender.draggingPasteboard
                 readObjectsForClasses:[NSArray arrayWithObject:[NSURL class]]
@@ -13,11 +13,20 @@
 
 #import "FolderController.h"
 #import <QuickLook/QuickLook.h>
+#import "FSNotify.h"
+#import "FolderIndex.h"
+#import "IconStore.h"
 #import "ImageTitleView.h"
+#import "InputLatency.h"
+#import "MetadataStore.h"
+#import "RefreshPolicy.h"
+#import "ResourceAccounting.h"
 
 static const NSSize smallItemSize = { 50, 30 };
 static const NSSize largeItemSize = { 150, 30 };
-static const NSUInteger maxFileCount = 100;
+static const NSUInteger prefetchItemCount = 16;
+static const NSUInteger firstPageCount = 64;
+static const NSUInteger maxPageCount = 4096;
 
 @interface FolderItem : NSObject
 @property (retain) NSURL *url;
@@ -33,6 +42,49 @@ static const NSUInteger maxFileCount = 100;
 }
 @end
 
+static BOOL FolderSortKeyValue(id value, double *pkey)
+{
+    if ([value isKindOfClass:[NSDate class]])
+    {
+        *pkey = [(NSDate *)value timeIntervalSinceReferenceDate];
+        return YES;
+    }
+    if ([value isKindOfClass:[NSNumber class]])
+    {
+        *pkey = [(NSNumber *)value doubleValue];
+        return YES;
+    }
+    return NO;
+}
+
+static void FolderGetEntry(FolderIndexEntry *entry, NSURL *url, NSURLResourceKey sortKey,
+    NSUInteger flags)
+{
+    id sortValue = nil;
+    if (nil != sortKey)
+        [url getResourceValue:&sortValue forKey:sortKey error:0];
+    entry->hasKey = FolderSortKeyValue(sortValue, &entry->key);
+    entry->flags = (uint8_t)flags;
+}
+
+static uint8_t FolderEntryFlags(NSURL *url)
+{
+    /* same flags as MetadataStore, from values prefetched by the directory enumerator */
+    NSNumber *isDir = nil, *isPackage = nil;
+    [url getResourceValue:&isDir forKey:NSURLIsDirectoryKey error:0];
+    [url getResourceValue:&isPackage forKey:NSURLIsPackageKey error:0];
+    uint8_t flags = MetadataIndexExists;
+    if (isDir.boolValue)
+        flags |= MetadataIndexDirectory;
+    if (isPackage.boolValue)
+    {
+        flags |= MetadataIndexPackage;
+        if (NSOrderedSame == [url.pathExtension caseInsensitiveCompare:@"app"])
+            flags |= MetadataIndexApplication;
+    }
+    return flags;
+}
+
 @interface FolderItemView : NSScrubberItemView
 @property (retain) ImageTitleView *imageTitleView;
 @end
@@ -78,11 +130,31 @@ static const NSUInteger maxFileCount = 100;
 @property (retain) IBOutlet NSTextField *label;
 @property (retain) IBOutlet NSButton *emptyButton;
 @property (retain) IBOutlet NSButton *openButton;
-@property (retain) NSArray<FolderItem *> *contents;
-@property (assign) BOOL tooManyItems;
+- (void)fsnotify:(const char *)path;
 @end
 
+static void FolderControllerFSNotify(const char *path, void *data)
+{
+    [(FolderController *)data fsnotify:path];
+}
+
 @implementation FolderController
+{
+    /* all entries live in the index; FolderItem's exist only around the visible range */
+    FolderIndex *_index;
+    NSMutableDictionary<NSString *, FolderItem *> *_items;  /* by index name */
+    NSMutableArray<NSURL *> *_iconURLs;
+    void *_stream;
+    NSString *_streamPath;
+    NSMutableSet<NSString *> *_changedPaths;
+    /* background enumeration; pages of older generations are dropped */
+    dispatch_queue_t _enumerationQueue;
+    NSUInteger _generation;
+    BOOL _enumerating;
+    NSTimeInterval _enumerationStart;
+    NSMutableSet<NSString *> *_removedNames;
+}
+
 + (id)controller
 {
     return [self controllerWithNibNamed:@"FolderBar"];
@@ -94,9 +166,17 @@ static const NSUInteger maxFileCount = 100;
     self.label = nil;
     self.emptyButton = nil;
     self.openButton = nil;
-    self.contents = nil;
     self.url = nil;
 
+    [self stopWatching];
+    [self resetContents];
+    [_items release];
+    [_iconURLs release];
+    [_changedPaths release];
+    [_removedNames release];
+    if (0 != _enumerationQueue)
+        dispatch_release(_enumerationQueue);
+
     [super dealloc];
 }
 
@@ -107,73 +187,16 @@ static const NSUInteger maxFileCount = 100;
 
 - (BOOL)presentWithPlacement:(NSInteger)placement
 {
-    NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager]
-        enumeratorAtURL:self.url
-        includingPropertiesForKeys: nil != self.sortKey ?
-            [NSArray arrayWithObjects:NSURLIsDirectoryKey, NSURLIsApplicationKey, self.sortKey, nil] :
-            nil
-        options:
-            (self.includeDescendants ? 0 : NSDirectoryEnumerationSkipsSubdirectoryDescendants) |
-            NSDirectoryEnumerationSkipsPackageDescendants |
-            NSDirectoryEnumerationSkipsHiddenFiles
-        errorHandler:nil];
-    NSMutableArray<NSURL *> *urls = [NSMutableArray array];
-    BOOL tooManyItems = NO;
-    NSURL *url;
-    while (0 != (url = [enumerator nextObject]))
-    {
-        if (maxFileCount <= urls.count)
-        {
-            tooManyItems = YES;
-            break;
-        }
-        [urls addObject:url];
-    }
-    [urls sortUsingComparator:^NSComparisonResult(id obj1, id obj2)
-    {
-        NSURL *url1 = obj1;
-        NSURL *url2 = obj2;
-        NSURLResourceKey sortKey = self.sortKey;
-        if (nil != sortKey)
-        {
-            NSDate *val1, *val2;
-            if ([url1 getResourceValue:&val1 forKey:sortKey error:0] &&
-                [url2 getResourceValue:&val2 forKey:sortKey error:0])
-            {
-                return [val2 compare:val1];
-            }
-        }
-        return [url1.path localizedStandardCompare:url2.path];
-    }];
+    NSTimeInterval start = InputLatencyStart();
 
-    NSMutableArray<FolderItem *> *contents = [NSMutableArray array];
-    NSImage *appIcon = [[NSWorkspace sharedWorkspace] iconForFileType:@".app"];
-    NSImage *dirIcon = [[NSWorkspace sharedWorkspace] iconForFileType:@"public.folder"];
-    NSImage *docIcon = [[NSWorkspace sharedWorkspace] iconForFileType:@"public.content"];
-    for (NSURL *url in urls)
-    {
-        NSNumber *value;
-        BOOL isDir = [url getResourceValue:&value forKey:NSURLIsDirectoryKey error:0] && [value boolValue];
-        BOOL isApp = [url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] && [value boolValue];
-
-        FolderItem *item = [[FolderItem alloc] init];
-        item.url = url;
-        item.icon = isApp ? appIcon : (isDir ? dirIcon : docIcon);
-        [contents addObject:item];
-        [item release];
-    }
-    self.contents = contents;
-    self.tooManyItems = tooManyItems;
+    /* the bar is presented empty; entries are paged in by the enumeration */
+    [self resetContents];
+    _index = FolderIndexCreate();
 
     [self.scrubber.scrubberLayout
         setItemSize:NSImageOnly != self.imagePosition ? largeItemSize : smallItemSize];
     [self.scrubber reloadData];
 
-    self.label.stringValue = [NSString stringWithFormat:@"%u%@ file%@",
-        (unsigned)self.contents.count,
-        self.tooManyItems ? @"+" : @"",
-        1 != self.contents.count ? @"s" : @""];
-
     NSMutableArray *itemIdentifiers = [[self.touchBar.defaultItemIdentifiers mutableCopy]
         autorelease];
     [itemIdentifiers removeObject:@"emptyButton"];
@@ -186,24 +209,419 @@ static const NSUInteger maxFileCount = 100;
     }
     self.touchBar.defaultItemIdentifiers = itemIdentifiers;
 
-    [self
-        performSelectorInBackground:@selector(prepareIconsInBackground:)
-        withObject:[[urls copy] autorelease]/* be paranoid */];
+    /* changes are watched from the start, so that none is missed while enumerating */
+    [self startWatching];
+    [self enumerateFolderWithStart:start];
+    [self resetLabel];
 
-    return [super presentWithPlacement:placement];
+    BOOL result = [super presentWithPlacement:placement];
+    InputLatencyRecord("FolderPresent", start);
+    return result;
 }
 
 - (void)dismiss
 {
-    self.contents = nil;
+    [self stopWatching];
+    [self resetContents];
     self.url = nil;
     [self.scrubber reloadData];
 
     [super dismiss];
 }
 
+- (void)enumerateFolderWithStart:(NSTimeInterval)start
+{
+    /*
+     * The folder is enumerated on a background queue into pages of growing size
+     * (small first, so that the bar fills at once), which are merged into the
+     * index on the main thread. A FolderIndex is not thread-safe: each page is
+     * owned by the enumeration until it is handed over.
+     */
+    NSUInteger generation = __atomic_load_n(&_generation, __ATOMIC_RELAXED);
+    NSURL *folderURL = self.url;
+    NSURLResourceKey sortKey = self.sortKey;
+    BOOL includeDescendants = self.includeDescendants;
+
+    if (0 == _enumerationQueue)
+        _enumerationQueue = dispatch_queue_create("FolderController.enumeration",
+            DISPATCH_QUEUE_SERIAL);
+    _enumerating = YES;
+    _enumerationStart = start;
+
+    dispatch_async(_enumerationQueue, ^
+    {
+        ResourceSpan span;
+        ResourceAccountBegin(ResourceAccountGet("Folder"), &span);
+
+        NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager]
+            enumeratorAtURL:folderURL
+            includingPropertiesForKeys:[NSArray arrayWithObjects:
+                NSURLIsDirectoryKey,
+                NSURLIsPackageKey,
+                sortKey,
+                nil]
+            options:
+                (includeDescendants ? 0 : NSDirectoryEnumerationSkipsSubdirectoryDescendants) |
+                NSDirectoryEnumerationSkipsPackageDescendants |
+                NSDirectoryEnumerationSkipsHiddenFiles
+            errorHandler:nil];
+        FolderIndex *page = FolderIndexCreate();
+        NSUInteger pageCount = firstPageCount;
+        for (;;)
+        {
+            @autoreleasepool
+            {
+                /* a newer enumeration or a dismiss stops this one */
+                if (generation != __atomic_load_n(&_generation, __ATOMIC_RELAXED))
+                    break;
+
+                NSURL *url = [enumerator nextObject];
+                if (nil == url || 0 == page)
+                    break;
+
+                /* the enumerator's URLs need not share our spelling of the folder path */
+                NSArray<NSString *> *components = url.pathComponents;
+                NSUInteger level = enumerator.level;
+                if (0 == level || components.count <= level)
+                    continue;
+                NSString *name = [NSString pathWithComponents:[components
+                    subarrayWithRange:NSMakeRange(components.count - level, level)]];
+
+                FolderIndexEntry entry = { 0 };
+                FolderGetEntry(&entry, url, sortKey, FolderEntryFlags(url));
+                entry.name = name.fileSystemRepresentation;
+                FolderIndexAdd(page, &entry);
+
+                if (pageCount <= FolderIndexCount(page))
+                {
+                    FolderIndexSort(page);
+                    [self postPage:page generation:generation done:NO];
+                    page = FolderIndexCreate();
+                    pageCount = MIN(pageCount * 2, maxPageCount);
+                }
+            }
+        }
+        if (0 != page)
+            FolderIndexSort(page);
+        [self postPage:page generation:generation done:YES];
+
+        ResourceAccountEnd(&span);
+    });
+}
+
+- (void)postPage:(FolderIndex *)page generation:(NSUInteger)generation done:(BOOL)done
+{
+    dispatch_async(dispatch_get_main_queue(), ^
+    {
+        [self mergePage:page generation:generation done:done];
+    });
+}
+
+- (void)mergePage:(FolderIndex *)page generation:(NSUInteger)generation done:(BOOL)done
+{
+    if (generation != _generation)
+    {
+        FolderIndexDelete(page);
+        return;
+    }
+
+    if (0 != page && 0 != _index)
+    {
+        /* entries removed since the enumeration started must not come back with a page */
+        for (NSString *name in _removedNames)
+        {
+            size_t from, to;
+            FolderIndexUpdate(page, name.fileSystemRepresentation, 0, &from, &to);
+        }
+
+        /* entries changed meanwhile are already in the index and keep their state */
+        if (0 < FolderIndexCount(page) && FolderIndexMerge(_index, page))
+            [self.scrubber reloadData];
+    }
+    FolderIndexDelete(page);
+
+    if (done)
+    {
+        _enumerating = NO;
+        [_removedNames removeAllObjects];
+        InputLatencyRecord("FolderEnumerate", _enumerationStart);
+    }
+
+    [self resetLabel];
+}
+
+- (NSString *)nameForPath:(NSString *)path
+{
+    /* index names are paths relative to the folder */
+    NSString *folderPath = self.url.path;
+    if (![path hasPrefix:folderPath] ||
+        folderPath.length + 1 >= path.length || '/' != [path characterAtIndex:folderPath.length])
+        return nil;
+    return [path substringFromIndex:folderPath.length + 1];
+}
+
+- (NSString *)nameForEntry:(const FolderIndexEntry *)entry
+{
+    return [[NSFileManager defaultManager]
+        stringWithFileSystemRepresentation:entry->name length:strlen(entry->name)];
+}
+
+- (NSUInteger)itemCount
+{
+    return 0 != _index ? FolderIndexCount(_index) : 0;
+}
+
+- (FolderItem *)itemAtIndex:(NSUInteger)index
+{
+    FolderIndexEntry entry;
+    if (0 == _index || !FolderIndexGet(_index, index, &entry))
+        return nil;
+
+    NSString *name = [self nameForEntry:&entry];
+    FolderItem *item = [_items objectForKey:name];
+    if (nil == item)
+    {
+        if (nil == _items)
+            _items = [[NSMutableDictionary alloc] init];
+        item = [self newItemWithName:name flags:entry.flags];
+        [_items setObject:item forKey:name];
+        [item release];
+    }
+    return item;
+}
+
+- (NSUInteger)indexOfItemWithPath:(NSString *)path
+{
+    NSString *name = [self nameForPath:path];
+    if (0 == _index || nil == name)
+        return NSNotFound;
+    size_t index = FolderIndexFind(_index, name.fileSystemRepresentation);
+    return FolderIndexNotFound != index ? index : NSNotFound;
+}
+
+- (void)resetWindow:(NSRange)visibleRange
+{
+    /* keep items for the visible range plus a margin on either side; drop the rest */
+    NSUInteger count = self.itemCount;
+    NSUInteger first = prefetchItemCount < visibleRange.location ?
+        visibleRange.location - prefetchItemCount : 0;
+    NSUInteger last = MIN(NSMaxRange(visibleRange) + prefetchItemCount, count);
+
+    NSMutableDictionary<NSString *, FolderItem *> *oldItems = _items;
+    _items = [[NSMutableDictionary alloc] initWithCapacity:last > first ? last - first : 0];
+    for (NSUInteger index = first; last > index; index++)
+    {
+        FolderIndexEntry entry;
+        if (!FolderIndexGet(_index, index, &entry))
+            break;
+        NSString *name = [self nameForEntry:&entry];
+        FolderItem *item = [oldItems objectForKey:name];
+        if (nil != item)
+            [_items setObject:item forKey:name];
+        else
+            [self itemAtIndex:index];
+    }
+    [oldItems release];
+}
+
+- (void)resetContents
+{
+    /* pages of an enumeration in progress are dropped when they arrive */
+    __atomic_add_fetch(&_generation, 1, __ATOMIC_RELAXED);
+    _enumerating = NO;
+    [_removedNames removeAllObjects];
+
+    [_items removeAllObjects];
+    [_iconURLs removeAllObjects];
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(prepareIcons)
+        object:nil];
+    FolderIndexDelete(_index);
+    _index = 0;
+}
+
+- (void)resetLabel
+{
+    NSUInteger count = self.itemCount;
+    self.label.stringValue = [NSString stringWithFormat:@"%u file%@%@",
+        (unsigned)count,
+        1 != count ? @"s" : @"",
+        _enumerating ? @"…" : @""];
+}
+
+- (FolderItem *)newItemWithName:(NSString *)name flags:(NSUInteger)flags
+{
+    /* returns a retained item; placeholder icons are replaced by prepareIconsInBackground: */
+    IconStore *iconStore = [IconStore sharedInstance];
+    BOOL isDir = 0 != (flags & MetadataIndexDirectory);
+    BOOL isApp = 0 != (flags & MetadataIndexApplication);
+    NSString *type = isApp ? @".app" : (isDir ? @"public.folder" : @"public.content");
+
+    NSString *key = [@"type:" stringByAppendingString:type];
+    NSImage *icon = [iconStore cachedIconForKey:key];
+    if (nil == icon)
+        icon = [iconStore iconForImage:[[NSWorkspace sharedWorkspace] iconForFileType:type] key:key];
+
+    FolderItem *item = [[FolderItem alloc] init];
+    item.url = [self.url URLByAppendingPathComponent:name isDirectory:isDir];
+    item.icon = icon;
+
+    if (nil == _iconURLs)
+        _iconURLs = [[NSMutableArray alloc] init];
+    if (0 == _iconURLs.count)
+        [self performSelector:@selector(prepareIcons) withObject:nil afterDelay:0];
+    [_iconURLs addObject:item.url];
+
+    return item;
+}
+
+- (void)prepareIcons
+{
+    /* items materialized since the last run loop pass get their real icons in one batch */
+    [self
+        performSelectorInBackground:@selector(prepareIconsInBackground:)
+        withObject:[[_iconURLs copy] autorelease]];
+    [_iconURLs removeAllObjects];
+}
+
+- (void)startWatching
+{
+    [self stopWatching];
+
+    /* FSEvents reports resolved paths (e.g. /private/var rather than /var) */
+    _streamPath = [self.url.URLByResolvingSymlinksInPath.path copy];
+    if (nil != _streamPath)
+        _stream = FSNotifyStartFiles(_streamPath.fileSystemRepresentation,
+            FolderControllerFSNotify, self);
+}
+
+- (void)stopWatching
+{
+    FSNotifyStop(_stream);
+    _stream = 0;
+    [_streamPath release];
+    _streamPath = nil;
+    [_changedPaths removeAllObjects];
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(applyChanges)
+        object:nil];
+}
+
+- (void)fsnotify:(const char *)cpath
+{
+    NSString *path = [[NSFileManager defaultManager]
+        stringWithFileSystemRepresentation:cpath length:strlen(cpath)];
+    if (nil == _streamPath || ![path hasPrefix:_streamPath] ||
+        _streamPath.length + 1 >= path.length || '/' != [path characterAtIndex:_streamPath.length])
+        return;
+
+    /* map back under the folder URL that items were enumerated with */
+    path = [self.url.path stringByAppendingPathComponent:
+        [path substringFromIndex:_streamPath.length + 1]];
+
+    if (nil == _changedPaths)
+        _changedPaths = [[NSMutableSet alloc] init];
+    if (0 == _changedPaths.count)
+        [self performSelector:@selector(applyChanges) withObject:nil afterDelay:0];
+    [_changedPaths addObject:path];
+}
+
+- (BOOL)isPathInFolder:(NSString *)path
+{
+    NSArray<NSString *> *components = [[path substringFromIndex:self.url.path.length + 1]
+        pathComponents];
+    if (0 == components.count || (!self.includeDescendants && 1 < components.count))
+        return NO;
+
+    /* the enumerator skips hidden files and package contents */
+    NSString *ancestor = self.url.path;
+    for (NSUInteger index = 0, count = components.count; count > index; index++)
+    {
+        if ([[components objectAtIndex:index] hasPrefix:@"."])
+            return NO;
+        if (0 < index && 0 != ([[MetadataStore sharedInstance]
+            flagsForURL:[NSURL fileURLWithPath:ancestor]] & MetadataIndexPackage))
+            return NO;
+        ancestor = [ancestor stringByAppendingPathComponent:[components objectAtIndex:index]];
+    }
+
+    return YES;
+}
+
+- (void)applyChanges
+{
+    NSArray<NSString *> *paths = [_changedPaths allObjects];
+    MetadataStore *metadataStore = [MetadataStore sharedInstance];
+
+    [_changedPaths removeAllObjects];
+    if (0 == _index)
+        return;
+
+    ResourceSpan span;
+    ResourceAccountBegin(ResourceAccountGet("Folder"), &span);
+
+    [self.scrubber performSequentialBatchUpdates:^
+    {
+        for (NSString *path in paths)
+        {
+            if (![self isPathInFolder:path])
+                continue;
+
+            /* only the changed entry is stat'ed again */
+            NSString *name = [self nameForPath:path];
+            if (nil == name)
+                continue;
+            [metadataStore invalidatePath:path];
+            NSURL *url = [NSURL fileURLWithPath:path];
+            NSNumber *hidden = nil;
+            FolderIndexEntry entry = { 0 };
+            BOOL exists = [url getResourceValue:&hidden forKey:NSURLIsHiddenKey error:0] &&
+                !hidden.boolValue;
+            if (exists)
+                FolderGetEntry(&entry, url, self.sortKey, [metadataStore flagsForURL:url]);
+
+            /* the enumeration may still deliver an entry that is gone by now */
+            if (_enumerating)
+            {
+                if (nil == _removedNames)
+                    _removedNames = [[NSMutableSet alloc] init];
+                if (exists)
+                    [_removedNames removeObject:name];
+                else
+                    [_removedNames addObject:name];
+            }
+
+            /* a stale item is dropped; views that show the entry materialize it again */
+            size_t from, to;
+            [_items removeObjectForKey:name];
+            if (!FolderIndexUpdate(_index, name.fileSystemRepresentation,
+                exists ? &entry : 0, &from, &to))
+                continue;
+
+            if (FolderIndexNotFound == from && FolderIndexNotFound != to)
+                [self.scrubber insertItemsAtIndexes:[NSIndexSet indexSetWithIndex:to]];
+            else if (FolderIndexNotFound != from && FolderIndexNotFound == to)
+                [self.scrubber removeItemsAtIndexes:[NSIndexSet indexSetWithIndex:from]];
+            else if (FolderIndexNotFound != from)
+            {
+                if (from != to)
+                    [self.scrubber moveItemAtIndex:from toIndex:to];
+                [self.scrubber reloadItemsAtIndexes:[NSIndexSet indexSetWithIndex:to]];
+            }
+        }
+    }];
+
+    ResourceAccountEnd(&span);
+
+    [self resetLabel];
+}
+
 - (void)prepareIconsInBackground:(NSArray<NSURL *> *)urls
 {
+    ResourceSpan span;
+    ResourceAccountBegin(ResourceAccountGet("Folder"), &span);
     @autoreleasepool
     {
         NSMutableDictionary *icons = [NSMutableDictionary dictionary];
@@ -211,19 +629,33 @@ static const NSUInteger maxFileCount = 100;
         NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:
             [NSNumber numberWithBool:YES], kQLThumbnailOptionIconModeKey,
             nil];
+        IconStore *iconStore = [IconStore sharedInstance];
+        BOOL thumbnails = RefreshPolicyEnabled(RefreshFeatureThumbnails);
         for (NSURL *url in urls)
         {
-            NSImage *icon = nil;
-            CGImageRef cgimage = QLThumbnailImageCreate(
-                0, (CFURLRef)url, size, (CFDictionaryRef)options);
-            if (0 != cgimage)
+            /* thumbnails are keyed by path and modification date, so that edits invalidate them */
+            NSDate *date = nil;
+            [url getResourceValue:&date forKey:NSURLContentModificationDateKey error:0];
+            NSString *key = [NSString stringWithFormat:@"thumbnail:%@:%f",
+                url.path, date.timeIntervalSinceReferenceDate];
+
+            /* cached thumbnails are still used when the refresh policy disables new ones */
+            NSImage *icon = [iconStore cachedIconForKey:key];
+            if (nil == icon && thumbnails)
             {
-                icon = [[[NSImage alloc] initWithCGImage:cgimage size:NSZeroSize] autorelease];
-                CGImageRelease(cgimage);
+                CGImageRef cgimage = QLThumbnailImageCreate(
+                    0, (CFURLRef)url, size, (CFDictionaryRef)options);
+                if (0 != cgimage)
+                {
+                    icon = [iconStore
+                        iconForImage:[[[NSImage alloc] initWithCGImage:cgimage size:NSZeroSize] autorelease]
+                        key:key];
+                    CGImageRelease(cgimage);
+                }
             }
 
             if (nil == icon)
-                icon = [[NSWorkspace sharedWorkspace] iconForFile:url.path];
+                icon = [iconStore iconForFile:url.path];
 
             if (nil != icon)
                 [icons setObject:icon forKey:url];
@@ -244,25 +676,23 @@ static const NSUInteger maxFileCount = 100;
                 withObject:[[icons copy] autorelease]
                 waitUntilDone:NO];
     }
+    ResourceAccountEnd(&span);
 }
 
 - (void)updateIcons:(NSDictionary *)icons
 {
     [self.scrubber performSequentialBatchUpdates:^
     {
-        NSArray<FolderItem *> *contents = self.contents;
         for (NSURL *url in icons)
         {
-            NSUInteger index = 0;
-            for (FolderItem *item in contents)
+            /* items dropped from the window meanwhile get their icons when materialized again */
+            NSString *name = [self nameForPath:url.path];
+            FolderItem *item = nil != name ? [_items objectForKey:name] : nil;
+            NSUInteger index = nil != item ? [self indexOfItemWithPath:url.path] : NSNotFound;
+            if (NSNotFound != index)
             {
-                if ([item.url isEqual:url])
-                {
-                    item.icon = [icons objectForKey:url];
-                    [self.scrubber reloadItemsAtIndexes:[NSIndexSet indexSetWithIndex:index]];
-                    break;
-                }
-                index++;
+                item.icon = [icons objectForKey:url];
+                [self.scrubber reloadItemsAtIndexes:[NSIndexSet indexSetWithIndex:index]];
             }
         }
     }];
@@ -282,12 +712,12 @@ static const NSUInteger maxFileCount = 100;
 
 - (NSInteger)numberOfItemsForScrubber:(NSScrubber *)scrubber
 {
-    return self.contents.count;
+    return self.itemCount;
 }
 
 - (NSScrubberItemView *)scrubber:(NSScrubber *)scrubber viewForItemAtIndex:(NSInteger)index
 {
-    FolderItem *item = [self.contents objectAtIndex:index];
+    FolderItem *item = [self itemAtIndex:index];
     FolderItemView *view = [self.scrubber makeItemWithIdentifier:@"item" owner:nil];
     view.hidden = NO;
     view.imageTitleView.image = item.icon;
@@ -297,11 +727,16 @@ static const NSUInteger maxFileCount = 100;
     return view;
 }
 
+- (void)scrubber:(NSScrubber *)scrubber didChangeVisibleRange:(NSRange)visibleRange
+{
+    [self resetWindow:visibleRange];
+}
+
 - (void)scrubber:(NSScrubber *)scrubber didSelectItemAtIndex:(NSInteger)index
 {
     if ([self.delegate respondsToSelector:@selector(folderController:didSelectURL:)])
     {
-        FolderItem *item = [self.contents objectAtIndex:index];
+        FolderItem *item = [self itemAtIndex:index];
         [self.delegate folderController:self didSelectURL:item.url];
     }
 }
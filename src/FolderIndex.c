@@ -0,0 +1,526 @@
+/**
+ * @file FolderIndex.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "FolderIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FolderIndexBlockSize            (64 * 1024)
+#define FolderIndexMinBuckets           64
+
+struct FolderIndexRecord
+{
+    double key;
+    uint32_t hash;
+    bool hasKey;
+    uint8_t flags;
+    char name[];
+};
+
+struct FolderIndexBlock
+{
+    struct FolderIndexBlock *next;
+    size_t used, size;
+    char data[];
+};
+
+struct FolderIndex
+{
+    struct FolderIndexBlock *blocks;
+    /* records in sort order; positions are indexes into this array */
+    struct FolderIndexRecord **order;
+    size_t count, capacity;
+    bool sorted;
+    /* open addressing by name hash; tombstones mark removed records */
+    struct FolderIndexRecord **buckets;
+    size_t bucketCount, tombstoneCount;
+    size_t blockBytes, garbage;
+};
+
+#define FolderIndexTombstone            ((struct FolderIndexRecord *)1)
+
+static uint32_t FolderIndexHash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        hash = (hash ^ *p) * 16777619u;
+    return hash;
+}
+
+static size_t FolderIndexRecordSize(size_t nameLength)
+{
+    /* keep records double aligned */
+    return (sizeof(struct FolderIndexRecord) + nameLength + 1 + 7) & ~(size_t)7;
+}
+
+static inline bool FolderIndexIsDigit(unsigned char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+static inline unsigned char FolderIndexFold(unsigned char c)
+{
+    /* bytes of multibyte UTF-8 sequences compare as is */
+    return 'A' <= c && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+int FolderIndexCompareNames(const char *name1, const char *name2)
+{
+    const unsigned char *p = (const unsigned char *)name1, *q = (const unsigned char *)name2;
+
+    while ('\0' != *p && '\0' != *q)
+    {
+        if (FolderIndexIsDigit(*p) && FolderIndexIsDigit(*q))
+        {
+            /* digit runs compare by value: shorter run without leading zeros is smaller */
+            const unsigned char *ps, *qs;
+            while ('0' == *p && FolderIndexIsDigit(p[1]))
+                p++;
+            while ('0' == *q && FolderIndexIsDigit(q[1]))
+                q++;
+            for (ps = p; FolderIndexIsDigit(*p); p++)
+                ;
+            for (qs = q; FolderIndexIsDigit(*q); q++)
+                ;
+            if (p - ps != q - qs)
+                return p - ps < q - qs ? -1 : +1;
+            int result = memcmp(ps, qs, (size_t)(p - ps));
+            if (0 != result)
+                return 0 > result ? -1 : +1;
+            continue;
+        }
+
+        unsigned char c1 = FolderIndexFold(*p), c2 = FolderIndexFold(*q);
+        if (c1 != c2)
+            return c1 < c2 ? -1 : +1;
+        p++;
+        q++;
+    }
+
+    return '\0' != *p ? +1 : '\0' != *q ? -1 : 0;
+}
+
+static int FolderIndexCompareRecords(const struct FolderIndexRecord *record1,
+    const struct FolderIndexRecord *record2)
+{
+    int result;
+
+    /* sort key descending (e.g. newest first); entries without one go last */
+    if (record1->hasKey != record2->hasKey)
+        return record1->hasKey ? -1 : +1;
+    if (record1->hasKey && record1->key != record2->key)
+        return record1->key > record2->key ? -1 : +1;
+
+    result = FolderIndexCompareNames(record1->name, record2->name);
+    if (0 != result)
+        return result;
+
+    /* names that differ only in case or leading zeros: keep a total order */
+    result = strcmp(record1->name, record2->name);
+    return 0 > result ? -1 : 0 < result ? +1 : 0;
+}
+
+static int FolderIndexQsortCompare(const void *a, const void *b)
+{
+    return FolderIndexCompareRecords(
+        *(struct FolderIndexRecord *const *)a, *(struct FolderIndexRecord *const *)b);
+}
+
+FolderIndex *FolderIndexCreate(void)
+{
+    FolderIndex *index;
+
+    index = calloc(1, sizeof *index);
+    if (0 == index)
+        return 0;
+
+    index->sorted = true;
+
+    return index;
+}
+
+static void FolderIndexFreeBlocks(struct FolderIndexBlock *block)
+{
+    for (struct FolderIndexBlock *next; 0 != block; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+}
+
+void FolderIndexDelete(FolderIndex *index)
+{
+    if (0 == index)
+        return;
+
+    FolderIndexFreeBlocks(index->blocks);
+    free(index->order);
+    free(index->buckets);
+    free(index);
+}
+
+static struct FolderIndexRecord *FolderIndexAllocRecord(FolderIndex *index, size_t size)
+{
+    struct FolderIndexBlock *block = index->blocks;
+
+    if (0 == block || block->size - block->used < size)
+    {
+        size_t blockSize = FolderIndexBlockSize > size ? FolderIndexBlockSize : size;
+        block = malloc(sizeof *block + blockSize);
+        if (0 == block)
+            return 0;
+        block->next = index->blocks;
+        block->used = 0;
+        block->size = blockSize;
+        index->blocks = block;
+        index->blockBytes += sizeof *block + blockSize;
+    }
+
+    struct FolderIndexRecord *record = (struct FolderIndexRecord *)(block->data + block->used);
+    block->used += size;
+    return record;
+}
+
+static struct FolderIndexRecord **FolderIndexBucket(FolderIndex *index,
+    const char *name, uint32_t hash)
+{
+    struct FolderIndexRecord **tombstone = 0;
+    size_t mask = index->bucketCount - 1;
+
+    /* the first empty bucket ends the probe; a tombstone before it is reused on insert */
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct FolderIndexRecord *record = index->buckets[i];
+        if (0 == record)
+            return 0 != tombstone ? tombstone : &index->buckets[i];
+        if (FolderIndexTombstone == record)
+        {
+            if (0 == tombstone)
+                tombstone = &index->buckets[i];
+        }
+        else if (hash == record->hash && 0 == strcmp(name, record->name))
+            return &index->buckets[i];
+    }
+}
+
+static struct FolderIndexRecord *FolderIndexLookup(FolderIndex *index, const char *name)
+{
+    if (0 == index->bucketCount)
+        return 0;
+
+    struct FolderIndexRecord *record = *FolderIndexBucket(index, name, FolderIndexHash(name));
+    return FolderIndexTombstone != record ? record : 0;
+}
+
+static bool FolderIndexRehash(FolderIndex *index, size_t count)
+{
+    struct FolderIndexRecord **buckets;
+    size_t bucketCount;
+
+    for (bucketCount = FolderIndexMinBuckets; count * 2 > bucketCount; bucketCount <<= 1)
+        ;
+
+    buckets = calloc(bucketCount, sizeof buckets[0]);
+    if (0 == buckets)
+        return false;
+
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucketCount = bucketCount;
+    index->tombstoneCount = 0;
+
+    for (size_t i = 0; index->count > i; i++)
+        *FolderIndexBucket(index, index->order[i]->name, index->order[i]->hash) = index->order[i];
+
+    return true;
+}
+
+static bool FolderIndexReserve(FolderIndex *index, size_t count)
+{
+    if (index->capacity < count)
+    {
+        size_t capacity = 0 != index->capacity ? index->capacity * 2 : FolderIndexMinBuckets;
+        if (capacity < count)
+            capacity = count;
+        struct FolderIndexRecord **order = realloc(index->order, capacity * sizeof order[0]);
+        if (0 == order)
+            return false;
+        index->order = order;
+        index->capacity = capacity;
+    }
+
+    /* keep the table at most half full, tombstones included */
+    if ((count + index->tombstoneCount) * 2 > index->bucketCount)
+        return FolderIndexRehash(index, count);
+
+    return true;
+}
+
+static struct FolderIndexRecord *FolderIndexNewRecord(FolderIndex *index,
+    const char *name, const FolderIndexEntry *entry)
+{
+    size_t nameLength = strlen(name);
+    struct FolderIndexRecord *record;
+
+    record = FolderIndexAllocRecord(index, FolderIndexRecordSize(nameLength));
+    if (0 == record)
+        return 0;
+
+    record->key = entry->hasKey ? entry->key : 0;
+    record->hash = FolderIndexHash(name);
+    record->hasKey = entry->hasKey;
+    record->flags = entry->flags;
+    memcpy(record->name, name, nameLength + 1);
+
+    return record;
+}
+
+bool FolderIndexAdd(FolderIndex *index, const FolderIndexEntry *entry)
+{
+    struct FolderIndexRecord *record, **bucket;
+
+    if (!FolderIndexReserve(index, index->count + 1))
+        return false;
+
+    bucket = FolderIndexBucket(index, entry->name, FolderIndexHash(entry->name));
+    if (0 != *bucket && FolderIndexTombstone != *bucket)
+        return false;
+
+    record = FolderIndexNewRecord(index, entry->name, entry);
+    if (0 == record)
+        return false;
+
+    if (FolderIndexTombstone == *bucket)
+        index->tombstoneCount--;
+    *bucket = record;
+    index->order[index->count++] = record;
+    index->sorted = false;
+
+    return true;
+}
+
+void FolderIndexSort(FolderIndex *index)
+{
+    if (index->sorted)
+        return;
+
+    qsort(index->order, index->count, sizeof index->order[0], FolderIndexQsortCompare);
+    index->sorted = true;
+}
+
+size_t FolderIndexCount(FolderIndex *index)
+{
+    return index->count;
+}
+
+bool FolderIndexGet(FolderIndex *index, size_t position, FolderIndexEntry *entry)
+{
+    FolderIndexSort(index);
+
+    if (index->count <= position)
+        return false;
+
+    struct FolderIndexRecord *record = index->order[position];
+    entry->name = record->name;
+    entry->key = record->key;
+    entry->hasKey = record->hasKey;
+    entry->flags = record->flags;
+
+    return true;
+}
+
+static size_t FolderIndexPosition(FolderIndex *index, const struct FolderIndexRecord *record)
+{
+    /* lower bound; records are distinct under the comparison, so this is exact when present */
+    size_t lo = 0, hi = index->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (0 < FolderIndexCompareRecords(record, index->order[mid]))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+size_t FolderIndexFind(FolderIndex *index, const char *name)
+{
+    struct FolderIndexRecord *record;
+
+    FolderIndexSort(index);
+
+    record = FolderIndexLookup(index, name);
+    return 0 != record ? FolderIndexPosition(index, record) : FolderIndexNotFound;
+}
+
+static void FolderIndexCompact(FolderIndex *index)
+{
+    struct FolderIndexBlock *oldBlocks = index->blocks;
+    size_t oldBlockBytes = index->blockBytes;
+
+    index->blocks = 0;
+    index->blockBytes = 0;
+
+    for (size_t i = 0; index->count > i; i++)
+    {
+        struct FolderIndexRecord *record = index->order[i];
+        size_t size = FolderIndexRecordSize(strlen(record->name));
+        struct FolderIndexRecord *copy = FolderIndexAllocRecord(index, size);
+        if (0 == copy)
+        {
+            /* out of memory: keep the old blocks (and the copies made so far) */
+            struct FolderIndexBlock **pblock = &index->blocks;
+            while (0 != *pblock)
+                pblock = &(*pblock)->next;
+            *pblock = oldBlocks;
+            index->blockBytes += oldBlockBytes;
+            return;
+        }
+        memcpy(copy, record, size);
+        index->order[i] = copy;
+    }
+
+    FolderIndexFreeBlocks(oldBlocks);
+    index->garbage = 0;
+
+    FolderIndexRehash(index, index->count);
+}
+
+bool FolderIndexUpdate(FolderIndex *index, const char *name, const FolderIndexEntry *entry,
+    size_t *from, size_t *to)
+{
+    struct FolderIndexRecord *oldRecord, *newRecord = 0, **bucket;
+    size_t position;
+
+    *from = *to = FolderIndexNotFound;
+
+    FolderIndexSort(index);
+
+    if (!FolderIndexReserve(index, index->count + 1))
+        return false;
+
+    if (0 != entry)
+    {
+        newRecord = FolderIndexNewRecord(index, name, entry);
+        if (0 == newRecord)
+            return false;
+    }
+
+    bucket = FolderIndexBucket(index, name, FolderIndexHash(name));
+    oldRecord = FolderIndexTombstone != *bucket ? *bucket : 0;
+
+    if (0 != oldRecord)
+    {
+        position = FolderIndexPosition(index, oldRecord);
+        memmove(index->order + position, index->order + position + 1,
+            (index->count - position - 1) * sizeof index->order[0]);
+        index->count--;
+        index->garbage += FolderIndexRecordSize(strlen(oldRecord->name));
+        *from = position;
+    }
+
+    if (0 != newRecord)
+    {
+        position = FolderIndexPosition(index, newRecord);
+        memmove(index->order + position + 1, index->order + position,
+            (index->count - position) * sizeof index->order[0]);
+        index->order[position] = newRecord;
+        index->count++;
+        *to = position;
+
+        if (FolderIndexTombstone == *bucket)
+            index->tombstoneCount--;
+        *bucket = newRecord;
+    }
+    else if (0 != oldRecord)
+    {
+        *bucket = FolderIndexTombstone;
+        index->tombstoneCount++;
+    }
+
+    /* reclaim removed records once they outweigh the live ones */
+    if (FolderIndexBlockSize < index->garbage && index->blockBytes < index->garbage * 2)
+        FolderIndexCompact(index);
+
+    return true;
+}
+
+bool FolderIndexMerge(FolderIndex *index, FolderIndex *other)
+{
+    struct FolderIndexRecord **bucket;
+    size_t count = 0;
+
+    FolderIndexSort(index);
+    FolderIndexSort(other);
+
+    if (!FolderIndexReserve(index, index->count + other->count))
+        return false;
+
+    /* entries already in the index (e.g. from later changes) win over the other's */
+    for (size_t i = 0; other->count > i; i++)
+    {
+        struct FolderIndexRecord *record = other->order[i];
+        bucket = FolderIndexBucket(index, record->name, record->hash);
+        if (0 != *bucket && FolderIndexTombstone != *bucket)
+        {
+            other->garbage += FolderIndexRecordSize(strlen(record->name));
+            continue;
+        }
+        if (FolderIndexTombstone == *bucket)
+            index->tombstoneCount--;
+        *bucket = record;
+        other->order[count++] = record;
+    }
+
+    /* merge from the back, so that the index order is rewritten in place */
+    for (size_t i = index->count, j = count, k = index->count + count; 0 < j;)
+    {
+        if (0 < i && 0 < FolderIndexCompareRecords(index->order[i - 1], other->order[j - 1]))
+            index->order[--k] = index->order[--i];
+        else
+            index->order[--k] = other->order[--j];
+    }
+    index->count += count;
+
+    /* the records stay where they are: the other's blocks move over */
+    struct FolderIndexBlock **pblock = &index->blocks;
+    while (0 != *pblock)
+        pblock = &(*pblock)->next;
+    *pblock = other->blocks;
+    index->blockBytes += other->blockBytes;
+    index->garbage += other->garbage;
+
+    other->blocks = 0;
+    other->count = 0;
+    other->sorted = true;
+    if (0 != other->bucketCount)
+        memset(other->buckets, 0, other->bucketCount * sizeof other->buckets[0]);
+    other->tombstoneCount = 0;
+    other->blockBytes = 0;
+    other->garbage = 0;
+
+    if (FolderIndexBlockSize < index->garbage && index->blockBytes < index->garbage * 2)
+        FolderIndexCompact(index);
+
+    return true;
+}
+
+void FolderIndexGetStats(FolderIndex *index, FolderIndexStats *stats)
+{
+    stats->count = index->count;
+    stats->bytes = sizeof *index + index->blockBytes +
+        index->capacity * sizeof index->order[0] +
+        index->bucketCount * sizeof index->buckets[0];
+    stats->garbage = index->garbage;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file FolderIndex.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef FOLDERINDEX_H_INCLUDED
+#define FOLDERINDEX_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A compact sorted index of the entries of a folder: name (relative path),
+ * optional sort key and type flags. Entries are ordered by sort key descending
+ * (entries without a key last), then by name in natural order: case-insensitive
+ * with digit runs compared by value, as in the Finder. Names are unique.
+ *
+ * Entries are kept in a few large string blocks plus a sorted array and a hash
+ * table of pointers, so that an index of 100k entries costs a few MB and no
+ * per-entry objects. Callers materialize objects only for the positions they
+ * display.
+ *
+ * An index is built by adding entries in any order and sorting once; after
+ * that it is kept sorted by FolderIndexUpdate, which reports where an entry
+ * was and where it went. FolderIndexMerge moves all entries of another index
+ * (e.g. a page built on another thread) into an index in linear time and
+ * leaves the other empty; names already present keep their entry. Names
+ * returned by FolderIndexGet remain valid until the next add, update or merge.
+ * A FolderIndex is not thread-safe.
+ */
+#define FolderIndexNotFound             SIZE_MAX
+
+typedef struct
+{
+    const char *name;
+    double key;                         /* ignored unless hasKey */
+    bool hasKey;
+    uint8_t flags;                      /* opaque to the index */
+} FolderIndexEntry;
+
+typedef struct
+{
+    size_t count;
+    size_t bytes;                       /* total memory held by the index */
+    size_t garbage;                     /* bytes of removed entries not yet reclaimed */
+} FolderIndexStats;
+
+typedef struct FolderIndex FolderIndex;
+
+FolderIndex *FolderIndexCreate(void);
+void FolderIndexDelete(FolderIndex *index);
+bool FolderIndexAdd(FolderIndex *index, const FolderIndexEntry *entry);
+void FolderIndexSort(FolderIndex *index);
+size_t FolderIndexCount(FolderIndex *index);
+bool FolderIndexGet(FolderIndex *index, size_t position, FolderIndexEntry *entry);
+size_t FolderIndexFind(FolderIndex *index, const char *name);
+bool FolderIndexUpdate(FolderIndex *index, const char *name, const FolderIndexEntry *entry,
+    size_t *from, size_t *to);
+bool FolderIndexMerge(FolderIndex *index, FolderIndex *other);
+void FolderIndexGetStats(FolderIndex *index, FolderIndexStats *stats);
+int FolderIndexCompareNames(const char *name1, const char *name2);
+
+#endif
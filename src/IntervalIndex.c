@@ -0,0 +1,122 @@
+/**
+ * @file IntervalIndex.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "IntervalIndex.h"
+#include <stdlib.h>
+
+struct IntervalIndexEntry
+{
+    double lo, hi;
+    intptr_t value;
+};
+
+struct IntervalIndex
+{
+    struct IntervalIndexEntry *entries;
+    size_t count, capacity;
+    bool sorted;
+};
+
+static int IntervalIndexCompare(const void *a, const void *b)
+{
+    const struct IntervalIndexEntry *ea = a, *eb = b;
+    return ea->lo < eb->lo ? -1 : ea->lo > eb->lo ? +1 : 0;
+}
+
+IntervalIndex *IntervalIndexCreate(void)
+{
+    IntervalIndex *index = calloc(1, sizeof *index);
+    if (0 == index)
+        return 0;
+
+    index->sorted = true;
+
+    return index;
+}
+
+void IntervalIndexDelete(IntervalIndex *index)
+{
+    if (0 == index)
+        return;
+
+    free(index->entries);
+    free(index);
+}
+
+void IntervalIndexReset(IntervalIndex *index)
+{
+    /* keep the allocated entries so that rebuilding on layout does not allocate */
+    index->count = 0;
+    index->sorted = true;
+}
+
+bool IntervalIndexAdd(IntervalIndex *index, double lo, double hi, intptr_t value)
+{
+    if (!(lo < hi))
+        return false;
+
+    if (index->capacity <= index->count)
+    {
+        size_t capacity = 0 != index->capacity ? index->capacity * 2 : 16;
+        struct IntervalIndexEntry *entries = realloc(index->entries, capacity * sizeof *entries);
+        if (0 == entries)
+            return false;
+
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    if (0 < index->count && index->entries[index->count - 1].lo > lo)
+        index->sorted = false;
+
+    index->entries[index->count].lo = lo;
+    index->entries[index->count].hi = hi;
+    index->entries[index->count].value = value;
+    index->count++;
+
+    return true;
+}
+
+void IntervalIndexBuild(IntervalIndex *index)
+{
+    if (index->sorted)
+        return;
+
+    qsort(index->entries, index->count, sizeof *index->entries, IntervalIndexCompare);
+    index->sorted = true;
+}
+
+bool IntervalIndexLookup(IntervalIndex *index, double x, intptr_t *pvalue)
+{
+    if (!index->sorted)
+        IntervalIndexBuild(index);
+
+    /* find the last interval whose lo <= x */
+    size_t lo = 0, hi = index->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].lo <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (0 == lo || !(x < index->entries[lo - 1].hi))
+        return false;
+
+    if (0 != pvalue)
+        *pvalue = index->entries[lo - 1].value;
+
+    return true;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file IntervalIndex.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef INTERVALINDEX_H_INCLUDED
+#define INTERVALINDEX_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A 1-D index of non-overlapping half-open intervals [lo, hi).
+ * Intervals are added in any order, sorted once by IntervalIndexBuild
+ * and then queried in O(log n) by IntervalIndexLookup.
+ */
+typedef struct IntervalIndex IntervalIndex;
+
+IntervalIndex *IntervalIndexCreate(void);
+void IntervalIndexDelete(IntervalIndex *index);
+void IntervalIndexReset(IntervalIndex *index);
+bool IntervalIndexAdd(IntervalIndex *index, double lo, double hi, intptr_t value);
+void IntervalIndexBuild(IntervalIndex *index);
+bool IntervalIndexLookup(IntervalIndex *index, double x, intptr_t *pvalue);
+
+#endif
@@ -15,5 +15,5 @@
 
 @interface NSView (TouchBarHitTest)
 + (void)loadTouchBarHitTest;
-+ (void)enableTouchBarHitTest:(id)flag;
++ (void)suppressTouchBarHitTestAfterKeyDown:(NSTimeInterval)timestamp;
 @end
@@ -13,44 +13,136 @@
 
 #import "NSView+TouchBarHitTest.h"
 #import "NSObject+MethodSwizzling.h"
+#import "TouchSuppression.h"
+#import <objc/runtime.h>
 
 @interface NSView ()
 - (BOOL)isHitTestAlwaysEnabled_;
 @end
 
+/*
+ * Per view cache of hit test eligibility. Eligibility depends on the chain of ancestors,
+ * so any view moving to a new superview or window (e.g. CustomMultiWidget swapping its
+ * children) bumps a generation that invalidates every cached result. Views move rarely
+ * compared to hit tests, so a hit test still does constant work per view.
+ *
+ * Moves are seen through the swizzled viewDidMoveToSuperview/viewDidMoveToWindow, so
+ * NSView subclasses that override those must call super. Frame and hidden changes bump
+ * the generation too: they accompany every move and cover such a subclass anyway.
+ */
+@interface TouchBarHitTestCache : NSObject
+{
+@public
+    NSUInteger generation;
+    BOOL enabled;
+}
+@end
+
+@implementation TouchBarHitTestCache
+@end
+
+static char TouchBarHitTestCacheKey;
+static NSUInteger TouchBarHitTestGeneration = 1;  /* main thread only */
+
+static BOOL TouchBarHitTestEnabledForView(NSView *view)
+{
+    if (nil == view)
+        return NO;
+
+    TouchBarHitTestCache *cache = objc_getAssociatedObject(view, &TouchBarHitTestCacheKey);
+    if (nil != cache && cache->generation == TouchBarHitTestGeneration)
+        return cache->enabled;
+
+    BOOL enabled =
+        ([view respondsToSelector:@selector(isHitTestAlwaysEnabled_)] &&
+            [view isHitTestAlwaysEnabled_]) ||
+        TouchBarHitTestEnabledForView(view.superview);
+
+    if (nil == cache)
+    {
+        cache = [[[TouchBarHitTestCache alloc] init] autorelease];
+        objc_setAssociatedObject(view, &TouchBarHitTestCacheKey, cache,
+            OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
+    cache->generation = TouchBarHitTestGeneration;
+    cache->enabled = enabled;
+
+    return enabled;
+}
+
+/* until the typing cadence is known touches are ignored for 0.3s after a key down */
+#define TouchBarHitTestInitialWindow    0.3
+static TouchSuppression touchSuppression;
+
 @implementation NSView (TouchBarHitTest)
 + (void)loadTouchBarHitTest
 {
     static BOOL done;
     if (!done)
     {
+        TouchSuppressionInit(&touchSuppression, TouchBarHitTestInitialWindow);
         [self
             swizzleInstanceMethod:@selector(hitTest:)
             withMethod:@selector(__swizzle__hitTest:)];
+        [self
+            swizzleInstanceMethod:@selector(viewDidMoveToSuperview)
+            withMethod:@selector(__swizzle__viewDidMoveToSuperview)];
+        [self
+            swizzleInstanceMethod:@selector(viewDidMoveToWindow)
+            withMethod:@selector(__swizzle__viewDidMoveToWindow)];
+        [self
+            swizzleInstanceMethod:@selector(setFrame:)
+            withMethod:@selector(__swizzle__setFrame:)];
+        [self
+            swizzleInstanceMethod:@selector(setHidden:)
+            withMethod:@selector(__swizzle__setHidden:)];
         done = YES;
     }
 }
 
-static int enableTouchBarHitTest;
-+ (void)enableTouchBarHitTest:(id)flag
++ (void)suppressTouchBarHitTestAfterKeyDown:(NSTimeInterval)timestamp
 {
-    if (flag)
-        enableTouchBarHitTest++;
-    else
-        enableTouchBarHitTest--;
+    /* timestamp is an event timestamp: seconds since boot, like systemUptime */
+    TouchSuppressionKeyDown(&touchSuppression, timestamp);
 }
 
 - (NSView *)__swizzle__hitTest:(NSPoint)point
 {
-    if (0 <= enableTouchBarHitTest || [NSWindow class] == [self.window class])
+    /* the time comes from the event being dispatched; without one nothing is suppressed */
+    NSEvent *event = [NSApp currentEvent];
+    if (nil == event ||
+        !TouchSuppressionActive(&touchSuppression, event.timestamp) ||
+        [NSWindow class] == [self.window class])
         return [self __swizzle__hitTest:point];
 
     NSView *hitTestView = [self __swizzle__hitTest:point];
-    for (NSView *view = hitTestView; nil != view; view = view.superview)
-        if ([view respondsToSelector:@selector(isHitTestAlwaysEnabled_)] &&
-            [view isHitTestAlwaysEnabled_])
-            return hitTestView;
+    if (TouchBarHitTestEnabledForView(hitTestView))
+        return hitTestView;
 
     return nil;
 }
+
+- (void)__swizzle__viewDidMoveToSuperview
+{
+    TouchBarHitTestGeneration++;
+    [self __swizzle__viewDidMoveToSuperview];
+}
+
+- (void)__swizzle__viewDidMoveToWindow
+{
+    TouchBarHitTestGeneration++;
+    [self __swizzle__viewDidMoveToWindow];
+}
+
+- (void)__swizzle__setFrame:(NSRect)frame
+{
+    TouchBarHitTestGeneration++;
+    [self __swizzle__setFrame:frame];
+}
+
+- (void)__swizzle__setHidden:(BOOL)hidden
+{
+    TouchBarHitTestGeneration++;
+    [self __swizzle__setHidden:hidden];
+}
 @end
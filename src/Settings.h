@@ -0,0 +1,53 @@
+/**
+ * @file Settings.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+
+typedef NS_OPTIONS(NSUInteger, SettingsField)
+{
+    SettingsFieldAcceptsDraggedItems        = 1 << 0,
+    SettingsFieldDockMagnification          = 1 << 1,
+    SettingsFieldShowsFoldersInTouchBar     = 1 << 2,
+    SettingsFieldShowsRunningApps           = 1 << 3,
+    SettingsFieldShowsTrash                 = 1 << 4,
+    SettingsFieldIgnoresAccidentalTouches   = 1 << 5,
+};
+
+typedef struct
+{
+    BOOL acceptsDraggedItems;
+    BOOL dockMagnification;
+    BOOL showsFoldersInTouchBar;
+    BOOL showsRunningApps;
+    BOOL showsTrash;
+    BOOL ignoresAccidentalTouches;
+} SettingsSnapshot;
+
+@interface Settings : NSObject
++ (Settings *)sharedInstance;
+- (void)reload;
+- (void)addObserver:(id)observer selector:(SEL)sel fields:(SettingsField)fields;
+- (void)removeObserver:(id)observer;
+@end
+
+/*
+ * The current snapshot is immutable and is replaced as a whole by -[Settings reload].
+ * Hot paths read it with a single pointer load instead of going through NSUserDefaults.
+ * Snapshots are never freed, so a pointer obtained from GetSettings stays valid.
+ */
+extern const SettingsSnapshot *SettingsCurrentSnapshot;
+
+static inline const SettingsSnapshot *GetSettings(void)
+{
+    return __atomic_load_n(&SettingsCurrentSnapshot, __ATOMIC_ACQUIRE);
+}
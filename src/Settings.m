@@ -0,0 +1,162 @@
+/**
+ * @file Settings.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "Settings.h"
+
+static const SettingsSnapshot defaultSnapshot;
+const SettingsSnapshot *SettingsCurrentSnapshot = &defaultSnapshot;
+
+@interface SettingsObserver : NSObject
+@property (assign) id observer;
+@property (assign) SEL selector;
+@property (assign) SettingsField fields;
+@end
+
+@implementation SettingsObserver
+@end
+
+@implementation Settings
+{
+    NSMutableArray<SettingsObserver *> *_observers;
+    /* every snapshot ever published, so that none is freed under a reader */
+    SettingsSnapshot **_snapshots;
+    NSUInteger _snapshotCount;
+}
+
++ (Settings *)sharedInstance
+{
+    static Settings *instance = 0;
+    if (0 == instance)
+        instance = [[Settings alloc] init];
+    return instance;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    _observers = [[NSMutableArray alloc] init];
+
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(userDefaultsDidChange:)
+        name:NSUserDefaultsDidChangeNotification
+        object:nil];
+
+    [self reload];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [_observers release];
+
+    [super dealloc];
+}
+
+- (void)userDefaultsDidChange:(NSNotification *)notification
+{
+    if (![NSThread isMainThread])
+    {
+        [self performSelectorOnMainThread:@selector(reload) withObject:nil waitUntilDone:NO];
+        return;
+    }
+
+    [self reload];
+}
+
+- (void)reload
+{
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    SettingsSnapshot values = { 0 };
+
+    values.acceptsDraggedItems = [defaults boolForKey:@"acceptsDraggedItems"];
+    values.dockMagnification = [defaults boolForKey:@"dockMagnification"];
+    values.showsFoldersInTouchBar = [defaults boolForKey:@"showsFoldersInTouchBar"];
+    values.showsRunningApps = [defaults boolForKey:@"showsRunningApps"];
+    values.showsTrash = [defaults boolForKey:@"showsTrash"];
+    values.ignoresAccidentalTouches = [defaults boolForKey:@"ignoresAccidentalTouches"];
+
+    const SettingsSnapshot *current = GetSettings();
+    SettingsField changed = 0;
+    if (current->acceptsDraggedItems != values.acceptsDraggedItems)
+        changed |= SettingsFieldAcceptsDraggedItems;
+    if (current->dockMagnification != values.dockMagnification)
+        changed |= SettingsFieldDockMagnification;
+    if (current->showsFoldersInTouchBar != values.showsFoldersInTouchBar)
+        changed |= SettingsFieldShowsFoldersInTouchBar;
+    if (current->showsRunningApps != values.showsRunningApps)
+        changed |= SettingsFieldShowsRunningApps;
+    if (current->showsTrash != values.showsTrash)
+        changed |= SettingsFieldShowsTrash;
+    if (current->ignoresAccidentalTouches != values.ignoresAccidentalTouches)
+        changed |= SettingsFieldIgnoresAccidentalTouches;
+
+    if (0 == changed && 0 != _snapshotCount)
+        return;
+
+    /*
+     * Readers on any thread may hold a snapshot pointer for as long as they like, so
+     * published snapshots are never freed. A snapshot with the same values is published
+     * again instead of a new one, which bounds them by the distinct combinations of
+     * settings actually used (a handful of bytes each).
+     */
+    SettingsSnapshot *snapshot = 0;
+    for (NSUInteger i = 0; _snapshotCount > i; i++)
+        if (0 == memcmp(_snapshots[i], &values, sizeof values))
+        {
+            snapshot = _snapshots[i];
+            break;
+        }
+    if (0 == snapshot)
+    {
+        SettingsSnapshot **snapshots = realloc(_snapshots, (_snapshotCount + 1) * sizeof *snapshots);
+        if (0 == snapshots)
+            return;
+        _snapshots = snapshots;
+        snapshot = malloc(sizeof *snapshot);
+        if (0 == snapshot)
+            return;
+        memcpy(snapshot, &values, sizeof values);
+        _snapshots[_snapshotCount++] = snapshot;
+    }
+
+    __atomic_store_n(&SettingsCurrentSnapshot, snapshot, __ATOMIC_RELEASE);
+
+    for (SettingsObserver *o in [[_observers copy] autorelease])
+        if (0 != (o.fields & changed))
+            [o.observer performSelector:o.selector withObject:self];
+}
+
+- (void)addObserver:(id)observer selector:(SEL)sel fields:(SettingsField)fields
+{
+    SettingsObserver *o = [[[SettingsObserver alloc] init] autorelease];
+    o.observer = observer;
+    o.selector = sel;
+    o.fields = fields;
+    [_observers addObject:o];
+}
+
+- (void)removeObserver:(id)observer
+{
+    for (NSUInteger index = _observers.count - 1; _observers.count > index; index--)
+        if ([_observers objectAtIndex:index].observer == observer)
+            [_observers removeObjectAtIndex:index];
+}
+@end
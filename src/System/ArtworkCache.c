@@ -0,0 +1,135 @@
+/**
+ * @file ArtworkCache.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "ArtworkCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* decode at a multiple of the final size, so that downsampling has pixels to average */
+#define ArtworkCacheDecodeFactor        4
+
+struct ArtworkCache
+{
+    ArtworkCacheDecoder decoder;
+    unsigned pixelSize;
+    IconCache *icons;
+    uint64_t hits, misses, failures;    /* atomic */
+};
+
+static uint64_t ArtworkCacheHash(const void *data, size_t size)
+{
+    /* FNV-1a */
+    const uint8_t *p = data, *endp = p + size;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; endp > p; p++)
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    return hash;
+}
+
+ArtworkCache *ArtworkCacheCreate(const ArtworkCacheDecoder *decoder,
+    unsigned pixelSize, size_t budget)
+{
+    ArtworkCache *cache;
+
+    if (0 == pixelSize)
+        return 0;
+
+    cache = calloc(1, sizeof *cache);
+    if (0 == cache)
+        return 0;
+
+    cache->icons = IconCacheCreate(budget);
+    if (0 == cache->icons)
+    {
+        free(cache);
+        return 0;
+    }
+
+    cache->decoder = *decoder;
+    cache->pixelSize = pixelSize;
+
+    return cache;
+}
+
+void ArtworkCacheDelete(ArtworkCache *cache)
+{
+    if (0 == cache)
+        return;
+
+    IconCacheDelete(cache->icons);
+    free(cache);
+}
+
+IconCacheBitmap *ArtworkCacheGet(ArtworkCache *cache, const void *encoded, size_t size)
+{
+    IconCacheBitmap *res = 0;
+    uint32_t *pixels = 0, *small = 0;
+    unsigned width = 0, height = 0, side, pixelSize = cache->pixelSize;
+    char key[64];
+
+    if (0 == encoded || 0 == size)
+        return 0;
+
+    /* the size is part of the key to make hash collisions even less likely */
+    snprintf(key, sizeof key, "%016llx-%llx",
+        (unsigned long long)ArtworkCacheHash(encoded, size), (unsigned long long)size);
+
+    res = IconCacheLookup(cache->icons, key);
+    if (0 != res)
+    {
+        __atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+        return res;
+    }
+
+    __atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+
+    if (!cache->decoder.decode(cache->decoder.data, encoded, size,
+        pixelSize * ArtworkCacheDecodeFactor, &pixels, &width, &height) ||
+        0 == pixels || 0 == width || 0 == height)
+        goto exit;
+
+    small = malloc((size_t)pixelSize * pixelSize * sizeof *small);
+    if (0 == small)
+        goto exit;
+
+    /* center crop to a square: covers see the middle of wide or tall images */
+    side = width < height ? width : height;
+    if (!IconCacheDownsample(
+        pixels + (size_t)((height - side) / 2) * width + (width - side) / 2, side, side, width,
+        small, pixelSize, pixelSize))
+        goto exit;
+
+    res = IconCacheInsert(cache->icons, key, small, pixelSize, pixelSize);
+
+exit:
+    if (0 == res)
+        __atomic_fetch_add(&cache->failures, 1, __ATOMIC_RELAXED);
+
+    free(small);
+    free(pixels);
+
+    return res;
+}
+
+void ArtworkCacheGetStats(ArtworkCache *cache, ArtworkCacheStats *stats)
+{
+    IconCacheStats iconStats;
+    IconCacheGetStats(cache->icons, &iconStats);
+
+    stats->hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&cache->failures, __ATOMIC_RELAXED);
+    stats->count = iconStats.count;
+    stats->bytes = iconStats.bytes;
+    stats->budget = iconStats.budget;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file ArtworkCache.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef ARTWORKCACHE_H_INCLUDED
+#define ARTWORKCACHE_H_INCLUDED
+
+#include "IconCache.h"
+
+/*
+ * A cache of album artwork keyed by the hash of its encoded contents. Artwork
+ * is decoded once through a decoder (ImageIO on macOS; anything on other
+ * platforms), center cropped to a square and area downsampled to a fixed
+ * pixel size. The same artwork delivered again (e.g. when skipping back and
+ * forth in a playlist) is found by hash and never decoded twice.
+ *
+ * All functions are thread-safe; ArtworkCacheGet is meant to be called off
+ * the main thread as it may decode.
+ */
+typedef struct
+{
+    /* decode to premultiplied RGBA no larger than maxPixelSize; *ppixels is freed by the cache */
+    bool (*decode)(void *data, const void *encoded, size_t size, unsigned maxPixelSize,
+        uint32_t **ppixels, unsigned *pwidth, unsigned *pheight);
+    void *data;
+} ArtworkCacheDecoder;
+
+typedef struct
+{
+    uint64_t hits, misses, failures;
+    size_t count, bytes, budget;
+} ArtworkCacheStats;
+
+typedef struct ArtworkCache ArtworkCache;
+
+ArtworkCache *ArtworkCacheCreate(const ArtworkCacheDecoder *decoder,
+    unsigned pixelSize, size_t budget);
+void ArtworkCacheDelete(ArtworkCache *cache);
+IconCacheBitmap *ArtworkCacheGet(ArtworkCache *cache, const void *encoded, size_t size);
+void ArtworkCacheGetStats(ArtworkCache *cache, ArtworkCacheStats *stats);
+
+#endif
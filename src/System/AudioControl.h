@@ -12,11 +12,23 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "ServiceState.h"
+
+typedef NS_OPTIONS(uint64_t, AudioControlField)
+{
+    AudioControlFieldVolume                 = 1 << 0,
+    AudioControlFieldMute                   = 1 << 1,
+};
+
+typedef struct
+{
+    double volume;                      /* NAN if unknown */
+    bool mute;
+} AudioControlState;
 
 @interface AudioControl : NSObject
 + (AudioControl *)sharedInstance;
 @property (getter=volume, setter=setVolume:) double volume;
 @property (getter=isMute, setter=setMute:) BOOL mute;
+@property (readonly) ServiceState *state;
 @end
-
-extern NSString *AudioControlNotification;
@@ -16,6 +16,18 @@
 #include <AudioToolbox/AudioServices.h>
 #include "Log.h"
 
+static const StateStoreField AudioControlFields[] =
+{
+    StateStoreFieldOf(AudioControlState, volume),
+    StateStoreFieldOf(AudioControlState, mute),
+};
+
+static const AudioObjectPropertySelector AudioDeviceSelectors[] =
+{
+    kAudioHardwareServiceDeviceProperty_VirtualMasterVolume,
+    kAudioDevicePropertyMute,
+};
+
 @interface AudioControl ()
 - (void)systemObjectPropertyDidChange;
 - (void)audioDevicePropertyDidChange;
@@ -48,6 +60,7 @@ static OSStatus AudioDevicePropertyListener(
 @implementation AudioControl
 {
     AudioDeviceID _audiodev;
+    ServiceState *_state;
 }
 
 + (AudioControl *)sharedInstance
@@ -66,8 +79,16 @@ static OSStatus AudioDevicePropertyListener(
 
     _audiodev = kAudioObjectUnknown;
 
+    AudioControlState initial = { .volume = NAN };
+    _state = [[ServiceState alloc]
+        initWithSize:sizeof initial
+        fields:AudioControlFields
+        count:sizeof AudioControlFields / sizeof AudioControlFields[0]
+        initial:&initial];
+
     [self registerSystemObjectListener:YES];
     [self getAudioDevice:YES];
+    [self audioDevicePropertyDidChange];
 
     return self;
 }
@@ -77,9 +98,16 @@ static OSStatus AudioDevicePropertyListener(
     [self resetAudioDevice];
     [self registerSystemObjectListener:NO];
 
+    [_state release];
+
     [super dealloc];
 }
 
+- (ServiceState *)state
+{
+    return _state;
+}
+
 - (double)volume
 {
     AudioObjectPropertyAddress address =
@@ -203,17 +231,20 @@ static OSStatus AudioDevicePropertyListener(
         {
             _audiodev = device;
 
-            AudioObjectPropertyAddress address =
+            for (size_t i = 0; sizeof AudioDeviceSelectors / sizeof AudioDeviceSelectors[0] > i; i++)
             {
-                .mSelector = kAudioDevicePropertyMute,
-                .mScope = kAudioDevicePropertyScopeOutput,
-                .mElement = kAudioObjectPropertyElementMaster,
-            };
-
-            status = AudioObjectAddPropertyListener(
-                device, &address, AudioDevicePropertyListener, self);
-            if (kAudioHardwareNoError != status)
-                LOG("AudioObjectAddPropertyListener = %d", status);
+                AudioObjectPropertyAddress address =
+                {
+                    .mSelector = AudioDeviceSelectors[i],
+                    .mScope = kAudioDevicePropertyScopeOutput,
+                    .mElement = kAudioObjectPropertyElementMaster,
+                };
+
+                status = AudioObjectAddPropertyListener(
+                    device, &address, AudioDevicePropertyListener, self);
+                if (kAudioHardwareNoError != status)
+                    LOG("AudioObjectAddPropertyListener = %d", status);
+            }
         }
     }
 
@@ -224,18 +255,21 @@ static OSStatus AudioDevicePropertyListener(
 {
     if (kAudioObjectUnknown != _audiodev)
     {
-        AudioObjectPropertyAddress address =
+        for (size_t i = 0; sizeof AudioDeviceSelectors / sizeof AudioDeviceSelectors[0] > i; i++)
         {
-            .mSelector = kAudioDevicePropertyMute,
-            .mScope = kAudioDevicePropertyScopeOutput,
-            .mElement = kAudioObjectPropertyElementMaster,
-        };
-        OSStatus status;
+            AudioObjectPropertyAddress address =
+            {
+                .mSelector = AudioDeviceSelectors[i],
+                .mScope = kAudioDevicePropertyScopeOutput,
+                .mElement = kAudioObjectPropertyElementMaster,
+            };
+            OSStatus status;
 
-        status = AudioObjectRemovePropertyListener(
-            _audiodev, &address, AudioDevicePropertyListener, self);
-        if (kAudioHardwareNoError != status)
-            LOG("AudioObjectRemovePropertyListener = %d", status);
+            status = AudioObjectRemovePropertyListener(
+                _audiodev, &address, AudioDevicePropertyListener, self);
+            if (kAudioHardwareNoError != status)
+                LOG("AudioObjectRemovePropertyListener = %d", status);
+        }
     }
 }
 
@@ -269,14 +303,14 @@ static OSStatus AudioDevicePropertyListener(
 {
     [self resetAudioDevice];
     [self getAudioDevice:YES];
+    [self audioDevicePropertyDidChange];
 }
 
 - (void)audioDevicePropertyDidChange
 {
-    [[NSNotificationCenter defaultCenter]
-        postNotificationName:AudioControlNotification
-        object:self];
+    AudioControlState state;
+    state.volume = self.volume;
+    state.mute = self.mute;
+    [_state update:&state fields:~0ULL];
 }
 @end
-
-NSString *AudioControlNotification = @"AudioControl";
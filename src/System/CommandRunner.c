@@ -0,0 +1,365 @@
+/**
+ * @file CommandRunner.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE                     /* pipe2 */
+#endif
+#include "CommandRunner.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+struct CommandEntry
+{
+    struct CommandEntry *next;
+    char *command;
+    CommandResult result;
+    double time;                        /* completion time of result */
+    uint64_t generation;                /* number of completed runs */
+    bool running;
+    unsigned waiters;
+    CommandStats stats;
+};
+
+struct CommandRunner
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct CommandEntry *entries;
+    size_t count, maxEntries;
+};
+
+static double CommandRunnerNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int CommandRunnerPipe(int fds[2])
+{
+    /*
+     * Other threads spawn too (NSTask, our own workers). Where pipe2 exists the
+     * descriptors are close-on-exec from the start; elsewhere there is a window
+     * before fcntl, which POSIX_SPAWN_CLOEXEC_DEFAULT closes for our own spawns.
+     */
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (-1 == pipe(fds))
+        return -1;
+    if (-1 == fcntl(fds[0], F_SETFD, FD_CLOEXEC) ||
+        -1 == fcntl(fds[1], F_SETFD, FD_CLOEXEC))
+    {
+        close(fds[0]);
+        close(fds[1]);
+        fds[0] = fds[1] = -1;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+static bool CommandRunnerReap(pid_t pid, double deadline, int *pstatus)
+{
+    /* the child may close its output and keep running; do not wait past the deadline */
+    for (;;)
+    {
+        pid_t res = waitpid(pid, pstatus, WNOHANG);
+        if (pid == res)
+            return true;
+        if (-1 == res && EINTR != errno)
+            return false;
+        if (CommandRunnerNow() >= deadline)
+            return false;
+        usleep(1000);
+    }
+}
+
+bool CommandSpawn(const char *command, double timeout, CommandResult *result)
+{
+    bool res = false;
+    int fds[2] = { -1, -1 };
+    posix_spawn_file_actions_t actions, *pactions = 0;
+    posix_spawnattr_t attr, *pattr = 0;
+    pid_t pid = -1;
+    int status = 0;
+    double start = CommandRunnerNow(), deadline = start + timeout;
+
+    result->status = -1;
+    result->timedOut = false;
+    result->spawnTime = result->runTime = 0;
+    result->length = 0;
+    result->output[0] = '\0';
+
+    if (-1 == CommandRunnerPipe(fds))
+        goto exit;
+
+    if (0 != posix_spawn_file_actions_init(&actions))
+        goto exit;
+    pactions = &actions;
+    if (0 != posix_spawn_file_actions_addopen(pactions, STDIN_FILENO, "/dev/null", O_RDONLY, 0) ||
+        0 != posix_spawn_file_actions_adddup2(pactions, fds[1], STDOUT_FILENO) ||
+        0 != posix_spawn_file_actions_addopen(pactions, STDERR_FILENO, "/dev/null", O_WRONLY, 0))
+        goto exit;
+
+    /*
+     * Own process group, so that a timeout kills everything the command started.
+     * Where available the child also gets only the descriptors set up above, not
+     * whatever another thread has open without close-on-exec at the moment.
+     */
+    if (0 != posix_spawnattr_init(&attr))
+        goto exit;
+    pattr = &attr;
+    short flags = POSIX_SPAWN_SETPGROUP;
+#if defined(POSIX_SPAWN_CLOEXEC_DEFAULT)
+    flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#endif
+    if (0 != posix_spawnattr_setflags(pattr, flags) ||
+        0 != posix_spawnattr_setpgroup(pattr, 0))
+        goto exit;
+
+    char *argv[] = { "sh", "-c", (char *)command, 0 };
+    if (0 != posix_spawn(&pid, "/bin/sh", pactions, pattr, argv, environ))
+    {
+        pid = -1;
+        goto exit;
+    }
+    result->spawnTime = CommandRunnerNow() - start;
+
+    close(fds[1]);
+    fds[1] = -1;
+
+    for (;;)
+    {
+        double remaining = deadline - CommandRunnerNow();
+        if (0 >= remaining)
+        {
+            result->timedOut = true;
+            break;
+        }
+
+        struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+        int n = poll(&pfd, 1, (int)(remaining * 1000) + 1);
+        if (-1 == n && EINTR != errno)
+            break;
+        if (0 >= n)
+            continue;
+
+        char buf[1024];
+        ssize_t bytes = read(fds[0], buf, sizeof buf);
+        if (0 == bytes)
+            break;
+        if (-1 == bytes)
+        {
+            if (EINTR == errno || EAGAIN == errno)
+                continue;
+            break;
+        }
+
+        /* keep draining past the limit so that the command does not block on a full pipe */
+        size_t avail = sizeof result->output - 1 - result->length;
+        size_t copy = (size_t)bytes < avail ? (size_t)bytes : avail;
+        memcpy(result->output + result->length, buf, copy);
+        result->length += copy;
+    }
+    result->output[result->length] = '\0';
+
+    if (result->timedOut || !CommandRunnerReap(pid, deadline, &status))
+    {
+        result->timedOut = true;
+        kill(-pid, SIGKILL);
+        while (-1 == waitpid(pid, &status, 0) && EINTR == errno)
+            ;
+    }
+    else if (WIFEXITED(status))
+        result->status = WEXITSTATUS(status);
+
+    res = !result->timedOut;
+
+exit:
+    if (0 != pattr)
+        posix_spawnattr_destroy(pattr);
+
+    if (0 != pactions)
+        posix_spawn_file_actions_destroy(pactions);
+
+    if (-1 != fds[1])
+        close(fds[1]);
+
+    if (-1 != fds[0])
+        close(fds[0]);
+
+    result->runTime = CommandRunnerNow() - start;
+
+    return res;
+}
+
+CommandRunner *CommandRunnerCreate(size_t maxEntries)
+{
+    CommandRunner *runner;
+
+    runner = calloc(1, sizeof *runner);
+    if (0 == runner)
+        return 0;
+
+    pthread_mutex_init(&runner->mutex, 0);
+    pthread_cond_init(&runner->cond, 0);
+    runner->maxEntries = 0 != maxEntries ? maxEntries : 1;
+
+    return runner;
+}
+
+void CommandRunnerDelete(CommandRunner *runner)
+{
+    if (0 == runner)
+        return;
+
+    for (struct CommandEntry *entry = runner->entries, *next; 0 != entry; entry = next)
+    {
+        next = entry->next;
+        free(entry->command);
+        free(entry);
+    }
+
+    pthread_cond_destroy(&runner->cond);
+    pthread_mutex_destroy(&runner->mutex);
+    free(runner);
+}
+
+static struct CommandEntry *CommandRunnerLookup(CommandRunner *runner, const char *command,
+    bool create)
+{
+    struct CommandEntry **pentry, **pvictim = 0;
+
+    for (pentry = &runner->entries; 0 != *pentry; pentry = &(*pentry)->next)
+    {
+        struct CommandEntry *entry = *pentry;
+        if (0 == strcmp(entry->command, command))
+            return entry;
+        if (!entry->running && 0 == entry->waiters &&
+            (0 == pvictim || entry->time < (*pvictim)->time))
+            pvictim = pentry;
+    }
+
+    if (!create)
+        return 0;
+
+    /* evict the entry that completed longest ago and that nobody is using */
+    if (runner->maxEntries <= runner->count && 0 != pvictim)
+    {
+        struct CommandEntry *victim = *pvictim;
+        *pvictim = victim->next;
+        free(victim->command);
+        free(victim);
+        runner->count--;
+    }
+
+    struct CommandEntry *entry = calloc(1, sizeof *entry);
+    if (0 == entry)
+        return 0;
+    entry->command = strdup(command);
+    if (0 == entry->command)
+    {
+        free(entry);
+        return 0;
+    }
+    entry->next = runner->entries;
+    runner->entries = entry;
+    runner->count++;
+
+    return entry;
+}
+
+void CommandRunnerRun(CommandRunner *runner, const char *command, double ttl, double timeout,
+    CommandResult *result)
+{
+    struct CommandEntry *entry;
+
+    pthread_mutex_lock(&runner->mutex);
+
+    entry = CommandRunnerLookup(runner, command, true);
+    if (0 == entry)
+    {
+        pthread_mutex_unlock(&runner->mutex);
+        CommandSpawn(command, timeout, result);
+        return;
+    }
+
+    if (0 != entry->generation && CommandRunnerNow() - entry->time < ttl)
+    {
+        entry->stats.hits++;
+        *result = entry->result;
+        pthread_mutex_unlock(&runner->mutex);
+        return;
+    }
+
+    if (entry->running)
+    {
+        /* join the run in progress instead of spawning another */
+        uint64_t generation = entry->generation;
+        entry->stats.joins++;
+        entry->waiters++;
+        while (entry->generation == generation)
+            pthread_cond_wait(&runner->cond, &runner->mutex);
+        entry->waiters--;
+        *result = entry->result;
+        pthread_mutex_unlock(&runner->mutex);
+        return;
+    }
+
+    entry->running = true;
+    pthread_mutex_unlock(&runner->mutex);
+
+    CommandSpawn(command, timeout, result);
+
+    pthread_mutex_lock(&runner->mutex);
+    entry->result = *result;
+    entry->time = CommandRunnerNow();
+    entry->generation++;
+    entry->running = false;
+    entry->stats.runs++;
+    if (result->timedOut)
+        entry->stats.timeouts++;
+    entry->stats.spawnTime += result->spawnTime;
+    if (entry->stats.spawnTimeMax < result->spawnTime)
+        entry->stats.spawnTimeMax = result->spawnTime;
+    entry->stats.runTime += result->runTime;
+    if (entry->stats.runTimeMax < result->runTime)
+        entry->stats.runTimeMax = result->runTime;
+    pthread_cond_broadcast(&runner->cond);
+    pthread_mutex_unlock(&runner->mutex);
+}
+
+bool CommandRunnerGetStats(CommandRunner *runner, const char *command, CommandStats *stats)
+{
+    struct CommandEntry *entry;
+
+    pthread_mutex_lock(&runner->mutex);
+    entry = CommandRunnerLookup(runner, command, false);
+    if (0 != entry)
+        *stats = entry->stats;
+    pthread_mutex_unlock(&runner->mutex);
+
+    return 0 != entry;
+}
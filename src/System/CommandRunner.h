@@ -0,0 +1,59 @@
+/**
+ * @file CommandRunner.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef COMMANDRUNNER_H_INCLUDED
+#define COMMANDRUNNER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Runs shell commands ("/bin/sh -c") with posix_spawn and captures their
+ * standard output through a pipe. Commands that run past their timeout are
+ * killed along with their process group.
+ *
+ * A CommandRunner adds a result cache on top: a result younger than the
+ * caller's TTL is returned without spawning, and callers that ask for a
+ * command that is already running wait for that run instead of starting
+ * another. All calls block and are meant for background queues.
+ */
+#define CommandRunnerOutputMax          4096
+
+typedef struct
+{
+    int status;                         /* exit status; -1 if not exited normally */
+    bool timedOut;
+    double spawnTime, runTime;          /* seconds */
+    size_t length;
+    char output[CommandRunnerOutputMax];/* stdout, NUL terminated, truncated */
+} CommandResult;
+
+typedef struct
+{
+    uint64_t runs, hits, joins, timeouts;
+    double spawnTime, spawnTimeMax;     /* seconds; total and maximum */
+    double runTime, runTimeMax;         /* seconds; total and maximum */
+} CommandStats;
+
+typedef struct CommandRunner CommandRunner;
+
+bool CommandSpawn(const char *command, double timeout, CommandResult *result);
+
+CommandRunner *CommandRunnerCreate(size_t maxEntries);
+void CommandRunnerDelete(CommandRunner *runner);
+void CommandRunnerRun(CommandRunner *runner, const char *command, double ttl, double timeout,
+    CommandResult *result);
+bool CommandRunnerGetStats(CommandRunner *runner, const char *command, CommandStats *stats);
+
+#endif
@@ -29,27 +29,56 @@ static void FSNotifyCallback(ConstFSEventStreamRef stream, void *info0,
         info->callback(((const char **)paths)[i], info->data);
 }
 
+static void *FSNotifyStartWithFlags(const char **cpaths, size_t count,
+    FSEventStreamCreateFlags flags, void (*callback)(const char *, void *), void *data);
+
 void *FSNotifyStart(const char *cpath, void (*callback)(const char *, void *), void *data)
 {
-    if (0 == cpath || 0 == callback)
+    return FSNotifyStartWithFlags(&cpath, 1, 0, callback, data);
+}
+
+void *FSNotifyStartPaths(const char **cpaths, size_t count,
+    void (*callback)(const char *, void *), void *data)
+{
+    return FSNotifyStartWithFlags(cpaths, count, 0, callback, data);
+}
+
+void *FSNotifyStartFiles(const char *cpath, void (*callback)(const char *, void *), void *data)
+{
+    /* the callback receives the paths of the files that changed rather than their directories */
+    return FSNotifyStartWithFlags(&cpath, 1, kFSEventStreamCreateFlagFileEvents, callback, data);
+}
+
+static void *FSNotifyStartWithFlags(const char **cpaths, size_t count,
+    FSEventStreamCreateFlags flags, void (*callback)(const char *, void *), void *data)
+{
+    if (0 == cpaths || 0 == count || 0 == callback)
         return 0;
 
     FSEventStreamRef res = 0;
-    CFStringRef path = 0;
-    CFArrayRef paths = 0;
+    CFMutableArrayRef paths = 0;
     struct FSNotifyInfo *info = 0;
     FSEventStreamContext context = { 0 };
     FSEventStreamRef stream = 0;
     bool scheduled = false;
 
-    path = CFStringCreateWithCString(0, cpath, kCFStringEncodingUTF8);
-    if (0 == path)
-        goto exit;
-
-    paths = CFArrayCreate(0, (const void **)&path, 1, &kCFTypeArrayCallBacks);
+    paths = CFArrayCreateMutable(0, (CFIndex)count, &kCFTypeArrayCallBacks);
     if (0 == paths)
         goto exit;
 
+    for (size_t i = 0; count > i; i++)
+    {
+        if (0 == cpaths[i])
+            goto exit;
+
+        CFStringRef path = CFStringCreateWithCString(0, cpaths[i], kCFStringEncodingUTF8);
+        if (0 == path)
+            goto exit;
+
+        CFArrayAppendValue(paths, path);
+        CFRelease(path);
+    }
+
     info = malloc(sizeof *info);
     if (0 == info)
         goto exit;
@@ -61,7 +90,7 @@ void *FSNotifyStart(const char *cpath, void (*callback)(const char *, void *), v
     context.release = (void (*)(const void *))(free);
 
     stream = FSEventStreamCreate(0, FSNotifyCallback,
-        &context, paths, kFSEventStreamEventIdSinceNow, 1.0, kFSEventStreamCreateFlagNoDefer);
+        &context, paths, kFSEventStreamEventIdSinceNow, 1.0, kFSEventStreamCreateFlagNoDefer | flags);
     if (0 == stream)
         goto exit;
 
@@ -86,9 +115,6 @@ exit:
     if (0 != paths)
         CFRelease(paths);
 
-    if (0 != path)
-        CFRelease(path);
-
     return res;
 }
 
@@ -14,7 +14,12 @@
 #ifndef FSNOTIFY_H_INCLUDED
 #define FSNOTIFY_H_INCLUDED
 
+#include <stddef.h>
+
 void *FSNotifyStart(const char *cpath, void (*callback)(const char *, void *), void *data);
+void *FSNotifyStartPaths(const char **cpaths, size_t count,
+    void (*callback)(const char *, void *), void *data);
+void *FSNotifyStartFiles(const char *cpath, void (*callback)(const char *, void *), void *data);
 void FSNotifyStop(void *stream);
 
 #endif
@@ -0,0 +1,955 @@
+/**
+ * @file FileOperation.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "FileOperation.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#endif
+
+#define FileOperationMaxWorkerCount     16
+#define FileOperationChunkSize          (1024 * 1024)
+
+enum
+{
+    FileOperationItemPending = 0,
+    FileOperationItemRenamed,
+    FileOperationItemCreated,
+};
+
+struct FileOperationItem
+{
+    char *src, *dst;
+    int state;
+};
+
+struct FileOperationJob
+{
+    char *src, *dst;
+    uint64_t size;
+    mode_t mode;
+    struct timespec times[2];           /* access, modification */
+};
+
+struct FileOperationDir
+{
+    char *dst;
+    mode_t mode;
+    struct timespec times[2];           /* access, modification */
+};
+
+struct FileOperation
+{
+    FileOperationKind kind;
+    char *dstdir;
+    unsigned workerCount;
+    void (*progress)(const FileOperationProgress *, void *);
+    void (*completion)(int, void *);
+    void *data;
+    struct FileOperationItem *items;
+    size_t itemCount, itemCapacity;
+    struct FileOperationJob *jobs;
+    size_t jobCount, jobCapacity;
+    struct FileOperationDir *dirs;      /* created directories, parents first */
+    size_t dirCount, dirCapacity;
+    size_t nextJob;                     /* atomic */
+    int cancel;                         /* atomic */
+    int error;                          /* atomic; first error wins */
+    pthread_mutex_t progressLock;
+    FileOperationProgress progressInfo;
+    pthread_t thread;
+    bool started, joined;
+    bool completed;                     /* atomic; all destination items are in place */
+};
+
+static void FileOperationSetError(FileOperation *op, int error)
+{
+    int expected = 0;
+    __atomic_compare_exchange_n(&op->error, &expected, error,
+        false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static bool FileOperationShouldStop(FileOperation *op)
+{
+    return __atomic_load_n(&op->cancel, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&op->error, __ATOMIC_RELAXED);
+}
+
+static char *FileOperationJoinPath(const char *dir, const char *name)
+{
+    size_t dirlen = strlen(dir), namelen = strlen(name);
+    while (1 < dirlen && '/' == dir[dirlen - 1])
+        dirlen--;
+    char *path = malloc(dirlen + 1 + namelen + 1);
+    if (0 == path)
+        return 0;
+    memcpy(path, dir, dirlen);
+    path[dirlen] = '/';
+    memcpy(path + dirlen + 1, name, namelen + 1);
+    return path;
+}
+
+static const char *FileOperationBaseName(const char *path, size_t *plen)
+{
+    size_t len = strlen(path);
+    while (1 < len && '/' == path[len - 1])
+        len--;
+    const char *p = path + len;
+    while (path < p && '/' != p[-1])
+        p--;
+    *plen = len - (size_t)(p - path);
+    return p;
+}
+
+static void FileOperationReportProgress(FileOperation *op, uint64_t bytes, size_t files)
+{
+    pthread_mutex_lock(&op->progressLock);
+    op->progressInfo.bytesDone += bytes;
+    op->progressInfo.filesDone += files;
+    FileOperationProgress info = op->progressInfo;
+    if (0 != op->progress)
+        op->progress(&info, op->data);
+    pthread_mutex_unlock(&op->progressLock);
+}
+
+static void FileOperationReportItem(FileOperation *op)
+{
+    pthread_mutex_lock(&op->progressLock);
+    op->progressInfo.filesTotal++;
+    op->progressInfo.filesDone++;
+    FileOperationProgress info = op->progressInfo;
+    if (0 != op->progress)
+        op->progress(&info, op->data);
+    pthread_mutex_unlock(&op->progressLock);
+}
+
+static __thread int FileOperationRemoveTreeError;
+
+static int FileOperationRemoveTreeEntry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    /* keep going after an error, so that as much as possible is removed */
+    if (-1 == remove(path) && 0 == FileOperationRemoveTreeError)
+        FileOperationRemoveTreeError = errno;
+    return 0;
+}
+
+static int FileOperationRemoveTree(const char *path)
+{
+    FileOperationRemoveTreeError = 0;
+    if (-1 == nftw(path, FileOperationRemoveTreeEntry, 16, FTW_DEPTH | FTW_PHYS) &&
+        0 == FileOperationRemoveTreeError)
+        FileOperationRemoveTreeError = errno;
+    return FileOperationRemoveTreeError;
+}
+
+static int FileOperationRename(const char *src, const char *dst)
+{
+    /*
+     * Never replace an item that appeared at the destination after the preflight.
+     * When the file system cannot rename exclusively, report EXDEV so that the item
+     * is copied instead (copies create every item exclusively).
+     */
+#if defined(__APPLE__)
+    if (0 == renamex_np(src, dst, RENAME_EXCL))
+        return 0;
+    return ENOTSUP == errno ? EXDEV : errno;
+#elif defined(__linux__)
+    if (0 == renameat2(AT_FDCWD, src, AT_FDCWD, dst, RENAME_NOREPLACE))
+        return 0;
+    return EINVAL == errno || ENOSYS == errno ? EXDEV : errno;
+#else
+    return EXDEV;
+#endif
+}
+
+static void FileOperationGetTimes(const struct stat *st, struct timespec times[2])
+{
+#if defined(__APPLE__)
+    times[0] = st->st_atimespec;
+    times[1] = st->st_mtimespec;
+#else
+    times[0] = st->st_atim;
+    times[1] = st->st_mtim;
+#endif
+}
+
+/*
+ * Extended attributes are copied on a best effort basis: an attribute that the
+ * destination cannot hold (unsupported file system or namespace) is skipped.
+ */
+static int FileOperationCopyXattrs(int sfd, int dfd)
+{
+#if defined(__APPLE__)
+    if (0 != fcopyfile(sfd, dfd, 0, COPYFILE_XATTR))
+        return errno;
+    return 0;
+#elif defined(__linux__)
+    char *names = 0, *value = 0;
+    ssize_t namesize, valuesize, valuecap = 0;
+    int res;
+
+    namesize = flistxattr(sfd, 0, 0);
+    if (0 >= namesize)
+    {
+        res = 0 == namesize || ENOTSUP == errno ? 0 : errno;
+        goto exit;
+    }
+
+    names = malloc((size_t)namesize);
+    if (0 == names)
+    {
+        res = ENOMEM;
+        goto exit;
+    }
+    namesize = flistxattr(sfd, names, (size_t)namesize);
+    if (-1 == namesize)
+    {
+        res = errno;
+        goto exit;
+    }
+
+    for (char *name = names; names + namesize > name; name += strlen(name) + 1)
+    {
+        valuesize = fgetxattr(sfd, name, 0, 0);
+        if (-1 == valuesize)
+            continue;
+        if (valuesize > valuecap)
+        {
+            char *p = realloc(value, (size_t)valuesize);
+            if (0 == p)
+            {
+                res = ENOMEM;
+                goto exit;
+            }
+            value = p;
+            valuecap = valuesize;
+        }
+        valuesize = fgetxattr(sfd, name, value, (size_t)valuecap);
+        if (-1 == valuesize)
+            continue;
+        if (-1 == fsetxattr(dfd, name, value, (size_t)valuesize, 0) &&
+            ENOTSUP != errno && EPERM != errno && EACCES != errno)
+        {
+            res = errno;
+            goto exit;
+        }
+    }
+
+    res = 0;
+
+exit:
+    free(value);
+    free(names);
+
+    return res;
+#else
+    return 0;
+#endif
+}
+
+static int FileOperationAddDir(FileOperation *op, const char *dst, const struct stat *st)
+{
+    if (op->dirCount >= op->dirCapacity)
+    {
+        size_t capacity = 0 != op->dirCapacity ? op->dirCapacity * 2 : 16;
+        struct FileOperationDir *dirs = realloc(op->dirs, capacity * sizeof *dirs);
+        if (0 == dirs)
+            return ENOMEM;
+        op->dirs = dirs;
+        op->dirCapacity = capacity;
+    }
+
+    struct FileOperationDir *dir = op->dirs + op->dirCount;
+    dir->dst = strdup(dst);
+    if (0 == dir->dst)
+        return ENOMEM;
+    dir->mode = st->st_mode & 07777;
+    FileOperationGetTimes(st, dir->times);
+    op->dirCount++;
+
+    return 0;
+}
+
+static int FileOperationRestoreDirs(FileOperation *op)
+{
+    /* children first: a parent that loses search permission still lets them be changed;
+     * times last, they are final once nothing is added to the directory */
+    for (size_t i = op->dirCount; 0 < i; i--)
+    {
+        struct FileOperationDir *dir = op->dirs + i - 1;
+        if (-1 == chmod(dir->dst, dir->mode))
+            return errno;
+        if (-1 == utimensat(AT_FDCWD, dir->dst, dir->times, 0))
+            return errno;
+    }
+
+    return 0;
+}
+
+static int FileOperationAddJob(FileOperation *op, const char *src, const char *dst, const struct stat *st)
+{
+    if (op->jobCount >= op->jobCapacity)
+    {
+        size_t capacity = 0 != op->jobCapacity ? op->jobCapacity * 2 : 64;
+        struct FileOperationJob *jobs = realloc(op->jobs, capacity * sizeof *jobs);
+        if (0 == jobs)
+            return ENOMEM;
+        op->jobs = jobs;
+        op->jobCapacity = capacity;
+    }
+
+    struct FileOperationJob *job = op->jobs + op->jobCount;
+    job->src = strdup(src);
+    job->dst = strdup(dst);
+    if (0 == job->src || 0 == job->dst)
+    {
+        free(job->src);
+        free(job->dst);
+        return ENOMEM;
+    }
+    job->size = (uint64_t)st->st_size;
+    job->mode = st->st_mode & 07777;
+    FileOperationGetTimes(st, job->times);
+    op->jobCount++;
+    op->progressInfo.bytesTotal += job->size;
+    op->progressInfo.filesTotal++;
+
+    return 0;
+}
+
+/*
+ * Walk the source tree on the operation thread: directories and symbolic links
+ * are created immediately (they are cheap), regular files become worker jobs.
+ * The top-level item is marked created as soon as it exists (or is queued),
+ * so that a partially planned or copied tree is removed on failure.
+ */
+static int FileOperationPlan(FileOperation *op, const char *src, const char *dst, int *pstate)
+{
+    struct stat st;
+    DIR *dir = 0;
+    struct dirent *dirent;
+    char *subsrc = 0, *subdst = 0;
+    int dfd = -1;
+    int res;
+
+    if (FileOperationShouldStop(op))
+    {
+        res = ECANCELED;
+        goto exit;
+    }
+
+    if (-1 == lstat(src, &st))
+    {
+        res = errno;
+        goto exit;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+        /* keep the directory writable until the workers have filled it; its mode is
+         * restored when they are done */
+        if (-1 == mkdir(dst, (st.st_mode & 07777) | S_IRWXU))
+        {
+            res = errno;
+            goto exit;
+        }
+        if (0 != pstate)
+            *pstate = FileOperationItemCreated;
+
+        res = FileOperationAddDir(op, dst, &st);
+        if (0 != res)
+            goto exit;
+
+        dir = opendir(src);
+        if (0 == dir)
+        {
+            res = errno;
+            goto exit;
+        }
+
+        /* extended attributes now, while the directory is writable */
+        dfd = open(dst, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (-1 == dfd)
+        {
+            res = errno;
+            goto exit;
+        }
+        res = FileOperationCopyXattrs(dirfd(dir), dfd);
+        if (0 != res)
+            goto exit;
+        close(dfd);
+        dfd = -1;
+
+        while (0 != (dirent = readdir(dir)))
+        {
+            if (0 == strcmp(dirent->d_name, ".") || 0 == strcmp(dirent->d_name, ".."))
+                continue;
+
+            subsrc = FileOperationJoinPath(src, dirent->d_name);
+            subdst = FileOperationJoinPath(dst, dirent->d_name);
+            if (0 == subsrc || 0 == subdst)
+            {
+                res = ENOMEM;
+                goto exit;
+            }
+
+            res = FileOperationPlan(op, subsrc, subdst, 0);
+            if (0 != res)
+                goto exit;
+
+            free(subsrc);
+            free(subdst);
+            subsrc = subdst = 0;
+        }
+    }
+    else if (S_ISLNK(st.st_mode))
+    {
+        char target[PATH_MAX];
+        ssize_t len = readlink(src, target, sizeof target - 1);
+        if (-1 == len)
+        {
+            res = errno;
+            goto exit;
+        }
+        target[len] = '\0';
+
+        if (-1 == symlink(target, dst))
+        {
+            res = errno;
+            goto exit;
+        }
+        if (0 != pstate)
+            *pstate = FileOperationItemCreated;
+
+        struct timespec times[2];
+        FileOperationGetTimes(&st, times);
+        if (-1 == utimensat(AT_FDCWD, dst, times, AT_SYMLINK_NOFOLLOW))
+        {
+            res = errno;
+            goto exit;
+        }
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        res = FileOperationAddJob(op, src, dst, &st);
+        if (0 != res)
+            goto exit;
+        if (0 != pstate)
+            *pstate = FileOperationItemCreated;
+    }
+    else
+    {
+        res = ENOTSUP;
+        goto exit;
+    }
+
+    res = 0;
+
+exit:
+    if (-1 != dfd)
+        close(dfd);
+
+    if (0 != dir)
+        closedir(dir);
+
+    free(subsrc);
+    free(subdst);
+
+    return res;
+}
+
+#if defined(__APPLE__)
+static int FileOperationCopyfileCallback(int what, int stage, copyfile_state_t state,
+    const char *src, const char *dst, void *ctx)
+{
+    return FileOperationShouldStop(ctx) ? COPYFILE_QUIT : COPYFILE_CONTINUE;
+}
+
+static int FileOperationCopyFile(FileOperation *op, struct FileOperationJob *job)
+{
+    copyfile_state_t state = 0;
+    int res;
+
+    state = copyfile_state_alloc();
+    if (0 == state)
+    {
+        res = ENOMEM;
+        goto exit;
+    }
+
+    copyfile_state_set(state, COPYFILE_STATE_STATUS_CB, FileOperationCopyfileCallback);
+    copyfile_state_set(state, COPYFILE_STATE_STATUS_CTX, op);
+
+    /* COPYFILE_CLONE clones on APFS and falls back to a full data/metadata copy */
+    if (0 != copyfile(job->src, job->dst, state, COPYFILE_CLONE))
+    {
+        res = FileOperationShouldStop(op) ? ECANCELED : errno;
+        goto exit;
+    }
+
+    res = 0;
+
+exit:
+    if (0 != state)
+        copyfile_state_free(state);
+
+    return res;
+}
+#else
+static int FileOperationCopyFile(FileOperation *op, struct FileOperationJob *job)
+{
+    int sfd = -1, dfd = -1;
+    char *buf = 0;
+    int res;
+
+    sfd = open(job->src, O_RDONLY | O_CLOEXEC);
+    if (-1 == sfd)
+    {
+        res = errno;
+        goto exit;
+    }
+
+    dfd = open(job->dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (-1 == dfd)
+    {
+        res = errno;
+        goto exit;
+    }
+
+#if defined(__linux__)
+    /* reflink when the file system supports it */
+    if (0 == ioctl(dfd, FICLONE, sfd))
+        goto done;
+
+    for (;;)
+    {
+        if (FileOperationShouldStop(op))
+        {
+            res = ECANCELED;
+            goto exit;
+        }
+
+        ssize_t bytes = copy_file_range(sfd, 0, dfd, 0, FileOperationChunkSize, 0);
+        if (0 == bytes)
+            goto done;
+        if (-1 == bytes)
+        {
+            if (EXDEV == errno || ENOSYS == errno || EINVAL == errno || EOPNOTSUPP == errno)
+                break;
+            res = errno;
+            goto exit;
+        }
+    }
+#endif
+
+    buf = malloc(FileOperationChunkSize);
+    if (0 == buf)
+    {
+        res = ENOMEM;
+        goto exit;
+    }
+
+    for (;;)
+    {
+        if (FileOperationShouldStop(op))
+        {
+            res = ECANCELED;
+            goto exit;
+        }
+
+        ssize_t bytes = read(sfd, buf, FileOperationChunkSize);
+        if (0 == bytes)
+            break;
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            res = errno;
+            goto exit;
+        }
+
+        for (ssize_t offset = 0; bytes > offset;)
+        {
+            ssize_t written = write(dfd, buf + offset, (size_t)(bytes - offset));
+            if (-1 == written)
+            {
+                if (EINTR == errno)
+                    continue;
+                res = errno;
+                goto exit;
+            }
+            offset += written;
+        }
+    }
+
+#if defined(__linux__)
+done:
+#endif
+    /* extended attributes before the mode, which may make the file read-only */
+    res = FileOperationCopyXattrs(sfd, dfd);
+    if (0 != res)
+        goto exit;
+
+    if (-1 == fchmod(dfd, job->mode))
+    {
+        res = errno;
+        goto exit;
+    }
+
+    if (-1 == futimens(dfd, job->times))
+    {
+        res = errno;
+        goto exit;
+    }
+
+    res = 0;
+
+exit:
+    free(buf);
+
+    if (-1 != dfd)
+        close(dfd);
+
+    if (-1 != sfd)
+        close(sfd);
+
+    return res;
+}
+#endif
+
+static void *FileOperationWorker(void *data)
+{
+    FileOperation *op = data;
+
+    for (;;)
+    {
+        if (FileOperationShouldStop(op))
+            break;
+
+        size_t index = __atomic_fetch_add(&op->nextJob, 1, __ATOMIC_RELAXED);
+        if (op->jobCount <= index)
+            break;
+
+        struct FileOperationJob *job = op->jobs + index;
+        int res = FileOperationCopyFile(op, job);
+        if (0 != res)
+        {
+            FileOperationSetError(op, res);
+            break;
+        }
+
+        FileOperationReportProgress(op, job->size, 1);
+    }
+
+    return 0;
+}
+
+static int FileOperationRunWorkers(FileOperation *op)
+{
+    pthread_t threads[FileOperationMaxWorkerCount];
+    unsigned count = op->workerCount;
+    if (op->jobCount < count)
+        count = (unsigned)op->jobCount;
+
+    /* the operation thread is itself a worker */
+    unsigned started = 0;
+    for (; count > started + 1; started++)
+        if (0 != pthread_create(&threads[started], 0, FileOperationWorker, op))
+            break;
+
+    FileOperationWorker(op);
+
+    for (unsigned i = 0; started > i; i++)
+        pthread_join(threads[i], 0);
+
+    return __atomic_load_n(&op->error, __ATOMIC_SEQ_CST);
+}
+
+static int FileOperationPreflight(FileOperation *op)
+{
+    struct stat st;
+
+    for (size_t i = 0; op->itemCount > i; i++)
+    {
+        struct FileOperationItem *item = op->items + i;
+
+        if (-1 == lstat(item->src, &st))
+            return errno;
+
+        if (0 == lstat(item->dst, &st))
+            return EEXIST;
+
+        /* refuse to copy or move a directory into itself */
+        size_t srclen = strlen(item->src);
+        if (0 == strncmp(item->dst, item->src, srclen) && '/' == item->dst[srclen])
+            return EINVAL;
+    }
+
+    return 0;
+}
+
+static void *FileOperationMain(void *data)
+{
+    FileOperation *op = data;
+    int res;
+
+    res = FileOperationPreflight(op);
+    if (0 != res)
+        goto exit;
+
+    for (size_t i = 0; op->itemCount > i; i++)
+    {
+        struct FileOperationItem *item = op->items + i;
+
+        if (FileOperationShouldStop(op))
+        {
+            res = ECANCELED;
+            goto exit;
+        }
+
+        if (FileOperationMove == op->kind)
+        {
+            res = FileOperationRename(item->src, item->dst);
+            if (0 == res)
+            {
+                item->state = FileOperationItemRenamed;
+                FileOperationReportItem(op);
+                continue;
+            }
+            if (EXDEV != res)
+                goto exit;
+        }
+
+#if defined(__APPLE__)
+        /* clonefile clones a whole directory tree in one call on APFS */
+        if (0 == clonefile(item->src, item->dst, CLONE_NOFOLLOW))
+        {
+            item->state = FileOperationItemCreated;
+            FileOperationReportItem(op);
+            continue;
+        }
+        if (EEXIST == errno)
+        {
+            res = EEXIST;
+            goto exit;
+        }
+#endif
+
+        res = FileOperationPlan(op, item->src, item->dst, &item->state);
+        if (0 != res)
+            goto exit;
+    }
+
+    res = FileOperationRunWorkers(op);
+    if (0 == res && __atomic_load_n(&op->cancel, __ATOMIC_SEQ_CST))
+        res = ECANCELED;
+    if (0 == res)
+        res = FileOperationRestoreDirs(op);
+
+exit:
+    if (0 != res)
+    {
+        FileOperationSetError(op, res);
+
+        /* directory modes may have been restored already; make them writable to remove them */
+        for (size_t i = 0; op->dirCount > i; i++)
+            chmod(op->dirs[i].dst, op->dirs[i].mode | S_IRWXU);
+
+        /* roll back in reverse order */
+        for (size_t i = op->itemCount; 0 < i; i--)
+        {
+            struct FileOperationItem *item = op->items + i - 1;
+            if (FileOperationItemRenamed == item->state)
+                FileOperationRename(item->dst, item->src);
+            else if (FileOperationItemCreated == item->state)
+                FileOperationRemoveTree(item->dst);
+            item->state = FileOperationItemPending;
+        }
+    }
+    else
+    {
+        __atomic_store_n(&op->completed, true, __ATOMIC_SEQ_CST);
+
+        /* cross-volume moves: the copies are complete, remove the sources; the copies
+         * stay in place even if some source cannot be removed, but the error is reported */
+        if (FileOperationMove == op->kind)
+            for (size_t i = 0; op->itemCount > i; i++)
+                if (FileOperationItemCreated == op->items[i].state)
+                {
+                    int error = FileOperationRemoveTree(op->items[i].src);
+                    if (0 != error && 0 == res)
+                        res = error;
+                }
+        if (0 != res)
+            FileOperationSetError(op, res);
+    }
+
+    if (0 != op->completion)
+        op->completion(res, op->data);
+
+    return 0;
+}
+
+FileOperation *FileOperationCreate(FileOperationKind kind, const char *dstdir, unsigned workerCount,
+    void (*progress)(const FileOperationProgress *, void *),
+    void (*completion)(int, void *),
+    void *data)
+{
+    if (0 == dstdir)
+        return 0;
+
+    FileOperation *op = calloc(1, sizeof *op);
+    if (0 == op)
+        return 0;
+
+    op->dstdir = strdup(dstdir);
+    if (0 == op->dstdir)
+    {
+        free(op);
+        return 0;
+    }
+
+    if (0 == workerCount)
+        workerCount = 1;
+    else if (FileOperationMaxWorkerCount < workerCount)
+        workerCount = FileOperationMaxWorkerCount;
+
+    op->kind = kind;
+    op->workerCount = workerCount;
+    op->progress = progress;
+    op->completion = completion;
+    op->data = data;
+    pthread_mutex_init(&op->progressLock, 0);
+
+    return op;
+}
+
+void FileOperationDelete(FileOperation *op)
+{
+    if (0 == op)
+        return;
+
+    if (op->started && !op->joined)
+    {
+        FileOperationCancel(op);
+        FileOperationWait(op);
+    }
+
+    for (size_t i = 0; op->itemCount > i; i++)
+    {
+        free(op->items[i].src);
+        free(op->items[i].dst);
+    }
+    for (size_t i = 0; op->jobCount > i; i++)
+    {
+        free(op->jobs[i].src);
+        free(op->jobs[i].dst);
+    }
+    for (size_t i = 0; op->dirCount > i; i++)
+        free(op->dirs[i].dst);
+    free(op->items);
+    free(op->jobs);
+    free(op->dirs);
+    free(op->dstdir);
+    pthread_mutex_destroy(&op->progressLock);
+    free(op);
+}
+
+bool FileOperationAdd(FileOperation *op, const char *src)
+{
+    if (op->started || 0 == src || '\0' == src[0])
+        return false;
+
+    if (op->itemCount >= op->itemCapacity)
+    {
+        size_t capacity = 0 != op->itemCapacity ? op->itemCapacity * 2 : 16;
+        struct FileOperationItem *items = realloc(op->items, capacity * sizeof *items);
+        if (0 == items)
+            return false;
+        op->items = items;
+        op->itemCapacity = capacity;
+    }
+
+    size_t namelen;
+    const char *name = FileOperationBaseName(src, &namelen);
+    char *namedup = 0 != namelen ? strndup(name, namelen) : 0;
+    struct FileOperationItem *item = op->items + op->itemCount;
+    item->src = strndup(src, (size_t)(name - src) + namelen);
+    item->dst = 0 != namedup ? FileOperationJoinPath(op->dstdir, namedup) : 0;
+    item->state = FileOperationItemPending;
+    free(namedup);
+    if (0 == item->src || 0 == item->dst)
+    {
+        free(item->src);
+        free(item->dst);
+        return false;
+    }
+    op->itemCount++;
+
+    return true;
+}
+
+bool FileOperationStart(FileOperation *op)
+{
+    if (op->started || 0 == op->itemCount)
+        return false;
+
+    if (0 != pthread_create(&op->thread, 0, FileOperationMain, op))
+        return false;
+
+    op->started = true;
+    return true;
+}
+
+void FileOperationCancel(FileOperation *op)
+{
+    __atomic_store_n(&op->cancel, 1, __ATOMIC_SEQ_CST);
+}
+
+int FileOperationWait(FileOperation *op)
+{
+    if (!op->started)
+        return EINVAL;
+
+    if (!op->joined)
+    {
+        pthread_join(op->thread, 0);
+        op->joined = true;
+    }
+
+    return __atomic_load_n(&op->error, __ATOMIC_SEQ_CST);
+}
+
+bool FileOperationCompleted(FileOperation *op)
+{
+    return __atomic_load_n(&op->completed, __ATOMIC_SEQ_CST);
+}
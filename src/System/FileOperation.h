@@ -0,0 +1,70 @@
+/**
+ * @file FileOperation.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef FILEOPERATION_H_INCLUDED
+#define FILEOPERATION_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-process copy/move of file trees into a destination directory.
+ *
+ * Items are moved with rename when source and destination share a volume;
+ * otherwise (and for copies) the whole item is cloned when the file system
+ * supports it, else the tree is planned on the operation thread and regular
+ * files are copied by a bounded pool of worker threads.
+ *
+ * The operation is all-or-nothing: on error or cancellation the items that
+ * were renamed are renamed back and the items that were created are removed,
+ * so the caller may retry by other means (e.g. Finder). Existing destination
+ * items are never replaced; they fail the operation with EEXIST, before any
+ * file system change is made or (if they appear later) when they are reached.
+ *
+ * The one exception is a cross-volume move whose copies are complete but
+ * whose sources cannot all be removed: the copies are kept, the error is
+ * reported and FileOperationCompleted returns true.
+ *
+ * Copies keep the mode, times and extended attributes of their source (directories
+ * get theirs once they are filled; attributes the destination cannot hold are skipped).
+ *
+ * The progress and completion callbacks are called on operation or worker
+ * threads. FileOperationDelete must not be called from within them.
+ */
+typedef struct FileOperation FileOperation;
+
+typedef enum
+{
+    FileOperationCopy = 0,
+    FileOperationMove = 1,
+} FileOperationKind;
+
+typedef struct
+{
+    uint64_t bytesDone, bytesTotal;
+    size_t filesDone, filesTotal;
+} FileOperationProgress;
+
+FileOperation *FileOperationCreate(FileOperationKind kind, const char *dstdir, unsigned workerCount,
+    void (*progress)(const FileOperationProgress *, void *),
+    void (*completion)(int, void *),
+    void *data);
+void FileOperationDelete(FileOperation *op);
+bool FileOperationAdd(FileOperation *op, const char *src);
+bool FileOperationStart(FileOperation *op);
+void FileOperationCancel(FileOperation *op);
+int FileOperationWait(FileOperation *op);
+bool FileOperationCompleted(FileOperation *op);
+
+#endif
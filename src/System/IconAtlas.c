@@ -0,0 +1,297 @@
+/**
+ * @file IconAtlas.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "IconAtlas.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IconAtlasNoCell                 UINT32_MAX
+
+typedef struct
+{
+    uint64_t key;
+    uint64_t tick;                      /* last lookup or insert; 0 if the cell is free */
+} IconAtlasCell;
+
+typedef struct
+{
+    uint32_t *pixels;
+    uint64_t generation;
+} IconAtlasPageInfo;
+
+struct IconAtlas
+{
+    unsigned cellSize, columns, rows, maxPages;
+    uint32_t capacity, used;            /* cells in all pages; cells handed out so far */
+    uint32_t *freeCells, freeCount;     /* removed cells, reused before new ones */
+    IconAtlasCell *cells;
+    uint32_t *table, tableMask;         /* key to cell; open addressing, linear probing */
+    IconAtlasPageInfo *pages;
+    uint64_t tick;
+    uint64_t hits, misses, evictions;
+    size_t count, pageCount;
+};
+
+static inline uint32_t IconAtlasHash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+IconAtlas *IconAtlasCreate(unsigned cellSize, unsigned columns, unsigned rows, unsigned maxPages)
+{
+    IconAtlas *atlas = 0;
+    uint64_t capacity = (uint64_t)columns * rows * maxPages;
+    uint32_t tableSize;
+
+    if (0 == cellSize || 0 == capacity || UINT32_MAX / 4 < capacity ||
+        UINT32_MAX / cellSize < columns || UINT32_MAX / cellSize < rows)
+        goto fail;
+
+    for (tableSize = 16; 2 * capacity > tableSize; tableSize <<= 1)
+        ;
+
+    atlas = calloc(1, sizeof *atlas);
+    if (0 == atlas)
+        goto fail;
+
+    atlas->cellSize = cellSize;
+    atlas->columns = columns;
+    atlas->rows = rows;
+    atlas->maxPages = maxPages;
+    atlas->capacity = (uint32_t)capacity;
+    atlas->tableMask = tableSize - 1;
+    atlas->cells = calloc(capacity, sizeof atlas->cells[0]);
+    atlas->freeCells = malloc(capacity * sizeof atlas->freeCells[0]);
+    atlas->table = malloc(tableSize * sizeof atlas->table[0]);
+    atlas->pages = calloc(maxPages, sizeof atlas->pages[0]);
+    if (0 == atlas->cells || 0 == atlas->freeCells || 0 == atlas->table || 0 == atlas->pages)
+        goto fail;
+    memset(atlas->table, 0xff, tableSize * sizeof atlas->table[0]);
+
+    return atlas;
+
+fail:
+    IconAtlasDelete(atlas);
+
+    return 0;
+}
+
+void IconAtlasDelete(IconAtlas *atlas)
+{
+    if (0 == atlas)
+        return;
+
+    if (0 != atlas->pages)
+        for (unsigned i = 0; atlas->maxPages > i; i++)
+            free(atlas->pages[i].pixels);
+    free(atlas->pages);
+    free(atlas->table);
+    free(atlas->freeCells);
+    free(atlas->cells);
+    free(atlas);
+}
+
+static uint32_t *IconAtlasFind(IconAtlas *atlas, uint64_t key)
+{
+    for (uint32_t i = IconAtlasHash(key) & atlas->tableMask;; i = (i + 1) & atlas->tableMask)
+    {
+        uint32_t *entry = &atlas->table[i];
+        if (IconAtlasNoCell == *entry || key == atlas->cells[*entry].key)
+            return entry;
+    }
+}
+
+static void IconAtlasUnlink(IconAtlas *atlas, uint32_t *entry)
+{
+    /* backward shift deletion: keeps probe sequences intact without tombstones */
+    uint32_t i = (uint32_t)(entry - atlas->table), j = i;
+    for (;;)
+    {
+        atlas->table[i] = IconAtlasNoCell;
+        for (;;)
+        {
+            j = (j + 1) & atlas->tableMask;
+            if (IconAtlasNoCell == atlas->table[j])
+                return;
+            uint32_t home = IconAtlasHash(atlas->cells[atlas->table[j]].key) & atlas->tableMask;
+            if (((j - home) & atlas->tableMask) >= ((j - i) & atlas->tableMask))
+                break;
+        }
+        atlas->table[i] = atlas->table[j];
+        i = j;
+    }
+}
+
+static void IconAtlasGetSlot(IconAtlas *atlas, uint32_t cell, IconAtlasSlot *slot)
+{
+    uint32_t perPage = atlas->columns * atlas->rows;
+    uint32_t index = cell % perPage;
+    slot->page = cell / perPage;
+    slot->x = index % atlas->columns * atlas->cellSize;
+    slot->y = index / atlas->columns * atlas->cellSize;
+    slot->size = atlas->cellSize;
+}
+
+bool IconAtlasLookup(IconAtlas *atlas, uint64_t key, IconAtlasSlot *slot)
+{
+    uint32_t *entry = IconAtlasFind(atlas, key);
+    if (IconAtlasNoCell == *entry)
+    {
+        atlas->misses++;
+        return false;
+    }
+
+    atlas->hits++;
+    atlas->cells[*entry].tick = ++atlas->tick;
+    if (0 != slot)
+        IconAtlasGetSlot(atlas, *entry, slot);
+
+    return true;
+}
+
+static uint32_t IconAtlasAllocCell(IconAtlas *atlas)
+{
+    if (0 < atlas->freeCount)
+        return atlas->freeCells[--atlas->freeCount];
+
+    if (atlas->capacity > atlas->used)
+    {
+        uint32_t cell = atlas->used;
+        unsigned page = cell / (atlas->columns * atlas->rows);
+        if (0 == atlas->pages[page].pixels)
+        {
+            size_t size = (size_t)atlas->columns * atlas->cellSize *
+                atlas->rows * atlas->cellSize * sizeof(uint32_t);
+            atlas->pages[page].pixels = calloc(1, size);
+            if (0 == atlas->pages[page].pixels)
+                goto evict;
+            atlas->pageCount++;
+        }
+        atlas->used++;
+        return cell;
+    }
+
+evict:
+    {
+        /* inserts are rare (once per new icon); a scan of a few hundred cells is fine */
+        uint32_t victim = IconAtlasNoCell;
+        for (uint32_t cell = 0; atlas->used > cell; cell++)
+            if (0 != atlas->cells[cell].tick &&
+                (IconAtlasNoCell == victim || atlas->cells[victim].tick > atlas->cells[cell].tick))
+                victim = cell;
+        if (IconAtlasNoCell == victim)
+            return IconAtlasNoCell;
+
+        IconAtlasUnlink(atlas, IconAtlasFind(atlas, atlas->cells[victim].key));
+        atlas->cells[victim].tick = 0;
+        atlas->count--;
+        atlas->evictions++;
+        return victim;
+    }
+}
+
+bool IconAtlasInsert(IconAtlas *atlas, uint64_t key,
+    const uint32_t *pixels, unsigned width, unsigned height, unsigned stride,
+    IconAtlasSlot *slot)
+{
+    IconAtlasSlot s;
+    uint32_t *entry, cell;
+
+    if (atlas->cellSize < width || atlas->cellSize < height)
+        return false;
+
+    entry = IconAtlasFind(atlas, key);
+    if (IconAtlasNoCell != *entry)
+        cell = *entry;
+    else
+    {
+        cell = IconAtlasAllocCell(atlas);
+        if (IconAtlasNoCell == cell)
+            return false;
+
+        /* eviction may have moved entries; probe again */
+        entry = IconAtlasFind(atlas, key);
+        *entry = cell;
+        atlas->cells[cell].key = key;
+        atlas->count++;
+    }
+    atlas->cells[cell].tick = ++atlas->tick;
+
+    /* copy centered into the cell; the margin is cleared so that no stale pixels show */
+    IconAtlasGetSlot(atlas, cell, &s);
+    IconAtlasPageInfo *page = &atlas->pages[s.page];
+    unsigned pageStride = atlas->columns * atlas->cellSize;
+    unsigned left = (atlas->cellSize - width) / 2, top = (atlas->cellSize - height) / 2;
+    uint32_t *dst = page->pixels + (size_t)s.y * pageStride + s.x;
+    for (unsigned y = 0; atlas->cellSize > y; y++, dst += pageStride)
+    {
+        if (top > y || top + height <= y)
+        {
+            memset(dst, 0, atlas->cellSize * sizeof *dst);
+            continue;
+        }
+        memset(dst, 0, left * sizeof *dst);
+        memcpy(dst + left, pixels + (size_t)(y - top) * stride, width * sizeof *dst);
+        memset(dst + left + width, 0, (atlas->cellSize - left - width) * sizeof *dst);
+    }
+    page->generation++;
+
+    if (0 != slot)
+        *slot = s;
+
+    return true;
+}
+
+void IconAtlasRemove(IconAtlas *atlas, uint64_t key)
+{
+    uint32_t *entry = IconAtlasFind(atlas, key);
+    if (IconAtlasNoCell == *entry)
+        return;
+
+    uint32_t cell = *entry;
+    IconAtlasUnlink(atlas, entry);
+    atlas->cells[cell].tick = 0;
+    atlas->freeCells[atlas->freeCount++] = cell;
+    atlas->count--;
+}
+
+const uint32_t *IconAtlasPage(IconAtlas *atlas, unsigned page,
+    unsigned *width, unsigned *height, uint64_t *generation)
+{
+    if (atlas->maxPages <= page || 0 == atlas->pages[page].pixels)
+        return 0;
+
+    if (0 != width)
+        *width = atlas->columns * atlas->cellSize;
+    if (0 != height)
+        *height = atlas->rows * atlas->cellSize;
+    if (0 != generation)
+        *generation = atlas->pages[page].generation;
+
+    return atlas->pages[page].pixels;
+}
+
+void IconAtlasGetStats(IconAtlas *atlas, IconAtlasStats *stats)
+{
+    stats->hits = atlas->hits;
+    stats->misses = atlas->misses;
+    stats->evictions = atlas->evictions;
+    stats->count = atlas->count;
+    stats->capacity = atlas->capacity;
+    stats->pageCount = atlas->pageCount;
+    stats->bytes = atlas->pageCount *
+        (size_t)atlas->columns * atlas->cellSize * atlas->rows * atlas->cellSize * sizeof(uint32_t);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file IconAtlas.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef ICONATLAS_H_INCLUDED
+#define ICONATLAS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Square icons of one size (e.g. Touch Bar icons: 30pt at 2x) packed into a
+ * few shared pages of 32-bit pixels, so that many layers can display them as
+ * sub-rects of a single image. Icons are keyed by integer; when all pages are
+ * full the least recently looked up icon gives up its cell.
+ *
+ * Pages are allocated as they are needed and are top-down, stride is width
+ * pixels. Every insert into a page bumps the page generation, so that callers
+ * can tell when an image made from the page is stale. An IconAtlas is not
+ * thread-safe.
+ */
+typedef struct IconAtlas IconAtlas;
+
+typedef struct
+{
+    unsigned page;
+    unsigned x, y, size;                /* pixels; origin is the top left of the page */
+} IconAtlasSlot;
+
+typedef struct
+{
+    uint64_t hits, misses, evictions;
+    size_t count, capacity;
+    size_t pageCount, bytes;
+} IconAtlasStats;
+
+IconAtlas *IconAtlasCreate(unsigned cellSize, unsigned columns, unsigned rows, unsigned maxPages);
+void IconAtlasDelete(IconAtlas *atlas);
+bool IconAtlasLookup(IconAtlas *atlas, uint64_t key, IconAtlasSlot *slot);
+bool IconAtlasInsert(IconAtlas *atlas, uint64_t key,
+    const uint32_t *pixels, unsigned width, unsigned height, unsigned stride,
+    IconAtlasSlot *slot);
+void IconAtlasRemove(IconAtlas *atlas, uint64_t key);
+const uint32_t *IconAtlasPage(IconAtlas *atlas, unsigned page,
+    unsigned *width, unsigned *height, uint64_t *generation);
+void IconAtlasGetStats(IconAtlas *atlas, IconAtlasStats *stats);
+
+#endif
@@ -0,0 +1,497 @@
+/**
+ * @file IconCache.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "IconCache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IconCacheInitialBucketCount     64
+#define IconCacheWeightOne              65536
+
+struct IconCacheBitmapPrivate
+{
+    IconCacheBitmap bitmap;             /* must be first */
+    size_t refcount;                    /* atomic */
+    size_t keyCount;                    /* keys referencing this bitmap; under cache lock */
+    uint64_t hash;
+    struct IconCacheBitmapPrivate *hashNext;
+};
+
+struct IconCacheEntry
+{
+    char *key;
+    uint64_t hash;
+    struct IconCacheBitmapPrivate *bitmap;
+    struct IconCacheEntry *hashNext;
+    struct IconCacheEntry *lruPrev, *lruNext;
+};
+
+struct IconCache
+{
+    pthread_mutex_t lock;
+    struct IconCacheEntry **entryBuckets;
+    struct IconCacheBitmapPrivate **bitmapBuckets;
+    size_t bucketCount;
+    struct IconCacheEntry lru;          /* sentinel: lru.lruNext is most recent */
+    IconCacheStats stats;
+};
+
+static uint64_t IconCacheHash(const void *data, size_t size)
+{
+    /* FNV-1a */
+    const uint8_t *p = data, *endp = p + size;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; endp > p; p++)
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    return hash;
+}
+
+static size_t IconCacheBitmapSize(const IconCacheBitmap *bitmap)
+{
+    return (size_t)bitmap->width * bitmap->height * sizeof(uint32_t);
+}
+
+void IconCacheBitmapRetain(IconCacheBitmap *bitmap)
+{
+    struct IconCacheBitmapPrivate *priv = (void *)bitmap;
+    __atomic_fetch_add(&priv->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void IconCacheBitmapRelease(IconCacheBitmap *bitmap)
+{
+    if (0 == bitmap)
+        return;
+
+    struct IconCacheBitmapPrivate *priv = (void *)bitmap;
+    if (1 == __atomic_fetch_sub(&priv->refcount, 1, __ATOMIC_ACQ_REL))
+        free(priv);
+}
+
+static void IconCacheLruUnlink(struct IconCacheEntry *entry)
+{
+    entry->lruPrev->lruNext = entry->lruNext;
+    entry->lruNext->lruPrev = entry->lruPrev;
+}
+
+static void IconCacheLruPushFront(IconCache *cache, struct IconCacheEntry *entry)
+{
+    entry->lruPrev = &cache->lru;
+    entry->lruNext = cache->lru.lruNext;
+    cache->lru.lruNext->lruPrev = entry;
+    cache->lru.lruNext = entry;
+}
+
+static struct IconCacheEntry **IconCacheFindEntry(IconCache *cache, const char *key, uint64_t hash)
+{
+    struct IconCacheEntry **pentry = &cache->entryBuckets[hash & (cache->bucketCount - 1)];
+    for (; 0 != *pentry; pentry = &(*pentry)->hashNext)
+        if (hash == (*pentry)->hash && 0 == strcmp(key, (*pentry)->key))
+            break;
+    return pentry;
+}
+
+static void IconCacheUnrefBitmap(IconCache *cache, struct IconCacheBitmapPrivate *bitmap)
+{
+    if (0 != --bitmap->keyCount)
+        return;
+
+    struct IconCacheBitmapPrivate **pbitmap =
+        &cache->bitmapBuckets[bitmap->hash & (cache->bucketCount - 1)];
+    for (; 0 != *pbitmap; pbitmap = &(*pbitmap)->hashNext)
+        if (bitmap == *pbitmap)
+        {
+            *pbitmap = bitmap->hashNext;
+            break;
+        }
+
+    cache->stats.bytes -= IconCacheBitmapSize(&bitmap->bitmap);
+    cache->stats.bitmapCount--;
+    IconCacheBitmapRelease(&bitmap->bitmap);
+}
+
+static void IconCacheDeleteEntry(IconCache *cache, struct IconCacheEntry **pentry)
+{
+    struct IconCacheEntry *entry = *pentry;
+    *pentry = entry->hashNext;
+    IconCacheLruUnlink(entry);
+    IconCacheUnrefBitmap(cache, entry->bitmap);
+    cache->stats.count--;
+    free(entry->key);
+    free(entry);
+}
+
+static void IconCacheEvict(IconCache *cache, struct IconCacheEntry *keep)
+{
+    while (cache->stats.budget < cache->stats.bytes)
+    {
+        struct IconCacheEntry *entry = cache->lru.lruPrev;
+        if (&cache->lru == entry || keep == entry)
+            break;
+        IconCacheDeleteEntry(cache, IconCacheFindEntry(cache, entry->key, entry->hash));
+        cache->stats.evictions++;
+    }
+}
+
+static void IconCacheGrow(IconCache *cache)
+{
+    size_t bucketCount = cache->bucketCount * 2;
+    struct IconCacheEntry **entryBuckets = calloc(bucketCount, sizeof *entryBuckets);
+    struct IconCacheBitmapPrivate **bitmapBuckets = calloc(bucketCount, sizeof *bitmapBuckets);
+    if (0 == entryBuckets || 0 == bitmapBuckets)
+    {
+        /* keep the current (longer) chains */
+        free(entryBuckets);
+        free(bitmapBuckets);
+        return;
+    }
+
+    for (size_t i = 0; cache->bucketCount > i; i++)
+    {
+        for (struct IconCacheEntry *entry = cache->entryBuckets[i], *next; 0 != entry; entry = next)
+        {
+            next = entry->hashNext;
+            entry->hashNext = entryBuckets[entry->hash & (bucketCount - 1)];
+            entryBuckets[entry->hash & (bucketCount - 1)] = entry;
+        }
+        for (struct IconCacheBitmapPrivate *bitmap = cache->bitmapBuckets[i], *next; 0 != bitmap; bitmap = next)
+        {
+            next = bitmap->hashNext;
+            bitmap->hashNext = bitmapBuckets[bitmap->hash & (bucketCount - 1)];
+            bitmapBuckets[bitmap->hash & (bucketCount - 1)] = bitmap;
+        }
+    }
+
+    free(cache->entryBuckets);
+    free(cache->bitmapBuckets);
+    cache->entryBuckets = entryBuckets;
+    cache->bitmapBuckets = bitmapBuckets;
+    cache->bucketCount = bucketCount;
+}
+
+IconCache *IconCacheCreate(size_t budget)
+{
+    IconCache *cache = calloc(1, sizeof *cache);
+    if (0 == cache)
+        return 0;
+
+    cache->bucketCount = IconCacheInitialBucketCount;
+    cache->entryBuckets = calloc(cache->bucketCount, sizeof *cache->entryBuckets);
+    cache->bitmapBuckets = calloc(cache->bucketCount, sizeof *cache->bitmapBuckets);
+    if (0 == cache->entryBuckets || 0 == cache->bitmapBuckets)
+    {
+        free(cache->entryBuckets);
+        free(cache->bitmapBuckets);
+        free(cache);
+        return 0;
+    }
+
+    cache->lru.lruPrev = cache->lru.lruNext = &cache->lru;
+    cache->stats.budget = budget;
+    pthread_mutex_init(&cache->lock, 0);
+
+    return cache;
+}
+
+void IconCacheDelete(IconCache *cache)
+{
+    if (0 == cache)
+        return;
+
+    while (&cache->lru != cache->lru.lruNext)
+    {
+        struct IconCacheEntry *entry = cache->lru.lruNext;
+        IconCacheDeleteEntry(cache, IconCacheFindEntry(cache, entry->key, entry->hash));
+    }
+
+    free(cache->entryBuckets);
+    free(cache->bitmapBuckets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+void IconCacheSetBudget(IconCache *cache, size_t budget)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.budget = budget;
+    IconCacheEvict(cache, 0);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+IconCacheBitmap *IconCacheLookup(IconCache *cache, const char *key)
+{
+    IconCacheBitmap *res = 0;
+    uint64_t hash = IconCacheHash(key, strlen(key));
+
+    pthread_mutex_lock(&cache->lock);
+    struct IconCacheEntry *entry = *IconCacheFindEntry(cache, key, hash);
+    if (0 != entry)
+    {
+        IconCacheLruUnlink(entry);
+        IconCacheLruPushFront(cache, entry);
+        res = &entry->bitmap->bitmap;
+        IconCacheBitmapRetain(res);
+        cache->stats.hits++;
+    }
+    else
+        cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    return res;
+}
+
+IconCacheBitmap *IconCacheInsert(IconCache *cache, const char *key,
+    const uint32_t *pixels, unsigned width, unsigned height)
+{
+    size_t size = (size_t)width * height * sizeof(uint32_t);
+    uint64_t hash = IconCacheHash(key, strlen(key));
+    uint64_t contentHash = IconCacheHash(pixels, size) ^ ((uint64_t)width << 32 | height);
+    struct IconCacheBitmapPrivate *bitmap = 0, *newBitmap = 0;
+    struct IconCacheEntry *newEntry = 0;
+
+    /* allocate outside the lock; freed below if a duplicate is found */
+    newBitmap = malloc(sizeof *newBitmap + size);
+    newEntry = malloc(sizeof *newEntry);
+    if (0 != newEntry)
+        newEntry->key = strdup(key);
+    if (0 == newBitmap || 0 == newEntry || 0 == newEntry->key)
+    {
+        free(newBitmap);
+        if (0 != newEntry)
+            free(newEntry->key);
+        free(newEntry);
+        return 0;
+    }
+    newBitmap->bitmap.width = width;
+    newBitmap->bitmap.height = height;
+    newBitmap->bitmap.pixels = (const uint32_t *)(newBitmap + 1);
+    newBitmap->refcount = 1;
+    newBitmap->keyCount = 0;
+    newBitmap->hash = contentHash;
+    memcpy(newBitmap + 1, pixels, size);
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* dedup: share an existing bitmap with identical contents */
+    for (bitmap = cache->bitmapBuckets[contentHash & (cache->bucketCount - 1)];
+        0 != bitmap; bitmap = bitmap->hashNext)
+        if (contentHash == bitmap->hash &&
+            width == bitmap->bitmap.width && height == bitmap->bitmap.height &&
+            0 == memcmp(bitmap->bitmap.pixels, pixels, size))
+            break;
+    if (0 != bitmap)
+        cache->stats.dedups++;
+    else
+    {
+        bitmap = newBitmap;
+        newBitmap = 0;
+        bitmap->hashNext = cache->bitmapBuckets[contentHash & (cache->bucketCount - 1)];
+        cache->bitmapBuckets[contentHash & (cache->bucketCount - 1)] = bitmap;
+        cache->stats.bytes += size;
+        cache->stats.bitmapCount++;
+    }
+    bitmap->keyCount++;
+
+    struct IconCacheEntry **pentry = IconCacheFindEntry(cache, key, hash);
+    struct IconCacheEntry *entry = *pentry;
+    if (0 != entry)
+    {
+        /* replace: take the new bitmap reference before dropping the old one */
+        struct IconCacheBitmapPrivate *oldBitmap = entry->bitmap;
+        entry->bitmap = bitmap;
+        IconCacheUnrefBitmap(cache, oldBitmap);
+        IconCacheLruUnlink(entry);
+    }
+    else
+    {
+        entry = newEntry;
+        newEntry = 0;
+        entry->hash = hash;
+        entry->bitmap = bitmap;
+        entry->hashNext = *pentry;
+        *pentry = entry;
+        cache->stats.count++;
+    }
+    IconCacheLruPushFront(cache, entry);
+
+    IconCacheBitmap *res = &bitmap->bitmap;
+    IconCacheBitmapRetain(res);
+
+    IconCacheEvict(cache, entry);
+    if (cache->stats.count > cache->bucketCount)
+        IconCacheGrow(cache);
+
+    pthread_mutex_unlock(&cache->lock);
+
+    free(newBitmap);
+    if (0 != newEntry)
+    {
+        free(newEntry->key);
+        free(newEntry);
+    }
+
+    return res;
+}
+
+void IconCacheRemove(IconCache *cache, const char *key)
+{
+    uint64_t hash = IconCacheHash(key, strlen(key));
+
+    pthread_mutex_lock(&cache->lock);
+    struct IconCacheEntry **pentry = IconCacheFindEntry(cache, key, hash);
+    if (0 != *pentry)
+        IconCacheDeleteEntry(cache, pentry);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void IconCacheGetStats(IconCache *cache, IconCacheStats *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+struct IconCacheTaps
+{
+    unsigned first, count;
+};
+
+/*
+ * Compute the source pixels (and their fixed point weights) that cover each
+ * destination pixel. Weights for a destination pixel always sum to one.
+ */
+static bool IconCacheComputeTaps(unsigned srcSize, unsigned dstSize,
+    struct IconCacheTaps **ptaps, uint32_t **pweights, unsigned *pmaxCount)
+{
+    double scale = (double)srcSize / dstSize;
+    unsigned maxCount = (unsigned)scale + 2;
+    struct IconCacheTaps *taps = malloc(dstSize * sizeof *taps);
+    uint32_t *weights = malloc((size_t)dstSize * maxCount * sizeof *weights);
+    if (0 == taps || 0 == weights)
+    {
+        free(taps);
+        free(weights);
+        return false;
+    }
+
+    for (unsigned x = 0; dstSize > x; x++)
+    {
+        double lo = x * scale, hi = (x + 1) * scale;
+        if (hi > srcSize)
+            hi = srcSize;
+        unsigned first = (unsigned)lo, last = (unsigned)hi;
+        if ((double)last == hi)
+            last--;                     /* hi is exclusive */
+        if (srcSize <= last)
+            last = srcSize - 1;
+
+        uint32_t *w = weights + (size_t)x * maxCount;
+        uint32_t sum = 0;
+        unsigned count = last - first + 1, maxi = 0;
+        for (unsigned i = 0; count > i; i++)
+        {
+            double plo = first + i, phi = first + i + 1;
+            double overlap = (phi < hi ? phi : hi) - (plo > lo ? plo : lo);
+            if (0 > overlap)
+                overlap = 0;
+            w[i] = (uint32_t)(overlap / (hi - lo) * IconCacheWeightOne + 0.5);
+            sum += w[i];
+            if (w[i] > w[maxi])
+                maxi = i;
+        }
+        w[maxi] += IconCacheWeightOne - sum;    /* rounding error goes to the largest tap */
+
+        taps[x].first = first;
+        taps[x].count = count;
+    }
+
+    *ptaps = taps;
+    *pweights = weights;
+    *pmaxCount = maxCount;
+    return true;
+}
+
+bool IconCacheDownsample(
+    const uint32_t *src, unsigned srcWidth, unsigned srcHeight, unsigned srcStride,
+    uint32_t *dst, unsigned dstWidth, unsigned dstHeight)
+{
+    bool res = false;
+    struct IconCacheTaps *xtaps = 0, *ytaps = 0;
+    uint32_t *xweights = 0, *yweights = 0;
+    unsigned xmax, ymax;
+    uint8_t *tmp = 0;
+    uint32_t *acc = 0;
+
+    if (0 == srcWidth || 0 == srcHeight || 0 == dstWidth || 0 == dstHeight ||
+        srcStride < srcWidth)
+        goto exit;
+
+    if (!IconCacheComputeTaps(srcWidth, dstWidth, &xtaps, &xweights, &xmax) ||
+        !IconCacheComputeTaps(srcHeight, dstHeight, &ytaps, &yweights, &ymax))
+        goto exit;
+
+    tmp = malloc((size_t)dstWidth * srcHeight * 4);
+    acc = malloc((size_t)dstWidth * 4 * sizeof *acc);
+    if (0 == tmp || 0 == acc)
+        goto exit;
+
+    /* horizontal pass: src (srcWidth x srcHeight) -> tmp (dstWidth x srcHeight) */
+    for (unsigned y = 0; srcHeight > y; y++)
+    {
+        const uint8_t *srow = (const uint8_t *)(src + (size_t)y * srcStride);
+        uint8_t *trow = tmp + (size_t)y * dstWidth * 4;
+        for (unsigned x = 0; dstWidth > x; x++)
+        {
+            const uint8_t *s = srow + (size_t)xtaps[x].first * 4;
+            const uint32_t *w = xweights + (size_t)x * xmax;
+            uint32_t a[4] = { IconCacheWeightOne / 2, IconCacheWeightOne / 2,
+                IconCacheWeightOne / 2, IconCacheWeightOne / 2 };
+            for (unsigned i = 0, n = xtaps[x].count; n > i; i++, s += 4)
+                for (unsigned c = 0; 4 > c; c++)
+                    a[c] += s[c] * w[i];
+            for (unsigned c = 0; 4 > c; c++)
+                trow[x * 4 + c] = (uint8_t)(a[c] >> 16);
+        }
+    }
+
+    /* vertical pass: tmp (dstWidth x srcHeight) -> dst (dstWidth x dstHeight); whole rows at a time */
+    for (unsigned y = 0; dstHeight > y; y++)
+    {
+        size_t rowSize = (size_t)dstWidth * 4;
+        const uint32_t *w = yweights + (size_t)y * ymax;
+        for (size_t k = 0; rowSize > k; k++)
+            acc[k] = IconCacheWeightOne / 2;
+        for (unsigned i = 0, n = ytaps[y].count; n > i; i++)
+        {
+            const uint8_t *trow = tmp + (size_t)(ytaps[y].first + i) * rowSize;
+            uint32_t wi = w[i];
+            for (size_t k = 0; rowSize > k; k++)
+                acc[k] += trow[k] * wi;
+        }
+        uint8_t *drow = (uint8_t *)(dst + (size_t)y * dstWidth);
+        for (size_t k = 0; rowSize > k; k++)
+            drow[k] = (uint8_t)(acc[k] >> 16);
+    }
+
+    res = true;
+
+exit:
+    free(acc);
+    free(tmp);
+    free(xtaps);
+    free(ytaps);
+    free(xweights);
+    free(yweights);
+
+    return res;
+}
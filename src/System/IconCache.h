@@ -0,0 +1,64 @@
+/**
+ * @file IconCache.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef ICONCACHE_H_INCLUDED
+#define ICONCACHE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A thread-safe store of small 32-bit bitmaps (e.g. premultiplied RGBA icons)
+ * keyed by string. Bitmaps with identical contents are shared between keys
+ * and counted once; the least recently used keys are evicted when the bytes
+ * held exceed the budget. Bitmaps are reference counted, so a bitmap that is
+ * evicted stays valid for as long as callers hold a reference to it.
+ */
+typedef struct IconCache IconCache;
+
+typedef struct
+{
+    unsigned width, height;             /* stride is width pixels */
+    const uint32_t *pixels;
+} IconCacheBitmap;
+
+typedef struct
+{
+    uint64_t hits, misses, evictions, dedups;
+    size_t bytes, budget;
+    size_t count, bitmapCount;
+} IconCacheStats;
+
+IconCache *IconCacheCreate(size_t budget);
+void IconCacheDelete(IconCache *cache);
+void IconCacheSetBudget(IconCache *cache, size_t budget);
+IconCacheBitmap *IconCacheLookup(IconCache *cache, const char *key);
+IconCacheBitmap *IconCacheInsert(IconCache *cache, const char *key,
+    const uint32_t *pixels, unsigned width, unsigned height);
+void IconCacheRemove(IconCache *cache, const char *key);
+void IconCacheGetStats(IconCache *cache, IconCacheStats *stats);
+
+void IconCacheBitmapRetain(IconCacheBitmap *bitmap);
+void IconCacheBitmapRelease(IconCacheBitmap *bitmap);
+
+/*
+ * Area-averaging downsampler for 32-bit pixels (4 independent 8-bit channels).
+ * Separable, fixed point; the per-channel inner loops are written to be
+ * auto-vectorized. Strides are in pixels.
+ */
+bool IconCacheDownsample(
+    const uint32_t *src, unsigned srcWidth, unsigned srcHeight, unsigned srcStride,
+    uint32_t *dst, unsigned dstWidth, unsigned dstHeight);
+
+#endif
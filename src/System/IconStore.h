@@ -0,0 +1,31 @@
+/**
+ * @file IconStore.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "IconCache.h"
+
+@interface IconStore : NSObject
++ (IconStore *)sharedInstance;
+- (NSString *)keyForFile:(NSString *)path;
+- (NSImage *)iconForFile:(NSString *)path;
+- (NSImage *)iconForRunningApplication:(NSRunningApplication *)app;
+- (NSImage *)iconForRunningApplication:(NSRunningApplication *)app key:(NSString **)pkey;
+- (NSImage *)iconForImage:(NSImage *)image key:(NSString *)key;
+- (NSImage *)cachedIconForKey:(NSString *)key;
+- (IconCacheBitmap *)bitmapForFile:(NSString *)path key:(NSString **)pkey;
+- (NSImage *)iconWithPixels:(const uint32_t *)pixels width:(unsigned)width height:(unsigned)height
+    key:(NSString *)key;
+- (NSImage *)imageWithBitmap:(IconCacheBitmap *)bitmap;
+- (IconCacheStats)statistics;
+@property (assign) size_t budget;
+@end
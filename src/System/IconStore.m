@@ -0,0 +1,456 @@
+/**
+ * @file IconStore.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "IconStore.h"
+#import <pthread.h>
+#import <sys/stat.h>
+#import "FSNotify.h"
+
+/*
+ * Icons are kept at Touch Bar resolution only: 30pt at 2x. They are drawn at a
+ * larger size first (so that NSImage picks a good representation) and then
+ * downsampled by area averaging.
+ */
+static const unsigned IconStorePixelSize = 60;
+static const unsigned IconStoreDrawSize = 128;
+static const CGFloat IconStoreScale = 2;
+static const size_t IconStoreDefaultBudget = 8 * 1024 * 1024;
+
+/*
+ * File keys are cached per path and invalidated by file system events on the
+ * directories that hold the files, with the same limits as MetadataStore: a
+ * small set of roots, never "/" or the directories at or above the home folder.
+ * Files past the limits are stat'ed on each lookup.
+ */
+static const NSUInteger IconStoreMaxKeys = 1024;
+static const NSUInteger IconStoreMaxRoots = 32;
+
+static pthread_once_t IconStore_once = PTHREAD_ONCE_INIT;
+static IconStore *IconStore_instance;
+
+static void IconStore_initonce(void)
+{
+    IconStore_instance = [[IconStore alloc] init];
+}
+
+static void IconStoreReleaseBitmap(void *info, const void *data, size_t size)
+{
+    IconCacheBitmapRelease(info);
+}
+
+static BOOL IconStoreIsUnder(NSString *path, NSString *root)
+{
+    return [path isEqualToString:root] ||
+        [path hasPrefix:[root hasSuffix:@"/"] ? root : [root stringByAppendingString:@"/"]];
+}
+
+static BOOL IconStoreIsWatchable(NSString *root, NSString *home)
+{
+    if (![root isAbsolutePath] || [root isEqualToString:@"/"])
+        return NO;
+
+    return nil == home || !IconStoreIsUnder(home, root);
+}
+
+@interface IconStore ()
+- (void)invalidateKeysForDirectory:(NSString *)path;
+@end
+
+static void IconStoreFSNotify(const char *path, void *data)
+{
+    @autoreleasepool
+    {
+        [(IconStore *)data invalidateKeysForDirectory:[NSString stringWithUTF8String:path]];
+    }
+}
+
+@implementation IconStore
+{
+    IconCache *_cache;
+    NSMutableDictionary<NSString *, NSString *> *_keys;
+    uint64_t _keysGeneration;
+    NSMutableArray *_roots;
+    NSString *_home;
+    void *_stream;
+    BOOL _restartPending;
+}
+
++ (IconStore *)sharedInstance
+{
+    pthread_once(&IconStore_once, IconStore_initonce);
+    return IconStore_instance;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    NSInteger budget = [[NSUserDefaults standardUserDefaults] integerForKey:@"iconStoreBudget"];
+    _cache = IconCacheCreate(0 < budget ? (size_t)budget : IconStoreDefaultBudget);
+    if (0 == _cache)
+    {
+        [self release];
+        return nil;
+    }
+
+    _keys = [[NSMutableDictionary alloc] init];
+    _roots = [[NSMutableArray alloc] init];
+    _home = [[NSHomeDirectory() stringByStandardizingPath] copy];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    FSNotifyStop(_stream);
+    [_keys release];
+    [_roots release];
+    [_home release];
+    IconCacheDelete(_cache);
+
+    [super dealloc];
+}
+
+- (size_t)budget
+{
+    return [self statistics].budget;
+}
+
+- (void)setBudget:(size_t)budget
+{
+    IconCacheSetBudget(_cache, budget);
+}
+
+- (IconCacheStats)statistics
+{
+    IconCacheStats stats;
+    IconCacheGetStats(_cache, &stats);
+    return stats;
+}
+
+- (NSString *)keyForFile:(NSString *)path
+{
+    /*
+     * File icons are keyed by path and status change time, which moves with content
+     * edits, replaced bundles and custom icons (set through extended attributes), so
+     * an icon that changes gets a new key; the stale one ages out of the LRU.
+     */
+    uint64_t generation;
+    @synchronized (self)
+    {
+        NSString *key = [_keys objectForKey:path];
+        if (nil != key)
+            return [[key retain] autorelease];
+        generation = _keysGeneration;
+    }
+
+    struct stat st;
+    if (-1 == stat(path.fileSystemRepresentation, &st))
+        return path;
+
+    NSString *key = [NSString stringWithFormat:@"%@:%ld.%09ld",
+        path, (long)st.st_ctimespec.tv_sec, (long)st.st_ctimespec.tv_nsec];
+
+    /* an invalidation since the stat may have been for this very file: do not cache */
+    if ([self watchDirectory:[path stringByDeletingLastPathComponent]])
+        @synchronized (self)
+        {
+            if (generation == _keysGeneration)
+            {
+                if (IconStoreMaxKeys <= _keys.count)
+                    [_keys removeAllObjects];
+                [_keys setObject:key forKey:path];
+            }
+        }
+
+    return key;
+}
+
+- (BOOL)watchDirectory:(NSString *)path
+{
+    @synchronized (self)
+    {
+        for (NSString *root in _roots)
+            if (IconStoreIsUnder(path, root))
+                return YES;
+
+        if (!IconStoreIsWatchable(path, _home))
+            return NO;
+
+        /* a new root replaces the roots under it */
+        NSIndexSet *covered = [_roots indexesOfObjectsPassingTest:
+            ^BOOL(NSString *root, NSUInteger index, BOOL *stop)
+            {
+                return IconStoreIsUnder(root, path);
+            }];
+        if (0 == covered.count && IconStoreMaxRoots <= _roots.count)
+            return NO;
+        [_roots removeObjectsAtIndexes:covered];
+        [_roots addObject:path];
+
+        if (!_restartPending)
+        {
+            _restartPending = YES;
+            [self
+                performSelectorOnMainThread:@selector(restartStream)
+                withObject:nil
+                waitUntilDone:NO];
+        }
+    }
+
+    return YES;
+}
+
+- (void)restartStream
+{
+    NSArray *roots;
+    @synchronized (self)
+    {
+        _restartPending = NO;
+        roots = [[_roots copy] autorelease];
+    }
+
+    const char **cpaths = malloc(roots.count * sizeof *cpaths);
+    if (0 == cpaths)
+        return;
+    for (NSUInteger i = 0; roots.count > i; i++)
+        cpaths[i] = [[roots objectAtIndex:i] fileSystemRepresentation];
+
+    FSNotifyStop(_stream);
+    _stream = FSNotifyStartPaths(cpaths, roots.count, IconStoreFSNotify, self);
+
+    free(cpaths);
+
+    /* without a stream nothing is watched; drop what might go stale */
+    if (0 == _stream)
+        @synchronized (self)
+        {
+            [_keys removeAllObjects];
+            _keysGeneration++;
+        }
+}
+
+- (void)invalidateKeysForDirectory:(NSString *)path
+{
+    /* events name the directory that changed: drop the files in it, under it and above it */
+    if (1 < path.length && [path hasSuffix:@"/"])
+        path = [path substringToIndex:path.length - 1];
+
+    @synchronized (self)
+    {
+        NSMutableArray *stale = [NSMutableArray array];
+        for (NSString *file in _keys)
+            if (IconStoreIsUnder(file, path) || IconStoreIsUnder(path, file))
+                [stale addObject:file];
+        [_keys removeObjectsForKeys:stale];
+        _keysGeneration++;
+    }
+}
+
+- (NSImage *)iconForFile:(NSString *)path
+{
+    return [self imageWithBitmap:[self bitmapForFile:path key:0]];
+}
+
+- (IconCacheBitmap *)bitmapForFile:(NSString *)path key:(NSString **)pkey
+{
+    /* returns a bitmap reference that the caller must release (or pass to imageWithBitmap:) */
+    if (nil == path)
+        return 0;
+
+    NSString *key = [self keyForFile:path];
+    IconCacheBitmap *bitmap = IconCacheLookup(_cache, key.UTF8String);
+    if (0 == bitmap)
+        bitmap = [self insertImage:[[NSWorkspace sharedWorkspace] iconForFile:path] forKey:key];
+
+    if (0 != pkey)
+        *pkey = key;
+    return bitmap;
+}
+
+- (NSImage *)iconForRunningApplication:(NSRunningApplication *)app
+{
+    return [self iconForRunningApplication:app key:0];
+}
+
+- (NSImage *)iconForRunningApplication:(NSRunningApplication *)app key:(NSString **)pkey
+{
+    NSString *path = app.bundleURL.path;
+    if (0 != pkey)
+        *pkey = nil;
+    if (nil == path)
+        return app.icon;
+
+    /* NSRunningApplication.icon is only materialized on a miss */
+    NSString *key = [self keyForFile:path];
+    IconCacheBitmap *bitmap = IconCacheLookup(_cache, key.UTF8String);
+    if (0 == bitmap)
+        bitmap = [self insertImage:app.icon forKey:key];
+
+    if (0 != pkey && 0 != bitmap)
+        *pkey = key;
+    return [self imageWithBitmap:bitmap];
+}
+
+- (NSImage *)iconForImage:(NSImage *)image key:(NSString *)key
+{
+    if (nil == image || nil == key)
+        return image;
+
+    IconCacheBitmap *bitmap = IconCacheLookup(_cache, key.UTF8String);
+    if (0 == bitmap)
+        bitmap = [self insertImage:image forKey:key];
+
+    NSImage *result = [self imageWithBitmap:bitmap];
+    return nil != result ? result : image;
+}
+
+- (NSImage *)cachedIconForKey:(NSString *)key
+{
+    if (nil == key)
+        return nil;
+
+    return [self imageWithBitmap:IconCacheLookup(_cache, key.UTF8String)];
+}
+
+- (NSImage *)iconWithPixels:(const uint32_t *)pixels width:(unsigned)width height:(unsigned)height
+    key:(NSString *)key
+{
+    /* seeds the store with pixels saved earlier, e.g. in the Dock warm start snapshot */
+    if (0 == pixels || nil == key)
+        return nil;
+
+    IconCacheBitmap *bitmap = IconCacheLookup(_cache, key.UTF8String);
+    if (0 == bitmap)
+        bitmap = IconCacheInsert(_cache, key.UTF8String, pixels, width, height);
+
+    return [self imageWithBitmap:bitmap];
+}
+
+- (IconCacheBitmap *)insertImage:(NSImage *)image forKey:(NSString *)key
+{
+    IconCacheBitmap *res = 0;
+    uint32_t *pixels = 0, *small = 0;
+    CGColorSpaceRef colorSpace = 0;
+    CGContextRef context = 0;
+
+    if (nil == image)
+        goto exit;
+
+    pixels = calloc(IconStoreDrawSize * IconStoreDrawSize, sizeof *pixels);
+    small = malloc(IconStorePixelSize * IconStorePixelSize * sizeof *small);
+    if (0 == pixels || 0 == small)
+        goto exit;
+
+    colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    if (0 == colorSpace)
+        goto exit;
+
+    context = CGBitmapContextCreate(pixels,
+        IconStoreDrawSize, IconStoreDrawSize, 8, IconStoreDrawSize * 4,
+        colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    if (0 == context)
+        goto exit;
+
+    /* aspect fit into the square */
+    NSSize size = image.size;
+    NSRect rect = NSMakeRect(0, 0, IconStoreDrawSize, IconStoreDrawSize);
+    if (0 < size.width && 0 < size.height && size.width != size.height)
+    {
+        if (size.width > size.height)
+            rect.size.height = IconStoreDrawSize * size.height / size.width;
+        else
+            rect.size.width = IconStoreDrawSize * size.width / size.height;
+        rect.origin.x = (IconStoreDrawSize - rect.size.width) / 2;
+        rect.origin.y = (IconStoreDrawSize - rect.size.height) / 2;
+    }
+
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext:
+        [NSGraphicsContext graphicsContextWithCGContext:context flipped:NO]];
+    [image
+        drawInRect:rect
+        fromRect:NSZeroRect
+        operation:NSCompositingOperationCopy
+        fraction:1.0];
+    [NSGraphicsContext restoreGraphicsState];
+
+    if (!IconCacheDownsample(pixels, IconStoreDrawSize, IconStoreDrawSize, IconStoreDrawSize,
+        small, IconStorePixelSize, IconStorePixelSize))
+        goto exit;
+
+    res = IconCacheInsert(_cache, key.UTF8String, small, IconStorePixelSize, IconStorePixelSize);
+
+exit:
+    if (0 != context)
+        CGContextRelease(context);
+
+    if (0 != colorSpace)
+        CGColorSpaceRelease(colorSpace);
+
+    free(small);
+    free(pixels);
+
+    return res;
+}
+
+- (NSImage *)imageWithBitmap:(IconCacheBitmap *)bitmap
+{
+    /* consumes the bitmap reference; the image shares the cached pixels */
+    NSImage *res = nil;
+    CGDataProviderRef provider = 0;
+    CGColorSpaceRef colorSpace = 0;
+    CGImageRef cgimage = 0;
+
+    if (0 == bitmap)
+        goto exit;
+
+    provider = CGDataProviderCreateWithData(bitmap,
+        bitmap->pixels, bitmap->width * bitmap->height * sizeof *bitmap->pixels,
+        IconStoreReleaseBitmap);
+    if (0 == provider)
+    {
+        IconCacheBitmapRelease(bitmap);
+        goto exit;
+    }
+
+    colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    if (0 == colorSpace)
+        goto exit;
+
+    cgimage = CGImageCreate(bitmap->width, bitmap->height, 8, 32, bitmap->width * 4,
+        colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big,
+        provider, 0, false, kCGRenderingIntentDefault);
+    if (0 == cgimage)
+        goto exit;
+
+    res = [[[NSImage alloc]
+        initWithCGImage:cgimage
+        size:NSMakeSize(bitmap->width / IconStoreScale, bitmap->height / IconStoreScale)]
+        autorelease];
+
+exit:
+    if (0 != cgimage)
+        CGImageRelease(cgimage);
+
+    if (0 != colorSpace)
+        CGColorSpaceRelease(colorSpace);
+
+    if (0 != provider)
+        CGDataProviderRelease(provider);
+
+    return res;
+}
+@end
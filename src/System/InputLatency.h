@@ -0,0 +1,32 @@
+/**
+ * @file InputLatency.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "LatencyHistogram.h"
+
+/*
+ * Input to effect latency: from the timestamp of the event being handled (a
+ * touch, gesture or click) to the time its effect has been applied. Event
+ * timestamps and systemUptime share a time base.
+ */
+static inline NSTimeInterval InputLatencyStart(void)
+{
+    NSEvent *event = [NSApp currentEvent];
+    return nil != event ? event.timestamp : [NSProcessInfo processInfo].systemUptime;
+}
+
+static inline void InputLatencyRecord(const char *name, NSTimeInterval start)
+{
+    LatencyHistogramRecord(LatencyHistogramGet(name),
+        [NSProcessInfo processInfo].systemUptime - start);
+}
@@ -0,0 +1,230 @@
+/**
+ * @file LatencyHistogram.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "LatencyHistogram.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LatencyHistogramMaxCount        16
+#define LatencyHistogramSubBits         5
+#define LatencyHistogramSubCount        (1 << LatencyHistogramSubBits)
+#define LatencyHistogramMaxBits         32
+#define LatencyHistogramBucketCount     \
+    (LatencyHistogramSubCount * (LatencyHistogramMaxBits - LatencyHistogramSubBits + 1))
+
+struct LatencyHistogram
+{
+    char name[LatencyHistogramNameMax];
+    uint64_t sum, max;                  /* microseconds */
+    uint64_t buckets[LatencyHistogramBucketCount];
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct LatencyHistogram histograms[LatencyHistogramMaxCount];
+static size_t histogramCount;
+
+static unsigned LatencyHistogramIndex(uint64_t value)
+{
+    if (LatencyHistogramSubCount > value)
+        return (unsigned)value;
+
+    /* value has its top bit at msb; keep SubBits + 1 bits of it */
+    unsigned msb = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = msb - LatencyHistogramSubBits;
+    return LatencyHistogramSubCount * (shift + 1) +
+        (unsigned)(value >> shift) - LatencyHistogramSubCount;
+}
+
+static uint64_t LatencyHistogramHighest(unsigned index)
+{
+    /* highest value that maps to the bucket */
+    if (2 * LatencyHistogramSubCount > index)
+        return index;
+
+    unsigned shift = index / LatencyHistogramSubCount - 1;
+    uint64_t sub = LatencyHistogramSubCount + index % LatencyHistogramSubCount;
+    return ((sub + 1) << shift) - 1;
+}
+
+LatencyHistogram *LatencyHistogramGet(const char *name)
+{
+    LatencyHistogram *histogram = 0;
+
+    pthread_mutex_lock(&mutex);
+
+    for (size_t i = 0; histogramCount > i; i++)
+        if (0 == strncmp(histograms[i].name, name, LatencyHistogramNameMax - 1))
+        {
+            histogram = &histograms[i];
+            goto exit;
+        }
+
+    /* past the limit, histograms share the last slot rather than fail */
+    if (LatencyHistogramMaxCount == histogramCount)
+    {
+        histogram = &histograms[LatencyHistogramMaxCount - 1];
+        goto exit;
+    }
+
+    histogram = &histograms[histogramCount];
+    strncpy(histogram->name, name, LatencyHistogramNameMax - 1);
+    __atomic_store_n(&histogramCount, histogramCount + 1, __ATOMIC_RELEASE);
+
+exit:
+    pthread_mutex_unlock(&mutex);
+
+    return histogram;
+}
+
+void LatencyHistogramRecord(LatencyHistogram *histogram, double latency)
+{
+    uint64_t value, max;
+
+    if (!(0 < latency))                 /* also catches NaN */
+        value = 0;
+    else if ((double)(1ULL << LatencyHistogramMaxBits) <= latency * 1e6)
+        value = (1ULL << LatencyHistogramMaxBits) - 1;
+    else
+        value = (uint64_t)(latency * 1e6 + 0.5);
+
+    __atomic_fetch_add(&histogram->buckets[LatencyHistogramIndex(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (max < value &&
+        !__atomic_compare_exchange_n(&histogram->max, &max, value,
+            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static double LatencyHistogramPercentileOf(const uint64_t *buckets, uint64_t count, uint64_t max,
+    double percentile)
+{
+    uint64_t target, total = 0;
+
+    if (0 == count)
+        return 0;
+
+    if (0 > percentile)
+        percentile = 0;
+    if (100 < percentile)
+        percentile = 100;
+    target = (uint64_t)ceil(percentile / 100 * (double)count);
+    if (0 == target)
+        target = 1;
+
+    for (unsigned i = 0; LatencyHistogramBucketCount > i; i++)
+    {
+        total += buckets[i];
+        if (total >= target)
+        {
+            uint64_t value = LatencyHistogramHighest(i);
+            return (double)(value < max ? value : max) * 1e-6;
+        }
+    }
+
+    return (double)max * 1e-6;
+}
+
+static uint64_t LatencyHistogramSnapshot(LatencyHistogram *histogram, uint64_t *buckets)
+{
+    /* count from the buckets themselves, so that percentiles see a consistent total */
+    uint64_t count = 0;
+    for (unsigned i = 0; LatencyHistogramBucketCount > i; i++)
+    {
+        buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        count += buckets[i];
+    }
+    return count;
+}
+
+double LatencyHistogramPercentile(LatencyHistogram *histogram, double percentile)
+{
+    uint64_t buckets[LatencyHistogramBucketCount];
+    uint64_t count = LatencyHistogramSnapshot(histogram, buckets);
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+    return LatencyHistogramPercentileOf(buckets, count, max, percentile);
+}
+
+void LatencyHistogramReset(LatencyHistogram *histogram)
+{
+    for (unsigned i = 0; LatencyHistogramBucketCount > i; i++)
+        __atomic_store_n(&histogram->buckets[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->sum, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->max, 0, __ATOMIC_RELAXED);
+}
+
+size_t LatencyHistogramGetStats(LatencyHistogramStats *stats, size_t count)
+{
+    uint64_t buckets[LatencyHistogramBucketCount];
+    size_t available = __atomic_load_n(&histogramCount, __ATOMIC_ACQUIRE);
+
+    if (available < count)
+        count = available;
+
+    for (size_t i = 0; count > i; i++)
+    {
+        LatencyHistogram *histogram = &histograms[i];
+        uint64_t n = LatencyHistogramSnapshot(histogram, buckets);
+        uint64_t sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+        memcpy(stats[i].name, histogram->name, sizeof stats[i].name);
+        stats[i].count = n;
+        stats[i].mean = 0 != n ? (double)sum / (double)n * 1e-6 : 0;
+        stats[i].p50 = LatencyHistogramPercentileOf(buckets, n, max, 50);
+        stats[i].p90 = LatencyHistogramPercentileOf(buckets, n, max, 90);
+        stats[i].p99 = LatencyHistogramPercentileOf(buckets, n, max, 99);
+        stats[i].p999 = LatencyHistogramPercentileOf(buckets, n, max, 99.9);
+        stats[i].max = (double)max * 1e-6;
+    }
+
+    return count;
+}
+
+size_t LatencyHistogramFormat(char *buf, size_t size)
+{
+    LatencyHistogramStats stats[LatencyHistogramMaxCount];
+    size_t count = LatencyHistogramGetStats(stats, LatencyHistogramMaxCount);
+    size_t length = 0;
+    int n;
+
+#define APPEND(...)                     \
+    do                                  \
+    {                                   \
+        n = snprintf(length < size ? buf + length : 0, length < size ? size - length : 0,\
+            __VA_ARGS__);               \
+        if (0 < n)                      \
+            length += (size_t)n;        \
+    } while (0)
+
+    APPEND("%-16s %8s %9s %9s %9s %9s %9s %9s\n",
+        "Interaction", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (size_t i = 0; count > i; i++)
+        APPEND("%-16s %8llu %7.1fms %7.1fms %7.1fms %7.1fms %7.1fms %7.1fms\n",
+            stats[i].name,
+            (unsigned long long)stats[i].count,
+            stats[i].mean * 1000,
+            stats[i].p50 * 1000,
+            stats[i].p90 * 1000,
+            stats[i].p99 * 1000,
+            stats[i].p999 * 1000,
+            stats[i].max * 1000);
+
+#undef APPEND
+
+    return length;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file LatencyHistogram.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef LATENCYHISTOGRAM_H_INCLUDED
+#define LATENCYHISTOGRAM_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed size latency histograms in the style of HdrHistogram. Latencies are
+ * kept in microseconds in log-linear buckets: each power of two range is split
+ * into 32 linear sub-buckets, so that any recorded value is reported within
+ * about 3% (and values under 64us exactly). Latencies above about 71 minutes
+ * are clamped.
+ *
+ * Histograms are created on first use and live for the life of the process.
+ * Recording is lock free and may race with reporting; reports are consistent
+ * to within the values recorded while they are made.
+ */
+#define LatencyHistogramNameMax         32
+
+typedef struct LatencyHistogram LatencyHistogram;
+
+typedef struct
+{
+    char name[LatencyHistogramNameMax];
+    uint64_t count;
+    double mean, p50, p90, p99, p999, max;  /* seconds */
+} LatencyHistogramStats;
+
+LatencyHistogram *LatencyHistogramGet(const char *name);
+void LatencyHistogramRecord(LatencyHistogram *histogram, double latency);
+double LatencyHistogramPercentile(LatencyHistogram *histogram, double percentile);
+void LatencyHistogramReset(LatencyHistogram *histogram);
+size_t LatencyHistogramGetStats(LatencyHistogramStats *stats, size_t count);
+size_t LatencyHistogramFormat(char *buf, size_t size);
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * @file MetadataIndex.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "MetadataIndex.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct MetadataIndexItem
+{
+    struct MetadataIndexItem *hnext;    /* hash chain */
+    struct MetadataIndexItem *prev, *next;  /* LRU list; most recently used first */
+    uint32_t hash;
+    bool byID;                          /* keyed by bundle ID; path is the bundle */
+    unsigned flags;
+    char *key, *path, *bundleID, *name;
+    char strings[];
+};
+
+struct MetadataIndex
+{
+    pthread_mutex_t mutex;
+    MetadataIndexResolver resolver;
+    struct MetadataIndexItem **buckets;
+    size_t bucketCount;                 /* power of 2 */
+    struct MetadataIndexItem lru;       /* list head */
+    uint64_t generation;                /* incremented by invalidations */
+    MetadataIndexStats stats;
+};
+
+static uint32_t MetadataIndexHash(const char *key, bool byID)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+        hash = (hash ^ *p) * 16777619u;
+    return byID ? ~hash : hash;
+}
+
+MetadataIndex *MetadataIndexCreate(const MetadataIndexResolver *resolver, size_t maxCount)
+{
+    MetadataIndex *index;
+    size_t bucketCount;
+
+    if (0 == maxCount)
+        maxCount = 1;
+    for (bucketCount = 16; maxCount > bucketCount; bucketCount <<= 1)
+        ;
+
+    index = calloc(1, sizeof *index);
+    if (0 == index)
+        return 0;
+
+    index->buckets = calloc(bucketCount, sizeof index->buckets[0]);
+    if (0 == index->buckets)
+    {
+        free(index);
+        return 0;
+    }
+
+    pthread_mutex_init(&index->mutex, 0);
+    index->resolver = *resolver;
+    index->bucketCount = bucketCount;
+    index->lru.prev = index->lru.next = &index->lru;
+    index->stats.maxCount = maxCount;
+
+    return index;
+}
+
+void MetadataIndexDelete(MetadataIndex *index)
+{
+    if (0 == index)
+        return;
+
+    for (struct MetadataIndexItem *item = index->lru.next, *next; &index->lru != item; item = next)
+    {
+        next = item->next;
+        free(item);
+    }
+
+    pthread_mutex_destroy(&index->mutex);
+    free(index->buckets);
+    free(index);
+}
+
+static struct MetadataIndexItem *MetadataIndexFind(MetadataIndex *index,
+    const char *key, bool byID)
+{
+    uint32_t hash = MetadataIndexHash(key, byID);
+    for (struct MetadataIndexItem *item = index->buckets[hash & (index->bucketCount - 1)];
+        0 != item; item = item->hnext)
+        if (hash == item->hash && byID == item->byID && 0 == strcmp(item->key, key))
+        {
+            /* move to the front of the LRU list */
+            item->prev->next = item->next;
+            item->next->prev = item->prev;
+            item->prev = &index->lru;
+            item->next = index->lru.next;
+            item->next->prev = item;
+            index->lru.next = item;
+            return item;
+        }
+    return 0;
+}
+
+static void MetadataIndexRemove(MetadataIndex *index, struct MetadataIndexItem *item)
+{
+    struct MetadataIndexItem **pitem = &index->buckets[item->hash & (index->bucketCount - 1)];
+    while (item != *pitem)
+        pitem = &(*pitem)->hnext;
+    *pitem = item->hnext;
+
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    index->stats.count--;
+
+    free(item);
+}
+
+static void MetadataIndexInsert(MetadataIndex *index, bool byID, unsigned flags,
+    const char *path, const char *bundleID, const char *name)
+{
+    const char *key = byID ? bundleID : path;
+    struct MetadataIndexItem *item;
+    size_t pathSize = strlen(path) + 1, bundleIDSize = strlen(bundleID) + 1,
+        nameSize = strlen(name) + 1;
+
+    item = MetadataIndexFind(index, key, byID);
+    if (0 != item)
+        MetadataIndexRemove(index, item);
+
+    if (index->stats.maxCount <= index->stats.count)
+    {
+        MetadataIndexRemove(index, index->lru.prev);
+        index->stats.evictions++;
+    }
+
+    item = malloc(sizeof *item + pathSize + bundleIDSize + nameSize);
+    if (0 == item)
+        return;
+
+    item->path = item->strings;
+    item->bundleID = item->path + pathSize;
+    item->name = item->bundleID + bundleIDSize;
+    memcpy(item->path, path, pathSize);
+    memcpy(item->bundleID, bundleID, bundleIDSize);
+    memcpy(item->name, name, nameSize);
+    item->key = byID ? item->bundleID : item->path;
+    item->byID = byID;
+    item->flags = flags;
+    item->hash = MetadataIndexHash(key, byID);
+
+    struct MetadataIndexItem **bucket = &index->buckets[item->hash & (index->bucketCount - 1)];
+    item->hnext = *bucket;
+    *bucket = item;
+    item->prev = &index->lru;
+    item->next = index->lru.next;
+    item->next->prev = item;
+    index->lru.next = item;
+    index->stats.count++;
+}
+
+static bool MetadataIndexCopyString(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size <= len)
+        return false;
+    memcpy(dst, src, len + 1);
+    return true;
+}
+
+static bool MetadataIndexResolvePath(MetadataIndex *index, const char *path,
+    MetadataIndexEntry *entry, bool *phit)
+{
+    struct MetadataIndexItem *item;
+    uint64_t generation;
+    bool cache;
+
+    memset(entry, 0, sizeof *entry);
+    if (!MetadataIndexCopyString(entry->path, path, sizeof entry->path))
+        return false;
+
+    pthread_mutex_lock(&index->mutex);
+    item = MetadataIndexFind(index, path, false);
+    if (0 != item)
+    {
+        entry->flags = item->flags;
+        MetadataIndexCopyString(entry->bundleID, item->bundleID, sizeof entry->bundleID);
+        MetadataIndexCopyString(entry->name, item->name, sizeof entry->name);
+        pthread_mutex_unlock(&index->mutex);
+        *phit = true;
+        return true;
+    }
+    generation = index->generation;
+    pthread_mutex_unlock(&index->mutex);
+
+    *phit = false;
+    cache = index->resolver.resolvePath(index->resolver.data, entry);
+    entry->bundleID[sizeof entry->bundleID - 1] = '\0';
+    entry->name[sizeof entry->name - 1] = '\0';
+
+    pthread_mutex_lock(&index->mutex);
+    if (cache && generation == index->generation)
+        MetadataIndexInsert(index, false, entry->flags, entry->path, entry->bundleID, entry->name);
+    pthread_mutex_unlock(&index->mutex);
+
+    return true;
+}
+
+bool MetadataIndexLookupPath(MetadataIndex *index, const char *path, MetadataIndexEntry *entry)
+{
+    bool res, hit = false;
+
+    res = MetadataIndexResolvePath(index, path, entry, &hit);
+
+    pthread_mutex_lock(&index->mutex);
+    if (hit)
+        index->stats.hits++;
+    else
+        index->stats.misses++;
+    pthread_mutex_unlock(&index->mutex);
+
+    return res;
+}
+
+bool MetadataIndexLookupBundleID(MetadataIndex *index, const char *bundleID,
+    MetadataIndexEntry *entry)
+{
+    struct MetadataIndexItem *item;
+    uint64_t generation;
+    char path[MetadataIndexPathMax];
+    bool res = false, idHit = false, pathHit = false;
+
+    if (MetadataIndexNameMax <= strlen(bundleID))
+        goto exit;
+
+    pthread_mutex_lock(&index->mutex);
+    item = MetadataIndexFind(index, bundleID, true);
+    if (0 != item)
+        idHit = MetadataIndexCopyString(path, item->path, sizeof path);
+    generation = index->generation;
+    pthread_mutex_unlock(&index->mutex);
+
+    /* applications that are not installed are not cached, so that new ones are found */
+    if (!idHit)
+    {
+        if (!index->resolver.resolveBundleID(index->resolver.data, bundleID, path, sizeof path))
+            goto exit;
+        path[sizeof path - 1] = '\0';
+
+        pthread_mutex_lock(&index->mutex);
+        if (generation == index->generation)
+            MetadataIndexInsert(index, true, 0, path, bundleID, "");
+        pthread_mutex_unlock(&index->mutex);
+    }
+
+    res = MetadataIndexResolvePath(index, path, entry, &pathHit);
+
+exit:
+    pthread_mutex_lock(&index->mutex);
+    if (idHit && pathHit)
+        index->stats.hits++;
+    else
+        index->stats.misses++;
+    pthread_mutex_unlock(&index->mutex);
+
+    return res;
+}
+
+static bool MetadataIndexAffects(const char *path, size_t len, const char *target)
+{
+    /* path changed: anything at, under or above it (e.g. a bundle that contains it) */
+    size_t targetLen = strlen(target);
+    if (0 == len)
+        return true;
+    if (0 == strncmp(target, path, len) && ('\0' == target[len] || '/' == target[len]))
+        return true;
+    if (targetLen < len && 0 == strncmp(target, path, targetLen) && '/' == path[targetLen])
+        return true;
+    return false;
+}
+
+void MetadataIndexInvalidate(MetadataIndex *index, const char *path)
+{
+    size_t len = strlen(path);
+    while (0 < len && '/' == path[len - 1])
+        len--;
+
+    pthread_mutex_lock(&index->mutex);
+
+    index->generation++;
+    for (struct MetadataIndexItem *item = index->lru.next, *next; &index->lru != item; item = next)
+    {
+        next = item->next;
+        if (MetadataIndexAffects(path, len, item->path))
+        {
+            MetadataIndexRemove(index, item);
+            index->stats.invalidations++;
+        }
+    }
+
+    pthread_mutex_unlock(&index->mutex);
+}
+
+void MetadataIndexInvalidateAll(MetadataIndex *index)
+{
+    MetadataIndexInvalidate(index, "/");
+}
+
+void MetadataIndexGetStats(MetadataIndex *index, MetadataIndexStats *stats)
+{
+    pthread_mutex_lock(&index->mutex);
+    *stats = index->stats;
+    pthread_mutex_unlock(&index->mutex);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file MetadataIndex.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef METADATAINDEX_H_INCLUDED
+#define METADATAINDEX_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A thread-safe index of file metadata: type flags, bundle identifier and
+ * display name by path, and path by bundle identifier. Entries are resolved
+ * lazily through a resolver (LaunchServices and URL resource values on macOS;
+ * anything on other platforms) and kept until a file system change under or
+ * above their path invalidates them, or until they are evicted as the least
+ * recently used.
+ *
+ * Resolvers are called without the index lock held. A resolution that races
+ * with an invalidation, or that the resolver marks as not cacheable (e.g.
+ * because changes to the file could not be observed), is returned to its
+ * caller but not cached. Files that do not exist are cached with no flags.
+ */
+#define MetadataIndexPathMax            1024
+#define MetadataIndexNameMax            256
+
+enum
+{
+    MetadataIndexExists                 = 0x01,
+    MetadataIndexDirectory              = 0x02,
+    MetadataIndexPackage                = 0x04,
+    MetadataIndexApplication            = 0x08,
+};
+
+typedef struct
+{
+    unsigned flags;                     /* MetadataIndex* */
+    char path[MetadataIndexPathMax];
+    char bundleID[MetadataIndexNameMax];/* empty if none */
+    char name[MetadataIndexNameMax];    /* display name; empty if none */
+} MetadataIndexEntry;
+
+typedef struct
+{
+    /* fill in flags, bundleID and name of entry->path; false if the result may not be cached */
+    bool (*resolvePath)(void *data, MetadataIndexEntry *entry);
+    /* find the path of an application bundle; false if there is none */
+    bool (*resolveBundleID)(void *data, const char *bundleID, char *path, size_t size);
+    void *data;
+} MetadataIndexResolver;
+
+typedef struct
+{
+    uint64_t hits, misses, invalidations, evictions;
+    size_t count, maxCount;
+} MetadataIndexStats;
+
+typedef struct MetadataIndex MetadataIndex;
+
+MetadataIndex *MetadataIndexCreate(const MetadataIndexResolver *resolver, size_t maxCount);
+void MetadataIndexDelete(MetadataIndex *index);
+bool MetadataIndexLookupPath(MetadataIndex *index, const char *path, MetadataIndexEntry *entry);
+bool MetadataIndexLookupBundleID(MetadataIndex *index, const char *bundleID,
+    MetadataIndexEntry *entry);
+void MetadataIndexInvalidate(MetadataIndex *index, const char *path);
+void MetadataIndexInvalidateAll(MetadataIndex *index);
+void MetadataIndexGetStats(MetadataIndex *index, MetadataIndexStats *stats);
+
+#endif
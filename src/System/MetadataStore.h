@@ -0,0 +1,24 @@
+/**
+ * @file MetadataStore.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "MetadataIndex.h"
+
+@interface MetadataStore : NSObject
++ (MetadataStore *)sharedInstance;
+- (NSUInteger)flagsForURL:(NSURL *)url;
+- (NSString *)pathForBundleIdentifier:(NSString *)bundleIdentifier;
+- (NSString *)displayNameAtPath:(NSString *)path;
+- (void)invalidatePath:(NSString *)path;
+- (MetadataIndexStats)statistics;
+@end
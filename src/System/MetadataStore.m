@@ -0,0 +1,289 @@
+/**
+ * @file MetadataStore.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "MetadataStore.h"
+#import <pthread.h>
+#import "FSNotify.h"
+
+/*
+ * Entries are invalidated by file system events on the directories that hold
+ * them. Watched directories are kept to a small set of roots (a directory
+ * under an existing root is not added); files in directories past the limit
+ * are still resolved, but not cached.
+ *
+ * FSEvents streams cover whole subtrees, so "/" and the directories at or above
+ * the home folder are never watched: a Dock folder such as /Applications or
+ * ~/Downloads would otherwise put a root on its parent and every change on the
+ * system (or in ~/Library) would invalidate the index. Items in such directories
+ * are resolved on each lookup instead.
+ */
+static const size_t MetadataStoreMaxCount = 4096;
+static const NSUInteger MetadataStoreMaxRoots = 32;
+
+static pthread_once_t MetadataStore_once = PTHREAD_ONCE_INIT;
+static MetadataStore *MetadataStore_instance;
+
+static void MetadataStore_initonce(void)
+{
+    MetadataStore_instance = [[MetadataStore alloc] init];
+}
+
+static BOOL MetadataStoreIsUnder(NSString *path, NSString *root)
+{
+    return [path isEqualToString:root] ||
+        [path hasPrefix:[root hasSuffix:@"/"] ? root : [root stringByAppendingString:@"/"]];
+}
+
+static BOOL MetadataStoreIsWatchable(NSString *root, NSString *home)
+{
+    if (![root isAbsolutePath] || [root isEqualToString:@"/"])
+        return NO;
+
+    return nil == home || !MetadataStoreIsUnder(home, root);
+}
+
+@interface MetadataStore ()
+- (BOOL)watchDirectory:(NSString *)path;
+@end
+
+static bool MetadataStoreResolvePath(void *data, MetadataIndexEntry *entry)
+{
+    MetadataStore *store = data;
+    bool cache;
+
+    @autoreleasepool
+    {
+        NSString *path = [NSString stringWithUTF8String:entry->path];
+        NSURL *url = [NSURL fileURLWithPath:path];
+        NSDictionary *values = [url
+            resourceValuesForKeys:[NSArray arrayWithObjects:
+                NSURLIsDirectoryKey, NSURLIsPackageKey, NSURLIsApplicationKey, nil]
+            error:0];
+        if (nil != values)
+        {
+            entry->flags |= MetadataIndexExists;
+            if ([[values objectForKey:NSURLIsDirectoryKey] boolValue])
+                entry->flags |= MetadataIndexDirectory;
+            if ([[values objectForKey:NSURLIsPackageKey] boolValue])
+                entry->flags |= MetadataIndexPackage;
+            if ([[values objectForKey:NSURLIsApplicationKey] boolValue])
+                entry->flags |= MetadataIndexApplication;
+        }
+
+        /* identifiers and names are only needed (and only paid for) for applications */
+        if (0 != (entry->flags & MetadataIndexApplication))
+        {
+            NSDictionary *info = [(id)CFBundleCopyInfoDictionaryForURL((CFURLRef)url) autorelease];
+            NSString *bundleID = [info objectForKey:(id)kCFBundleIdentifierKey];
+            NSString *name = [[NSFileManager defaultManager] displayNameAtPath:path];
+            if ([bundleID isKindOfClass:[NSString class]])
+                strlcpy(entry->bundleID, bundleID.UTF8String, sizeof entry->bundleID);
+            if (nil != name)
+                strlcpy(entry->name, name.UTF8String, sizeof entry->name);
+        }
+
+        cache = [store watchDirectory:[path stringByDeletingLastPathComponent]];
+    }
+
+    return cache;
+}
+
+static bool MetadataStoreResolveBundleID(void *data, const char *bundleID, char *path, size_t size)
+{
+    bool res = false;
+
+    @autoreleasepool
+    {
+        NSString *appPath = [[NSWorkspace sharedWorkspace]
+            absolutePathForAppBundleWithIdentifier:[NSString stringWithUTF8String:bundleID]];
+        if (nil != appPath)
+            res = size > strlcpy(path, appPath.fileSystemRepresentation, size);
+    }
+
+    return res;
+}
+
+static void MetadataStoreFSNotify(const char *path, void *data)
+{
+    MetadataIndexInvalidate(data, path);
+}
+
+@implementation MetadataStore
+{
+    MetadataIndex *_index;
+    NSMutableArray *_roots;
+    NSString *_home;
+    void *_stream;
+    BOOL _restartPending;
+}
+
++ (MetadataStore *)sharedInstance
+{
+    pthread_once(&MetadataStore_once, MetadataStore_initonce);
+    return MetadataStore_instance;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    MetadataIndexResolver resolver =
+    {
+        .resolvePath = MetadataStoreResolvePath,
+        .resolveBundleID = MetadataStoreResolveBundleID,
+        .data = self,
+    };
+    _index = MetadataIndexCreate(&resolver, MetadataStoreMaxCount);
+    if (0 == _index)
+    {
+        [self release];
+        return nil;
+    }
+
+    _roots = [[NSMutableArray alloc] init];
+    _home = [[NSHomeDirectory() stringByStandardizingPath] copy];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    FSNotifyStop(_stream);
+    MetadataIndexDelete(_index);
+    [_roots release];
+    [_home release];
+
+    [super dealloc];
+}
+
+- (NSUInteger)flagsForURL:(NSURL *)url
+{
+    if (!url.isFileURL)
+        return 0;
+
+    MetadataIndexEntry entry;
+    if (!MetadataIndexLookupPath(_index, url.fileSystemRepresentation, &entry))
+        return 0;
+
+    return entry.flags;
+}
+
+- (NSString *)pathForBundleIdentifier:(NSString *)bundleIdentifier
+{
+    if (nil == bundleIdentifier)
+        return nil;
+
+    MetadataIndexEntry entry;
+    if (!MetadataIndexLookupBundleID(_index, bundleIdentifier.UTF8String, &entry) ||
+        0 == (entry.flags & MetadataIndexExists))
+        return nil;
+
+    return [[NSFileManager defaultManager]
+        stringWithFileSystemRepresentation:entry.path length:strlen(entry.path)];
+}
+
+- (NSString *)displayNameAtPath:(NSString *)path
+{
+    if (nil == path)
+        return nil;
+
+    MetadataIndexEntry entry;
+    if (!MetadataIndexLookupPath(_index, path.fileSystemRepresentation, &entry) ||
+        0 == (entry.flags & MetadataIndexExists))
+        return nil;
+
+    /* names are only indexed for applications */
+    if ('\0' == entry.name[0])
+        return [[NSFileManager defaultManager] displayNameAtPath:path];
+
+    return [NSString stringWithUTF8String:entry.name];
+}
+
+- (void)invalidatePath:(NSString *)path
+{
+    /* for callers that learn of a change before the store's own stream reports it */
+    if (nil == path)
+        return;
+
+    MetadataIndexInvalidate(_index, path.fileSystemRepresentation);
+}
+
+- (MetadataIndexStats)statistics
+{
+    MetadataIndexStats stats;
+    MetadataIndexGetStats(_index, &stats);
+    return stats;
+}
+
+- (BOOL)watchDirectory:(NSString *)path
+{
+    @synchronized (self)
+    {
+        for (NSString *root in _roots)
+            if (MetadataStoreIsUnder(path, root))
+                return YES;
+
+        if (!MetadataStoreIsWatchable(path, _home))
+            return NO;
+
+        /* a new root replaces the roots under it */
+        NSIndexSet *covered = [_roots indexesOfObjectsPassingTest:
+            ^BOOL(NSString *root, NSUInteger index, BOOL *stop)
+            {
+                return MetadataStoreIsUnder(root, path);
+            }];
+        if (0 == covered.count && MetadataStoreMaxRoots <= _roots.count)
+            return NO;
+        [_roots removeObjectsAtIndexes:covered];
+        [_roots addObject:path];
+
+        if (!_restartPending)
+        {
+            _restartPending = YES;
+            [self
+                performSelectorOnMainThread:@selector(restartStream)
+                withObject:nil
+                waitUntilDone:NO];
+        }
+    }
+
+    return YES;
+}
+
+- (void)restartStream
+{
+    NSArray *roots;
+    @synchronized (self)
+    {
+        _restartPending = NO;
+        roots = [[_roots copy] autorelease];
+    }
+
+    const char **cpaths = malloc(roots.count * sizeof *cpaths);
+    if (0 == cpaths)
+        return;
+    for (NSUInteger i = 0; roots.count > i; i++)
+        cpaths[i] = [[roots objectAtIndex:i] fileSystemRepresentation];
+
+    FSNotifyStop(_stream);
+    _stream = FSNotifyStartPaths(cpaths, roots.count, MetadataStoreFSNotify, _index);
+
+    free(cpaths);
+
+    /* without a stream nothing is watched; drop what might go stale */
+    if (0 == _stream)
+        MetadataIndexInvalidateAll(_index);
+}
+@end
@@ -0,0 +1,276 @@
+/**
+ * @file MetricsRing.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "MetricsRing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MetricsRingMagic                0x4d524245  /* 'EBRM' */
+#define MetricsRingVersion              1
+#define MetricsRingMaxCapacity          (1 << 16)
+
+/*
+ * Layout: header, records[capacity]. Head and tail are free running counters,
+ * each on its own cache line; the producer only writes head, the consumer only
+ * writes tail. Records between tail and head are owned by the consumer.
+ */
+struct MetricsRingHeader
+{
+    uint32_t magic, version;
+    uint32_t capacity, recordSize;
+    uint64_t dropped;                   /* producer */
+    uint8_t pad0[40];
+    uint64_t head;                      /* producer */
+    uint8_t pad1[56];
+    uint64_t tail;                      /* consumer */
+    uint8_t pad2[56];
+};
+
+struct MetricsRing
+{
+    struct MetricsRingHeader *header;
+    MetricsRingRecord *records;
+    size_t size;
+    uint32_t capacity;                  /* validated at open; the shared header is not trusted */
+    uint64_t cache;                     /* producer: last seen tail; consumer: last seen head */
+};
+
+static size_t MetricsRingSize(uint32_t capacity)
+{
+    return sizeof(struct MetricsRingHeader) + (size_t)capacity * sizeof(MetricsRingRecord);
+}
+
+static MetricsRing *MetricsRingMap(int fd, size_t size, uint32_t capacity)
+{
+    MetricsRing *ring;
+    void *base;
+
+    ring = malloc(sizeof *ring);
+    if (0 == ring)
+        return 0;
+
+    base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == base)
+    {
+        free(ring);
+        return 0;
+    }
+
+    ring->header = base;
+    ring->records = (void *)(ring->header + 1);
+    ring->size = size;
+    ring->capacity = capacity;
+    ring->cache = 0;
+
+    return ring;
+}
+
+MetricsRing *MetricsRingCreate(const char *name, uint32_t capacity)
+{
+    MetricsRing *res = 0;
+    int fd = -1;
+    struct stat st;
+    size_t size;
+    uint32_t c;
+
+    if (0 == capacity || MetricsRingMaxCapacity < capacity)
+        goto exit;
+    for (c = 2; capacity > c; c <<= 1)
+        ;
+    capacity = c;
+    size = MetricsRingSize(capacity);
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (-1 == fd || -1 == fstat(fd, &st))
+        goto exit;
+
+    if (0 != st.st_size && (off_t)size != st.st_size)
+    {
+        /* shared memory objects cannot be resized on all systems; start over */
+        close(fd);
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (-1 == fd)
+            goto exit;
+        st.st_size = 0;
+    }
+
+    if (0 == st.st_size && -1 == ftruncate(fd, (off_t)size))
+        goto exit;
+
+    res = MetricsRingMap(fd, size, capacity);
+    if (0 == res)
+        goto exit;
+
+    struct MetricsRingHeader *header = res->header;
+    if (MetricsRingMagic == __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) &&
+        MetricsRingVersion == header->version &&
+        capacity == header->capacity &&
+        sizeof(MetricsRingRecord) == header->recordSize)
+    {
+        /* a previous producer left the segment behind; keep the consumer's position */
+        res->cache = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        goto exit;
+    }
+
+    header->version = MetricsRingVersion;
+    header->capacity = capacity;
+    header->recordSize = sizeof(MetricsRingRecord);
+    header->dropped = 0;
+    header->head = 0;
+    header->tail = 0;
+    __atomic_store_n(&header->magic, MetricsRingMagic, __ATOMIC_RELEASE);
+
+exit:
+    if (-1 != fd)
+        close(fd);
+
+    return res;
+}
+
+MetricsRing *MetricsRingOpen(const char *name)
+{
+    MetricsRing *res = 0;
+    int fd = -1;
+    struct stat st;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (-1 == fd || -1 == fstat(fd, &st) ||
+        (off_t)sizeof(struct MetricsRingHeader) > st.st_size)
+        goto exit;
+
+    res = MetricsRingMap(fd, (size_t)st.st_size, 0);
+    if (0 == res)
+        goto exit;
+
+    struct MetricsRingHeader *header = res->header;
+    uint32_t capacity = __atomic_load_n(&header->capacity, __ATOMIC_RELAXED);
+    if (MetricsRingMagic != __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) ||
+        MetricsRingVersion != header->version ||
+        sizeof(MetricsRingRecord) != header->recordSize ||
+        0 == capacity || 0 != (capacity & (capacity - 1)) ||
+        MetricsRingMaxCapacity < capacity ||
+        MetricsRingSize(capacity) != res->size)
+    {
+        MetricsRingClose(res);
+        res = 0;
+        goto exit;
+    }
+
+    res->capacity = capacity;
+    res->cache = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+exit:
+    if (-1 != fd)
+        close(fd);
+
+    return res;
+}
+
+void MetricsRingClose(MetricsRing *ring)
+{
+    if (0 == ring)
+        return;
+
+    munmap(ring->header, ring->size);
+    free(ring);
+}
+
+bool MetricsRingUnlink(const char *name)
+{
+    return 0 == shm_unlink(name) || ENOENT == errno;
+}
+
+uint32_t MetricsRingCapacity(MetricsRing *ring)
+{
+    return ring->capacity;
+}
+
+uint64_t MetricsRingDropped(MetricsRing *ring)
+{
+    return __atomic_load_n(&ring->header->dropped, __ATOMIC_RELAXED);
+}
+
+bool MetricsRingPublish(MetricsRing *ring, const char *name, const char *text, double value)
+{
+    struct MetricsRingHeader *header = ring->header;
+    uint32_t capacity = ring->capacity;
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+
+    /* only touch the consumer's cache line when the ring looks full */
+    if (head - ring->cache >= capacity)
+    {
+        ring->cache = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        if (head - ring->cache >= capacity)
+        {
+            __atomic_store_n(&header->dropped, header->dropped + 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+
+    MetricsRingRecord *record = &ring->records[head & (capacity - 1)];
+    strncpy(record->name, 0 != name ? name : "", sizeof record->name - 1);
+    record->name[sizeof record->name - 1] = '\0';
+    strncpy(record->text, 0 != text ? text : "", sizeof record->text - 1);
+    record->text[sizeof record->text - 1] = '\0';
+    record->value = value;
+
+    __atomic_store_n(&header->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool MetricsRingIsEmpty(MetricsRing *ring)
+{
+    struct MetricsRingHeader *header = ring->header;
+    uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+
+    if (ring->cache != tail)
+        return false;
+
+    ring->cache = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    return ring->cache == tail;
+}
+
+size_t MetricsRingConsume(MetricsRing *ring, MetricsRingRecord *records, size_t count)
+{
+    struct MetricsRingHeader *header = ring->header;
+    uint32_t capacity = ring->capacity;
+    uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+    uint64_t head;
+    size_t i;
+
+    if (ring->cache - tail < count)
+        ring->cache = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    head = ring->cache;
+
+    /* the producer is not trusted: skip anything it claims beyond one lap */
+    if (head - tail > capacity)
+        tail = head > capacity ? head - capacity : 0;
+
+    for (i = 0; count > i && head != tail; i++, tail++)
+    {
+        records[i] = ring->records[tail & (capacity - 1)];
+        records[i].name[sizeof records[i].name - 1] = '\0';
+        records[i].text[sizeof records[i].text - 1] = '\0';
+    }
+
+    __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+
+    return i;
+}
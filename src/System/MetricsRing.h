@@ -0,0 +1,56 @@
+/**
+ * @file MetricsRing.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef METRICSRING_H_INCLUDED
+#define METRICSRING_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A lock-free single-producer/single-consumer ring of metric records in a named
+ * POSIX shared memory segment. The producer (an external tool) creates the
+ * segment and publishes records; the consumer (the MetricsFeed widget) opens it
+ * and drains records. Publishing never blocks: a record that does not fit is
+ * counted as dropped. This file and MetricsRing.c have no other dependencies so
+ * that producers can build them on any POSIX system.
+ *
+ * Segment names follow shm_open rules ("/name"); macOS limits them to 31 chars.
+ */
+#define MetricsRingDefaultName          "/EnergyBar.metrics"
+
+typedef struct MetricsRing MetricsRing;
+
+typedef struct
+{
+    char name[24];                      /* NUL terminated */
+    char text[32];                      /* NUL terminated; empty to show value */
+    double value;
+} MetricsRingRecord;
+
+MetricsRing *MetricsRingCreate(const char *name, uint32_t capacity);
+MetricsRing *MetricsRingOpen(const char *name);
+void MetricsRingClose(MetricsRing *ring);
+bool MetricsRingUnlink(const char *name);
+uint32_t MetricsRingCapacity(MetricsRing *ring);
+uint64_t MetricsRingDropped(MetricsRing *ring);
+
+/* producer */
+bool MetricsRingPublish(MetricsRing *ring, const char *name, const char *text, double value);
+
+/* consumer */
+bool MetricsRingIsEmpty(MetricsRing *ring);
+size_t MetricsRingConsume(MetricsRing *ring, MetricsRingRecord *records, size_t count);
+
+#endif
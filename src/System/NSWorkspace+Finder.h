@@ -12,6 +12,17 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "ServiceState.h"
+
+typedef NS_OPTIONS(uint64_t, NSWorkspaceTrashField)
+{
+    NSWorkspaceTrashFieldFull               = 1 << 0,
+};
+
+typedef struct
+{
+    bool full;
+} NSWorkspaceTrashState;
 
 @interface NSWorkspace (FileOperations)
 - (BOOL)copyItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url;
@@ -19,12 +30,30 @@
 - (BOOL)aliasItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url;
 @end
 
+/*
+ * Copies and moves run in the background. They post their progress and their end on
+ * the main thread, with the destination URL as the notification object.
+ *
+ * Progress: NSWorkspaceFileOperationProgressKey is the fraction done (0 to 1).
+ * End: NSWorkspaceFileOperationErrorKey is the error, absent on success;
+ * NSWorkspaceFileOperationCompletedKey is YES when the items are at the destination
+ * (a move may still fail to remove some sources); NSWorkspaceFileOperationRetriedKey
+ * is YES when a failed operation was handed to Finder, which reports its own errors.
+ */
+extern NSString *NSWorkspaceFileOperationProgressNotification;
+extern NSString *NSWorkspaceFileOperationDidEndNotification;
+extern NSString *NSWorkspaceFileOperationProgressKey;
+extern NSString *NSWorkspaceFileOperationErrorKey;
+extern NSString *NSWorkspaceFileOperationCompletedKey;
+extern NSString *NSWorkspaceFileOperationRetriedKey;
+
 @interface NSWorkspace (Trash)
 - (NSString *)trashPath;
 - (BOOL)openTrash;
 - (BOOL)emptyTrash;
 - (BOOL)moveItemsToTrash:(NSArray<NSURL *> *)urls;
 - (BOOL)isTrashFull;
+- (ServiceState *)trashState;
 - (void)addTrashObserver:(id)observer selector:(SEL)sel;
 - (void)removeTrashObserver:(id)observer;
 @end
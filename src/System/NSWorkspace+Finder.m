@@ -13,7 +13,151 @@
 
 #import "NSWorkspace+Finder.h"
 #import <pthread.h>
+#import "FileOperation.h"
 #import "FSNotify.h"
+#import "Log.h"
+
+@interface NSWorkspace (FileOperationsPrivate)
+- (BOOL)performEventID:(AEEventID)eventID forItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url;
+@end
+
+@interface NSWorkspaceFileOperation : NSObject
+@property (retain) NSArray<NSURL *> *urls;
+@property (retain) NSURL *url;
+@property (assign) AEEventID eventID;
+@property (assign) FileOperation *op;
+@end
+
+NSString *NSWorkspaceFileOperationProgressNotification = @"NSWorkspaceFileOperationProgress";
+NSString *NSWorkspaceFileOperationDidEndNotification = @"NSWorkspaceFileOperationDidEnd";
+NSString *NSWorkspaceFileOperationProgressKey = @"progress";
+NSString *NSWorkspaceFileOperationErrorKey = @"error";
+NSString *NSWorkspaceFileOperationCompletedKey = @"completed";
+NSString *NSWorkspaceFileOperationRetriedKey = @"retried";
+
+#define NSWorkspaceFileOperationProgressInterval 0.1
+
+@implementation NSWorkspaceFileOperation
+{
+    NSTimeInterval _progressTime;       /* serialized by the engine's progress lock */
+}
+
+static void NSWorkspaceFileOperationProgress(const FileOperationProgress *info, void *data)
+{
+    /* called on worker threads, one at a time; throttled to keep the main thread free */
+    NSWorkspaceFileOperation *operation = data;
+    bool done = info->filesDone == info->filesTotal && info->bytesDone == info->bytesTotal;
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (!done && now < operation->_progressTime + NSWorkspaceFileOperationProgressInterval)
+        return;
+    operation->_progressTime = now;
+
+    double fraction = 0 != info->bytesTotal ?
+        (double)info->bytesDone / (double)info->bytesTotal :
+        0 != info->filesTotal ? (double)info->filesDone / (double)info->filesTotal : 0;
+    @autoreleasepool
+    {
+        [operation
+            performSelectorOnMainThread:@selector(progress:)
+            withObject:[NSNumber numberWithDouble:fraction]
+            waitUntilDone:NO];
+    }
+}
+
+static void NSWorkspaceFileOperationCompletion(int error, void *data)
+{
+    /* called on the operation thread; FileOperationDelete must happen elsewhere */
+    [(NSWorkspaceFileOperation *)data
+        performSelectorOnMainThread:@selector(complete:)
+        withObject:[NSNumber numberWithInt:error]
+        waitUntilDone:NO];
+}
+
++ (BOOL)startWithKind:(FileOperationKind)kind eventID:(AEEventID)eventID
+    forItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
+{
+    if (0 == urls.count || !url.isFileURL)
+        return NO;
+
+    NSWorkspaceFileOperation *operation = [[NSWorkspaceFileOperation alloc] init];
+    operation.urls = urls;
+    operation.url = url;
+    operation.eventID = eventID;
+    operation.op = FileOperationCreate(kind, url.fileSystemRepresentation,
+        (unsigned)[[NSProcessInfo processInfo] activeProcessorCount],
+        NSWorkspaceFileOperationProgress, NSWorkspaceFileOperationCompletion, operation);
+    if (0 == operation.op)
+        goto fail;
+
+    for (NSURL *u in urls)
+        if (!u.isFileURL || !FileOperationAdd(operation.op, u.fileSystemRepresentation))
+            goto fail;
+
+    if (!FileOperationStart(operation.op))
+        goto fail;
+
+    /* released in complete: */
+    return YES;
+
+fail:
+    [operation release];
+    return NO;
+}
+
+- (void)dealloc
+{
+    FileOperationDelete(self.op);
+    self.urls = nil;
+    self.url = nil;
+
+    [super dealloc];
+}
+
+- (void)progress:(NSNumber *)fraction
+{
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:NSWorkspaceFileOperationProgressNotification
+        object:self.url
+        userInfo:[NSDictionary dictionaryWithObject:fraction forKey:NSWorkspaceFileOperationProgressKey]];
+}
+
+- (void)complete:(NSNumber *)error
+{
+    /*
+     * The engine rolls back on failure, so a failed operation can be handed to Finder
+     * as a whole; Finder then deals with conflicts, permissions and authentication.
+     * A move whose items are in place but whose sources could not all be removed is
+     * not retried (Finder would find the items in the way); it is reported instead.
+     */
+    FileOperationWait(self.op);
+    BOOL completed = FileOperationCompleted(self.op);
+    BOOL retried = NO;
+    if (0 != error.intValue && completed)
+        LOG("FileOperation = %d; could not remove all moved items", error.intValue);
+    else if (0 != error.intValue && ECANCELED != error.intValue)
+    {
+        LOG("FileOperation = %d; retrying with Finder", error.intValue);
+        retried = [[NSWorkspace sharedWorkspace]
+            performEventID:self.eventID
+            forItemsAtURLs:self.urls
+            toURL:self.url];
+    }
+
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
+    if (0 != error.intValue)
+        [userInfo
+            setObject:[NSError errorWithDomain:NSPOSIXErrorDomain code:error.intValue userInfo:nil]
+            forKey:NSWorkspaceFileOperationErrorKey];
+    [userInfo setObject:[NSNumber numberWithBool:completed] forKey:NSWorkspaceFileOperationCompletedKey];
+    [userInfo setObject:[NSNumber numberWithBool:retried] forKey:NSWorkspaceFileOperationRetriedKey];
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:NSWorkspaceFileOperationDidEndNotification
+        object:self.url
+        userInfo:userInfo];
+
+    [self release];
+}
+@end
 
 @implementation NSWorkspace (FileOperations)
 - (BOOL)performEventID:(AEEventID)eventID forItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
@@ -53,16 +197,70 @@
 
 - (BOOL)copyItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
 {
+    if ([NSWorkspaceFileOperation
+        startWithKind:FileOperationCopy eventID:kAEClone forItemsAtURLs:urls toURL:url])
+        return YES;
+
     return [self performEventID:kAEClone forItemsAtURLs:urls toURL:url];
 }
 
 - (BOOL)moveItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
 {
+    if ([NSWorkspaceFileOperation
+        startWithKind:FileOperationMove eventID:kAEMove forItemsAtURLs:urls toURL:url])
+        return YES;
+
     return [self performEventID:kAEMove forItemsAtURLs:urls toURL:url];
 }
 
+- (BOOL)writeAliasesForItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
+{
+    if (0 == urls.count || !url.isFileURL)
+        return NO;
+
+    NSMutableArray *aliases = [NSMutableArray arrayWithCapacity:urls.count];
+    for (NSURL *u in urls)
+    {
+        NSURL *alias = [url URLByAppendingPathComponent:
+            [u.lastPathComponent stringByAppendingString:@" alias"]];
+        if (!u.isFileURL || [alias checkResourceIsReachableAndReturnError:0])
+            return NO;
+        [aliases addObject:alias];
+    }
+
+    NSUInteger count = 0;
+    for (NSURL *u in urls)
+    {
+        NSData *bookmark = [u
+            bookmarkDataWithOptions:NSURLBookmarkCreationSuitableForBookmarkFile
+            includingResourceValuesForKeys:nil
+            relativeToURL:nil
+            error:0];
+        if (nil == bookmark ||
+            ![NSURL
+                writeBookmarkData:bookmark
+                toURL:[aliases objectAtIndex:count]
+                options:NSURLBookmarkCreationSuitableForBookmarkFile
+                error:0])
+            break;
+        count++;
+    }
+
+    if (urls.count != count)
+    {
+        for (NSUInteger i = 0; count > i; i++)
+            [[NSFileManager defaultManager] removeItemAtURL:[aliases objectAtIndex:i] error:0];
+        return NO;
+    }
+
+    return YES;
+}
+
 - (BOOL)aliasItemsAtURLs:(NSArray<NSURL *> *)urls toURL:(NSURL *)url
 {
+    if ([self writeAliasesForItemsAtURLs:urls toURL:url])
+        return YES;
+
     NSAppleEventDescriptor *finder = [NSAppleEventDescriptor
         descriptorWithBundleIdentifier:@"com.apple.finder"];
     NSAppleEventDescriptor *event = [NSAppleEventDescriptor
@@ -97,20 +295,35 @@
 }
 @end
 
+static const StateStoreField NSWorkspaceTrashFields[] =
+{
+    StateStoreFieldOf(NSWorkspaceTrashState, full),
+};
+
 static pthread_once_t NSWorkspaceTrashFSNotify_once = PTHREAD_ONCE_INIT;
+static ServiceState *NSWorkspaceTrashServiceState;
 static void NSWorkspaceTrashFSNotify(const char *path, void *data);
 
 static void NSWorkspaceTrashFSNotify_initonce(void)
 {
+    NSWorkspaceTrashState initial;
+    initial.full = [[NSWorkspace sharedWorkspace] isTrashFull];
+    NSWorkspaceTrashServiceState = [[ServiceState alloc]
+        initWithSize:sizeof initial
+        fields:NSWorkspaceTrashFields
+        count:sizeof NSWorkspaceTrashFields / sizeof NSWorkspaceTrashFields[0]
+        initial:&initial];
+
     NSString *trash = [NSHomeDirectory() stringByAppendingPathComponent:@".Trash"];
     FSNotifyStart([trash UTF8String], NSWorkspaceTrashFSNotify, 0);
 }
 
 static void NSWorkspaceTrashFSNotify(const char *path, void *data)
 {
-    [[NSNotificationCenter defaultCenter]
-        postNotificationName:@"NSWorkspace+Trash"
-        object:nil];
+    /* most events (e.g. .DS_Store writes) do not change whether the trash is full */
+    NSWorkspaceTrashState state;
+    state.full = [[NSWorkspace sharedWorkspace] isTrashFull];
+    [NSWorkspaceTrashServiceState update:&state fields:NSWorkspaceTrashFieldFull];
 }
 
 @implementation NSWorkspace (Trash)
@@ -200,22 +413,20 @@ static void NSWorkspaceTrashFSNotify(const char *path, void *data)
     return res;
 }
 
-- (void)addTrashObserver:(id)observer selector:(SEL)sel
+- (ServiceState *)trashState
 {
     pthread_once(&NSWorkspaceTrashFSNotify_once, NSWorkspaceTrashFSNotify_initonce);
 
-    [[NSNotificationCenter defaultCenter]
-        addObserver:observer
-        selector:sel
-        name:@"NSWorkspace+Trash"
-        object:nil];
+    return NSWorkspaceTrashServiceState;
+}
+
+- (void)addTrashObserver:(id)observer selector:(SEL)sel
+{
+    [[self trashState] addObserver:observer selector:sel fields:NSWorkspaceTrashFieldFull];
 }
 
 - (void)removeTrashObserver:(id)observer
 {
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:observer
-        name:@"NSWorkspace+Trash"
-        object:nil];
+    [[self trashState] removeObserver:observer];
 }
 @end
@@ -12,6 +12,30 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "PlaybackProgress.h"
+#import "ServiceState.h"
+
+typedef NS_OPTIONS(uint64_t, NowPlayingField)
+{
+    NowPlayingFieldApp                      = 1 << 0,
+    NowPlayingFieldInfo                     = 1 << 1,
+    NowPlayingFieldArtwork                  = 1 << 2,
+    NowPlayingFieldPlaying                  = 1 << 3,
+    NowPlayingFieldProgress                 = 1 << 4,
+};
+
+/*
+ * The app, info and artwork objects remain main thread properties; the state
+ * carries a generation for each, so that observers learn which of them changed.
+ */
+typedef struct
+{
+    uint64_t app;
+    uint64_t info;
+    uint64_t artwork;
+    bool playing;
+    PlaybackProgress progress;          /* clock is systemUptime */
+} NowPlayingState;
 
 @interface NowPlaying : NSObject
 + (NowPlaying *)sharedInstance;
@@ -21,8 +45,8 @@
 @property (retain) NSString *album;
 @property (retain) NSString *artist;
 @property (retain) NSString *title;
-@property (assign) BOOL playing;
+@property (retain) NSImage *artwork;
+@property (readonly) BOOL playing;
+@property (readonly) PlaybackProgress progress; /* clock is systemUptime */
+@property (readonly) ServiceState *state;
 @end
-
-extern NSString *NowPlayingInfoNotification;
-extern NSString *NowPlayingStateNotification;
@@ -12,6 +12,10 @@
  */
 
 #import "NowPlaying.h"
+#import <ImageIO/ImageIO.h>
+#import "ArtworkCache.h"
+#import "IconStore.h"
+#import "MetadataStore.h"
 
 typedef void (^MRMediaRemoteGetNowPlayingInfoBlock)(NSDictionary *info);
 typedef void (^MRMediaRemoteGetNowPlayingClientBlock)(id clientObj);
@@ -36,8 +40,113 @@ extern NSString *kMRMediaRemoteNowPlayingApplicationDidChangeNotification;
 extern NSString *kMRMediaRemoteNowPlayingInfoAlbum;
 extern NSString *kMRMediaRemoteNowPlayingInfoArtist;
 extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
+extern NSString *kMRMediaRemoteNowPlayingInfoArtworkData;
+extern NSString *kMRMediaRemoteNowPlayingInfoDuration;
+extern NSString *kMRMediaRemoteNowPlayingInfoElapsedTime;
+extern NSString *kMRMediaRemoteNowPlayingInfoPlaybackRate;
+extern NSString *kMRMediaRemoteNowPlayingInfoTimestamp;
+
+/*
+ * Artwork is kept at the Now Playing widget image size: 26pt at 2x.
+ */
+static const unsigned NowPlayingArtworkPixelSize = 52;
+static const size_t NowPlayingArtworkBudget = 1024 * 1024;
+
+static bool NowPlayingDecodeArtwork(void *data, const void *encoded, size_t size,
+    unsigned maxPixelSize, uint32_t **ppixels, unsigned *pwidth, unsigned *pheight)
+{
+    bool res = false;
+    CFDataRef cfdata = 0;
+    CGImageSourceRef source = 0;
+    CGImageRef image = 0;
+    CGColorSpaceRef colorSpace = 0;
+    CGContextRef context = 0;
+    uint32_t *pixels = 0;
+    size_t width, height;
+
+    cfdata = CFDataCreateWithBytesNoCopy(0, encoded, (CFIndex)size, kCFAllocatorNull);
+    if (0 == cfdata)
+        goto exit;
+
+    source = CGImageSourceCreateWithData(cfdata, 0);
+    if (0 == source)
+        goto exit;
+
+    /* let ImageIO decode at reduced size (JPEG can skip most of the work) */
+    image = CGImageSourceCreateThumbnailAtIndex(source, 0, (CFDictionaryRef)@{
+        (id)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+        (id)kCGImageSourceCreateThumbnailWithTransform: @YES,
+        (id)kCGImageSourceThumbnailMaxPixelSize: @(maxPixelSize),
+    });
+    if (0 == image)
+        goto exit;
+
+    width = CGImageGetWidth(image);
+    height = CGImageGetHeight(image);
+    if (0 == width || 0 == height || maxPixelSize < width || maxPixelSize < height)
+        goto exit;
+
+    pixels = calloc(width * height, sizeof *pixels);
+    if (0 == pixels)
+        goto exit;
+
+    colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    if (0 == colorSpace)
+        goto exit;
+
+    context = CGBitmapContextCreate(pixels, width, height, 8, width * 4,
+        colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    if (0 == context)
+        goto exit;
+
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+
+    *ppixels = pixels;
+    *pwidth = (unsigned)width;
+    *pheight = (unsigned)height;
+    pixels = 0;
+    res = true;
+
+exit:
+    if (0 != context)
+        CGContextRelease(context);
+
+    if (0 != colorSpace)
+        CGColorSpaceRelease(colorSpace);
+
+    if (0 != image)
+        CGImageRelease(image);
+
+    if (0 != source)
+        CFRelease(source);
+
+    if (0 != cfdata)
+        CFRelease(cfdata);
+
+    free(pixels);
+
+    return res;
+}
+
+static const StateStoreField NowPlayingFields[] =
+{
+    StateStoreFieldOf(NowPlayingState, app),
+    StateStoreFieldOf(NowPlayingState, info),
+    StateStoreFieldOf(NowPlayingState, artwork),
+    StateStoreFieldOf(NowPlayingState, playing),
+    StateStoreFieldOf(NowPlayingState, progress),
+};
 
 @implementation NowPlaying
+{
+    ServiceState *_state;
+    uint64_t _appGeneration, _infoGeneration;
+    dispatch_queue_t _artworkQueue;
+    ArtworkCache *_artworkCache;
+    NSData *_artworkData;
+    uint64_t _artworkGeneration;
+}
+
 + (void)load
 {
     MRMediaRemoteRegisterForNowPlayingNotifications(dispatch_get_main_queue());
@@ -57,6 +166,19 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
     if (nil == self)
         return nil;
 
+    NowPlayingState initial;
+    memset(&initial, 0, sizeof initial);
+    _state = [[ServiceState alloc]
+        initWithSize:sizeof initial
+        fields:NowPlayingFields
+        count:sizeof NowPlayingFields / sizeof NowPlayingFields[0]
+        initial:&initial];
+
+    ArtworkCacheDecoder decoder = { NowPlayingDecodeArtwork, 0 };
+    _artworkCache = ArtworkCacheCreate(&decoder,
+        NowPlayingArtworkPixelSize, NowPlayingArtworkBudget);
+    _artworkQueue = dispatch_queue_create("NowPlaying.artwork", DISPATCH_QUEUE_SERIAL);
+
     [[NSNotificationCenter defaultCenter]
         addObserver:self
         selector:@selector(appDidChange:)
@@ -101,10 +223,38 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
     self.album = nil;
     self.artist = nil;
     self.title = nil;
+    self.artwork = nil;
+
+    /* the artwork queue retains self while it has work, so it is idle here */
+    if (0 != _artworkQueue)
+        dispatch_release(_artworkQueue);
+    ArtworkCacheDelete(_artworkCache);
+    [_artworkData release];
+
+    [_state release];
 
     [super dealloc];
 }
 
+- (ServiceState *)state
+{
+    return _state;
+}
+
+- (BOOL)playing
+{
+    NowPlayingState state;
+    [_state read:&state];
+    return state.playing;
+}
+
+- (PlaybackProgress)progress
+{
+    NowPlayingState state;
+    [_state read:&state];
+    return state.progress;
+}
+
 - (void)updateApp
 {
     MRMediaRemoteGetNowPlayingClient(dispatch_get_main_queue(),
@@ -122,12 +272,12 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
 
                 if (nil != appBundleIdentifier)
                 {
-                    NSString *path = [[NSWorkspace sharedWorkspace]
-                        absolutePathForAppBundleWithIdentifier:appBundleIdentifier];
+                    MetadataStore *store = [MetadataStore sharedInstance];
+                    NSString *path = [store pathForBundleIdentifier:appBundleIdentifier];
                     if (nil != path)
                     {
-                        appName = [[NSFileManager defaultManager] displayNameAtPath:path];
-                        appIcon = [[NSWorkspace sharedWorkspace] iconForFile:path];
+                        appName = [store displayNameAtPath:path];
+                        appIcon = [[IconStore sharedInstance] iconForFile:path];
                     }
                 }
             }
@@ -140,9 +290,9 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
                 self.appName = appName;
                 self.appIcon = appIcon;
 
-                [[NSNotificationCenter defaultCenter]
-                    postNotificationName:NowPlayingInfoNotification
-                    object:self];
+                NowPlayingState state;
+                state.app = ++_appGeneration;
+                [_state update:&state fields:NowPlayingFieldApp];
             }
         });
 }
@@ -155,18 +305,94 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
             NSString *album = [info objectForKey:kMRMediaRemoteNowPlayingInfoAlbum];
             NSString *artist = [info objectForKey:kMRMediaRemoteNowPlayingInfoArtist];
             NSString *title = [info objectForKey:kMRMediaRemoteNowPlayingInfoTitle];
+            NSData *artworkData = [info objectForKey:kMRMediaRemoteNowPlayingInfoArtworkData];
 
+            PlaybackProgress progress = [self progressWithInfo:info];
+
+            [self updateArtworkData:artworkData];
+
+            /* the store drops the progress if its anchor is unchanged */
+            NowPlayingState state;
+            NowPlayingField fields = NowPlayingFieldProgress;
+            state.progress = progress;
             if (self.album != album || self.artist != artist || self.title != title)
             {
                 self.album = album;
                 self.artist = artist;
                 self.title = title;
 
-                [[NSNotificationCenter defaultCenter]
-                    postNotificationName:NowPlayingInfoNotification
-                    object:self];
+                state.info = ++_infoGeneration;
+                fields |= NowPlayingFieldInfo;
             }
+            [_state update:&state fields:fields];
+        });
+}
+
+- (PlaybackProgress)progressWithInfo:(NSDictionary *)info
+{
+    NSNumber *duration = [info objectForKey:kMRMediaRemoteNowPlayingInfoDuration];
+    NSNumber *elapsed = [info objectForKey:kMRMediaRemoteNowPlayingInfoElapsedTime];
+    NSNumber *rate = [info objectForKey:kMRMediaRemoteNowPlayingInfoPlaybackRate];
+    NSDate *date = [info objectForKey:kMRMediaRemoteNowPlayingInfoTimestamp];
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    PlaybackProgress progress;
+
+    /* the elapsed time is as of the info timestamp; move it to the monotonic clock */
+    NSTimeInterval timestamp = now;
+    if ([date isKindOfClass:[NSDate class]])
+        timestamp += date.timeIntervalSinceNow;
+
+    PlaybackProgressAnchor(&progress,
+        [duration isKindOfClass:[NSNumber class]] ? duration.doubleValue : 0,
+        [elapsed isKindOfClass:[NSNumber class]] ? elapsed.doubleValue : 0,
+        timestamp,
+        [rate isKindOfClass:[NSNumber class]] ? rate.doubleValue : 0);
+
+    return progress;
+}
+
+- (void)updateArtworkData:(NSData *)artworkData
+{
+    if (![artworkData isKindOfClass:[NSData class]])
+        artworkData = nil;
+
+    if (_artworkData == artworkData || [_artworkData isEqualToData:artworkData])
+        return;
+
+    [_artworkData release];
+    _artworkData = [artworkData retain];
+    uint64_t generation = ++_artworkGeneration;
+
+    if (nil == artworkData || 0 == _artworkCache)
+    {
+        [self setArtworkImage:nil generation:generation];
+        return;
+    }
+
+    /* hash, decode and downsample off the main thread; later info supersedes this one */
+    dispatch_async(_artworkQueue, ^
+    {
+        IconCacheBitmap *bitmap = ArtworkCacheGet(_artworkCache,
+            artworkData.bytes, artworkData.length);
+        dispatch_async(dispatch_get_main_queue(), ^
+        {
+            [self
+                setArtworkImage:[[IconStore sharedInstance] imageWithBitmap:bitmap]
+                generation:generation];
         });
+    });
+}
+
+- (void)setArtworkImage:(NSImage *)artwork generation:(uint64_t)generation
+{
+    if (_artworkGeneration != generation || self.artwork == artwork)
+        return;
+
+    self.artwork = artwork;
+
+    NowPlayingState state;
+    state.artwork = generation;
+    [_state update:&state fields:NowPlayingFieldArtwork];
 }
 
 - (void)updateState
@@ -174,13 +400,15 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
     MRMediaRemoteGetNowPlayingApplicationIsPlaying(dispatch_get_main_queue(),
         ^(BOOL playing)
         {
-            if (self.playing != playing)
+            NowPlayingState state;
+            [_state read:&state];
+            if (state.playing != playing)
             {
-                self.playing = playing;
+                state.playing = playing;
+                if (!playing)
+                    PlaybackProgressPause(&state.progress, [NSProcessInfo processInfo].systemUptime);
 
-                [[NSNotificationCenter defaultCenter]
-                    postNotificationName:NowPlayingStateNotification
-                    object:self];
+                [_state update:&state fields:NowPlayingFieldPlaying | NowPlayingFieldProgress];
             }
         });
 }
@@ -197,9 +425,8 @@ extern NSString *kMRMediaRemoteNowPlayingInfoTitle;
 
 - (void)playingDidChange:(NSNotification *)notification
 {
+    /* re-anchor the progress; players report a new elapsed time and rate on play/pause */
     [self updateState];
+    [self updateInfo];
 }
 @end
-
-NSString *NowPlayingInfoNotification = @"NowPlayingInfo";
-NSString *NowPlayingStateNotification = @"NowPlayingState";
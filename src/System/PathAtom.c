@@ -0,0 +1,244 @@
+/**
+ * @file PathAtom.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "PathAtom.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PathAtomMinTableSize            16
+
+typedef struct
+{
+    char *path;                         /* 0 if the atom is free */
+    uint64_t hash;
+    uint32_t refs;
+    uint32_t nextFree;                  /* free list of atoms; 0 ends it */
+} PathAtomEntry;
+
+struct PathAtomTable
+{
+    pthread_mutex_t mutex;
+    PathAtomEntry *entries;             /* atom i is entries[i - 1] */
+    uint32_t entryCount, entryCapacity, firstFree;
+    uint32_t *table, tableMask;         /* path to atom; open addressing, linear probing */
+    size_t count;
+};
+
+uint64_t PathAtomHash(const char *path)
+{
+    /* FNV-1a, then a finalizer so that the low bits are usable as a table index */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+PathAtomTable *PathAtomTableCreate(void)
+{
+    PathAtomTable *table = calloc(1, sizeof *table);
+    if (0 == table)
+        return 0;
+
+    table->table = calloc(PathAtomMinTableSize, sizeof table->table[0]);
+    if (0 == table->table)
+    {
+        free(table);
+        return 0;
+    }
+
+    pthread_mutex_init(&table->mutex, 0);
+    table->tableMask = PathAtomMinTableSize - 1;
+
+    return table;
+}
+
+void PathAtomTableDelete(PathAtomTable *table)
+{
+    if (0 == table)
+        return;
+
+    for (uint32_t i = 0; table->entryCount > i; i++)
+        free(table->entries[i].path);
+    pthread_mutex_destroy(&table->mutex);
+    free(table->entries);
+    free(table->table);
+    free(table);
+}
+
+static uint32_t *PathAtomLocate(PathAtomTable *table, const char *path, uint64_t hash)
+{
+    for (uint32_t i = hash & table->tableMask;; i = (i + 1) & table->tableMask)
+    {
+        uint32_t *slot = &table->table[i];
+        if (0 == *slot)
+            return slot;
+        PathAtomEntry *entry = &table->entries[*slot - 1];
+        if (hash == entry->hash && 0 == strcmp(path, entry->path))
+            return slot;
+    }
+}
+
+static int PathAtomResize(PathAtomTable *table, uint32_t size)
+{
+    uint32_t *newTable = calloc(size, sizeof newTable[0]);
+    if (0 == newTable)
+        return -1;
+
+    uint32_t mask = size - 1;
+    for (uint32_t atom = 1; table->entryCount >= atom; atom++)
+    {
+        PathAtomEntry *entry = &table->entries[atom - 1];
+        if (0 == entry->path)
+            continue;
+        uint32_t i = entry->hash & mask;
+        while (0 != newTable[i])
+            i = (i + 1) & mask;
+        newTable[i] = atom;
+    }
+
+    free(table->table);
+    table->table = newTable;
+    table->tableMask = mask;
+
+    return 0;
+}
+
+static void PathAtomUnlink(PathAtomTable *table, uint32_t *slot)
+{
+    /* backward shift deletion: keeps probe sequences intact without tombstones */
+    uint32_t i = (uint32_t)(slot - table->table), j = i;
+    for (;;)
+    {
+        table->table[i] = 0;
+        for (;;)
+        {
+            j = (j + 1) & table->tableMask;
+            if (0 == table->table[j])
+                return;
+            uint32_t home = table->entries[table->table[j] - 1].hash & table->tableMask;
+            if (((j - home) & table->tableMask) >= ((j - i) & table->tableMask))
+                break;
+        }
+        table->table[i] = table->table[j];
+        i = j;
+    }
+}
+
+uint32_t PathAtomIntern(PathAtomTable *table, const char *path)
+{
+    uint64_t hash = PathAtomHash(path);
+    uint32_t atom = 0, *slot;
+    char *copy = 0;
+
+    pthread_mutex_lock(&table->mutex);
+
+    slot = PathAtomLocate(table, path, hash);
+    if (0 != *slot)
+    {
+        atom = *slot;
+        table->entries[atom - 1].refs++;
+        goto exit;
+    }
+
+    /* keep the table at most half full */
+    if (table->tableMask + 1 < 2 * (table->count + 1))
+    {
+        if (0 != PathAtomResize(table, 2 * (table->tableMask + 1)))
+            goto exit;
+        slot = PathAtomLocate(table, path, hash);
+    }
+
+    if (0 == table->firstFree && table->entryCapacity == table->entryCount)
+    {
+        uint32_t capacity = 0 != table->entryCapacity ? 2 * table->entryCapacity : 16;
+        PathAtomEntry *entries = realloc(table->entries, capacity * sizeof entries[0]);
+        if (0 == entries)
+            goto exit;
+        table->entries = entries;
+        table->entryCapacity = capacity;
+    }
+
+    copy = strdup(path);
+    if (0 == copy)
+        goto exit;
+
+    if (0 != table->firstFree)
+    {
+        atom = table->firstFree;
+        table->firstFree = table->entries[atom - 1].nextFree;
+    }
+    else
+        atom = ++table->entryCount;
+
+    table->entries[atom - 1] = (PathAtomEntry){ .path = copy, .hash = hash, .refs = 1 };
+    *slot = atom;
+    table->count++;
+
+exit:
+    pthread_mutex_unlock(&table->mutex);
+
+    return atom;
+}
+
+uint32_t PathAtomFind(PathAtomTable *table, const char *path)
+{
+    uint64_t hash = PathAtomHash(path);
+    uint32_t atom;
+
+    pthread_mutex_lock(&table->mutex);
+    atom = *PathAtomLocate(table, path, hash);
+    pthread_mutex_unlock(&table->mutex);
+
+    return atom;
+}
+
+void PathAtomRelease(PathAtomTable *table, uint32_t atom)
+{
+    if (0 == atom)
+        return;
+
+    pthread_mutex_lock(&table->mutex);
+
+    PathAtomEntry *entry = table->entryCount >= atom ? &table->entries[atom - 1] : 0;
+    if (0 == entry || 0 == entry->path || 0 != --entry->refs)
+        goto exit;
+
+    PathAtomUnlink(table, PathAtomLocate(table, entry->path, entry->hash));
+    free(entry->path);
+    entry->path = 0;
+    entry->nextFree = table->firstFree;
+    table->firstFree = atom;
+    table->count--;
+
+    /* shrink when mostly empty, so that the table follows the paths in use */
+    if (PathAtomMinTableSize < table->tableMask + 1 && table->tableMask + 1 > 8 * table->count)
+        PathAtomResize(table, (table->tableMask + 1) / 2);
+
+exit:
+    pthread_mutex_unlock(&table->mutex);
+}
+
+size_t PathAtomCount(PathAtomTable *table)
+{
+    size_t count;
+
+    pthread_mutex_lock(&table->mutex);
+    count = table->count;
+    pthread_mutex_unlock(&table->mutex);
+
+    return count;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file PathAtom.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef PATHATOM_H_INCLUDED
+#define PATHATOM_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Paths interned into small nonzero integers. Each PathAtomIntern takes a
+ * reference on the atom and each PathAtomRelease drops one; when the last
+ * reference goes the path is forgotten and its atom is reused, so the table
+ * holds only paths that are in use. Interning a path that is already in the
+ * table and finding a path never allocate.
+ *
+ * A PathAtomTable is thread-safe.
+ */
+typedef struct PathAtomTable PathAtomTable;
+
+PathAtomTable *PathAtomTableCreate(void);
+void PathAtomTableDelete(PathAtomTable *table);
+uint32_t PathAtomIntern(PathAtomTable *table, const char *path);
+uint32_t PathAtomFind(PathAtomTable *table, const char *path);
+void PathAtomRelease(PathAtomTable *table, uint32_t atom);
+size_t PathAtomCount(PathAtomTable *table);
+uint64_t PathAtomHash(const char *path);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file PlaybackProgress.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "PlaybackProgress.h"
+#include <math.h>
+
+void PlaybackProgressAnchor(PlaybackProgress *progress,
+    double duration, double elapsed, double timestamp, double rate)
+{
+    progress->duration = isfinite(duration) && 0 < duration ? duration : 0;
+    progress->elapsed = isfinite(elapsed) && 0 < elapsed ? elapsed : 0;
+    progress->timestamp = timestamp;
+    progress->rate = isfinite(rate) ? rate : 0;
+}
+
+void PlaybackProgressPause(PlaybackProgress *progress, double now)
+{
+    progress->elapsed = PlaybackProgressElapsed(progress, now);
+    progress->timestamp = now;
+    progress->rate = 0;
+}
+
+bool PlaybackProgressIsValid(const PlaybackProgress *progress)
+{
+    return 0 < progress->duration;
+}
+
+double PlaybackProgressElapsed(const PlaybackProgress *progress, double now)
+{
+    double elapsed = progress->elapsed;
+    if (0 != progress->rate && now > progress->timestamp)
+        elapsed += (now - progress->timestamp) * progress->rate;
+    if (0 > elapsed)
+        elapsed = 0;
+    if (0 < progress->duration && progress->duration < elapsed)
+        elapsed = progress->duration;
+    return elapsed;
+}
+
+double PlaybackProgressFraction(const PlaybackProgress *progress, double now)
+{
+    if (!PlaybackProgressIsValid(progress))
+        return 0;
+    return PlaybackProgressElapsed(progress, now) / progress->duration;
+}
+
+unsigned PlaybackProgressPixels(const PlaybackProgress *progress, double now, unsigned width)
+{
+    unsigned pixels = (unsigned)floor(PlaybackProgressFraction(progress, now) * width);
+    return width < pixels ? width : pixels;
+}
+
+double PlaybackProgressNextPixelDelay(const PlaybackProgress *progress, double now, unsigned width)
+{
+    /* time until the bar grows (or, when rewinding, shrinks) by a whole pixel */
+    unsigned pixels;
+    double boundary, delay;
+
+    if (!PlaybackProgressIsValid(progress) || 0 == progress->rate || 0 == width)
+        return INFINITY;
+
+    pixels = PlaybackProgressPixels(progress, now, width);
+    if (0 < progress->rate)
+    {
+        if (width <= pixels)
+            return INFINITY;
+        boundary = progress->duration * (pixels + 1) / width;
+    }
+    else
+    {
+        if (0 == pixels)
+            return INFINITY;
+        /* the pixel count drops just below the boundary of the current pixel */
+        boundary = progress->duration * pixels / width;
+    }
+
+    delay = (boundary - PlaybackProgressElapsed(progress, now)) / progress->rate;
+    if (now < progress->timestamp)
+        delay += progress->timestamp - now;
+    return 0 < delay ? delay : 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file PlaybackProgress.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef PLAYBACKPROGRESS_H_INCLUDED
+#define PLAYBACKPROGRESS_H_INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Playback position interpolated locally from an anchor: the elapsed time at
+ * some instant and the playback rate from then on. The anchor is replaced only
+ * when the player reports new information, so progress is never polled.
+ *
+ * Times are seconds of a monotonic clock supplied by the caller.
+ */
+typedef struct
+{
+    double duration;                    /* 0 if unknown */
+    double elapsed;                     /* at timestamp */
+    double timestamp;
+    double rate;                        /* 0 when paused */
+} PlaybackProgress;
+
+void PlaybackProgressAnchor(PlaybackProgress *progress,
+    double duration, double elapsed, double timestamp, double rate);
+void PlaybackProgressPause(PlaybackProgress *progress, double now);
+bool PlaybackProgressIsValid(const PlaybackProgress *progress);
+double PlaybackProgressElapsed(const PlaybackProgress *progress, double now);
+double PlaybackProgressFraction(const PlaybackProgress *progress, double now);
+unsigned PlaybackProgressPixels(const PlaybackProgress *progress, double now, unsigned width);
+double PlaybackProgressNextPixelDelay(const PlaybackProgress *progress, double now, unsigned width);
+
+#endif
@@ -12,21 +12,36 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "ServiceState.h"
+
+typedef NS_ENUM(uint8_t, PowerStatusSource)
+{
+    PowerStatusSourceUnknown,
+    PowerStatusSourceAC,
+    PowerStatusSourceBattery,
+    PowerStatusSourceUPS,
+};
+
+typedef NS_OPTIONS(uint64_t, PowerStatusField)
+{
+    PowerStatusFieldSource                  = 1 << 0,
+    PowerStatusFieldCapacity                = 1 << 1,
+    PowerStatusFieldCharging                = 1 << 2,
+    PowerStatusFieldCharged                 = 1 << 3,
+    PowerStatusFieldRemainingTime           = 1 << 4,
+};
+
+typedef struct
+{
+    PowerStatusSource source;
+    bool charging;                      /* as reported by the power source */
+    bool charged;
+    double capacity;                    /* percent; NAN if unknown */
+    NSTimeInterval remainingTime;       /* NAN if unknown, +INFINITY if unlimited */
+} PowerStatusState;
 
 @interface PowerStatus : NSObject
 + (PowerStatus *)sharedInstance;
-- (NSTimeInterval)remainingTime;
-- (NSString *)providingSource;
-- (NSDictionary *)providingSourceInfoDictionary;
+- (void)refresh;
+@property (readonly) ServiceState *state;
 @end
-
-extern NSString *PowerStatusACPower;
-extern NSString *PowerStatusBatteryPower;
-extern NSString *PowerStatusUPSPower;
-extern NSString *PowerStatusSourceState;
-extern NSString *PowerStatusCurrentCapacity;
-extern NSString *PowerStatusMaxCapacity;
-extern NSString *PowerStatusIsCharging;
-extern NSString *PowerStatusIsCharged;
-
-extern NSString *PowerStatusNotification;
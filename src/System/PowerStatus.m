@@ -14,16 +14,24 @@
 #import "PowerStatus.h"
 #import <IOKit/ps/IOPowerSources.h>
 
+static const StateStoreField PowerStatusFields[] =
+{
+    StateStoreFieldOf(PowerStatusState, source),
+    StateStoreFieldOf(PowerStatusState, capacity),
+    StateStoreFieldOf(PowerStatusState, charging),
+    StateStoreFieldOf(PowerStatusState, charged),
+    StateStoreFieldOf(PowerStatusState, remainingTime),
+};
+
 static void PowerStatusCallback(void *context)
 {
-    [[NSNotificationCenter defaultCenter]
-        postNotificationName:PowerStatusNotification
-        object:context];
+    [(PowerStatus *)context refresh];
 }
 
 @implementation PowerStatus
 {
     CFRunLoopSourceRef _source;
+    ServiceState *_state;
 }
 
 + (PowerStatus *)sharedInstance
@@ -44,9 +52,18 @@ static void PowerStatusCallback(void *context)
     if (nil == self)
         return nil;
 
+    PowerStatusState initial = { .capacity = NAN, .remainingTime = NAN };
+    _state = [[ServiceState alloc]
+        initWithSize:sizeof initial
+        fields:PowerStatusFields
+        count:sizeof PowerStatusFields / sizeof PowerStatusFields[0]
+        initial:&initial];
+
     _source = source;
     CFRunLoopAddSource(CFRunLoopGetCurrent(), _source, kCFRunLoopDefaultMode);
 
+    [self refresh];
+
     return self;
 }
 
@@ -54,47 +71,45 @@ static void PowerStatusCallback(void *context)
 {
     CFRunLoopRemoveSource(CFRunLoopGetCurrent(), _source, kCFRunLoopDefaultMode);
 
+    [_state release];
+
     [super dealloc];
 }
 
-- (NSTimeInterval)remainingTime
+- (ServiceState *)state
 {
-    NSTimeInterval time = IOPSGetTimeRemainingEstimate();
-    if (kIOPSTimeRemainingUnknown == time)
-        time = NAN;
-    else if (kIOPSTimeRemainingUnlimited == time)
-        time = +INFINITY;
-    return time;
+    return _state;
 }
 
-- (NSString *)providingSource
+- (void)refresh
 {
-    NSString *source = nil;
+    PowerStatusState state = { .capacity = NAN, .remainingTime = NAN };
 
     CFTypeRef blob = IOPSCopyPowerSourcesInfo();
     if (0 != blob)
     {
-        source = (NSString *)IOPSGetProvidingPowerSourceType(blob);
-
-        CFRelease(blob);
-    }
-
-    return source;
-}
-
-- (NSDictionary *)providingSourceInfoDictionary
-{
-    NSDictionary *info = nil;
+        NSString *type = (NSString *)IOPSGetProvidingPowerSourceType(blob);
+        if ([type isEqualToString:@kIOPMACPowerKey])
+            state.source = PowerStatusSourceAC;
+        else if ([type isEqualToString:@kIOPMBatteryPowerKey])
+            state.source = PowerStatusSourceBattery;
+        else if ([type isEqualToString:@kIOPMUPSPowerKey])
+            state.source = PowerStatusSourceUPS;
 
-    CFTypeRef blob = IOPSCopyPowerSourcesInfo();
-    if (0 != blob)
-    {
         CFArrayRef list = IOPSCopyPowerSourcesList(blob);
         if (0 != list)
         {
             if (0 < CFArrayGetCount(list))
-                info = [[(id)IOPSGetPowerSourceDescription(blob, CFArrayGetValueAtIndex(list, 0))
-                    retain] autorelease];
+            {
+                NSDictionary *info = (NSDictionary *)IOPSGetPowerSourceDescription(
+                    blob, CFArrayGetValueAtIndex(list, 0));
+                NSNumber *currentCapacity = [info objectForKey:@kIOPSCurrentCapacityKey];
+                NSNumber *maxCapacity = [info objectForKey:@kIOPSMaxCapacityKey];
+                if (nil != currentCapacity && nil != maxCapacity)
+                    state.capacity = 100 * [currentCapacity doubleValue] / [maxCapacity doubleValue];
+                state.charging = [[info objectForKey:@kIOPSIsChargingKey] boolValue];
+                state.charged = [[info objectForKey:@kIOPSIsChargedKey] boolValue];
+            }
 
             CFRelease(list);
         }
@@ -102,17 +117,13 @@ static void PowerStatusCallback(void *context)
         CFRelease(blob);
     }
 
-    return info;
+    NSTimeInterval time = IOPSGetTimeRemainingEstimate();
+    if (kIOPSTimeRemainingUnknown == time)
+        time = NAN;
+    else if (kIOPSTimeRemainingUnlimited == time)
+        time = +INFINITY;
+    state.remainingTime = time;
+
+    [_state update:&state fields:~0ULL];
 }
 @end
-
-NSString *PowerStatusACPower = @kIOPMACPowerKey;
-NSString *PowerStatusBatteryPower = @kIOPMBatteryPowerKey;
-NSString *PowerStatusUPSPower = @kIOPMUPSPowerKey;
-NSString *PowerStatusSourceState = @kIOPSPowerSourceStateKey;
-NSString *PowerStatusCurrentCapacity = @kIOPSCurrentCapacityKey;
-NSString *PowerStatusMaxCapacity = @kIOPSMaxCapacityKey;
-NSString *PowerStatusIsCharging = @kIOPSIsChargingKey;
-NSString *PowerStatusIsCharged = @kIOPSIsChargedKey;
-
-NSString *PowerStatusNotification = @"PowerStatus";
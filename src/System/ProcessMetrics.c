@@ -0,0 +1,303 @@
+/**
+ * @file ProcessMetrics.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "ProcessMetrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <libproc.h>
+#include <mach/mach_time.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+/* a raised badge is lowered only once usage falls below this fraction of its threshold */
+#define ProcessMetricsCpuRelease        0.5
+#define ProcessMetricsMemoryRelease     0.9
+
+struct ProcessMetricsState
+{
+    pid_t pid;
+    unsigned badge;
+    uint64_t cpuTime;                   /* nanoseconds */
+    SystemMetricsHistory history;
+};
+
+struct ProcessMetrics
+{
+    ProcessMetricsThresholds thresholds;
+    /* states of the last sweep sorted by pid; the next sweep is built in spare */
+    struct ProcessMetricsState *states, *spare;
+    size_t count, capacity;
+    double time;
+    SystemMetricsCost cost;
+#if defined(__APPLE__)
+    mach_timebase_info_data_t timebase;
+#else
+    uint64_t tickNanos, pageSize;
+#endif
+};
+
+static double ProcessMetricsClock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int ProcessMetricsCompare(const void *a, const void *b)
+{
+    pid_t pa = ((const struct ProcessMetricsState *)a)->pid;
+    pid_t pb = ((const struct ProcessMetricsState *)b)->pid;
+    return pa < pb ? -1 : pa > pb ? +1 : 0;
+}
+
+static struct ProcessMetricsState *ProcessMetricsLookup(ProcessMetrics *metrics, pid_t pid)
+{
+    struct ProcessMetricsState key;
+    key.pid = pid;
+    return bsearch(&key, metrics->states, metrics->count, sizeof key, ProcessMetricsCompare);
+}
+
+#if defined(__APPLE__)
+static void ProcessMetricsInit(ProcessMetrics *metrics)
+{
+    mach_timebase_info(&metrics->timebase);
+}
+
+static bool ProcessMetricsRead(ProcessMetrics *metrics, pid_t pid,
+    uint64_t *cpuTime, uint64_t *memory)
+{
+    struct proc_taskinfo info;
+
+    if ((int)sizeof info != proc_pidinfo(pid, PROC_PIDTASKINFO, 0, &info, sizeof info))
+        return false;
+
+    /* task times are in mach absolute time units, which are not nanoseconds on arm64 */
+    *cpuTime = (info.pti_total_user + info.pti_total_system) *
+        metrics->timebase.numer / metrics->timebase.denom;
+    *memory = info.pti_resident_size;
+
+    return true;
+}
+#else
+static void ProcessMetricsInit(ProcessMetrics *metrics)
+{
+    long ticks = sysconf(_SC_CLK_TCK);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    metrics->tickNanos = 0 < ticks ? 1000000000 / (uint64_t)ticks : 10000000;
+    metrics->pageSize = 0 < pageSize ? (uint64_t)pageSize : 4096;
+}
+
+static bool ProcessMetricsRead(ProcessMetrics *metrics, pid_t pid,
+    uint64_t *cpuTime, uint64_t *memory)
+{
+    char path[32], buf[1024];
+    const char *p;
+    char *endp;
+    uint64_t utime = 0, stime = 0, rss = 0;
+    ssize_t bytes;
+    int fd;
+
+    snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        return false;
+    bytes = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (0 >= bytes)
+        return false;
+    buf[bytes] = '\0';
+
+    /* pid (comm) state ppid ...: comm may contain anything, so count fields from its end */
+    p = strrchr(buf, ')');
+    if (0 == p)
+        return false;
+    p++;
+    for (unsigned field = 3; 24 >= field; field++)
+    {
+        while (' ' == *p)
+            p++;
+        if ('\0' == *p)
+            return false;
+        if (14 == field)
+            utime = strtoull(p, &endp, 10);
+        else if (15 == field)
+            stime = strtoull(p, &endp, 10);
+        else if (24 == field)
+            rss = strtoull(p, &endp, 10);
+        while (' ' != *p && '\0' != *p)
+            p++;
+    }
+
+    *cpuTime = (utime + stime) * metrics->tickNanos;
+    *memory = rss * metrics->pageSize;
+
+    return true;
+}
+#endif
+
+ProcessMetrics *ProcessMetricsCreate(const ProcessMetricsThresholds *thresholds)
+{
+    ProcessMetrics *metrics;
+
+    metrics = calloc(1, sizeof *metrics);
+    if (0 == metrics)
+        return 0;
+
+    metrics->thresholds = *thresholds;
+    metrics->time = ProcessMetricsClock(CLOCK_MONOTONIC);
+    ProcessMetricsInit(metrics);
+
+    return metrics;
+}
+
+void ProcessMetricsDelete(ProcessMetrics *metrics)
+{
+    if (0 == metrics)
+        return;
+
+    free(metrics->states);
+    free(metrics->spare);
+    free(metrics);
+}
+
+void ProcessMetricsSetThresholds(ProcessMetrics *metrics, const ProcessMetricsThresholds *thresholds)
+{
+    metrics->thresholds = *thresholds;
+}
+
+static unsigned ProcessMetricsSelectBadge(const ProcessMetricsThresholds *thresholds,
+    unsigned badge, double cpu, uint64_t memory)
+{
+    if (0 < thresholds->cpu &&
+        (thresholds->cpu <= cpu ||
+            (ProcessMetricsBadgeCpu == badge && thresholds->cpu * ProcessMetricsCpuRelease <= cpu)))
+        return ProcessMetricsBadgeCpu;
+    if (0 < thresholds->memory &&
+        (thresholds->memory <= memory ||
+            (ProcessMetricsBadgeMemory == badge &&
+                thresholds->memory * ProcessMetricsMemoryRelease <= memory)))
+        return ProcessMetricsBadgeMemory;
+    return ProcessMetricsBadgeNone;
+}
+
+size_t ProcessMetricsSample(ProcessMetrics *metrics,
+    const pid_t *pids, size_t count, ProcessMetricsEntry *entries)
+{
+    double cpuTime = ProcessMetricsClock(CLOCK_THREAD_CPUTIME_ID);
+    double time = ProcessMetricsClock(CLOCK_MONOTONIC);
+    double elapsed = time - metrics->time;
+    struct ProcessMetricsState *states, *state, *last;
+    size_t stateCount = 0, changedCount = 0;
+
+    memset(entries, 0, count * sizeof *entries);
+    for (size_t i = 0; count > i; i++)
+        entries[i].pid = pids[i];
+
+    if (metrics->capacity < count)
+    {
+        states = realloc(metrics->spare, count * sizeof *states);
+        if (0 == states)
+            goto exit;
+        metrics->spare = states;
+        states = malloc(count * sizeof *states);
+        if (0 == states)
+            goto exit;
+        /* keep the last sweep: it is needed to compute this one */
+        if (0 != metrics->count)
+            memcpy(states, metrics->states, metrics->count * sizeof *states);
+        free(metrics->states);
+        metrics->states = states;
+        metrics->capacity = count;
+    }
+    states = metrics->spare;
+
+    for (size_t i = 0; count > i; i++)
+    {
+        ProcessMetricsEntry *entry = &entries[i];
+        uint64_t processTime, memory;
+
+        last = ProcessMetricsLookup(metrics, pids[i]);
+
+        if (!ProcessMetricsRead(metrics, pids[i], &processTime, &memory))
+        {
+            /* exited (or not ours to look at): any badge it had goes away */
+            entry->changed = 0 != last && ProcessMetricsBadgeNone != last->badge;
+            changedCount += entry->changed;
+            continue;
+        }
+
+        state = &states[stateCount++];
+        if (0 != last)
+        {
+            *state = *last;
+            if (0 < elapsed && processTime >= state->cpuTime)
+                entry->cpu = (processTime - state->cpuTime) * 1e-9 / elapsed;
+            SystemMetricsHistoryPush(&state->history,
+                (unsigned)((1 < entry->cpu ? 1 : entry->cpu) * SystemMetricsLevelMax + 0.5));
+        }
+        else
+        {
+            memset(state, 0, sizeof *state);
+            state->pid = pids[i];
+        }
+        state->cpuTime = processTime;
+
+        entry->memory = memory;
+        entry->badge = ProcessMetricsSelectBadge(&metrics->thresholds, state->badge,
+            entry->cpu, memory);
+        entry->changed = state->badge != entry->badge;
+        changedCount += entry->changed;
+        state->badge = entry->badge;
+    }
+
+    /* sort for lookups; a pid listed twice is only kept once */
+    qsort(states, stateCount, sizeof *states, ProcessMetricsCompare);
+    size_t uniqueCount = 0;
+    for (size_t i = 0; stateCount > i; i++)
+        if (0 == uniqueCount || states[uniqueCount - 1].pid != states[i].pid)
+            states[uniqueCount++] = states[i];
+
+    metrics->spare = metrics->states;
+    metrics->states = states;
+    metrics->count = uniqueCount;
+    metrics->time = time;
+
+exit:
+    metrics->cost.count++;
+    metrics->cost.time += ProcessMetricsClock(CLOCK_THREAD_CPUTIME_ID) - cpuTime;
+
+    return changedCount;
+}
+
+unsigned ProcessMetricsBadge(ProcessMetrics *metrics, pid_t pid)
+{
+    struct ProcessMetricsState *state = ProcessMetricsLookup(metrics, pid);
+    return 0 != state ? state->badge : ProcessMetricsBadgeNone;
+}
+
+size_t ProcessMetricsHistory(ProcessMetrics *metrics, pid_t pid, uint8_t *levels, size_t count)
+{
+    struct ProcessMetricsState *state = ProcessMetricsLookup(metrics, pid);
+    return 0 != state ? SystemMetricsHistoryGet(&state->history, levels, count) : 0;
+}
+
+void ProcessMetricsGetCost(ProcessMetrics *metrics, SystemMetricsCost *cost)
+{
+    *cost = metrics->cost;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file ProcessMetrics.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef PROCESSMETRICS_H_INCLUDED
+#define PROCESSMETRICS_H_INCLUDED
+
+#include "SystemMetrics.h"
+#include <sys/types.h>
+
+/*
+ * Per-process CPU and memory for a set of processes (e.g. the running apps in
+ * the Dock), collected in one sweep per call: proc_pidinfo on macOS and
+ * /proc/<pid>/stat elsewhere. Each process keeps a SystemMetricsHistory of its
+ * CPU level and a badge that is raised when its CPU or resident memory crosses
+ * a threshold. The CPU badge is lowered only when usage falls well below its
+ * threshold, so that a process hovering at the threshold does not flicker.
+ *
+ * A sweep reports which badges changed; callers redraw only those. Processes
+ * that are not part of a sweep (or that have exited) are forgotten. CPU usage
+ * is computed against the previous sweep; a process seen for the first time
+ * reports no CPU usage. A ProcessMetrics is not thread-safe.
+ */
+typedef struct ProcessMetrics ProcessMetrics;
+
+enum
+{
+    ProcessMetricsBadgeNone = 0,
+    ProcessMetricsBadgeCpu,
+    ProcessMetricsBadgeMemory,
+};
+
+typedef struct
+{
+    double cpu;                         /* fraction of one core; badge at or above */
+    uint64_t memory;                    /* resident bytes; badge at or above */
+} ProcessMetricsThresholds;
+
+typedef struct
+{
+    pid_t pid;
+    double cpu;                         /* fraction of one core; may exceed 1 */
+    uint64_t memory;                    /* resident bytes */
+    unsigned badge;                     /* ProcessMetricsBadge* */
+    bool changed;                       /* badge differs from the previous sweep */
+} ProcessMetricsEntry;
+
+ProcessMetrics *ProcessMetricsCreate(const ProcessMetricsThresholds *thresholds);
+void ProcessMetricsDelete(ProcessMetrics *metrics);
+void ProcessMetricsSetThresholds(ProcessMetrics *metrics, const ProcessMetricsThresholds *thresholds);
+size_t ProcessMetricsSample(ProcessMetrics *metrics,
+    const pid_t *pids, size_t count, ProcessMetricsEntry *entries);
+unsigned ProcessMetricsBadge(ProcessMetrics *metrics, pid_t pid);
+size_t ProcessMetricsHistory(ProcessMetrics *metrics, pid_t pid, uint8_t *levels, size_t count);
+void ProcessMetricsGetCost(ProcessMetrics *metrics, SystemMetricsCost *cost);
+
+#endif
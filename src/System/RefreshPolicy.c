@@ -0,0 +1,277 @@
+/**
+ * @file RefreshPolicy.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "RefreshPolicy.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RefreshPolicyMaxTimers          32
+
+struct RefreshPolicyTimer
+{
+    char name[RefreshPolicyTimerNameMax];
+    double interval;
+    unsigned feature;
+    bool scaled;
+};
+
+static const char *profileNames[RefreshProfileCount] =
+{
+    "AC",
+    "Battery",
+    "LowPower",
+    "Thermal",
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static RefreshProfileInfo profiles[RefreshProfileCount] =
+{
+    [RefreshProfileAC] = { 1, 0, RefreshFeatureAll },
+    [RefreshProfileBattery] = { 2, 0.5,
+        RefreshFeatureHover | RefreshFeatureThumbnails | RefreshFeatureLocation },
+    [RefreshProfileLowPower] = { 4, 2, 0 },
+    [RefreshProfileThermal] = { 4, 2, RefreshFeatureLocation },
+};
+static RefreshProfile currentProfile = RefreshProfileAC;
+static struct RefreshPolicyTimer timers[RefreshPolicyMaxTimers];
+static size_t timerCount;
+
+const char *RefreshProfileName(RefreshProfile profile)
+{
+    return RefreshProfileCount > (unsigned)profile ? profileNames[profile] : "?";
+}
+
+RefreshProfile RefreshProfileFromName(const char *name)
+{
+    for (unsigned i = 0; RefreshProfileCount > i; i++)
+        if (0 == strcmp(profileNames[i], name))
+            return (RefreshProfile)i;
+    return RefreshProfileCount;
+}
+
+void RefreshProfileGetInfo(RefreshProfile profile, RefreshProfileInfo *info)
+{
+    pthread_mutex_lock(&mutex);
+    *info = profiles[RefreshProfileCount > (unsigned)profile ? profile : RefreshProfileAC];
+    pthread_mutex_unlock(&mutex);
+}
+
+void RefreshProfileSetInfo(RefreshProfile profile, const RefreshProfileInfo *info)
+{
+    if (RefreshProfileCount <= (unsigned)profile)
+        return;
+
+    pthread_mutex_lock(&mutex);
+    profiles[profile].scale = 1 <= info->scale ? info->scale : 1;
+    profiles[profile].coalesce = 0 <= info->coalesce ? info->coalesce : 0;
+    profiles[profile].features = info->features & RefreshFeatureAll;
+    pthread_mutex_unlock(&mutex);
+}
+
+RefreshProfile RefreshPolicySelect(const RefreshPolicyState *state)
+{
+    /* heat is the most urgent input, then the user's explicit low power choice */
+    if (RefreshThermalSerious <= state->thermal)
+        return RefreshProfileThermal;
+    if (state->lowPower)
+        return RefreshProfileLowPower;
+    if (state->onBattery)
+        return RefreshProfileBattery;
+    return RefreshProfileAC;
+}
+
+bool RefreshPolicyUpdate(const RefreshPolicyState *state)
+{
+    RefreshProfile profile = RefreshPolicySelect(state);
+    bool changed;
+
+    pthread_mutex_lock(&mutex);
+    changed = currentProfile != profile;
+    currentProfile = profile;
+    pthread_mutex_unlock(&mutex);
+
+    return changed;
+}
+
+RefreshProfile RefreshPolicyGetProfile(void)
+{
+    RefreshProfile profile;
+
+    pthread_mutex_lock(&mutex);
+    profile = currentProfile;
+    pthread_mutex_unlock(&mutex);
+
+    return profile;
+}
+
+double RefreshPolicyInterval(double interval)
+{
+    double scale;
+
+    pthread_mutex_lock(&mutex);
+    scale = profiles[currentProfile].scale;
+    pthread_mutex_unlock(&mutex);
+
+    return interval * scale;
+}
+
+double RefreshPolicyCoalesceDelay(void)
+{
+    double coalesce;
+
+    pthread_mutex_lock(&mutex);
+    coalesce = profiles[currentProfile].coalesce;
+    pthread_mutex_unlock(&mutex);
+
+    return coalesce;
+}
+
+bool RefreshPolicyEnabled(unsigned feature)
+{
+    unsigned features;
+
+    pthread_mutex_lock(&mutex);
+    features = profiles[currentProfile].features;
+    pthread_mutex_unlock(&mutex);
+
+    return feature == (features & feature);
+}
+
+static struct RefreshPolicyTimer *RefreshPolicyTimerLookup(const char *name)
+{
+    for (size_t i = 0; timerCount > i; i++)
+        if (0 == strncmp(timers[i].name, name, RefreshPolicyTimerNameMax - 1))
+            return &timers[i];
+    return 0;
+}
+
+void RefreshPolicyTimerSet(const char *name, double interval, unsigned feature, bool scaled)
+{
+    struct RefreshPolicyTimer *timer;
+
+    if (0 >= interval)
+    {
+        RefreshPolicyTimerClear(name);
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    timer = RefreshPolicyTimerLookup(name);
+    if (0 == timer)
+    {
+        /* past the limit timers go unreported rather than fail */
+        if (RefreshPolicyMaxTimers == timerCount)
+            goto exit;
+
+        timer = &timers[timerCount++];
+        strncpy(timer->name, name, RefreshPolicyTimerNameMax - 1);
+    }
+
+    timer->interval = interval;
+    timer->feature = feature;
+    timer->scaled = scaled;
+
+exit:
+    pthread_mutex_unlock(&mutex);
+}
+
+void RefreshPolicyTimerClear(const char *name)
+{
+    struct RefreshPolicyTimer *timer;
+
+    pthread_mutex_lock(&mutex);
+
+    timer = RefreshPolicyTimerLookup(name);
+    if (0 != timer)
+        *timer = timers[--timerCount];
+
+    pthread_mutex_unlock(&mutex);
+}
+
+static double RefreshPolicyTimerWakeups(const struct RefreshPolicyTimer *timer,
+    const RefreshProfileInfo *info)
+{
+    if (timer->feature != (info->features & timer->feature))
+        return 0;
+    return 3600 / (timer->scaled ? timer->interval * info->scale : timer->interval);
+}
+
+double RefreshPolicyWakeupsPerHour(RefreshProfile profile)
+{
+    double wakeups = 0;
+
+    if (RefreshProfileCount <= (unsigned)profile)
+        return 0;
+
+    pthread_mutex_lock(&mutex);
+    for (size_t i = 0; timerCount > i; i++)
+        wakeups += RefreshPolicyTimerWakeups(&timers[i], &profiles[profile]);
+    pthread_mutex_unlock(&mutex);
+
+    return wakeups;
+}
+
+size_t RefreshPolicyFormat(char *buf, size_t size)
+{
+    RefreshProfileInfo infos[RefreshProfileCount];
+    struct RefreshPolicyTimer copy[RefreshPolicyMaxTimers];
+    double totals[RefreshProfileCount] = { 0 };
+    RefreshProfile profile;
+    size_t count, length = 0;
+    int n;
+
+    pthread_mutex_lock(&mutex);
+    memcpy(infos, profiles, sizeof infos);
+    count = timerCount;
+    memcpy(copy, timers, count * sizeof copy[0]);
+    profile = currentProfile;
+    pthread_mutex_unlock(&mutex);
+
+#define APPEND(...)                     \
+    do                                  \
+    {                                   \
+        n = snprintf(length < size ? buf + length : 0, length < size ? size - length : 0,\
+            __VA_ARGS__);               \
+        if (0 < n)                      \
+            length += (size_t)n;        \
+    } while (0)
+
+    APPEND("Wakeups/hour by profile (current: %s)\n", RefreshProfileName(profile));
+    APPEND("%-16s %10s", "Timer", "Interval");
+    for (unsigned p = 0; RefreshProfileCount > p; p++)
+        APPEND(" %10s", profileNames[p]);
+    APPEND("\n");
+
+    for (size_t i = 0; count > i; i++)
+    {
+        APPEND("%-16s %9.2fs", copy[i].name, copy[i].interval);
+        for (unsigned p = 0; RefreshProfileCount > p; p++)
+        {
+            double wakeups = RefreshPolicyTimerWakeups(&copy[i], &infos[p]);
+            totals[p] += wakeups;
+            APPEND(" %10.1f", wakeups);
+        }
+        APPEND("\n");
+    }
+
+    APPEND("%-16s %10s", "Total", "");
+    for (unsigned p = 0; RefreshProfileCount > p; p++)
+        APPEND(" %10.1f", totals[p]);
+    APPEND("\n");
+
+#undef APPEND
+
+    return length;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file RefreshPolicy.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef REFRESHPOLICY_H_INCLUDED
+#define REFRESHPOLICY_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Power-aware refresh policy. The power source, low power mode and thermal
+ * state select one of a fixed set of named profiles. A profile stretches the
+ * intervals of periodic refreshes, sets how long bursts of event driven work
+ * are coalesced and enables optional features (hover tracking, thumbnails...).
+ *
+ * Widgets register their periodic timers while they are scheduled, so that
+ * the wakeups per hour of every profile can be estimated for the timers that
+ * are actually running.
+ *
+ * The policy is process-wide and all functions are thread-safe.
+ */
+typedef enum
+{
+    RefreshProfileAC = 0,
+    RefreshProfileBattery,
+    RefreshProfileLowPower,
+    RefreshProfileThermal,
+    RefreshProfileCount,
+} RefreshProfile;
+
+enum
+{
+    RefreshFeatureHover                 = 0x0001,   /* edge window hover tracking */
+    RefreshFeatureThumbnails            = 0x0002,   /* Quick Look thumbnails in folders */
+    RefreshFeatureLocation              = 0x0004,   /* new location fix per weather refresh */
+    RefreshFeatureBatteryPolling        = 0x0008,   /* battery queries on clock ticks */
+    RefreshFeatureAll                   = 0x000f,
+};
+
+enum
+{
+    RefreshThermalNominal = 0,
+    RefreshThermalFair,
+    RefreshThermalSerious,
+    RefreshThermalCritical,
+};
+
+typedef struct
+{
+    bool onBattery;
+    bool lowPower;
+    int thermal;                        /* RefreshThermal* */
+} RefreshPolicyState;
+
+typedef struct
+{
+    double scale;                       /* interval multiplier */
+    double coalesce;                    /* seconds to coalesce event driven work */
+    unsigned features;                  /* RefreshFeature* */
+} RefreshProfileInfo;
+
+#define RefreshPolicyTimerNameMax       32
+
+const char *RefreshProfileName(RefreshProfile profile);
+RefreshProfile RefreshProfileFromName(const char *name);
+void RefreshProfileGetInfo(RefreshProfile profile, RefreshProfileInfo *info);
+void RefreshProfileSetInfo(RefreshProfile profile, const RefreshProfileInfo *info);
+
+RefreshProfile RefreshPolicySelect(const RefreshPolicyState *state);
+bool RefreshPolicyUpdate(const RefreshPolicyState *state);
+RefreshProfile RefreshPolicyGetProfile(void);
+double RefreshPolicyInterval(double interval);
+double RefreshPolicyCoalesceDelay(void);
+bool RefreshPolicyEnabled(unsigned feature);
+
+void RefreshPolicyTimerSet(const char *name, double interval, unsigned feature, bool scaled);
+void RefreshPolicyTimerClear(const char *name);
+double RefreshPolicyWakeupsPerHour(RefreshProfile profile);
+size_t RefreshPolicyFormat(char *buf, size_t size);
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * @file RefreshPolicyMonitor.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "RefreshPolicy.h"
+
+@interface RefreshPolicyMonitor : NSObject
++ (RefreshPolicyMonitor *)sharedInstance;
+- (void)resetProfiles:(NSDictionary *)dict;
+- (void)update;
+@end
+
+extern NSString *RefreshPolicyNotification;
@@ -0,0 +1,166 @@
+/**
+ * @file RefreshPolicyMonitor.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "RefreshPolicyMonitor.h"
+#import "Log.h"
+#import "PowerStatus.h"
+
+static struct
+{
+    NSString *key;
+    unsigned feature;
+} RefreshPolicyFeatureKeys[] =
+{
+    { @"hover", RefreshFeatureHover },
+    { @"thumbnails", RefreshFeatureThumbnails },
+    { @"location", RefreshFeatureLocation },
+    { @"batteryPolling", RefreshFeatureBatteryPolling },
+};
+
+@implementation RefreshPolicyMonitor
++ (RefreshPolicyMonitor *)sharedInstance
+{
+    static RefreshPolicyMonitor *instance = 0;
+    if (0 == instance)
+        instance = [[RefreshPolicyMonitor alloc] init];
+    return instance;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    [[PowerStatus sharedInstance].state
+        addObserver:self
+        selector:@selector(powerStatusChange:)
+        fields:PowerStatusFieldSource];
+    if (@available(macOS 12.0, *))
+        [[NSNotificationCenter defaultCenter]
+            addObserver:self
+            selector:@selector(inputsChange:)
+            name:NSProcessInfoPowerStateDidChangeNotification
+            object:nil];
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(inputsChange:)
+        name:NSProcessInfoThermalStateDidChangeNotification
+        object:nil];
+
+    [self update];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [[PowerStatus sharedInstance].state removeObserver:self];
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [super dealloc];
+}
+
+- (void)resetProfiles:(NSDictionary *)dict
+{
+    /* profile name to overrides, e.g. Battery = { scale = 3; hover = NO; } */
+    for (NSString *name in dict)
+    {
+        NSDictionary *overrides = [dict objectForKey:name];
+        RefreshProfile profile = RefreshProfileFromName(name.UTF8String);
+        if (RefreshProfileCount == profile || ![overrides isKindOfClass:[NSDictionary class]])
+            continue;
+
+        RefreshProfileInfo info;
+        RefreshProfileGetInfo(profile, &info);
+
+        id value = [overrides objectForKey:@"scale"];
+        if ([value respondsToSelector:@selector(doubleValue)])
+            info.scale = [value doubleValue];
+        value = [overrides objectForKey:@"coalesce"];
+        if ([value respondsToSelector:@selector(doubleValue)])
+            info.coalesce = [value doubleValue];
+        for (size_t i = 0; sizeof RefreshPolicyFeatureKeys / sizeof RefreshPolicyFeatureKeys[0] > i; i++)
+        {
+            value = [overrides objectForKey:RefreshPolicyFeatureKeys[i].key];
+            if (![value respondsToSelector:@selector(boolValue)])
+                continue;
+            if ([value boolValue])
+                info.features |= RefreshPolicyFeatureKeys[i].feature;
+            else
+                info.features &= ~RefreshPolicyFeatureKeys[i].feature;
+        }
+
+        RefreshProfileSetInfo(profile, &info);
+    }
+
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:RefreshPolicyNotification
+        object:self];
+}
+
+- (void)inputsChange:(NSNotification *)notification
+{
+    /* NSProcessInfo notifications are posted on arbitrary threads */
+    [self
+        performSelectorOnMainThread:@selector(update)
+        withObject:nil
+        waitUntilDone:NO];
+}
+
+- (void)powerStatusChange:(ServiceState *)state
+{
+    [self update];
+}
+
+- (void)update
+{
+    NSProcessInfo *processInfo = [NSProcessInfo processInfo];
+    RefreshPolicyState state;
+    PowerStatusState powerStatus;
+    [[PowerStatus sharedInstance].state read:&powerStatus];
+    state.onBattery = PowerStatusSourceBattery == powerStatus.source;
+    state.lowPower = false;
+    if (@available(macOS 12.0, *))
+        state.lowPower = processInfo.lowPowerModeEnabled;
+    switch (processInfo.thermalState)
+    {
+    case NSProcessInfoThermalStateFair:
+        state.thermal = RefreshThermalFair;
+        break;
+    case NSProcessInfoThermalStateSerious:
+        state.thermal = RefreshThermalSerious;
+        break;
+    case NSProcessInfoThermalStateCritical:
+        state.thermal = RefreshThermalCritical;
+        break;
+    default:
+        state.thermal = RefreshThermalNominal;
+        break;
+    }
+
+    if (!RefreshPolicyUpdate(&state))
+        return;
+
+    RefreshProfile profile = RefreshPolicyGetProfile();
+    LOG("refresh profile %{public}s (%.0f wakeups/hour)",
+        RefreshProfileName(profile), RefreshPolicyWakeupsPerHour(profile));
+
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:RefreshPolicyNotification
+        object:self];
+}
+@end
+
+NSString *RefreshPolicyNotification = @"RefreshPolicy";
@@ -0,0 +1,257 @@
+/**
+ * @file ResourceAccounting.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "ResourceAccounting.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+#define ResourceAccountingMaxCount      64
+
+struct ResourceAccount
+{
+    ResourceAccountStats stats;
+    uint64_t runs;                      /* ShouldRun calls */
+    double windowStart, windowCpuTime;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ResourceAccount accounts[ResourceAccountingMaxCount];
+static size_t accountCount;
+
+#if defined(__APPLE__)
+static void ResourceAccountingMallocZoneProbe(uint64_t *blocks, uint64_t *bytes)
+{
+    malloc_statistics_t stats;
+    malloc_zone_statistics(0, &stats);
+    *blocks = stats.blocks_in_use;
+    *bytes = stats.size_in_use;
+}
+static ResourceAccountingHeapProbe defaultHeapProbe = ResourceAccountingMallocZoneProbe;
+#else
+static ResourceAccountingHeapProbe defaultHeapProbe;
+#endif
+static ResourceAccountingHeapProbe heapProbe;  /* off unless enabled */
+
+static double ResourceAccountingClock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void ResourceAccountingSetHeapProbe(ResourceAccountingHeapProbe probe)
+{
+    __atomic_store_n(&heapProbe, probe, __ATOMIC_RELEASE);
+}
+
+bool ResourceAccountingEnableHeapProbe(bool enable)
+{
+    ResourceAccountingSetHeapProbe(enable ? defaultHeapProbe : 0);
+    return !enable || 0 != defaultHeapProbe;
+}
+
+ResourceAccount *ResourceAccountGet(const char *name)
+{
+    ResourceAccount *account = 0;
+
+    pthread_mutex_lock(&mutex);
+
+    for (size_t i = 0; accountCount > i; i++)
+        if (0 == strncmp(accounts[i].stats.name, name, ResourceAccountNameMax - 1))
+        {
+            account = &accounts[i];
+            goto exit;
+        }
+
+    /* past the limit, accounts share the last slot rather than fail */
+    if (ResourceAccountingMaxCount == accountCount)
+    {
+        account = &accounts[ResourceAccountingMaxCount - 1];
+        goto exit;
+    }
+
+    account = &accounts[accountCount++];
+    strncpy(account->stats.name, name, ResourceAccountNameMax - 1);
+    account->stats.throttle = 1;
+    account->windowStart = ResourceAccountingClock(CLOCK_MONOTONIC);
+
+exit:
+    pthread_mutex_unlock(&mutex);
+
+    return account;
+}
+
+void ResourceAccountSetBudget(ResourceAccount *account, double budget)
+{
+    pthread_mutex_lock(&mutex);
+    account->stats.budget = 0 < budget ? budget : 0;
+    if (0 == account->stats.budget)
+        account->stats.throttle = 1;
+    pthread_mutex_unlock(&mutex);
+}
+
+bool ResourceAccountShouldRun(ResourceAccount *account)
+{
+    bool res;
+
+    pthread_mutex_lock(&mutex);
+    res = 0 == account->runs++ % account->stats.throttle;
+    if (!res)
+        account->stats.skipped++;
+    pthread_mutex_unlock(&mutex);
+
+    return res;
+}
+
+void ResourceAccountBegin(ResourceAccount *account, ResourceSpan *span)
+{
+    /* without a heap probe a span is a single clock read at each end */
+    ResourceAccountingHeapProbe probe = __atomic_load_n(&heapProbe, __ATOMIC_ACQUIRE);
+
+    span->account = account;
+    span->heapBlocks = span->heapBytes = 0;
+    span->heapProbe = probe;
+
+    if (0 != probe)
+        probe(&span->heapBlocks, &span->heapBytes);
+
+    span->cpuTime = ResourceAccountingClock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void ResourceAccountEnd(ResourceSpan *span)
+{
+    ResourceAccount *account = span->account;
+    ResourceAccountingHeapProbe probe = span->heapProbe;
+    uint64_t heapBlocks = 0, heapBytes = 0;
+    double cpuTime = ResourceAccountingClock(CLOCK_THREAD_CPUTIME_ID) - span->cpuTime;
+    double now = ResourceAccountingClock(CLOCK_MONOTONIC);
+
+    if (0 != probe)
+        probe(&heapBlocks, &heapBytes);
+
+    pthread_mutex_lock(&mutex);
+
+    account->stats.wakeups++;
+    account->stats.cpuTime += cpuTime;
+    if (0 != probe)
+    {
+        if (heapBlocks > span->heapBlocks)
+            account->stats.allocations += heapBlocks - span->heapBlocks;
+        account->stats.bytes += (int64_t)(heapBytes - span->heapBytes);
+    }
+
+    account->windowCpuTime += cpuTime;
+    double elapsed = now - account->windowStart;
+    if (ResourceAccountWindow <= elapsed)
+    {
+        double budget = account->stats.budget;
+        account->stats.usage = account->windowCpuTime / elapsed;
+        if (0 < budget && budget < account->stats.usage)
+        {
+            if (ResourceAccountMaxThrottle > account->stats.throttle)
+                account->stats.throttle *= 2;
+        }
+        else if (budget / 2 > account->stats.usage || 0 == budget)
+        {
+            if (1 < account->stats.throttle)
+                account->stats.throttle /= 2;
+        }
+        account->windowStart = now;
+        account->windowCpuTime = 0;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+size_t ResourceAccountingGetStats(ResourceAccountStats *stats, size_t count)
+{
+    pthread_mutex_lock(&mutex);
+    if (accountCount < count)
+        count = accountCount;
+    for (size_t i = 0; count > i; i++)
+        stats[i] = accounts[i].stats;
+    pthread_mutex_unlock(&mutex);
+
+    return count;
+}
+
+size_t ResourceAccountingFormat(char *buf, size_t size)
+{
+    ResourceAccountStats stats[ResourceAccountingMaxCount];
+    size_t count = ResourceAccountingGetStats(stats, ResourceAccountingMaxCount);
+    size_t length = 0;
+    int n;
+
+#define APPEND(...)                     \
+    do                                  \
+    {                                   \
+        n = snprintf(length < size ? buf + length : 0, length < size ? size - length : 0,\
+            __VA_ARGS__);               \
+        if (0 < n)                      \
+            length += (size_t)n;        \
+    } while (0)
+
+    APPEND("%-16s %8s %8s %10s %10s %12s %7s %7s %4s\n",
+        "Widget", "Wakeups", "Skipped", "CPU (ms)", "Allocs", "Bytes", "Budget", "Usage", "Div");
+    for (size_t i = 0; count > i; i++)
+        APPEND("%-16s %8llu %8llu %10.1f %10llu %12lld %6.2f%% %6.3f%% %4u\n",
+            stats[i].name,
+            (unsigned long long)stats[i].wakeups,
+            (unsigned long long)stats[i].skipped,
+            stats[i].cpuTime * 1000,
+            (unsigned long long)stats[i].allocations,
+            (long long)stats[i].bytes,
+            stats[i].budget * 100,
+            stats[i].usage * 100,
+            stats[i].throttle);
+
+#undef APPEND
+
+    return length;
+}
+
+bool ResourceAccountingDump(const char *path)
+{
+    bool res = false;
+    char *buf = 0;
+    FILE *file = 0;
+    size_t size, n;
+
+    size = ResourceAccountingFormat(0, 0) + 1;
+    buf = malloc(size);
+    if (0 == buf)
+        goto exit;
+    n = ResourceAccountingFormat(buf, size);
+    size = n < size ? n : size - 1;
+
+    file = fopen(path, "w");
+    if (0 == file)
+        goto exit;
+
+    res = size == fwrite(buf, 1, size, file);
+
+exit:
+    if (0 != file && 0 != fclose(file))
+        res = false;
+
+    free(buf);
+
+    return res;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file ResourceAccounting.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef RESOURCEACCOUNTING_H_INCLUDED
+#define RESOURCEACCOUNTING_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-widget resource accounts. A widget brackets its callbacks (timer ticks,
+ * background refreshes) with ResourceAccountBegin/End; each span counts as one
+ * wakeup and adds the thread CPU time it used. Heap usage is sampled only when
+ * a heap probe is enabled: the probe is process-wide (malloc zone statistics on
+ * macOS walk every zone), so it costs more than the span it measures and it
+ * also attributes allocations made by other threads during a span.
+ *
+ * An account may have a CPU budget (fraction of one CPU, averaged over a
+ * window). While an account is over budget, ResourceAccountShouldRun lets only
+ * every Nth refresh through; N doubles each window the budget is exceeded and
+ * halves each window usage is below half the budget.
+ *
+ * Accounts are created on first use and live for the life of the process.
+ * All functions are thread-safe.
+ */
+#define ResourceAccountNameMax          32
+#if !defined(ResourceAccountWindow)
+#define ResourceAccountWindow           60.0    /* seconds; tests build with a shorter one */
+#endif
+#define ResourceAccountMaxThrottle      16
+
+typedef struct ResourceAccount ResourceAccount;
+typedef void (*ResourceAccountingHeapProbe)(uint64_t *blocks, uint64_t *bytes);
+
+typedef struct
+{
+    ResourceAccount *account;
+    double cpuTime;
+    ResourceAccountingHeapProbe heapProbe;  /* probe at Begin; 0 if none */
+    uint64_t heapBlocks, heapBytes;
+} ResourceSpan;
+
+typedef struct
+{
+    char name[ResourceAccountNameMax];
+    uint64_t wakeups, skipped;
+    double cpuTime;                     /* seconds */
+    uint64_t allocations;               /* blocks by which spans grew the heap */
+    int64_t bytes;                      /* net bytes retained by spans */
+    double budget;                      /* CPU fraction; 0 for none */
+    double usage;                       /* CPU fraction over the last window */
+    unsigned throttle;                  /* refresh divisor; 1 for full rate */
+} ResourceAccountStats;
+
+void ResourceAccountingSetHeapProbe(ResourceAccountingHeapProbe probe);
+bool ResourceAccountingEnableHeapProbe(bool enable);
+ResourceAccount *ResourceAccountGet(const char *name);
+void ResourceAccountSetBudget(ResourceAccount *account, double budget);
+bool ResourceAccountShouldRun(ResourceAccount *account);
+void ResourceAccountBegin(ResourceAccount *account, ResourceSpan *span);
+void ResourceAccountEnd(ResourceSpan *span);
+size_t ResourceAccountingGetStats(ResourceAccountStats *stats, size_t count);
+size_t ResourceAccountingFormat(char *buf, size_t size);
+bool ResourceAccountingDump(const char *path);
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file ServiceState.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "StateStore.h"
+
+/*
+ * The typed state of a System service (a plain struct described by a StateStore
+ * field table). Services update it from any thread; readers on any thread get a
+ * consistent snapshot with -read:. Observers are called on the main thread at most
+ * once per frame, with the fields changed since their last call in -changedFields.
+ */
+@interface ServiceState : NSObject
+- (id)initWithSize:(size_t)size fields:(const StateStoreField *)fields count:(size_t)count
+    initial:(const void *)initial;
+- (uint64_t)update:(const void *)state fields:(uint64_t)fields;
+- (uint64_t)read:(void *)state;
+- (uint64_t)version;
+- (uint64_t)changedFields;
+- (void)addObserver:(id)observer selector:(SEL)sel fields:(uint64_t)fields;
+- (void)removeObserver:(id)observer;
+@end
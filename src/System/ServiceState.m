@@ -0,0 +1,129 @@
+/**
+ * @file ServiceState.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "ServiceState.h"
+
+static const NSTimeInterval frameInterval = 1.0 / 60;
+
+@interface ServiceStateObserver : NSObject
+@property (assign) id observer;
+@property (assign) SEL selector;
+@property (assign) uint64_t fields;
+@end
+
+@implementation ServiceStateObserver
+@end
+
+static void ServiceStateFlush(void *data);
+
+static void ServiceStateSchedule(void *data)
+{
+    /* called once per delta on the updating thread; the flush keeps the state alive */
+    [(id)data retain];
+    dispatch_after_f(
+        dispatch_time(DISPATCH_TIME_NOW, (int64_t)(frameInterval * NSEC_PER_SEC)),
+        dispatch_get_main_queue(),
+        data,
+        ServiceStateFlush);
+}
+
+@implementation ServiceState
+{
+    StateStore *_store;
+    NSMutableArray<ServiceStateObserver *> *_observers;
+    uint64_t _changedFields;
+}
+
+- (id)initWithSize:(size_t)size fields:(const StateStoreField *)fields count:(size_t)count
+    initial:(const void *)initial
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    _store = StateStoreCreate(size, fields, count, initial, ServiceStateSchedule, self);
+    if (0 == _store)
+    {
+        [self release];
+        return nil;
+    }
+
+    _observers = [[NSMutableArray alloc] init];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    StateStoreDelete(_store);
+    [_observers release];
+
+    [super dealloc];
+}
+
+- (uint64_t)update:(const void *)state fields:(uint64_t)fields
+{
+    return StateStoreUpdate(_store, state, fields);
+}
+
+- (uint64_t)read:(void *)state
+{
+    return StateStoreRead(_store, state);
+}
+
+- (uint64_t)version
+{
+    return StateStoreVersion(_store);
+}
+
+- (uint64_t)changedFields
+{
+    return _changedFields;
+}
+
+- (void)flush
+{
+    uint64_t changed = StateStoreFlush(_store, 0);
+    if (0 == changed)
+        return;
+
+    _changedFields = changed;
+    for (ServiceStateObserver *o in [[_observers copy] autorelease])
+        if (0 != (o.fields & changed))
+            [o.observer performSelector:o.selector withObject:self];
+    _changedFields = 0;
+}
+
+- (void)addObserver:(id)observer selector:(SEL)sel fields:(uint64_t)fields
+{
+    ServiceStateObserver *o = [[[ServiceStateObserver alloc] init] autorelease];
+    o.observer = observer;
+    o.selector = sel;
+    o.fields = fields;
+    [_observers addObject:o];
+}
+
+- (void)removeObserver:(id)observer
+{
+    for (NSUInteger index = _observers.count - 1; _observers.count > index; index--)
+        if ([_observers objectAtIndex:index].observer == observer)
+            [_observers removeObjectAtIndex:index];
+}
+@end
+
+static void ServiceStateFlush(void *data)
+{
+    ServiceState *state = data;
+    [state flush];
+    [state release];
+}
@@ -0,0 +1,61 @@
+/**
+ * @file StartupTimings.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "StartupTimings.h"
+#include <string.h>
+#include <time.h>
+
+#define StartupTimingsMaxCount          32
+
+static StartupTiming timings[StartupTimingsMaxCount];
+static size_t timingCount;
+static struct timespec startTime;
+
+void StartupTimingsMark(const char *phase)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (0 == timingCount)
+        startTime = now;
+
+    if (StartupTimingsMaxCount <= timingCount)
+        return;
+
+    timings[timingCount].phase = phase;
+    timings[timingCount].elapsed =
+        (double)(now.tv_sec - startTime.tv_sec) +
+        (double)(now.tv_nsec - startTime.tv_nsec) * 1e-9;
+    timingCount++;
+}
+
+size_t StartupTimingsGet(StartupTiming *buf, size_t count)
+{
+    if (timingCount < count)
+        count = timingCount;
+
+    for (size_t i = 0; count > i; i++)
+        buf[i] = timings[i];
+
+    return count;
+}
+
+double StartupTimingsElapsed(const char *phase)
+{
+    /* the first mark of the phase; -1 if it has not been reached */
+    for (size_t i = 0; timingCount > i; i++)
+        if (0 == strcmp(phase, timings[i].phase))
+            return timings[i].elapsed;
+
+    return -1;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file StartupTimings.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef STARTUPTIMINGS_H_INCLUDED
+#define STARTUPTIMINGS_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+ * Launch phase marks. The first mark starts the clock; phase names are not
+ * copied and must be string literals. Marks are made on the main thread.
+ */
+typedef struct
+{
+    const char *phase;
+    double elapsed;                     /* seconds since the first mark */
+} StartupTiming;
+
+void StartupTimingsMark(const char *phase);
+size_t StartupTimingsGet(StartupTiming *timings, size_t count);
+double StartupTimingsElapsed(const char *phase);
+
+#endif
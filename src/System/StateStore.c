@@ -0,0 +1,190 @@
+/**
+ * @file StateStore.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "StateStore.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct StateStore
+{
+    pthread_mutex_t mutex;
+    void (*schedule)(void *data);
+    void *data;
+    size_t size, wordCount, fieldCount;
+    StateStoreField fields[StateStoreFieldMax];
+    uint64_t pending;                   /* atomic; merged delta since the last flush */
+    uint64_t sequence;                  /* atomic; odd while a writer publishes */
+    StateStoreStats stats;              /* atomic counters */
+    uint8_t *current;                   /* writer's copy; guarded by mutex */
+    /* published snapshot: the version, then the state; accessed only by atomic word ops
+     * so that readers racing with a writer see torn words that they discard, never UB */
+    uint64_t words[];
+};
+
+StateStore *StateStoreCreate(size_t size,
+    const StateStoreField *fields, size_t fieldCount, const void *initial,
+    void (*schedule)(void *data), void *data)
+{
+    StateStore *store;
+    size_t wordCount = 1 + (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    if (StateStoreFieldMax < fieldCount)
+        return 0;
+    for (size_t i = 0; fieldCount > i; i++)
+        if (size < fields[i].offset || size - fields[i].offset < fields[i].size)
+            return 0;
+
+    store = calloc(1, sizeof *store + wordCount * sizeof store->words[0]);
+    if (0 == store)
+        return 0;
+
+    /* the writer's copy is word sized too, so that it can be published word by word */
+    store->current = calloc(wordCount - 1, sizeof(uint64_t));
+    if (0 == store->current)
+    {
+        free(store);
+        return 0;
+    }
+
+    pthread_mutex_init(&store->mutex, 0);
+    store->schedule = schedule;
+    store->data = data;
+    store->size = size;
+    store->wordCount = wordCount;
+    store->fieldCount = fieldCount;
+    memcpy(store->fields, fields, fieldCount * sizeof fields[0]);
+    if (0 != initial)
+        memcpy(store->current, initial, size);
+    memcpy(store->words + 1, store->current, size);
+
+    return store;
+}
+
+void StateStoreDelete(StateStore *store)
+{
+    if (0 == store)
+        return;
+
+    pthread_mutex_destroy(&store->mutex);
+    free(store->current);
+    free(store);
+}
+
+static void StateStorePublish(StateStore *store, uint64_t version)
+{
+    uint64_t sequence = __atomic_load_n(&store->sequence, __ATOMIC_RELAXED);
+    const uint64_t *src = (const uint64_t *)store->current;
+
+    __atomic_store_n(&store->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&store->words[0], version, __ATOMIC_RELAXED);
+    for (size_t i = 1; store->wordCount > i; i++)
+        __atomic_store_n(&store->words[i], src[i - 1], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&store->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t StateStoreUpdate(StateStore *store, const void *state, uint64_t fields)
+{
+    const uint8_t *src = state;
+    uint64_t changed = 0, pending = 0;
+
+    pthread_mutex_lock(&store->mutex);
+
+    for (size_t i = 0; store->fieldCount > i; i++)
+    {
+        const StateStoreField *field = &store->fields[i];
+        if (0 == (fields & (1ULL << i)) ||
+            0 == memcmp(store->current + field->offset, src + field->offset, field->size))
+            continue;
+        memcpy(store->current + field->offset, src + field->offset, field->size);
+        changed |= 1ULL << i;
+    }
+
+    __atomic_add_fetch(&store->stats.updates, 1, __ATOMIC_RELAXED);
+    if (0 != changed)
+    {
+        uint64_t version = __atomic_add_fetch(&store->stats.changes, 1, __ATOMIC_RELAXED);
+        StateStorePublish(store, version);
+        pending = __atomic_fetch_or(&store->pending, changed, __ATOMIC_ACQ_REL);
+    }
+
+    pthread_mutex_unlock(&store->mutex);
+
+    /* only the update that starts a delta schedules a flush */
+    if (0 != changed && 0 == pending && 0 != store->schedule)
+    {
+        __atomic_add_fetch(&store->stats.schedules, 1, __ATOMIC_RELAXED);
+        store->schedule(store->data);
+    }
+
+    return changed;
+}
+
+uint64_t StateStoreRead(StateStore *store, void *state)
+{
+    uint64_t *dst = state, word, version, sequence;
+    size_t size;
+
+    for (;;)
+    {
+        sequence = __atomic_load_n(&store->sequence, __ATOMIC_ACQUIRE);
+        if (0 == (sequence & 1))
+        {
+            version = __atomic_load_n(&store->words[0], __ATOMIC_RELAXED);
+            size = store->size;
+            for (size_t i = 1; store->wordCount > i; i++, size -= sizeof word)
+            {
+                word = __atomic_load_n(&store->words[i], __ATOMIC_RELAXED);
+                if (sizeof word <= size)
+                    dst[i - 1] = word;
+                else
+                    memcpy(&dst[i - 1], &word, size);
+            }
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (sequence == __atomic_load_n(&store->sequence, __ATOMIC_RELAXED))
+                return version;
+        }
+
+        __atomic_add_fetch(&store->stats.retries, 1, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t StateStoreVersion(StateStore *store)
+{
+    return __atomic_load_n(&store->stats.changes, __ATOMIC_ACQUIRE);
+}
+
+uint64_t StateStoreFlush(StateStore *store, uint64_t *version)
+{
+    uint64_t changed = __atomic_exchange_n(&store->pending, 0, __ATOMIC_ACQ_REL);
+
+    if (0 != changed)
+        __atomic_add_fetch(&store->stats.flushes, 1, __ATOMIC_RELAXED);
+    if (0 != version)
+        *version = StateStoreVersion(store);
+
+    return changed;
+}
+
+void StateStoreGetStats(StateStore *store, StateStoreStats *stats)
+{
+    stats->updates = __atomic_load_n(&store->stats.updates, __ATOMIC_RELAXED);
+    stats->changes = __atomic_load_n(&store->stats.changes, __ATOMIC_RELAXED);
+    stats->schedules = __atomic_load_n(&store->stats.schedules, __ATOMIC_RELAXED);
+    stats->flushes = __atomic_load_n(&store->stats.flushes, __ATOMIC_RELAXED);
+    stats->retries = __atomic_load_n(&store->stats.retries, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file StateStore.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef STATESTORE_H_INCLUDED
+#define STATESTORE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The state of a service as a plain struct, described by a table of up to 64
+ * fields (bit i of a field mask is fields[i]). Writers supply some or all of
+ * the fields; the store compares them with the current state and, when any
+ * differ, publishes the new state under the next version and merges the
+ * changed fields into a pending delta.
+ *
+ * When the pending delta goes from empty to non-empty the store calls its
+ * scheduler once; the owner then takes the merged delta with StateStoreFlush
+ * (e.g. on the next frame) and notifies its observers. Any number of updates
+ * in between cost observers a single notification.
+ *
+ * Writers are serialized by a mutex. Readers on any thread copy a consistent
+ * snapshot without locking (a sequence lock); a reader retries only when it
+ * races with a writer.
+ */
+#define StateStoreFieldMax              64
+
+typedef struct
+{
+    size_t offset, size;
+} StateStoreField;
+
+#define StateStoreFieldOf(type, member) { offsetof(type, member), sizeof(((type *)0)->member) }
+
+typedef struct
+{
+    uint64_t updates;                   /* StateStoreUpdate calls */
+    uint64_t changes;                   /* updates that changed a field (== version) */
+    uint64_t schedules;                 /* scheduler calls */
+    uint64_t flushes;                   /* flushes that returned a delta */
+    uint64_t retries;                   /* reads that raced with a writer */
+} StateStoreStats;
+
+typedef struct StateStore StateStore;
+
+StateStore *StateStoreCreate(size_t size,
+    const StateStoreField *fields, size_t fieldCount, const void *initial,
+    void (*schedule)(void *data), void *data);
+void StateStoreDelete(StateStore *store);
+uint64_t StateStoreUpdate(StateStore *store, const void *state, uint64_t fields);
+uint64_t StateStoreRead(StateStore *store, void *state);
+uint64_t StateStoreVersion(StateStore *store);
+uint64_t StateStoreFlush(StateStore *store, uint64_t *version);
+void StateStoreGetStats(StateStore *store, StateStoreStats *stats);
+
+#endif
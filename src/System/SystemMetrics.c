@@ -0,0 +1,507 @@
+/**
+ * @file SystemMetrics.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "SystemMetrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/storage/IOBlockStorageDriver.h>
+#include <mach/mach.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#else
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* block storage drivers come and go rarely; rescan for them every so many samples */
+#define SystemMetricsDiskRescanCount    60
+
+typedef struct
+{
+    uint64_t cpuBusy, cpuTotal;
+    uint64_t memUsed, memTotal;
+    uint64_t netIn, netOut;
+    uint64_t diskRead, diskWrite;
+} SystemMetricsCounters;
+
+struct SystemMetricsSampler
+{
+    SystemMetricsCounters counters;
+    double time;
+    bool primed;
+    SystemMetricsCost cost;
+#if defined(__APPLE__)
+    mach_port_t host;
+    uint64_t memTotal;
+    void *buffer;
+    size_t bufferSize;
+    io_service_t *disks;
+    size_t diskCount;
+    unsigned diskRescan;
+#else
+    int statFd, meminfoFd, netdevFd, diskstatsFd;
+    char *buffer;
+    size_t bufferSize;
+#endif
+};
+
+static double SystemMetricsClock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t SystemMetricsDelta(uint64_t newValue, uint64_t oldValue)
+{
+    /* counters may be reset (e.g. an interface goes away) */
+    return newValue >= oldValue ? newValue - oldValue : 0;
+}
+
+#if defined(__APPLE__)
+static bool SystemMetricsSamplerInit(SystemMetricsSampler *sampler)
+{
+    uint64_t memsize = 0;
+    size_t size = sizeof memsize;
+
+    if (-1 == sysctlbyname("hw.memsize", &memsize, &size, 0, 0) || 0 == memsize)
+        return false;
+
+    sampler->host = mach_host_self();
+    sampler->memTotal = memsize;
+
+    return true;
+}
+
+static void SystemMetricsSamplerFini(SystemMetricsSampler *sampler)
+{
+    for (size_t i = 0; sampler->diskCount > i; i++)
+        IOObjectRelease(sampler->disks[i]);
+    free(sampler->disks);
+    free(sampler->buffer);
+
+    if (MACH_PORT_NULL != sampler->host)
+        mach_port_deallocate(mach_task_self(), sampler->host);
+}
+
+static void SystemMetricsRescanDisks(SystemMetricsSampler *sampler)
+{
+    io_iterator_t iterator;
+    io_service_t service;
+    io_service_t *disks = 0;
+    size_t count = 0, capacity = 0;
+
+    if (KERN_SUCCESS != IOServiceGetMatchingServices(kIOMasterPortDefault,
+        IOServiceMatching(kIOBlockStorageDriverClass), &iterator))
+        return;
+
+    while (0 != (service = IOIteratorNext(iterator)))
+    {
+        if (count == capacity)
+        {
+            capacity = 0 == capacity ? 8 : capacity * 2;
+            io_service_t *newDisks = realloc(disks, capacity * sizeof *disks);
+            if (0 == newDisks)
+            {
+                IOObjectRelease(service);
+                break;
+            }
+            disks = newDisks;
+        }
+        disks[count++] = service;
+    }
+    IOObjectRelease(iterator);
+
+    for (size_t i = 0; sampler->diskCount > i; i++)
+        IOObjectRelease(sampler->disks[i]);
+    free(sampler->disks);
+    sampler->disks = disks;
+    sampler->diskCount = count;
+}
+
+static uint64_t SystemMetricsNumber(CFDictionaryRef dict, CFStringRef key)
+{
+    CFNumberRef number = CFDictionaryGetValue(dict, key);
+    int64_t value = 0;
+    if (0 != number && CFNumberGetTypeID() == CFGetTypeID(number))
+        CFNumberGetValue(number, kCFNumberSInt64Type, &value);
+    return 0 < value ? (uint64_t)value : 0;
+}
+
+static bool SystemMetricsRead(SystemMetricsSampler *sampler, SystemMetricsCounters *counters)
+{
+    memset(counters, 0, sizeof *counters);
+
+    /* cpu */
+    host_cpu_load_info_data_t load;
+    mach_msg_type_number_t count = HOST_CPU_LOAD_INFO_COUNT;
+    if (KERN_SUCCESS != host_statistics(sampler->host, HOST_CPU_LOAD_INFO,
+        (host_info_t)&load, &count))
+        return false;
+    for (int i = 0; CPU_STATE_MAX > i; i++)
+        counters->cpuTotal += load.cpu_ticks[i];
+    counters->cpuBusy = counters->cpuTotal - load.cpu_ticks[CPU_STATE_IDLE];
+
+    /* memory: app memory + wired + compressed, as Activity Monitor reports it */
+    vm_statistics64_data_t vm;
+    count = HOST_VM_INFO64_COUNT;
+    if (KERN_SUCCESS != host_statistics64(sampler->host, HOST_VM_INFO64,
+        (host_info64_t)&vm, &count))
+        return false;
+    uint64_t pages = (uint64_t)vm.internal_page_count - vm.purgeable_count +
+        vm.wire_count + vm.compressor_page_count;
+    counters->memUsed = pages * vm_kernel_page_size;
+    counters->memTotal = sampler->memTotal;
+
+    /* network: 64-bit interface counters */
+    int mib[] = { CTL_NET, PF_ROUTE, 0, 0, NET_RT_IFLIST2, 0 };
+    size_t size = 0;
+    if (-1 == sysctl(mib, 6, 0, &size, 0, 0))
+        return false;
+    if (sampler->bufferSize < size)
+    {
+        free(sampler->buffer);
+        sampler->bufferSize = size + size / 4;
+        sampler->buffer = malloc(sampler->bufferSize);
+        if (0 == sampler->buffer)
+        {
+            sampler->bufferSize = 0;
+            return false;
+        }
+    }
+    size = sampler->bufferSize;
+    if (-1 == sysctl(mib, 6, sampler->buffer, &size, 0, 0))
+        return false;
+    for (char *p = sampler->buffer, *endp = p + size; endp > p;)
+    {
+        struct if_msghdr *ifm = (void *)p;
+        if (0 == ifm->ifm_msglen)
+            break;
+        if (RTM_IFINFO2 == ifm->ifm_type && 0 == (ifm->ifm_flags & IFF_LOOPBACK))
+        {
+            struct if_msghdr2 *ifm2 = (void *)p;
+            counters->netIn += ifm2->ifm_data.ifi_ibytes;
+            counters->netOut += ifm2->ifm_data.ifi_obytes;
+        }
+        p += ifm->ifm_msglen;
+    }
+
+    /* disk */
+    if (0 == sampler->diskRescan--)
+    {
+        sampler->diskRescan = SystemMetricsDiskRescanCount - 1;
+        SystemMetricsRescanDisks(sampler);
+    }
+    for (size_t i = 0; sampler->diskCount > i; i++)
+    {
+        CFDictionaryRef stats = IORegistryEntryCreateCFProperty(sampler->disks[i],
+            CFSTR(kIOBlockStorageDriverStatisticsKey), kCFAllocatorDefault, 0);
+        if (0 == stats)
+            continue;
+        if (CFDictionaryGetTypeID() == CFGetTypeID(stats))
+        {
+            counters->diskRead += SystemMetricsNumber(stats,
+                CFSTR(kIOBlockStorageDriverStatisticsBytesReadKey));
+            counters->diskWrite += SystemMetricsNumber(stats,
+                CFSTR(kIOBlockStorageDriverStatisticsBytesWrittenKey));
+        }
+        CFRelease(stats);
+    }
+
+    return true;
+}
+#else
+static bool SystemMetricsSamplerInit(SystemMetricsSampler *sampler)
+{
+    sampler->statFd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    sampler->meminfoFd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    sampler->netdevFd = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+    sampler->diskstatsFd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    sampler->bufferSize = 4096;
+    sampler->buffer = malloc(sampler->bufferSize);
+
+    return -1 != sampler->statFd && -1 != sampler->meminfoFd && 0 != sampler->buffer;
+}
+
+static void SystemMetricsSamplerFini(SystemMetricsSampler *sampler)
+{
+    int *fds[] = { &sampler->statFd, &sampler->meminfoFd, &sampler->netdevFd, &sampler->diskstatsFd };
+    for (size_t i = 0; sizeof fds / sizeof fds[0] > i; i++)
+        if (-1 != *fds[i])
+            close(*fds[i]);
+    free(sampler->buffer);
+}
+
+static const char *SystemMetricsReadFile(SystemMetricsSampler *sampler, int fd)
+{
+    ssize_t bytes;
+
+    if (-1 == fd)
+        return 0;
+
+    for (;;)
+    {
+        bytes = pread(fd, sampler->buffer, sampler->bufferSize - 1, 0);
+        if (-1 == bytes)
+            return 0;
+        if ((size_t)bytes < sampler->bufferSize - 1)
+            break;
+
+        char *buffer = realloc(sampler->buffer, sampler->bufferSize * 2);
+        if (0 == buffer)
+            return 0;
+        sampler->buffer = buffer;
+        sampler->bufferSize *= 2;
+    }
+    sampler->buffer[bytes] = '\0';
+
+    return sampler->buffer;
+}
+
+static const char *SystemMetricsNextLine(const char *p)
+{
+    p = strchr(p, '\n');
+    return 0 != p ? p + 1 : 0;
+}
+
+static uint64_t SystemMetricsMeminfo(const char *text, const char *key)
+{
+    const char *p = strstr(text, key);
+    return 0 != p ? strtoull(p + strlen(key), 0, 10) * 1024 : 0;
+}
+
+static bool SystemMetricsRead(SystemMetricsSampler *sampler, SystemMetricsCounters *counters)
+{
+    const char *text, *p;
+    char *endp;
+
+    memset(counters, 0, sizeof *counters);
+
+    /* cpu: user nice system idle iowait irq softirq steal */
+    text = SystemMetricsReadFile(sampler, sampler->statFd);
+    if (0 == text || 0 != strncmp(text, "cpu ", 4))
+        return false;
+    p = text + 4;
+    for (int i = 0; 8 > i; i++, p = endp)
+    {
+        uint64_t value = strtoull(p, &endp, 10);
+        if (p == endp)
+            break;
+        counters->cpuTotal += value;
+        if (3 != i && 4 != i)
+            counters->cpuBusy += value;
+    }
+
+    /* memory */
+    text = SystemMetricsReadFile(sampler, sampler->meminfoFd);
+    if (0 == text)
+        return false;
+    counters->memTotal = SystemMetricsMeminfo(text, "MemTotal:");
+    uint64_t available = SystemMetricsMeminfo(text, "MemAvailable:");
+    counters->memUsed = counters->memTotal > available ? counters->memTotal - available : 0;
+
+    /* network: "name: rx_bytes packets errs drop fifo frame compressed multicast tx_bytes ..." */
+    text = SystemMetricsReadFile(sampler, sampler->netdevFd);
+    for (p = 0 != text ? text : ""; 0 != p && '\0' != *p; p = SystemMetricsNextLine(p))
+    {
+        const char *colon = strchr(p, ':'), *eol = strchr(p, '\n');
+        if (0 == colon || (0 != eol && eol < colon))
+            continue;
+        while (' ' == *p)
+            p++;
+        if (0 == strncmp(p, "lo:", 3))
+            continue;
+        p = colon + 1;
+        for (int i = 0; 9 > i; i++, p = endp)
+        {
+            uint64_t value = strtoull(p, &endp, 10);
+            if (0 == i)
+                counters->netIn += value;
+            else if (8 == i)
+                counters->netOut += value;
+        }
+    }
+
+    /* disk: "major minor name reads merged sectors ms writes merged sectors ..." */
+    text = SystemMetricsReadFile(sampler, sampler->diskstatsFd);
+    char disk[64] = "";
+    size_t diskLength = 0;
+    for (p = 0 != text ? text : ""; 0 != p && '\0' != *p; p = SystemMetricsNextLine(p))
+    {
+        char name[64];
+        strtoul(p, &endp, 10);
+        strtoul(endp, &endp, 10);
+        while (' ' == *endp)
+            endp++;
+        size_t length = strcspn(endp, " \n");
+        if (0 == length || sizeof name <= length)
+            continue;
+        memcpy(name, endp, length);
+        name[length] = '\0';
+        p = endp + length;
+        if (0 == strncmp(name, "loop", 4) || 0 == strncmp(name, "ram", 3) ||
+            0 == strncmp(name, "dm-", 3))
+            continue;
+        /* partitions follow their disk and extend its name (sda1, nvme0n1p1) */
+        if (0 != diskLength && 0 == strncmp(name, disk, diskLength) && isdigit(name[length - 1]))
+            continue;
+        memcpy(disk, name, length + 1);
+        diskLength = length;
+        for (int i = 0; 7 > i; i++, p = endp)
+        {
+            uint64_t value = strtoull(p, &endp, 10);
+            if (2 == i)
+                counters->diskRead += value * 512;
+            else if (6 == i)
+                counters->diskWrite += value * 512;
+        }
+    }
+
+    return true;
+}
+#endif
+
+SystemMetricsSampler *SystemMetricsSamplerCreate(void)
+{
+    SystemMetricsSampler *sampler;
+
+    sampler = calloc(1, sizeof *sampler);
+    if (0 == sampler)
+        return 0;
+
+#if !defined(__APPLE__)
+    sampler->statFd = sampler->meminfoFd = sampler->netdevFd = sampler->diskstatsFd = -1;
+#endif
+
+    if (!SystemMetricsSamplerInit(sampler))
+    {
+        SystemMetricsSamplerDelete(sampler);
+        return 0;
+    }
+
+    return sampler;
+}
+
+void SystemMetricsSamplerDelete(SystemMetricsSampler *sampler)
+{
+    if (0 == sampler)
+        return;
+
+    SystemMetricsSamplerFini(sampler);
+    free(sampler);
+}
+
+bool SystemMetricsSamplerSample(SystemMetricsSampler *sampler, SystemMetricsSample *sample)
+{
+    double cpuTime = SystemMetricsClock(CLOCK_THREAD_CPUTIME_ID);
+    double time = SystemMetricsClock(CLOCK_MONOTONIC);
+    SystemMetricsCounters counters, *last = &sampler->counters;
+    bool res = false;
+
+    memset(sample, 0, sizeof *sample);
+
+    if (!SystemMetricsRead(sampler, &counters))
+        goto exit;
+
+    if (!sampler->primed)
+        *last = (SystemMetricsCounters){ 0 };
+
+    uint64_t cpuTotal = SystemMetricsDelta(counters.cpuTotal, last->cpuTotal);
+    if (0 != cpuTotal)
+        sample->cpu = (double)SystemMetricsDelta(counters.cpuBusy, last->cpuBusy) / cpuTotal;
+    if (0 != counters.memTotal)
+        sample->memory = (double)counters.memUsed / counters.memTotal;
+
+    double elapsed = time - sampler->time;
+    if (sampler->primed && 0 < elapsed)
+    {
+        sample->netIn = SystemMetricsDelta(counters.netIn, last->netIn) / elapsed;
+        sample->netOut = SystemMetricsDelta(counters.netOut, last->netOut) / elapsed;
+        sample->diskRead = SystemMetricsDelta(counters.diskRead, last->diskRead) / elapsed;
+        sample->diskWrite = SystemMetricsDelta(counters.diskWrite, last->diskWrite) / elapsed;
+    }
+
+    *last = counters;
+    sampler->time = time;
+    sampler->primed = true;
+    res = true;
+
+exit:
+    sampler->cost.count++;
+    sampler->cost.time += SystemMetricsClock(CLOCK_THREAD_CPUTIME_ID) - cpuTime;
+
+    return res;
+}
+
+void SystemMetricsSamplerGetCost(SystemMetricsSampler *sampler, SystemMetricsCost *cost)
+{
+    *cost = sampler->cost;
+}
+
+void SystemMetricsHistoryPush(SystemMetricsHistory *history, unsigned level)
+{
+    if (SystemMetricsLevelMax < level)
+        level = SystemMetricsLevelMax;
+
+    if (0 == history->count)
+    {
+        history->first = history->last = (uint8_t)level;
+        history->count = 1;
+        return;
+    }
+
+    /* count levels are held as first plus (count - 1) deltas starting at tail */
+    if (SystemMetricsHistoryCapacity == history->count)
+    {
+        history->first = (uint8_t)(history->first + history->deltas[history->tail]);
+        history->tail = (history->tail + 1) % SystemMetricsHistoryCapacity;
+        history->count--;
+    }
+
+    history->deltas[(history->tail + history->count - 1) % SystemMetricsHistoryCapacity] =
+        (int8_t)((int)level - (int)history->last);
+    history->last = (uint8_t)level;
+    history->count++;
+}
+
+size_t SystemMetricsHistoryGet(const SystemMetricsHistory *history,
+    uint8_t *levels, size_t count)
+{
+    size_t skip;
+    int level;
+
+    if (history->count < count)
+        count = history->count;
+    if (0 == count)
+        return 0;
+
+    skip = history->count - count;
+    level = history->first;
+    for (size_t i = 0; history->count > i; i++)
+    {
+        if (0 != i)
+            level += history->deltas[(history->tail + i - 1) % SystemMetricsHistoryCapacity];
+        if (skip <= i)
+            levels[i - skip] = (uint8_t)level;
+    }
+
+    return count;
+}
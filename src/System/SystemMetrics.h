@@ -0,0 +1,68 @@
+/**
+ * @file SystemMetrics.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef SYSTEMMETRICS_H_INCLUDED
+#define SYSTEMMETRICS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * One sampler call collects CPU, memory, network and disk counters in a single
+ * batch: host statistics, the interface list and block storage statistics on
+ * macOS; /proc/stat, /proc/meminfo, /proc/net/dev and /proc/diskstats elsewhere
+ * (the files are kept open and reread in place). Rates are computed from the
+ * counters of the previous call; the first call reports zero rates.
+ */
+typedef struct SystemMetricsSampler SystemMetricsSampler;
+
+typedef struct
+{
+    double cpu;                         /* busy fraction, 0..1 */
+    double memory;                      /* used fraction, 0..1 */
+    double netIn, netOut;               /* bytes per second */
+    double diskRead, diskWrite;         /* bytes per second */
+} SystemMetricsSample;
+
+typedef struct
+{
+    uint64_t count;
+    double time;                        /* thread CPU seconds spent sampling */
+} SystemMetricsCost;
+
+SystemMetricsSampler *SystemMetricsSamplerCreate(void);
+void SystemMetricsSamplerDelete(SystemMetricsSampler *sampler);
+bool SystemMetricsSamplerSample(SystemMetricsSampler *sampler, SystemMetricsSample *sample);
+void SystemMetricsSamplerGetCost(SystemMetricsSampler *sampler, SystemMetricsCost *cost);
+
+/*
+ * Fixed-size history of levels (0..SystemMetricsLevelMax), stored as the oldest
+ * level plus one signed byte delta per later sample. Pushing into a full
+ * history drops the oldest sample.
+ */
+#define SystemMetricsHistoryCapacity    64
+#define SystemMetricsLevelMax           127
+
+typedef struct
+{
+    int8_t deltas[SystemMetricsHistoryCapacity];
+    uint8_t first, last;
+    uint16_t tail, count;
+} SystemMetricsHistory;
+
+void SystemMetricsHistoryPush(SystemMetricsHistory *history, unsigned level);
+size_t SystemMetricsHistoryGet(const SystemMetricsHistory *history,
+    uint8_t *levels, size_t count);
+
+#endif
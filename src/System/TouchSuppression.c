@@ -0,0 +1,63 @@
+/**
+ * @file TouchSuppression.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "TouchSuppression.h"
+#include <string.h>
+
+void TouchSuppressionInit(TouchSuppression *suppression, double initialWindow)
+{
+    memset(suppression, 0, sizeof *suppression);
+    suppression->initialWindow = initialWindow;
+}
+
+double TouchSuppressionWindow(const TouchSuppression *suppression)
+{
+    double window;
+
+    if (TouchSuppressionWarmupCount > suppression->count)
+        return suppression->initialWindow;
+
+    window = suppression->cadence * TouchSuppressionCadenceScale;
+    if (TouchSuppressionMinWindow > window)
+        window = TouchSuppressionMinWindow;
+    if (TouchSuppressionMaxWindow < window)
+        window = TouchSuppressionMaxWindow;
+    return window;
+}
+
+void TouchSuppressionKeyDown(TouchSuppression *suppression, double now)
+{
+    double interval = now - suppression->lastKey;
+
+    /* only intervals within a burst of typing say anything about the cadence */
+    if (0 != suppression->lastKey && 0 < interval && TouchSuppressionBurstGap > interval)
+    {
+        if (0 == suppression->count)
+            suppression->cadence = interval;
+        else
+            suppression->cadence += (interval - suppression->cadence) / 8;
+        if (TouchSuppressionWarmupCount > suppression->count)
+            suppression->count++;
+    }
+    suppression->lastKey = now;
+
+    double deadline = now + TouchSuppressionWindow(suppression);
+    __atomic_store(&suppression->deadline, &deadline, __ATOMIC_RELAXED);
+}
+
+bool TouchSuppressionActive(TouchSuppression *suppression, double now)
+{
+    double deadline;
+    __atomic_load(&suppression->deadline, &deadline, __ATOMIC_RELAXED);
+    return now < deadline;
+}
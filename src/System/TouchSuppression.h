@@ -0,0 +1,54 @@
+/**
+ * @file TouchSuppression.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef TOUCHSUPPRESSION_H_INCLUDED
+#define TOUCHSUPPRESSION_H_INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Accidental touch suppression. Every key down moves a single "suppress until"
+ * deadline forward with one atomic store; hit testing compares the current time
+ * against it with one atomic load. The length of the window follows the typing
+ * cadence: a smoothed average of the intervals between keys within a burst of
+ * typing, scaled and clamped. Until enough keys have been seen, the initial
+ * window is used.
+ *
+ * KeyDown is for keys pressed, not auto-repeated: repeats arrive faster than
+ * anyone types and would shrink the window to its minimum.
+ *
+ * KeyDown must be called from a single thread (the main thread in practice);
+ * Active may be called from any thread. Times are seconds of a monotonic clock
+ * supplied by the caller.
+ */
+#define TouchSuppressionMinWindow       0.15
+#define TouchSuppressionMaxWindow       0.6
+#define TouchSuppressionCadenceScale    2.0
+#define TouchSuppressionBurstGap        1.0     /* longer pauses end a burst */
+#define TouchSuppressionWarmupCount     4
+
+typedef struct
+{
+    double deadline;                    /* atomic */
+    double initialWindow;
+    double lastKey;
+    double cadence;                     /* smoothed interval between keys; 0 if unknown */
+    unsigned count;                     /* intervals measured */
+} TouchSuppression;
+
+void TouchSuppressionInit(TouchSuppression *suppression, double initialWindow);
+void TouchSuppressionKeyDown(TouchSuppression *suppression, double now);
+bool TouchSuppressionActive(TouchSuppression *suppression, double now);
+double TouchSuppressionWindow(const TouchSuppression *suppression);
+
+#endif
@@ -18,6 +18,8 @@
 - (BOOL)present;
 - (BOOL)presentWithPlacement:(NSInteger)placement;
 - (void)dismiss;
+- (NSTouchBar *)activeTouchBar;
+- (__kindof NSTouchBarItem *)itemForIdentifier:(NSTouchBarItemIdentifier)identifier;
 - (IBAction)close:(id)sender;
 - (IBAction)customize:(id)sender;
 @property (retain) IBOutlet NSTouchBar *touchBar;
@@ -47,7 +47,7 @@
     if (self.presented)
         return NO;
     BOOL res = [NSTouchBar
-        presentSystemModal:self.touchBar
+        presentSystemModal:[self activeTouchBar]
         placement:placement
         systemTrayItemIdentifier:nil];
     if (res)
@@ -60,10 +60,21 @@
     if (!self.presented)
         return;
     [NSTouchBar
-        dismissSystemModal:self.touchBar];
+        dismissSystemModal:[self activeTouchBar]];
     self.presented = NO;
 }
 
+- (NSTouchBar *)activeTouchBar
+{
+    /* the touch bar that is presented; subclasses may present one other than touchBar */
+    return self.touchBar;
+}
+
+- (__kindof NSTouchBarItem *)itemForIdentifier:(NSTouchBarItemIdentifier)identifier
+{
+    return [self.touchBar itemForIdentifier:identifier];
+}
+
 - (IBAction)close:(id)sender
 {
     [self dismiss];
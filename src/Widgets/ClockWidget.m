@@ -15,6 +15,8 @@
 #import "FixedSizeLabel.h"
 #import "ImageTitleView.h"
 #import "PowerStatus.h"
+#import "RefreshPolicy.h"
+#import "ResourceAccounting.h"
 #import "WeatherWidget.h"
 
 @interface ClockWidgetView : ImageTitleView
@@ -33,6 +35,8 @@
 @property (retain) NSImage *clockBatteryChargedImage;
 @property (retain) NSDateFormatter *formatter;
 @property (retain) NSTimer *timer;
+@property (retain) NSImage *batteryImage;
+@property (retain) NSString *batteryString;
 @property (assign) BOOL showsBatteryStatus;
 @property (assign) BOOL showsBatteryTimeRemaining;
 @end
@@ -67,12 +71,13 @@
     [self.timer invalidate];
     self.timer = nil;
 
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[PowerStatus sharedInstance].state removeObserver:self];
 
     self.clockBatteryImage = nil;
     self.clockBatteryChargingImage = nil;
     self.clockBatteryChargedImage = nil;
+    self.batteryImage = nil;
+    self.batteryString = nil;
     self.formatter = nil;
 
     [super dealloc];
@@ -80,11 +85,10 @@
 
 - (void)viewWillAppear
 {
-    [[NSNotificationCenter defaultCenter]
+    [[PowerStatus sharedInstance].state
         addObserver:self
-        selector:@selector(powerStatusNotification:)
-        name:PowerStatusNotification
-        object:nil];
+        selector:@selector(powerStatusChange:)
+        fields:~0ULL];
 
     NSDate *date = [[NSDate date] dateByAddingTimeInterval:60.0];
     NSDateComponents *comp = [[NSCalendar currentCalendar]
@@ -101,6 +105,7 @@
         userInfo:nil
         repeats:YES] autorelease];
     [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
+    RefreshPolicyTimerSet("Clock", 60.0, 0, false);
 
     [self tick:nil];
 }
@@ -109,18 +114,23 @@
 {
     [self.timer invalidate];
     self.timer = nil;
+    RefreshPolicyTimerClear("Clock");
 
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[PowerStatus sharedInstance].state removeObserver:self];
 }
 
-- (void)powerStatusNotification:(NSNotification *)notification
+- (void)powerStatusChange:(ServiceState *)state
 {
     [self tick:nil];
 }
 
 - (void)tick:(NSTimer *)sender
 {
+    /* the time always advances; only the battery query on timer ticks is throttled */
+    ResourceAccount *account = ResourceAccountGet("Clock");
+    ResourceSpan span;
+    ResourceAccountBegin(account, &span);
+
     ImageTitleView *view = self.view;
 
     if (!self.showsBatteryStatus)
@@ -132,38 +142,51 @@
     }
     else
     {
-        NSDictionary *info = [[PowerStatus sharedInstance] providingSourceInfoDictionary];
-        NSNumber *currentCapacity = [info objectForKey:PowerStatusCurrentCapacity];
-        NSNumber *maxCapacity = [info objectForKey:PowerStatusMaxCapacity];
-        double capacity = 100 * [currentCapacity doubleValue] / [maxCapacity doubleValue];
-        //BOOL charging = [[info objectForKey:PowerStatusIsCharging] boolValue];
-        BOOL charging = ![[[PowerStatus sharedInstance] providingSource]
-            isEqualToString:PowerStatusBatteryPower];
-        BOOL charged = [[info objectForKey:PowerStatusIsCharged] boolValue];
-        NSTimeInterval timeRemaining = [[PowerStatus sharedInstance] remainingTime];
-
-        NSString *clockString = [self.formatter stringFromDate:[NSDate date]];
-        NSString *batteryString = isnan(capacity) || isinf(capacity) ?
-            @"--" :
-            [NSString stringWithFormat:@"%@%.0f%%", charging ? @"⚡︎" : @"", capacity];
-        if (self.showsBatteryTimeRemaining)
-            batteryString = isnan(timeRemaining) || isinf(timeRemaining) ?
-                batteryString :
-                [batteryString stringByAppendingFormat:@" (%u:%02u)",
-                    (unsigned)timeRemaining / 3600, (unsigned)timeRemaining / 60 % 60];
-
-        view.image = charged ?
-            self.clockBatteryChargedImage :
-            (charging ? self.clockBatteryChargingImage : self.clockBatteryImage);
+        /* the time shown must advance every minute, but the battery status is also
+         * refreshed by power source notifications; when the refresh policy allows,
+         * do not query the battery on timer ticks */
+        if (nil != sender && RefreshPolicyEnabled(RefreshFeatureBatteryPolling) &&
+            ResourceAccountShouldRun(account))
+            [[PowerStatus sharedInstance] refresh];
+        [self resetBattery];
+
+        view.image = self.batteryImage;
         view.titleFont = [NSFont systemFontOfSize:[NSFont
             systemFontSizeForControlSize:NSControlSizeSmall]];
-        view.title = clockString;
-        view.subtitle = batteryString;
+        view.title = [self.formatter stringFromDate:[NSDate date]];
+        view.subtitle = self.batteryString;
         view.layoutOptions =
             ImageTitleViewLayoutOptionImage |
             ImageTitleViewLayoutOptionTitle |
             ImageTitleViewLayoutOptionSubtitle;
     }
+
+    ResourceAccountEnd(&span);
+}
+
+- (void)resetBattery
+{
+    PowerStatusState state;
+    [[PowerStatus sharedInstance].state read:&state];
+    double capacity = state.capacity;
+    //BOOL charging = state.charging;
+    BOOL charging = PowerStatusSourceBattery != state.source;
+    BOOL charged = state.charged;
+    NSTimeInterval timeRemaining = state.remainingTime;
+
+    NSString *batteryString = isnan(capacity) || isinf(capacity) ?
+        @"--" :
+        [NSString stringWithFormat:@"%@%.0f%%", charging ? @"⚡︎" : @"", capacity];
+    if (self.showsBatteryTimeRemaining)
+        batteryString = isnan(timeRemaining) || isinf(timeRemaining) ?
+            batteryString :
+            [batteryString stringByAppendingFormat:@" (%u:%02u)",
+                (unsigned)timeRemaining / 3600, (unsigned)timeRemaining / 60 % 60];
+
+    self.batteryImage = charged ?
+        self.clockBatteryChargedImage :
+        (charging ? self.clockBatteryChargingImage : self.clockBatteryImage);
+    self.batteryString = batteryString;
 }
 
 - (void)resetClock
@@ -197,7 +220,7 @@
 
 - (void)resetWeather
 {
-    WeatherWidget *widget = 2 <= self.widgets.count ? (id)[self.widgets objectAtIndex:1] : nil;
+    WeatherWidget *widget = (id)[self widgetWithIdentifier:@"_Weather"];
     [widget resetWeather];
 }
 
@@ -246,7 +269,7 @@
 {
     _temperatureUnit = value;
 
-    WeatherWidget *widget = 2 <= self.widgets.count ? (id)[self.widgets objectAtIndex:1] : nil;
+    WeatherWidget *widget = (id)[self widgetWithIdentifier:@"_Weather"];
     widget.temperatureUnit = value;
 }
 
@@ -262,16 +285,19 @@
 
     _showsWeather = value;
     if (_showsWeather)
-    {
-        WeatherWidget *widget = [[[WeatherWidget alloc]
-            initWithIdentifier:@"_Weather"] autorelease];
-        widget.temperatureUnit = _temperatureUnit;
-        [self addWidget:widget];
-    }
+        [self addWidgetWithIdentifier:@"_Weather" factory:@selector(makeWeatherWidget:)];
     else
         [self removeWidgetWithIdentifier:@"_Weather"];
 }
 
+- (NSTouchBarItem *)makeWeatherWidget:(NSString *)identifier
+{
+    WeatherWidget *widget = [[[WeatherWidget alloc]
+        initWithIdentifier:identifier] autorelease];
+    widget.temperatureUnit = _temperatureUnit;
+    return widget;
+}
+
 - (void)setPressTarget:(id)target action:(SEL)action
 {
     _target = target;
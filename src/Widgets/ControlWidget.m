@@ -16,6 +16,8 @@
 #import "AudioControl.h"
 #import "Brightness.h"
 #import "CBBlueLightClient.h"
+#import "InputLatency.h"
+#import "IntervalIndex.h"
 #import "KeyEvent.h"
 #import "NSTouchBar+SystemModal.h"
 #import "NowPlaying.h"
@@ -449,6 +451,8 @@
 {
     NSInteger _pressKind;
     CGFloat _xmin, _xmax;
+    IntervalIndex *_segmentIndex;
+    CGFloat _segmentIndexWidth;
 }
 
 - (void)commonInit
@@ -502,33 +506,33 @@
 
 - (void)dealloc
 {
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[NowPlaying sharedInstance].state removeObserver:self];
+    [[AudioControl sharedInstance].state removeObserver:self];
 
     self.brightnessBarController = nil;
     self.volumeBarController = nil;
 
+    IntervalIndexDelete(_segmentIndex);
+
     [super dealloc];
 }
 
 - (void)viewWillAppear
 {
-    [[NSNotificationCenter defaultCenter]
+    [[NowPlaying sharedInstance].state
         addObserver:self
-        selector:@selector(nowPlayingNotification:)
-        name:NowPlayingStateNotification
-        object:nil];
-    [[NSNotificationCenter defaultCenter]
+        selector:@selector(nowPlayingChange:)
+        fields:NowPlayingFieldPlaying];
+    [[AudioControl sharedInstance].state
         addObserver:self
-        selector:@selector(audioControlNotification:)
-        name:AudioControlNotification
-        object:nil];
+        selector:@selector(audioControlChange:)
+        fields:AudioControlFieldMute];
 }
 
 - (void)viewDidDisappear
 {
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[NowPlaying sharedInstance].state removeObserver:self];
+    [[AudioControl sharedInstance].state removeObserver:self];
 }
 
 - (NSImage *)playPauseImage
@@ -540,17 +544,19 @@
 
 - (NSImage *)volumeMuteImage
 {
-    BOOL mute = [AudioControl sharedInstance].mute;
+    AudioControlState state;
+    [[AudioControl sharedInstance].state read:&state];
+    BOOL mute = state.mute;
     return [NSImage imageNamed:mute ? @"VolumeMuteOn" : @"VolumeMuteOff"];
 }
 
-- (void)nowPlayingNotification:(NSNotification *)notification
+- (void)nowPlayingChange:(ServiceState *)state
 {
     NSSegmentedControl *control = [self.view viewWithTag:'ctrl'];
     [control setImage:[self playPauseImage] forSegment:0];
 }
 
-- (void)audioControlNotification:(NSNotification *)notification
+- (void)audioControlChange:(ServiceState *)state
 {
     NSSegmentedControl *control = [self.view viewWithTag:'ctrl'];
     [control setImage:[self volumeMuteImage] forSegment:3];
@@ -559,10 +565,12 @@
 - (void)click:(id)sender
 {
     NSSegmentedControl *control = sender;
+    NSTimeInterval start = InputLatencyStart();
     switch (control.selectedSegment)
     {
     case 0:
         PostAuxKeyPress(NX_KEYTYPE_PLAY);
+        InputLatencyRecord("MediaKey", start);
         break;
     case 1:
         [self.brightnessBarController present];
@@ -648,6 +656,7 @@
     point.x = MAX(point.x, _xmin);
     point.x = MIN(point.x, _xmax);
     double value = (point.x - _xmin) / MaxPanDistance;
+    NSTimeInterval start = InputLatencyStart();
 
     switch (_pressKind)
     {
@@ -662,11 +671,13 @@
     case 'brgt':
         level.value = isnan(value) ? 0.5 : value;
         SetDisplayBrightness(0, value);
+        InputLatencyRecord("Brightness", start);
         break;
     case 'audi':
         level.value = isnan(value) ? 0.5 : value;
         [AudioControl sharedInstance].volume = value;
         [AudioControl sharedInstance].mute = value < 1.0 / (16 * 4);
+        InputLatencyRecord("Volume", start);
         break;
     }
 }
@@ -682,16 +693,23 @@
     point.x = MAX(point.x, _xmin);
     point.x = MIN(point.x, _xmax);
     double value = (point.x - _xmin) / MaxPanDistance;
+    NSTimeInterval start = InputLatencyStart();
 
     switch (_pressKind)
     {
     case 'play':
         if (0.25 > value)
+        {
             PostAuxKeyPress(NX_KEYTYPE_PREVIOUS);
+            InputLatencyRecord("MediaKey", start);
+        }
         else if (0.25 <= value && value <= 0.75)
             ;
         else
+        {
             PostAuxKeyPress(NX_KEYTYPE_NEXT);
+            InputLatencyRecord("MediaKey", start);
+        }
         [control setImage:[self playPauseImage] forSegment:0];
         break;
     default:
@@ -704,6 +722,29 @@
 }
 
 - (NSInteger)segmentForX:(CGFloat)x
+{
+    NSSegmentedControl *control = [self.view viewWithTag:'ctrl'];
+    NSRect rect = control.bounds;
+
+    /* segment widths only change on layout; rebuild the index when the control is resized */
+    if (0 == _segmentIndex || _segmentIndexWidth != rect.size.width)
+    {
+        if (0 == _segmentIndex)
+            _segmentIndex = IntervalIndexCreate();
+        if (0 == _segmentIndex)
+            return -1;
+        [self buildSegmentIndex:control];
+        _segmentIndexWidth = rect.size.width;
+    }
+
+    intptr_t segment;
+    if (!IntervalIndexLookup(_segmentIndex, x, &segment))
+        return -1;
+
+    return segment;
+}
+
+- (void)buildSegmentIndex:(NSSegmentedControl *)control
 {
     /* HACK:
      * There does not appear to be a direct way to determine the segment from a point.
@@ -714,10 +755,9 @@
      *
      * So I am adapting here some code that I wrote a long time for "DarwinKit"...
      */
-    NSSegmentedControl *control = [self.view viewWithTag:'ctrl'];
     NSRect rect = control.bounds;
     CGFloat widths[16] = { 0 }, totalWidth = 0;
-    NSInteger count = control.segmentCount, zeroWidthCells = 0;
+    NSInteger count = MIN(control.segmentCount, 16), zeroWidthCells = 0;
     for (NSInteger i = 0; count > i; i++)
     {
         widths[i] = [control widthForSegment:i];
@@ -748,16 +788,14 @@
         }
     }
 
-    /* now that we have the widths go ahead and figure out which segment has X */
+    /* now that we have the widths index the segments by X */
+    IntervalIndexReset(_segmentIndex);
     totalWidth = 0;
     for (NSInteger i = 0; count > i; i++)
     {
-        if (totalWidth <= x && x < totalWidth + widths[i])
-            return i;
-
+        IntervalIndexAdd(_segmentIndex, totalWidth, totalWidth + widths[i], i);
         totalWidth += widths[i];
     }
-
-    return -1;
+    IntervalIndexBuild(_segmentIndex);
 }
 @end
@@ -28,6 +28,7 @@
 @property (readonly, getter=widgets) NSArray<NSTouchBarItem *> *widgets;
 @property (getter=activeIndex, setter=setActiveIndex:) NSUInteger activeIndex;
 - (void)addWidget:(NSTouchBarItem *)widget;
+- (void)addWidgetWithIdentifier:(NSString *)identifier factory:(SEL)factory;
 - (void)removeWidgetWithIdentifier:(NSString *)identifier;
 - (NSTouchBarItem *)widgetWithIdentifier:(NSString *)identifier;
 - (void)tapAction:(id)sender;
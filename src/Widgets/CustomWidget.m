@@ -134,9 +134,33 @@
 }
 @end
 
+/*
+ * A child of a multi widget. Children added with a factory are created on
+ * first activation; until then they have no view, hold no resources and take
+ * no part in layout. Once created they are kept, so that switching back shows
+ * their last state at once. Children only receive viewWillAppear/viewDidDisappear
+ * while they are the active child, because only the active child's view is in
+ * the view hierarchy.
+ */
+@interface CustomMultiWidgetSlot : NSObject
+@property (copy) NSString *identifier;
+@property (assign) SEL factory;
+@property (retain) NSTouchBarItem *widget;
+@end
+
+@implementation CustomMultiWidgetSlot
+- (void)dealloc
+{
+    self.identifier = nil;
+    self.widget = nil;
+
+    [super dealloc];
+}
+@end
+
 @implementation CustomMultiWidget
 {
-    NSMutableArray<NSTouchBarItem *> *_widgets;
+    NSMutableArray<CustomMultiWidgetSlot *> *_slots;
 }
 
 - (void)commonInit_
@@ -146,7 +170,7 @@
     controller.widget = self;
     self.viewController = controller;
 
-    _widgets = [[NSMutableArray alloc] init];
+    _slots = [[NSMutableArray alloc] init];
 
     CustomMultiWidgetView *view = [[[CustomMultiWidgetView alloc]
         initWithFrame:NSZeroRect] autorelease];
@@ -164,28 +188,46 @@
 
     [self commonInit];
 
-    NSTouchBarItem *primaryWidget = [_widgets firstObject];
+    NSTouchBarItem *primaryWidget = [_slots firstObject].widget;
     self.customizationLabel = [primaryWidget customizationLabel];
 }
 
 - (void)dealloc
 {
-    [_widgets release];
+    [_slots release];
 
     [super dealloc];
 }
 
 - (NSArray<NSTouchBarItem *> *)widgets
 {
-    return _widgets;
+    /* created widgets only */
+    NSMutableArray *widgets = [NSMutableArray arrayWithCapacity:_slots.count];
+    for (CustomMultiWidgetSlot *slot in _slots)
+        if (nil != slot.widget)
+            [widgets addObject:slot.widget];
+    return widgets;
+}
+
+- (NSTouchBarItem *)widgetAtIndex:(NSUInteger)index
+{
+    CustomMultiWidgetSlot *slot = [_slots objectAtIndex:index];
+    if (nil == slot.widget && 0 != slot.factory)
+    {
+        slot.widget = [self performSelector:slot.factory withObject:slot.identifier];
+        slot.factory = 0;
+        [self.view invalidateIntrinsicContentSize];
+    }
+
+    return slot.widget;
 }
 
 - (NSUInteger)activeIndex
 {
-    for (NSUInteger index = 0, count = _widgets.count; count > index; index++)
+    for (NSUInteger index = 0, count = _slots.count; count > index; index++)
     {
-        NSTouchBarItem *widget = [_widgets objectAtIndex:index];
-        if (widget.view.superview == self.view)
+        NSTouchBarItem *widget = [_slots objectAtIndex:index].widget;
+        if (nil != widget && widget.view.superview == self.view)
             return index;
     }
 
@@ -198,28 +240,47 @@
         return;
 
     [[self.view.subviews firstObject] removeFromSuperview];
-    if (value < _widgets.count)
-        [self.view addSubview:[[_widgets objectAtIndex:value] view]];
+    if (value < _slots.count)
+    {
+        NSView *view = [self widgetAtIndex:value].view;
+        if (nil != view)
+            [self.view addSubview:view];
+    }
 }
 
 - (void)addWidget:(NSTouchBarItem *)widget
 {
-    [_widgets addObject:widget];
+    CustomMultiWidgetSlot *slot = [[[CustomMultiWidgetSlot alloc] init] autorelease];
+    slot.identifier = widget.identifier;
+    slot.widget = widget;
+    [_slots addObject:slot];
     [self.view invalidateIntrinsicContentSize];
 
     if (NSNotFound == self.activeIndex)
         self.activeIndex = 0;
 }
 
+- (void)addWidgetWithIdentifier:(NSString *)identifier factory:(SEL)factory
+{
+    /* factory is a method of self that takes the identifier and returns an autoreleased widget */
+    CustomMultiWidgetSlot *slot = [[[CustomMultiWidgetSlot alloc] init] autorelease];
+    slot.identifier = identifier;
+    slot.factory = factory;
+    [_slots addObject:slot];
+
+    if (NSNotFound == self.activeIndex)
+        self.activeIndex = 0;
+}
+
 - (void)removeWidgetWithIdentifier:(NSString *)identifier
 {
-    for (NSUInteger index = 0, count = _widgets.count; count > index; index++)
+    for (NSUInteger index = 0, count = _slots.count; count > index; index++)
     {
-        NSTouchBarItem *widget = [_widgets objectAtIndex:index];
-        if ([widget.identifier isEqualToString:identifier])
+        CustomMultiWidgetSlot *slot = [_slots objectAtIndex:index];
+        if ([slot.identifier isEqualToString:identifier])
         {
-            [widget.view removeFromSuperview];
-            [_widgets removeObjectAtIndex:index];
+            [slot.widget.view removeFromSuperview];
+            [_slots removeObjectAtIndex:index];
             [self.view invalidateIntrinsicContentSize];
             break;
         }
@@ -231,11 +292,12 @@
 
 - (NSTouchBarItem *)widgetWithIdentifier:(NSString *)identifier
 {
-    for (NSUInteger index = 0, count = _widgets.count; count > index; index++)
+    /* nil for widgets that have not been created yet */
+    for (NSUInteger index = 0, count = _slots.count; count > index; index++)
     {
-        NSTouchBarItem *widget = [_widgets objectAtIndex:index];
-        if ([widget.identifier isEqualToString:identifier])
-            return widget;
+        CustomMultiWidgetSlot *slot = [_slots objectAtIndex:index];
+        if ([slot.identifier isEqualToString:identifier])
+            return slot.widget;
     }
 
     return nil;
@@ -251,7 +313,10 @@
 
 - (void)tapAction:(id)sender
 {
-    self.activeIndex = (self.activeIndex + 1) % _widgets.count;
+    if (0 == _slots.count)
+        return;
+
+    self.activeIndex = (self.activeIndex + 1) % _slots.count;
 }
 
 - (void)longPressAction_:(NSGestureRecognizer *)recognizer
@@ -260,15 +325,16 @@
         return;
 
     NSUInteger index = self.activeIndex;
-    if (NSNotFound != index && [_widgets[index] respondsToSelector:@selector(longPressAction:)])
-        [(id)_widgets[index] longPressAction:self];
+    NSTouchBarItem *widget = NSNotFound != index ? [_slots objectAtIndex:index].widget : nil;
+    if ([widget respondsToSelector:@selector(longPressAction:)])
+        [(id)widget longPressAction:self];
     else
         [self longPressAction:self];
 }
 
 - (void)longPressAction:(id)sender
 {
-    NSTouchBarItem *primaryWidget = [_widgets firstObject];
+    NSTouchBarItem *primaryWidget = [_slots firstObject].widget;
     if ([primaryWidget respondsToSelector:@selector(longPressAction:)])
         [(id)primaryWidget longPressAction:sender];
 }
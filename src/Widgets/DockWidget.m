@@ -12,14 +12,30 @@
  */
 
 #import "DockWidget.h"
+#import "DockSnapshot.h"
 #import "EdgeWindowController.h"
 #import "FolderController.h"
+#import "IconAtlas.h"
+#import "IconStore.h"
+#import "InputLatency.h"
+#import "IntervalIndex.h"
+#import "MetadataStore.h"
 #import "NSWorkspace+Finder.h"
+#import "PathAtom.h"
+#import "ProcessMetrics.h"
+#import "RefreshPolicy.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
+#import "Settings.h"
+#import "StartupTimings.h"
 
 static NSSize dockItemSize = { 50, 30 };
 static CGFloat dockDotHeight = 4;
 static CGFloat dockItemBounce = 10;
+static CGFloat dockBadgeSize = 6;
 static const NSUInteger maxPersistentItemCount = 8;
+static const uint64_t dockAtlasDotKey = UINT64_MAX;
+static const NSTimeInterval dockItemBounceDuration = 0.25;
 
 static NSShadow *shadowWithOffset(NSSize shadowOffset)
 {
@@ -33,10 +49,80 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     return shadow;
 }
 
+static const char *pathString(NSString *path, char *buf, size_t size)
+{
+    /* most paths are stored as UTF-8 already; otherwise convert into the caller's buffer */
+    const char *str = CFStringGetCStringPtr((CFStringRef)path, kCFStringEncodingUTF8);
+    if (0 != str)
+        return str;
+    if ([path getCString:buf maxLength:size encoding:NSUTF8StringEncoding])
+        return buf;
+    return path.UTF8String;
+}
+
+static uint64_t pathKey(NSString *path)
+{
+    /* atlas keys: a path (or icon key) hash, so that lookups need no table and never allocate */
+    char buf[PATH_MAX];
+    const char *str;
+    if (nil == path || 0 == (str = pathString(path, buf, sizeof buf)))
+        return 0;
+    return PathAtomHash(str);
+}
+
+static uint64_t iconKeyAtlasKey(NSString *iconKey, NSString *path)
+{
+    /*
+     * Atlas keys name icon contents: the IconStore key (path and change time) when
+     * known, else the path. A changed icon gets a new cell and the cell of the old
+     * one is never looked up again, so the atlas evicts it first when it fills up.
+     */
+    return pathKey(nil != iconKey ? iconKey : path);
+}
+
+static void *scratchBuffer(void **buffer, size_t *capacity, size_t count, size_t size)
+{
+    /* grown as needed and kept, so that steady state rebuilds do not allocate */
+    if (*capacity < count)
+    {
+        void *p = realloc(*buffer, count * size);
+        if (0 == p)
+            return 0;
+        *buffer = p;
+        *capacity = count;
+    }
+    return *buffer;
+}
+
+enum
+{
+    DockSnapshotIsDirectory = 1,
+};
+
+enum
+{
+    dockAtlasCellSize = 60,             /* Touch Bar icons: 30pt at 2x */
+    dockAtlasColumns = 8,
+    dockAtlasRows = 4,
+    dockAtlasMaxPages = 4,
+};
+
+static NSString *dockSnapshotPath(void)
+{
+    NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES)
+        firstObject];
+    NSString *bundleIdentifier = [[NSBundle mainBundle] bundleIdentifier];
+    if (nil == caches || nil == bundleIdentifier)
+        return nil;
+    return [[caches stringByAppendingPathComponent:bundleIdentifier]
+        stringByAppendingPathComponent:@"DockSnapshot"];
+}
+
 @interface DockWidgetApplication : NSObject <NSCopying>
 @property (retain) NSString *name;
 @property (retain) NSString *path;
 @property (retain) NSImage *icon;
+@property (retain) NSString *iconKey;   /* IconStore key; changes when the icon does */
 @property (assign) BOOL isDefault;
 @property (assign) pid_t pid;
 @property (assign) BOOL launching;
@@ -48,6 +134,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     self.name = nil;
     self.path = nil;
     self.icon = nil;
+    self.iconKey = nil;
     [super dealloc];
 }
 
@@ -57,15 +144,533 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     copy.name = self.name;
     copy.path = self.path;
     copy.icon = self.icon;
+    copy.iconKey = self.iconKey;
     copy.isDefault = self.isDefault;
     copy.pid = self.pid;
     copy.launching = self.launching;
     return copy;
 }
+@end
+
+static NSImage *dockItemImage(NSImage *icon, NSRect rect)
+{
+    /* composited lazily at draw time, so that models can be built off the main thread */
+    NSSize size = NSMakeSize(dockItemSize.height, dockItemSize.height); // square!
+    return [NSImage imageWithSize:size flipped:NO drawingHandler:^BOOL(NSRect dstRect)
+    {
+        NSSize iconSize = icon.size;
+        [[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
+        [icon
+            drawInRect:rect
+            fromRect:NSMakeRect(0, 0, iconSize.width, iconSize.height)
+            operation:NSCompositingOperationSourceOver
+            fraction:1.0];
+        return YES;
+    }];
+}
+
+@interface DockWidgetPersistentItem : NSObject
+@property (retain) NSURL *url;
+@property (assign) NSStackViewGravity gravity;
+@property (retain) NSImage *icon;
+@property (retain) NSString *iconKey;   /* IconStore key; nil if unknown */
+@property (retain) NSImage *image;
+@property (retain) NSImage *prominentImage;
+@end
+
+@implementation DockWidgetPersistentItem
+- (void)dealloc
+{
+    self.url = nil;
+    self.icon = nil;
+    self.iconKey = nil;
+    self.image = nil;
+    self.prominentImage = nil;
+    [super dealloc];
+}
+@end
+
+/*
+ * Everything a Dock reset needs from the file system: persistent items, default
+ * apps and their icons. Models are built on a background queue (or from the warm
+ * start snapshot) and are not modified after they are handed to the main thread.
+ */
+@interface DockWidgetModel : NSObject
++ (DockWidgetModel *)modelWithSnapshot:(DockSnapshot *)snapshot superseded:(BOOL (^)(void))superseded;
+@property (assign) NSUInteger generation;
+@property (retain) NSArray<DockWidgetPersistentItem *> *persistentItems;
+@property (retain) NSArray<DockWidgetApplication *> *defaultApps;
+@property (retain) NSData *snapshotData;    /* nil when built from a snapshot */
+@end
+
+@implementation DockWidgetModel
++ (DockWidgetModel *)modelWithSnapshot:(DockSnapshot *)snapshot superseded:(BOOL (^)(void))superseded
+{
+    NSMutableArray *items = [NSMutableArray array];
+    NSMutableArray *apps = [NSMutableArray array];
+    NSUInteger leftCount = 0, rightCount = 0;
+    DockSnapshotBuilder *builder = 0;
+    DockWidgetModel *model = nil;
+
+    NSString *defaultAppsFolder = [[NSUserDefaults standardUserDefaults]
+        stringForKey:@"defaultAppsFolder"];
+    IconStore *iconStore = [IconStore sharedInstance];
+    NSMutableArray *urls = [NSMutableArray array];
+    NSMutableArray *gravities = [NSMutableArray array];
+    NSMutableArray *icons = [NSMutableArray array];
+    NSMutableArray *iconKeys = [NSMutableArray array];
+    if (0 != snapshot)
+    {
+        /* the first paint uses the icons saved with the snapshot; nothing is drawn */
+        DockSnapshotItem item;
+        for (size_t i = 0; DockSnapshotItemAtIndex(snapshot, i, &item); i++)
+        {
+            [urls addObject:[NSURL
+                fileURLWithPath:[NSString stringWithUTF8String:item.path]
+                isDirectory:0 != (item.flags & DockSnapshotIsDirectory)]];
+            [gravities addObject:[NSNumber numberWithInteger:item.group]];
+            NSString *iconKey = [NSString stringWithUTF8String:item.iconKey];
+            NSImage *icon = 0 != item.iconPixels ?
+                [iconStore
+                    iconWithPixels:item.iconPixels
+                    width:item.iconWidth
+                    height:item.iconHeight
+                    key:iconKey] :
+                nil;
+            [icons addObject:nil != icon ? icon : (id)[NSNull null]];
+            [iconKeys addObject:nil != icon ? iconKey : (id)[NSNull null]];
+        }
+    }
+    else if (nil != defaultAppsFolder)
+    {
+        builder = DockSnapshotBuilderCreate(defaultAppsFolder.fileSystemRepresentation);
+
+        NSArray *contents = [[NSFileManager defaultManager]
+            contentsOfDirectoryAtPath:defaultAppsFolder error:0];
+        contents = [contents sortedArrayUsingSelector:@selector(localizedStandardCompare:)];
+        for (NSString *c in contents)
+        {
+            if (nil != superseded && superseded())
+                goto exit;
+
+            if ([c hasPrefix:@"."])
+                continue;
+
+            NSURL *url = [NSURL
+                URLByResolvingAliasFileAtURL:[NSURL
+                    fileURLWithPath:[defaultAppsFolder stringByAppendingPathComponent:c]]
+                options:NSURLBookmarkResolutionWithoutUI|NSURLBookmarkResolutionWithoutMounting
+                error:0];
+            if (nil == url)
+                continue;
+
+            NSStackViewGravity gravity;
+            if ([c hasSuffix:@".lpinned"])
+                gravity = NSStackViewGravityLeading;
+            else if ([c hasSuffix:@".pinned"])
+                gravity = NSStackViewGravityTrailing;
+            else if (0 != ([[MetadataStore sharedInstance] flagsForURL:url] &
+                MetadataIndexApplication))
+                gravity = NSStackViewGravityCenter;
+            else
+                gravity = NSStackViewGravityTrailing;
+            if (0 != builder &&
+                !DockSnapshotBuilderAdd(builder, url.fileSystemRepresentation, (uint8_t)gravity,
+                    url.hasDirectoryPath ? DockSnapshotIsDirectory : 0))
+            {
+                /* items and snapshot entries must stay in step; skip the snapshot instead */
+                DockSnapshotBuilderDelete(builder);
+                builder = 0;
+            }
+            [urls addObject:url];
+            [gravities addObject:[NSNumber numberWithInteger:gravity]];
+        }
+    }
+
+    for (NSUInteger i = 0; urls.count > i; i++)
+    {
+        if (nil != superseded && superseded())
+            goto exit;
+
+        NSURL *url = [urls objectAtIndex:i];
+        NSStackViewGravity gravity = [[gravities objectAtIndex:i] integerValue];
+        NSImage *icon = i < icons.count ? [icons objectAtIndex:i] : nil;
+        NSString *iconKey = i < iconKeys.count ? [iconKeys objectAtIndex:i] : nil;
+        if ([NSNull null] == (id)icon)
+        {
+            icon = nil;
+            iconKey = nil;
+        }
+        switch (gravity)
+        {
+        case NSStackViewGravityCenter:
+            {
+                DockWidgetApplication *app = [[[DockWidgetApplication alloc] init] autorelease];
+                app.name = [url.path lastPathComponent];
+                app.path = url.path;
+                if (nil == icon)
+                    icon = [self iconForItemAtIndex:i path:url.path builder:builder key:&iconKey];
+                app.icon = icon;
+                app.iconKey = iconKey;
+                app.isDefault = YES;
+                [apps addObject:app];
+            }
+            continue;
+        case NSStackViewGravityLeading:
+            if (maxPersistentItemCount < leftCount++)
+                continue;
+            break;
+        case NSStackViewGravityTrailing:
+            if (maxPersistentItemCount < rightCount++)
+                continue;
+            break;
+        default:
+            continue;
+        }
+
+        if (nil == icon)
+            icon = [self iconForItemAtIndex:i path:url.path builder:builder key:&iconKey];
+        NSRect iconRect = NSMakeRect(dockDotHeight / 2, dockDotHeight,
+            dockItemSize.height - dockDotHeight, dockItemSize.height - dockDotHeight);  // square!
+        NSRect prominentIconRect = NSMakeRect(0, dockDotHeight,
+            dockItemSize.height, dockItemSize.height);  // square!
+        DockWidgetPersistentItem *item = [[[DockWidgetPersistentItem alloc] init] autorelease];
+        item.url = url;
+        item.gravity = gravity;
+        item.icon = icon;
+        item.iconKey = iconKey;
+        item.image = dockItemImage(icon, iconRect);
+        item.prominentImage = dockItemImage(icon, prominentIconRect);
+        [items addObject:item];
+    }
+
+    if (0 == apps.count)
+    {
+        NSArray *defaultApps = [[NSUserDefaults standardUserDefaults] arrayForKey:@"defaultApps"];
+        for (NSDictionary *a in defaultApps)
+        {
+            DockWidgetApplication *app = [[[DockWidgetApplication alloc] init] autorelease];
+            app.name = [a objectForKey:@"NSApplicationName"];
+            app.path = [a objectForKey:@"NSApplicationPath"];
+            NSString *iconKey = nil;
+            app.icon = [[IconStore sharedInstance] imageWithBitmap:
+                [[IconStore sharedInstance] bitmapForFile:app.path key:&iconKey]];
+            app.iconKey = iconKey;
+            app.isDefault = YES;
+            [apps addObject:app];
+        }
+    }
+
+    model = [[[DockWidgetModel alloc] init] autorelease];
+    model.persistentItems = items;
+    model.defaultApps = apps;
+    if (0 != builder)
+    {
+        size_t size;
+        const void *data = DockSnapshotBuilderData(builder, &size);
+        if (0 != data)
+            model.snapshotData = [NSData dataWithBytes:data length:size];
+    }
+
+exit:
+    DockSnapshotBuilderDelete(builder);
+
+    return model;
+}
+
++ (NSImage *)iconForItemAtIndex:(NSUInteger)index path:(NSString *)path
+    builder:(DockSnapshotBuilder *)builder key:(NSString **)pkey
+{
+    /* save the icon with the snapshot, so that the next launch paints without drawing it */
+    NSString *key = nil;
+    IconCacheBitmap *bitmap = [[IconStore sharedInstance] bitmapForFile:path key:&key];
+    if (0 != builder && 0 != bitmap)
+        DockSnapshotBuilderSetIcon(builder, index, key.UTF8String,
+            bitmap->pixels, bitmap->width, bitmap->height);
+    if (0 != pkey)
+        *pkey = key;
+    return [[IconStore sharedInstance] imageWithBitmap:bitmap];
+}
+
+- (void)dealloc
+{
+    self.persistentItems = nil;
+    self.defaultApps = nil;
+    self.snapshotData = nil;
+    [super dealloc];
+}
+@end
+
+static CGRect dockLayerFrame(NSView *view, NSRect rect)
+{
+    /* rects are given bottom-up; a layer-backed view lays out sublayers in its own geometry */
+    if (view.isFlipped)
+        rect.origin.y = NSHeight(view.bounds) - NSMaxY(rect);
+    return NSRectToCGRect(rect);
+}
+
+static NSRect dockSquareRect(NSRect rect)
+{
+    /* the largest centered square: icons are square and scale proportionally */
+    CGFloat side = MIN(NSWidth(rect), NSHeight(rect));
+    return NSMakeRect(
+        NSMinX(rect) + (NSWidth(rect) - side) / 2, NSMinY(rect) + (NSHeight(rect) - side) / 2,
+        side, side);
+}
+
+static void dockLayerSetShadow(CALayer *layer, BOOL prominent)
+{
+    if (!prominent)
+    {
+        layer.shadowOpacity = 0;
+        return;
+    }
+
+    NSShadow *shadow = shadowWithOffset(NSMakeSize(0, -dockDotHeight));
+    layer.shadowColor = [shadow.shadowColor CGColor];
+    layer.shadowOffset = NSSizeToCGSize(shadow.shadowOffset);
+    layer.shadowRadius = shadow.shadowBlurRadius;
+    layer.shadowOpacity = 1;
+}
+
+/*
+ * Alternate Dock rendering (dockIconAtlas): icons are rasterized once into the
+ * pages of an IconAtlas and every item shows its icon as a sub-rect of a shared
+ * page image, so the whole strip uploads a few textures. Launch bounces and
+ * running dots use shared animations in a common phase instead of per-view
+ * animation groups and completion handlers.
+ */
+@interface DockWidgetAtlas : NSObject
+- (void)addIcon:(NSImage *)icon key:(uint64_t)key;
+- (BOOL)commit;
+- (void)applyIcon:(NSImage *)icon key:(uint64_t)key toLayer:(CALayer *)layer;
+- (void)applyDotToLayer:(CALayer *)layer;
+@property (readonly) CAAnimation *bounceAnimation;
+@property (readonly) CAAnimation *dotAnimation;
+@end
+
+@implementation DockWidgetAtlas
+{
+    IconAtlas *_atlas;
+    CGColorSpaceRef _colorSpace;
+    CGContextRef _context;              /* one cell, reused for every rasterization */
+    uint32_t *_pixels;
+    CGImageRef _pageImages[dockAtlasMaxPages];
+    uint64_t _pageGenerations[dockAtlasMaxPages];
+    CABasicAnimation *_bounceAnimation;
+    CABasicAnimation *_dotAnimation;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (nil == self)
+        return nil;
+
+    _atlas = IconAtlasCreate(dockAtlasCellSize, dockAtlasColumns, dockAtlasRows, dockAtlasMaxPages);
+    _colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    _pixels = malloc(dockAtlasCellSize * dockAtlasCellSize * sizeof *_pixels);
+    if (0 != _colorSpace && 0 != _pixels)
+        _context = CGBitmapContextCreate(_pixels,
+            dockAtlasCellSize, dockAtlasCellSize, 8, dockAtlasCellSize * 4,
+            _colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    if (0 == _atlas || 0 == _context)
+    {
+        [self release];
+        return nil;
+    }
+
+    /* all bounces share one phase: begin at a common epoch and repeat */
+    _bounceAnimation = [[CABasicAnimation animationWithKeyPath:@"position.y"] retain];
+    _bounceAnimation.fromValue = [NSNumber numberWithDouble:0];
+    _bounceAnimation.toValue = [NSNumber numberWithDouble:dockItemBounce];
+    _bounceAnimation.additive = YES;
+    _bounceAnimation.duration = dockItemBounceDuration;
+    _bounceAnimation.autoreverses = YES;
+    _bounceAnimation.repeatCount = HUGE_VALF;
+    _bounceAnimation.beginTime = CACurrentMediaTime();
+    _bounceAnimation.timingFunction = [CAMediaTimingFunction
+        functionWithName:kCAMediaTimingFunctionEaseOut];
+
+    _dotAnimation = [[CABasicAnimation animationWithKeyPath:@"opacity"] retain];
+    _dotAnimation.fromValue = [NSNumber numberWithDouble:0];
+    _dotAnimation.toValue = [NSNumber numberWithDouble:1];
+    _dotAnimation.duration = dockItemBounceDuration;
+
+    return self;
+}
+
+- (void)dealloc
+{
+    for (unsigned i = 0; dockAtlasMaxPages > i; i++)
+        if (0 != _pageImages[i])
+            CGImageRelease(_pageImages[i]);
+    if (0 != _context)
+        CGContextRelease(_context);
+    if (0 != _colorSpace)
+        CGColorSpaceRelease(_colorSpace);
+    free(_pixels);
+    IconAtlasDelete(_atlas);
+
+    [_bounceAnimation release];
+    [_dotAnimation release];
+
+    [super dealloc];
+}
+
+- (CAAnimation *)bounceAnimation
+{
+    return _bounceAnimation;
+}
+
+- (CAAnimation *)dotAnimation
+{
+    return _dotAnimation;
+}
+
+- (BOOL)insertImage:(NSImage *)image key:(uint64_t)key template:(BOOL)template
+    slot:(IconAtlasSlot *)slot
+{
+    if (nil == image)
+        return NO;
+
+    CGRect rect = CGRectMake(0, 0, dockAtlasCellSize, dockAtlasCellSize);
+    CGContextClearRect(_context, rect);
+
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext:
+        [NSGraphicsContext graphicsContextWithCGContext:_context flipped:NO]];
+    [[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
+    [image
+        drawInRect:NSRectFromCGRect(rect)
+        fromRect:NSZeroRect
+        operation:NSCompositingOperationSourceOver
+        fraction:1.0];
+    [NSGraphicsContext restoreGraphicsState];
+
+    if (template)
+    {
+        /* template images are drawn in black; the Touch Bar shows them in white */
+        CGContextSaveGState(_context);
+        CGContextSetBlendMode(_context, kCGBlendModeSourceIn);
+        CGContextSetRGBFillColor(_context, 1, 1, 1, 1);
+        CGContextFillRect(_context, rect);
+        CGContextRestoreGState(_context);
+    }
+    CGContextFlush(_context);
+
+    return IconAtlasInsert(_atlas, key,
+        _pixels, dockAtlasCellSize, dockAtlasCellSize, dockAtlasCellSize, slot);
+}
+
+- (BOOL)lookupIcon:(NSImage *)icon key:(uint64_t)key slot:(IconAtlasSlot *)slot
+{
+    /*
+     * Keys name contents (iconKeyAtlasKey), not NSImage instances, which IconStore
+     * makes anew on every call: a cell found is the right one and an icon is only
+     * rasterized when its contents are new. Stale cells go by atlas eviction.
+     */
+    if (IconAtlasLookup(_atlas, key, slot))
+        return YES;
+
+    return [self insertImage:icon key:key template:NO slot:slot];
+}
+
+- (void)addIcon:(NSImage *)icon key:(uint64_t)key
+{
+    [self lookupIcon:icon key:key slot:0];
+}
+
+- (CGImageRef)imageForPage:(unsigned)page regenerated:(BOOL *)regenerated
+{
+    unsigned width, height;
+    uint64_t generation;
+    const uint32_t *pixels = IconAtlasPage(_atlas, page, &width, &height, &generation);
+    if (0 == pixels)
+        return 0;
+
+    if (0 == _pageImages[page] || _pageGenerations[page] != generation)
+    {
+        /* layers keep the image they were given, so each generation is a copy */
+        CFDataRef data = CFDataCreate(0,
+            (const UInt8 *)pixels, (CFIndex)width * height * sizeof *pixels);
+        CGDataProviderRef provider = 0 != data ? CGDataProviderCreateWithCFData(data) : 0;
+        CGImageRef image = 0 != provider ?
+            CGImageCreate(width, height, 8, 32, width * 4,
+                _colorSpace, kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big,
+                provider, 0, false, kCGRenderingIntentDefault) :
+            0;
+        if (0 != provider)
+            CGDataProviderRelease(provider);
+        if (0 != data)
+            CFRelease(data);
+        if (0 == image)
+            return _pageImages[page];
+
+        if (0 != _pageImages[page])
+            CGImageRelease(_pageImages[page]);
+        _pageImages[page] = image;
+        _pageGenerations[page] = generation;
+        if (0 != regenerated)
+            *regenerated = YES;
+    }
+
+    return _pageImages[page];
+}
+
+- (BOOL)commit
+{
+    BOOL regenerated = NO;
+    for (unsigned i = 0; dockAtlasMaxPages > i; i++)
+        [self imageForPage:i regenerated:&regenerated];
+    return regenerated;
+}
 
-- (id)key
+- (void)applySlot:(const IconAtlasSlot *)slot toLayer:(CALayer *)layer
 {
-    return [NSString stringWithFormat:@"%d:%@", self.pid, self.path];
+    CGImageRef image = [self imageForPage:slot->page regenerated:0];
+    if (0 == image)
+    {
+        layer.contents = nil;
+        return;
+    }
+
+    CGFloat width = CGImageGetWidth(image), height = CGImageGetHeight(image);
+    CGFloat y = slot->y;
+    if (!layer.contentsAreFlipped)
+        y = height - slot->y - slot->size;
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    layer.contents = (id)image;
+    layer.contentsRect = CGRectMake(
+        slot->x / width, y / height, slot->size / width, slot->size / height);
+    [CATransaction commit];
+}
+
+- (void)applyIcon:(NSImage *)icon key:(uint64_t)key toLayer:(CALayer *)layer
+{
+    IconAtlasSlot slot;
+    if (nil == icon || ![self lookupIcon:icon key:key slot:&slot])
+    {
+        layer.contents = nil;
+        return;
+    }
+
+    [self applySlot:&slot toLayer:layer];
+}
+
+- (void)applyDotToLayer:(CALayer *)layer
+{
+    IconAtlasSlot slot;
+    if (!IconAtlasLookup(_atlas, dockAtlasDotKey, &slot) &&
+        ![self insertImage:[NSImage imageNamed:@"DockDot"] key:dockAtlasDotKey template:YES slot:&slot])
+    {
+        layer.contents = nil;
+        return;
+    }
+
+    [self applySlot:&slot toLayer:layer];
 }
 @end
 
@@ -76,23 +681,48 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 @property (retain) NSString *appPath;
 @property (assign) pid_t appPid;
 @property (retain, getter=getAppIcon, setter=setAppIcon:) NSImage *appIcon;
+@property (retain) NSString *appIconKey;    /* IconStore key of appIcon; set before it */
 @property (assign, getter=isAppRunning, setter=setAppRunning:) BOOL appRunning;
 @property (assign, getter=isAppLaunching, setter=setAppLaunching:) BOOL appLaunching;
 @property (assign, getter=isProminent, setter=setProminent:) BOOL prominent;
 @property (assign, getter=getDockMagnification, setter=setDockMagnification:) BOOL dockMagnification;
+@property (assign, getter=getAppBadge, setter=setAppBadge:) unsigned appBadge;  /* ProcessMetricsBadge* */
+- (void)prepareWithAtlas:(DockWidgetAtlas *)atlas;
+- (void)resetAtlasContents;
 @end
 
 @implementation DockWidgetItemView
 {
     BOOL _appLaunching;
     BOOL _prominent;
+    unsigned _appBadge;
+    CALayer *_badgeLayer;               /* created on the first badge */
+    /* atlas rendering: two plain layers instead of the icon and running subviews */
+    DockWidgetAtlas *_atlas;
+    NSImage *_appIcon;
+    CALayer *_iconLayer, *_dotLayer;
 }
 
-- (id)initWithFrame:(NSRect)frame
+- (void)prepareWithAtlas:(DockWidgetAtlas *)atlas
 {
-    self = [super initWithFrame:frame];
-    if (nil == self)
-        return nil;
+    /* views come from the scrubber's reuse queue; contents are created on first use */
+    if (nil != _iconLayer || nil != self.appIconContainerView)
+        return;
+
+    if (nil != atlas)
+    {
+        _atlas = [atlas retain];
+
+        self.wantsLayer = YES;
+        _iconLayer = [[CALayer alloc] init];
+        _dotLayer = [[CALayer alloc] init];
+        _dotLayer.hidden = YES;
+        [self.layer addSublayer:_iconLayer];
+        [self.layer addSublayer:_dotLayer];
+        [_atlas applyDotToLayer:_dotLayer];
+
+        return;
+    }
 
     self.appIconContainerView = [[[NSView alloc] initWithFrame:NSZeroRect] autorelease];
     self.appIconContainerView.autoresizingMask = NSViewWidthSizable | NSViewHeightSizable;
@@ -108,8 +738,6 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     [self.appIconContainerView addSubview:self.appIconView];
     [self addSubview:self.appIconContainerView];
     [self addSubview:self.appRunningView];
-
-    return self;
 }
 
 - (void)dealloc
@@ -118,27 +746,75 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     self.appIconView = nil;
     self.appRunningView = nil;
     self.appPath = nil;
+    self.appIconKey = nil;
+
+    [_badgeLayer release];
+    [_iconLayer release];
+    [_dotLayer release];
+    [_appIcon release];
+    [_atlas release];
 
     [super dealloc];
 }
 
 - (NSImage *)getAppIcon
 {
+    if (nil != _atlas)
+        return _appIcon;
+
     return self.appIconView.image;
 }
 
 - (void)setAppIcon:(NSImage *)value
 {
+    if (nil != _atlas)
+    {
+        if (_appIcon == value)
+            return;
+
+        [_appIcon release];
+        _appIcon = [value retain];
+        [self resetAtlasContents];
+        return;
+    }
+
     self.appIconView.image = value;
 }
 
+- (void)resetAtlasContents
+{
+    /* cheap when the icon is in the atlas: a lookup and a pointer to the shared page image */
+    if (nil == _atlas)
+        return;
+
+    [_atlas applyIcon:_appIcon key:iconKeyAtlasKey(self.appIconKey, self.appPath) toLayer:_iconLayer];
+    [_atlas applyDotToLayer:_dotLayer];
+}
+
 - (BOOL)isAppRunning
 {
+    if (nil != _atlas)
+        return !_dotLayer.hidden;
+
     return !self.appRunningView.hidden;
 }
 
 - (void)setAppRunning:(BOOL)value
 {
+    if (nil != _atlas)
+    {
+        if (_dotLayer.hidden == !value)
+            return;
+
+        [CATransaction begin];
+        [CATransaction setDisableActions:YES];
+        _dotLayer.hidden = !value;
+        if (value && nil != self.window)
+            [_dotLayer addAnimation:_atlas.dotAnimation forKey:@"dot"];
+        [CATransaction commit];
+        return;
+    }
+
     self.appRunningView.hidden = !value;
 }
 
@@ -170,21 +846,80 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     [self resizeAppIconView];
 }
 
+- (unsigned)getAppBadge
+{
+    return _appBadge;
+}
+
+- (void)setAppBadge:(unsigned)value
+{
+    if (_appBadge == value)
+        return;
+
+    _appBadge = value;
+
+    if (nil == _badgeLayer)
+    {
+        if (ProcessMetricsBadgeNone == value)
+            return;
+
+        self.wantsLayer = YES;
+        _badgeLayer = [[CALayer alloc] init];
+        _badgeLayer.cornerRadius = dockBadgeSize / 2;
+        [self.layer addSublayer:_badgeLayer];
+        [self resizeBadgeLayer];
+    }
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    _badgeLayer.hidden = ProcessMetricsBadgeNone == value;
+    if (ProcessMetricsBadgeCpu == value)
+        _badgeLayer.backgroundColor = [[NSColor systemOrangeColor] CGColor];
+    else if (ProcessMetricsBadgeMemory == value)
+        _badgeLayer.backgroundColor = [[NSColor systemPurpleColor] CGColor];
+    [CATransaction commit];
+}
+
+- (void)resizeBadgeLayer
+{
+    if (nil == _badgeLayer)
+        return;
+
+    /* top right corner of the icon area, clear of the running dot */
+    NSRect bounds = self.bounds;
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    _badgeLayer.frame = CGRectMake(
+        NSMaxX(bounds) - dockBadgeSize - 2, NSMaxY(bounds) - dockBadgeSize - 1,
+        dockBadgeSize, dockBadgeSize);
+    [CATransaction commit];
+}
+
 - (void)bounce
 {
+    if (nil != _atlas)
+    {
+        /* one shared repeating animation; it keeps running while the view is off screen */
+        if (_appLaunching)
+            [_iconLayer addAnimation:_atlas.bounceAnimation forKey:@"bounce"];
+        else
+            [_iconLayer removeAnimationForKey:@"bounce"];
+        return;
+    }
+
     if (!_appLaunching || nil == self.superview)
         return;
 
     [NSAnimationContext runAnimationGroup:^(NSAnimationContext *context)
     {
-        context.duration = 0.25;
+        context.duration = dockItemBounceDuration;
         [self.appIconContainerView.animator setFrameOrigin:NSMakePoint(0, dockItemBounce)];
     }
     completionHandler:^
     {
         [NSAnimationContext runAnimationGroup:^(NSAnimationContext *context)
         {
-            context.duration = 0.25;
+            context.duration = dockItemBounceDuration;
             [self.appIconContainerView.animator setFrameOrigin:NSMakePoint(0, 0)];
         }
         completionHandler:^
@@ -207,6 +942,18 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         else
             iconRect.origin.y += dockDotHeight;
     }
+
+    if (nil != _atlas)
+    {
+        [CATransaction begin];
+        [CATransaction setDisableActions:YES];
+        _iconLayer.frame = dockLayerFrame(self, dockSquareRect(iconRect));
+        _dotLayer.frame = dockLayerFrame(self, dockSquareRect(self.bounds));
+        dockLayerSetShadow(_iconLayer, _prominent);
+        [CATransaction commit];
+        return;
+    }
+
     self.appIconView.frame = iconRect;
 
     if (!_prominent)
@@ -218,6 +965,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 - (void)resizeSubviewsWithOldSize:(NSSize)oldSize
 {
     [self resizeAppIconView];
+    [self resizeBadgeLayer];
     [super resizeSubviewsWithOldSize:oldSize];
 }
 @end
@@ -237,12 +985,33 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 @property (retain) NSImage *regularImage;
 @property (retain) NSImage *prominentImage;
 @property (assign, getter=isProminent, setter=setProminent:) BOOL prominent;
+@property (assign) double progress;     /* file operation into the folder; < 0 when none */
+- (void)setAtlas:(DockWidgetAtlas *)atlas icon:(NSImage *)icon key:(NSString *)iconKey;
+- (void)resetAtlasContents;
 - (void)resetImage;
 @end
 
 @implementation DockWidgetButton
 {
     BOOL _prominent;
+    /* atlas rendering: the icon is a layer over the atlas instead of two pre-rendered images */
+    DockWidgetAtlas *_atlas;
+    NSImage *_icon;
+    NSString *_iconKey;
+    CALayer *_iconLayer;
+    double _progress;
+    CALayer *_progressLayer;
+}
+
+- (id)initWithFrame:(NSRect)frame
+{
+    self = [super initWithFrame:frame];
+    if (nil == self)
+        return nil;
+
+    _progress = -1;
+
+    return self;
 }
 
 - (void)dealloc
@@ -251,14 +1020,101 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     self.regularImage = nil;
     self.prominentImage = nil;
 
+    [_progressLayer release];
+    [_iconLayer release];
+    [_iconKey release];
+    [_icon release];
+    [_atlas release];
+
     [super dealloc];
 }
 
+- (void)setAtlas:(DockWidgetAtlas *)atlas icon:(NSImage *)icon key:(NSString *)iconKey
+{
+    [_atlas release];
+    _atlas = [atlas retain];
+    [_icon release];
+    _icon = [icon retain];
+    [_iconKey release];
+    _iconKey = [iconKey copy];
+
+    if (nil == _iconLayer)
+    {
+        self.wantsLayer = YES;
+        _iconLayer = [[CALayer alloc] init];
+        [self.layer addSublayer:_iconLayer];
+    }
+
+    [self resetAtlasContents];
+    [self resetImage];
+}
+
+- (void)resetAtlasContents
+{
+    if (nil == _atlas)
+        return;
+
+    [_atlas applyIcon:_icon key:iconKeyAtlasKey(_iconKey, self.url.path) toLayer:_iconLayer];
+}
+
+- (void)resizeSubviewsWithOldSize:(NSSize)oldSize
+{
+    [super resizeSubviewsWithOldSize:oldSize];
+    if (nil != _atlas)
+        [self resetImage];
+    if (nil != _progressLayer)
+        [self resetProgress];
+}
+
 - (NSSize)intrinsicContentSize
 {
     return dockItemSize;
 }
 
+- (double)progress
+{
+    return _progress;
+}
+
+- (void)setProgress:(double)value
+{
+    if (_progress == value)
+        return;
+
+    _progress = value;
+    [self resetProgress];
+}
+
+- (void)resetProgress
+{
+    /* a bar in the dot area, under the icon */
+    if (0 > _progress)
+    {
+        _progressLayer.hidden = YES;
+        return;
+    }
+
+    if (nil == _progressLayer)
+    {
+        self.wantsLayer = YES;
+        _progressLayer = [[CALayer alloc] init];
+        _progressLayer.backgroundColor = [[NSColor controlAccentColor] CGColor];
+        _progressLayer.cornerRadius = dockDotHeight / 4;
+        [self.layer addSublayer:_progressLayer];
+    }
+
+    NSRect bounds = self.bounds;
+    CGFloat width = dockItemSize.height - dockDotHeight;
+    NSRect rect = NSMakeRect((NSWidth(bounds) - width) / 2, dockDotHeight / 4,
+        width * MIN(_progress, 1), dockDotHeight / 2);
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    _progressLayer.hidden = NO;
+    _progressLayer.frame = dockLayerFrame(self, rect);
+    [CATransaction commit];
+}
+
 - (BOOL)isProminent
 {
     return _prominent;
@@ -275,6 +1131,24 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
 - (void)resetImage
 {
+    if (nil != _atlas)
+    {
+        /* the same rects that the pre-rendered images use, centered in the button */
+        NSRect bounds = self.bounds;
+        NSRect rect = !_prominent ?
+            NSMakeRect(dockDotHeight / 2, dockDotHeight,
+                dockItemSize.height - dockDotHeight, dockItemSize.height - dockDotHeight) :
+            NSMakeRect(0, dockDotHeight, dockItemSize.height, dockItemSize.height);
+        rect.origin.x += (NSWidth(bounds) - dockItemSize.height) / 2;
+
+        [CATransaction begin];
+        [CATransaction setDisableActions:YES];
+        _iconLayer.frame = dockLayerFrame(self, rect);
+        dockLayerSetShadow(_iconLayer, _prominent);
+        [CATransaction commit];
+        return;
+    }
+
     if (!_prominent)
         self.image = self.regularImage;
     else
@@ -287,17 +1161,58 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 }
 @end
 
+enum
+{
+    DockDragTargetIsDir = 1,
+    DockDragTargetIsApp = 2,
+};
+
+static NSUInteger dragTargetFlags(NSURL *url, EdgeWindowDragSession *session)
+{
+    NSNumber *flags = [session.cache objectForKey:url];
+    if (nil == flags)
+    {
+        NSNumber *value;
+        NSUInteger f = 0;
+        if ([url getResourceValue:&value forKey:NSURLIsDirectoryKey error:0] && [value boolValue])
+            f |= DockDragTargetIsDir;
+        if ([url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] && [value boolValue])
+            f |= DockDragTargetIsApp;
+        flags = [NSNumber numberWithUnsignedInteger:f];
+        [session.cache setObject:flags forKey:url];
+    }
+    return [flags unsignedIntegerValue];
+}
+
 @interface DockWidgetView : NSStackView
 @property (retain) NSView *dragTargetView;
+@property (readonly) NSUInteger dragIndexGeneration;
+- (void)invalidateDragIndex;
 @end
 
 @implementation DockWidgetView
+{
+    IntervalIndex *_dragIndex;          /* drag targets (buttons and scrubber) by x */
+    IntervalIndex *_scrubberIndex;      /* scrubber item indexes by content x */
+    BOOL _dragIndexValid;
+    NSInteger _scrubberIndexCount;
+}
+
 - (id)initWithFrame:(NSRect)frame
 {
     self = [super initWithFrame:frame];
     if (nil == self)
         return nil;
 
+    _dragIndex = IntervalIndexCreate();
+    _scrubberIndex = IntervalIndexCreate();
+    _scrubberIndexCount = -1;
+    if (0 == _dragIndex || 0 == _scrubberIndex)
+    {
+        [self release];
+        return nil;
+    }
+
     self.dragTargetView = [NSImageView imageViewWithImage:[NSImage imageNamed:@"DragTarget"]];
     self.dragTargetView.wantsLayer = YES;
     self.dragTargetView.layer.opacity = 0.80;
@@ -315,23 +1230,100 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 {
     self.dragTargetView = nil;
 
+    IntervalIndexDelete(_dragIndex);
+    IntervalIndexDelete(_scrubberIndex);
+
     [super dealloc];
 }
 
-- (NSSize)intrinsicContentSize
+- (NSSize)intrinsicContentSize
+{
+    return NSMakeSize(NSViewNoIntrinsicMetric, NSViewNoIntrinsicMetric);
+}
+
+- (void)layout
+{
+    [super layout];
+
+    [self invalidateDragIndex];
+}
+
+- (void)invalidateDragIndex
+{
+    _dragIndexValid = NO;
+    _scrubberIndexCount = -1;
+    _dragIndexGeneration++;
+}
+
+- (void)addDragView:(NSView *)view
+{
+    if (view.hidden)
+        return;
+
+    NSRect rect = [self convertRect:view.bounds fromView:view];
+    IntervalIndexAdd(_dragIndex, NSMinX(rect), NSMaxX(rect), (intptr_t)view);
+}
+
+- (void)buildDragIndex
+{
+    IntervalIndexReset(_dragIndex);
+    for (NSView *view in self.views)
+    {
+        if ([view isKindOfClass:[NSStackView class]])
+            for (NSView *subview in [(NSStackView *)view views])
+                [self addDragView:subview];
+        else if ([view isKindOfClass:[DockWidgetButton class]] ||
+            [view isKindOfClass:[DockWidgetScrubber class]])
+            [self addDragView:view];
+    }
+    IntervalIndexBuild(_dragIndex);
+    _dragIndexValid = YES;
+}
+
+- (void)buildScrubberIndex:(NSScrubber *)scrubber
 {
-    return NSMakeSize(NSViewNoIntrinsicMetric, NSViewNoIntrinsicMetric);
+    NSInteger count = scrubber.numberOfItems;
+    IntervalIndexReset(_scrubberIndex);
+    for (NSInteger index = 0; count > index; index++)
+    {
+        NSRect rect = [scrubber.scrubberLayout layoutAttributesForItemAtIndex:index].frame;
+        IntervalIndexAdd(_scrubberIndex, NSMinX(rect), NSMaxX(rect), index);
+    }
+    IntervalIndexBuild(_scrubberIndex);
+    _scrubberIndexCount = count;
 }
 
 - (NSView *)dragViewAtPoint:(NSPoint)point
 {
-    NSView *view;
+    /*
+     * The indexes are rebuilt lazily after layout, so the hover and drag paths
+     * only do a couple of binary searches instead of walking the view tree.
+     */
     point = [self convertPoint:point fromView:nil];
-    for (view = [self hitTest:point]; nil != view; view = view.superview)
-        if ([view isKindOfClass:[DockWidgetItemView class]] ||
-            [view isKindOfClass:[DockWidgetButton class]])
-            return view;
-    return nil;
+    if (!NSPointInRect(point, self.bounds))
+        return nil;
+
+    if (!_dragIndexValid)
+        [self buildDragIndex];
+
+    intptr_t value;
+    if (!IntervalIndexLookup(_dragIndex, point.x, &value))
+        return nil;
+
+    NSView *view = (id)value;
+    if (![view isKindOfClass:[DockWidgetScrubber class]])
+        return view;
+
+    NSScrubber *scrubber = (id)view;
+    if (_scrubberIndexCount != scrubber.numberOfItems)
+        [self buildScrubberIndex:scrubber];
+
+    point = [self convertPoint:point toView:scrubber];
+    point.x += scrubber.scrubberLayout.visibleRect.origin.x;
+    if (!IntervalIndexLookup(_scrubberIndex, point.x, &value))
+        return nil;
+
+    return [scrubber itemViewForItemAtIndex:value];
 }
 @end
 
@@ -351,12 +1343,29 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
 @implementation DockWidget
 {
-    NSMutableDictionary *_itemViews;
+    void *_badgePids, *_badgeIndexes, *_badgeEntries;
+    size_t _badgePidsCapacity, _badgeIndexesCapacity, _badgeEntriesCapacity;
+    /* warm start: the last model, replayed once at launch until the live model is built */
+    DockSnapshot *_snapshot;
+    NSData *_snapshotData;
+    BOOL _snapshotLoaded;
+    /* models are built on _modelQueue; a commit is dropped if a newer reset has started */
+    dispatch_queue_t _modelQueue;
+    NSUInteger _modelGeneration;        /* atomic */
+    BOOL _modelCommitted, _liveModelCommitted;
+    /* CPU and memory badges: one sweep over all running app pids per tick */
+    ProcessMetrics *_processMetrics;
+    NSTimer *_badgeTimer;
+    /* alternate rendering: icons from a shared atlas; nil unless dockIconAtlas */
+    DockWidgetAtlas *_atlas;
 }
 
 - (void)commonInit
 {
-    _itemViews = [[NSMutableDictionary alloc] init];
+    _modelQueue = dispatch_queue_create("DockWidget.model", DISPATCH_QUEUE_SERIAL);
+    _processMetrics = ProcessMetricsCreate(&(ProcessMetricsThresholds){ 0 });
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"dockIconAtlas"])
+        _atlas = [[DockWidgetAtlas alloc] init];
 
     self.folderController = [FolderController controller];
     self.folderController.delegate = self;
@@ -375,6 +1384,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     scrubber.continuous = NO;
     scrubber.itemAlignment = NSScrubberAlignmentNone;
     scrubber.scrubberLayout = layout;
+    [scrubber registerClass:[DockWidgetItemView class] forItemIdentifier:@"item"];
 
     NSStackView *leftItemView = [NSStackView stackViewWithViews:[NSArray array]];
     leftItemView.userInterfaceLayoutDirection = NSUserInterfaceLayoutDirectionLeftToRight;
@@ -412,14 +1422,32 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     view.orientation = NSUserInterfaceLayoutOrientationHorizontal;
     view.spacing = 0;
     self.view = view;
+
+    [[Settings sharedInstance]
+        addObserver:self
+        selector:@selector(settingsChange:)
+        fields:
+            SettingsFieldAcceptsDraggedItems |
+            SettingsFieldDockMagnification |
+            SettingsFieldShowsRunningApps |
+            SettingsFieldShowsTrash];
 }
 
 - (void)dealloc
 {
+    [[Settings sharedInstance]
+        removeObserver:self];
     [[NSWorkspace sharedWorkspace]
         removeTrashObserver:self];
     [[[NSWorkspace sharedWorkspace] notificationCenter]
         removeObserver:self];
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [_badgeTimer invalidate];
+    [_badgeTimer release];
+    ProcessMetricsDelete(_processMetrics);
+    [_atlas release];
 
     self.prominentView = nil;
 
@@ -429,7 +1457,13 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     self.folderController = nil;
     self.edgeWindowController = nil;
 
-    [_itemViews release];
+    free(_badgeEntries);
+    free(_badgeIndexes);
+    free(_badgePids);
+
+    DockSnapshotClose(_snapshot);
+    [_snapshotData release];
+    dispatch_release(_modelQueue);
 
     [super dealloc];
 }
@@ -448,7 +1482,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         object:nil];
     [[[NSWorkspace sharedWorkspace] notificationCenter]
         addObserver:self
-        selector:@selector(resetRunningApps:)
+        selector:@selector(activateNotify:)
         name:NSWorkspaceDidActivateApplicationNotification
         object:nil];
     [[[NSWorkspace sharedWorkspace] notificationCenter]
@@ -459,8 +1493,24 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     [[NSWorkspace sharedWorkspace]
         addTrashObserver:self
         selector:@selector(trashNotify:)];
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(refreshPolicyChange:)
+        name:RefreshPolicyNotification
+        object:nil];
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(fileOperationProgress:)
+        name:NSWorkspaceFileOperationProgressNotification
+        object:nil];
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(fileOperationDidEnd:)
+        name:NSWorkspaceFileOperationDidEndNotification
+        object:nil];
 
     [self reset];
+    [self scheduleBadgeTimer];
 }
 
 - (void)viewDidDisappear
@@ -469,6 +1519,27 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         removeTrashObserver:self];
     [[[NSWorkspace sharedWorkspace] notificationCenter]
         removeObserver:self];
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:RefreshPolicyNotification
+        object:nil];
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:NSWorkspaceFileOperationProgressNotification
+        object:nil];
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:NSWorkspaceFileOperationDidEndNotification
+        object:nil];
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(resetRunningApps:)
+        object:nil];
+
+    [_badgeTimer invalidate];
+    [_badgeTimer release];
+    _badgeTimer = nil;
+    RefreshPolicyTimerClear("DockBadges");
 
     self.edgeWindowController = nil;
 }
@@ -481,30 +1552,33 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 - (NSScrubberItemView *)scrubber:(NSScrubber *)scrubber viewForItemAtIndex:(NSInteger)index
 {
     DockWidgetApplication *app = [self.apps objectAtIndex:index];
-    DockWidgetItemView *view = [_itemViews objectForKey:app.key];
-    if (nil == view)
-    {
-        view = [[[DockWidgetItemView alloc] initWithFrame:NSZeroRect] autorelease];
-        [_itemViews setObject:view forKey:app.key];
-    }
+    /* the scrubber owns and reuses item views; every property is set from the app */
+    DockWidgetItemView *view = [scrubber makeItemWithIdentifier:@"item" owner:nil];
+    [view prepareWithAtlas:_atlas];
 
-    BOOL showsRunningApps = [[NSUserDefaults standardUserDefaults] boolForKey:@"showsRunningApps"];
-    BOOL dockMagnification = [[NSUserDefaults standardUserDefaults] boolForKey:@"dockMagnification"];
+    const SettingsSnapshot *settings = GetSettings();
+    BOOL showsRunningApps = settings->showsRunningApps;
+    BOOL dockMagnification = settings->dockMagnification;
     view.appPath = app.path;
     view.appPid = app.pid;
+    view.appIconKey = app.iconKey;
     view.appIcon = app.icon;
     view.appRunning = showsRunningApps ? 0 != app.pid : NO;
     view.appLaunching = showsRunningApps ? app.launching : NO;
     view.prominent = NO;
     view.dockMagnification = dockMagnification;
+    view.appBadge = showsRunningApps && 0 != app.pid && 0 != _processMetrics ?
+        ProcessMetricsBadge(_processMetrics, app.pid) : ProcessMetricsBadgeNone;
 
     return view;
 }
 
 - (void)scrubber:(NSScrubber *)scrubber didSelectItemAtIndex:(NSInteger)index
 {
+    NSTimeInterval start = InputLatencyStart();
     DockWidgetApplication *app = [self.apps objectAtIndex:index];
     [self launchApp:app.path pid:app.pid];
+    InputLatencyRecord("DockLaunch", start);
     scrubber.selectedIndex = -1;
 }
 
@@ -514,7 +1588,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     [(id)self.prominentView setProminent:NO];
 
     if (self.folderController.presented ||
-        ![[NSUserDefaults standardUserDefaults] boolForKey:@"acceptsDraggedItems"])
+        !GetSettings()->acceptsDraggedItems)
         return;
 
     if (isnan(point.x))
@@ -535,7 +1609,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     [(id)self.prominentView setProminent:NO];
 
     if (self.folderController.presented ||
-        ![[NSUserDefaults standardUserDefaults] boolForKey:@"acceptsDraggedItems"])
+        !GetSettings()->acceptsDraggedItems)
         return;
 
     DockWidgetView *view = self.view;
@@ -561,22 +1635,33 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     dragURLs:(NSArray *)urls atPoint:(NSPoint)point operation:(NSDragOperation)operation
 {
     DockWidgetView *view = self.view;
+    EdgeWindowDragSession *session = controller.dragSession;
     NSDragOperation res = NSDragOperationNone;
 
     if (self.folderController.presented ||
-        ![[NSUserDefaults standardUserDefaults] boolForKey:@"acceptsDraggedItems"])
+        !GetSettings()->acceptsDraggedItems)
     {
         view.dragTargetView.hidden = YES;
+        session.hasLastResult = NO;
         return res;
     }
 
     if (nil == urls)
     {
         view.dragTargetView.hidden = YES;
+        session.hasLastResult = NO;
         return res;
     }
 
     NSView *dragView = [view dragViewAtPoint:point];
+
+    /* draggingUpdated: fires continuously; only recompute when target or operation changes */
+    if (session.hasLastResult &&
+        session.lastTarget == dragView &&
+        session.lastGeneration == view.dragIndexGeneration &&
+        session.lastOperation == operation)
+        return session.lastResult;
+
     if ([dragView isKindOfClass:[DockWidgetItemView class]])
         res = 0 < urls.count ? NSDragOperationGeneric : NSDragOperationNone;
     else
@@ -585,11 +1670,9 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         NSURL *url = [(DockWidgetButton *)dragView url];
         if (nil != url)
         {
-            NSNumber *value;
-            BOOL isDir = [url getResourceValue:&value forKey:NSURLIsDirectoryKey error:0] &&
-                [value boolValue];
-            BOOL isApp = [url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] &&
-                [value boolValue];
+            NSUInteger flags = dragTargetFlags(url, session);
+            BOOL isDir = 0 != (flags & DockDragTargetIsDir);
+            BOOL isApp = 0 != (flags & DockDragTargetIsApp);
             if (isApp)
                 res = 0 < urls.count ? NSDragOperationGeneric : NSDragOperationNone;
             else if (isDir)
@@ -619,6 +1702,12 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     view.dragTargetView.frame = [view convertRect:dragView.visibleRect fromView:dragView];
     view.dragTargetView.hidden = NSDragOperationNone == res;
 
+    session.lastTarget = dragView;
+    session.lastGeneration = view.dragIndexGeneration;
+    session.lastOperation = operation;
+    session.lastResult = res;
+    session.hasLastResult = YES;
+
     return res;
 }
 
@@ -630,7 +1719,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     BOOL res = NO;
 
     if (self.folderController.presented ||
-        ![[NSUserDefaults standardUserDefaults] boolForKey:@"acceptsDraggedItems"])
+        !GetSettings()->acceptsDraggedItems)
     {
         view.dragTargetView.hidden = YES;
         return res;
@@ -655,11 +1744,9 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         NSURL *url = [(DockWidgetButton *)dragView url];
         if (nil != url)
         {
-            NSNumber *value;
-            BOOL isDir = [url getResourceValue:&value forKey:NSURLIsDirectoryKey error:0] &&
-                [value boolValue];
-            BOOL isApp = [url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] &&
-                [value boolValue];
+            NSUInteger flags = dragTargetFlags(url, controller.dragSession);
+            BOOL isDir = 0 != (flags & DockDragTargetIsDir);
+            BOOL isApp = 0 != (flags & DockDragTargetIsApp);
             if (isApp)
                 res = 0 < urls.count &&
                     nil != [[NSWorkspace sharedWorkspace]
@@ -727,44 +1814,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
 - (NSArray *)apps
 {
-    BOOL updateItemViews = NO;
-
-    if (nil == self.defaultApps)
-    {
-        self.runningApps = nil;
-
-        NSMutableArray *newDefaultApps = [NSMutableArray array];
-        [self enumerateDefaultAppsFolder:^(NSURL *url, NSStackViewGravity gravity)
-        {
-            if (NSStackViewGravityCenter != gravity)
-                return;
-
-            DockWidgetApplication *app = [[[DockWidgetApplication alloc] init] autorelease];
-            app.name = [url.path lastPathComponent];
-            app.path = url.path;
-            app.icon = [[NSWorkspace sharedWorkspace] iconForFile:app.path];
-            app.isDefault = YES;
-            [newDefaultApps addObject:app];
-        }];
-
-        if (0 == newDefaultApps.count)
-        {
-            NSArray *defaultApps = [[NSUserDefaults standardUserDefaults] arrayForKey:@"defaultApps"];
-            for (NSDictionary *a in defaultApps)
-            {
-                DockWidgetApplication *app = [[[DockWidgetApplication alloc] init] autorelease];
-                app.name = [a objectForKey:@"NSApplicationName"];
-                app.path = [a objectForKey:@"NSApplicationPath"];
-                app.icon = [[NSWorkspace sharedWorkspace] iconForFile:app.path];
-                app.isDefault = YES;
-                [newDefaultApps addObject:app];
-            }
-        }
-
-        self.defaultApps = [[newDefaultApps copy] autorelease];
-
-        updateItemViews = YES;
-    }
+    BOOL updateAtlas = NO;
 
     if (nil == self.runningApps)
     {
@@ -788,9 +1838,11 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
             NSString *path = a.bundleURL.path;
             if (nil == path)
                 continue;
+            NSString *iconKey = nil;
             if (nil != (app = [defaultAppsDict objectForKey:path]) && 0 == app.pid)
             {
-                app.icon = a.icon;
+                app.icon = [[IconStore sharedInstance] iconForRunningApplication:a key:&iconKey];
+                app.iconKey = iconKey;
                 app.pid = a.processIdentifier;
                 app.launching = !a.finishedLaunching;
                 continue;
@@ -799,7 +1851,8 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
             app = [[[DockWidgetApplication alloc] init] autorelease];
             app.name = a.localizedName;
             app.path = path;
-            app.icon = a.icon;
+            app.icon = [[IconStore sharedInstance] iconForRunningApplication:a key:&iconKey];
+            app.iconKey = iconKey;
             app.pid = a.processIdentifier;
             app.launching = !a.finishedLaunching;
             [newRunningApps addObject:app];
@@ -807,81 +1860,190 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
         self.runningApps = [[newRunningApps copy] autorelease];
 
-        updateItemViews = YES;
+        updateAtlas = YES;
     }
 
-    BOOL showsRunningApps = [[NSUserDefaults standardUserDefaults] boolForKey:@"showsRunningApps"];
+    NSArray *defaultApps = nil != self.defaultApps ? self.defaultApps : [NSArray array];
+    BOOL showsRunningApps = GetSettings()->showsRunningApps;
     NSArray *apps = showsRunningApps ?
-        [self.defaultApps arrayByAddingObjectsFromArray:self.runningApps] :
-        self.defaultApps;
+        [defaultApps arrayByAddingObjectsFromArray:self.runningApps] :
+        defaultApps;
+
+    if (updateAtlas)
+        [self prepareAtlasForApps:apps];
+
+    return apps;
+}
+
+- (void)prepareAtlasForApps:(NSArray *)apps
+{
+    if (nil == _atlas)
+        return;
+
+    /* rasterize new icons in one batch, so that each page image is copied once per change */
+    for (DockWidgetApplication *app in apps)
+        [_atlas addIcon:app.icon key:iconKeyAtlasKey(app.iconKey, app.path)];
+    if (![_atlas commit])
+        return;
+
+    [self resetAtlasContents];
+}
+
+- (void)resetAtlasContents
+{
+    /* move every visible item to the current page images, so that the strip shares a few textures */
+    NSScrubber *scrubber = [self.view viewWithTag:'dock'];
+    for (NSInteger i = 0, count = scrubber.numberOfItems; count > i; i++)
+        [(DockWidgetItemView *)[scrubber itemViewForItemAtIndex:i] resetAtlasContents];
+
+    DockWidgetView *view = self.view;
+    for (NSStackView *itemView in [NSArray arrayWithObjects:
+        [view.views objectAtIndex:0], [view.views objectAtIndex:3], nil])
+        for (DockWidgetButton *button in itemView.views)
+            [button resetAtlasContents];
+}
+
+- (void)reset
+{
+    [self resetDrag];
+
+    if (!_snapshotLoaded)
+    {
+        _snapshotLoaded = YES;
+        [self loadSnapshot];
+    }
 
-    if (updateItemViews)
+    if (!_modelCommitted)
     {
-        NSMutableDictionary *itemViews = _itemViews;
+        /* nothing on screen yet: build now, from the warm start snapshot if there is one */
+        DockWidgetModel *model = [DockWidgetModel modelWithSnapshot:_snapshot superseded:nil];
+        model.generation = __atomic_add_fetch(&_modelGeneration, 1, __ATOMIC_RELAXED);
+        [self commitModel:model];
+
+        if (0 != _snapshot)
+        {
+            DockSnapshotClose(_snapshot);
+            _snapshot = 0;
+            StartupTimingsMark("dock snapshot");
+
+            /* reconcile against the live model after the first paint */
+            [self performSelector:@selector(buildModel) withObject:nil afterDelay:0];
+        }
+    }
+    else
+        [self buildModel];
+}
 
-        _itemViews = [[NSMutableDictionary alloc] init];
-        for (DockWidgetApplication *app in apps)
+- (void)buildModel
+{
+    NSUInteger generation = __atomic_add_fetch(&_modelGeneration, 1, __ATOMIC_RELAXED);
+    NSUInteger *pgeneration = &_modelGeneration;
+    dispatch_async(_modelQueue, ^
+    {
+        @autoreleasepool
         {
-            id key = app.key;
-            id obj = [itemViews objectForKey:key];
-            if (nil != obj)
-                [_itemViews setObject:obj forKey:key];
+            DockWidgetModel *model = [DockWidgetModel
+                modelWithSnapshot:0
+                superseded:^BOOL(void)
+                {
+                    return generation != __atomic_load_n(pgeneration, __ATOMIC_RELAXED);
+                }];
+            if (nil == model)
+                return;
+
+            model.generation = generation;
+            [self
+                performSelectorOnMainThread:@selector(commitModel:)
+                withObject:model
+                waitUntilDone:NO];
         }
+    });
+}
+
+- (void)commitModel:(DockWidgetModel *)model
+{
+    if (model.generation != _modelGeneration)
+        return; /* superseded by a newer reset */
+
+    _modelCommitted = YES;
 
-        [itemViews release];
+    if (nil != model.snapshotData)
+    {
+        [self writeSnapshotData:model.snapshotData];
+        if (!_liveModelCommitted)
+        {
+            _liveModelCommitted = YES;
+            StartupTimingsMark("dock live");
+        }
     }
 
-    return apps;
+    [self resetPersistentItems:model.persistentItems];
+    [self resetDefaultApps:model.defaultApps];
 }
 
-- (void)enumerateDefaultAppsFolder:(void (^)(NSURL *url, NSStackViewGravity gravity))block
+- (void)loadSnapshot
 {
     NSString *defaultAppsFolder = [[NSUserDefaults standardUserDefaults]
         stringForKey:@"defaultAppsFolder"];
-    if (nil != defaultAppsFolder)
-    {
-        NSArray *contents = [[NSFileManager defaultManager]
-            contentsOfDirectoryAtPath:defaultAppsFolder error:0];
-        contents = [contents sortedArrayUsingSelector:@selector(localizedStandardCompare:)];
-        for (NSString *c in contents)
-        {
-            if ([c hasPrefix:@"."])
-                continue;
+    NSString *path = dockSnapshotPath();
+    if (nil == defaultAppsFolder || nil == path)
+        return;
 
-            NSURL *url = [NSURL
-                URLByResolvingAliasFileAtURL:[NSURL
-                    fileURLWithPath:[defaultAppsFolder stringByAppendingPathComponent:c]]
-                options:NSURLBookmarkResolutionWithoutUI|NSURLBookmarkResolutionWithoutMounting
-                error:0];
-            if (nil == url)
-                continue;
+    _snapshot = DockSnapshotOpen(path.fileSystemRepresentation);
+    if (0 == _snapshot)
+        return;
 
-            NSStackViewGravity gravity;
-            NSNumber *value;
-            if ([c hasSuffix:@".lpinned"])
-                gravity = NSStackViewGravityLeading;
-            else if ([c hasSuffix:@".pinned"])
-                gravity = NSStackViewGravityTrailing;
-            else if ([url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] &&
-                [value boolValue])
-                gravity = NSStackViewGravityCenter;
-            else
-                gravity = NSStackViewGravityTrailing;
-            block(url, gravity);
-        }
+    if (0 != strcmp(DockSnapshotRoot(_snapshot), defaultAppsFolder.fileSystemRepresentation))
+    {
+        DockSnapshotClose(_snapshot);
+        _snapshot = 0;
+        return;
     }
+
+    size_t size;
+    const void *data = DockSnapshotData(_snapshot, &size);
+    _snapshotData = [[NSData alloc] initWithBytes:data length:size];
 }
 
-- (void)reset
+- (void)writeSnapshotData:(NSData *)snapshotData
 {
-    [self resetDrag];
-    [self resetPersistentItems];
-    [self resetDefaultApps];
+    if ([_snapshotData isEqualToData:snapshotData])
+        return;
+
+    [_snapshotData release];
+    _snapshotData = [snapshotData retain];
+
+    NSString *path = dockSnapshotPath();
+    if (nil == path)
+        return;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^
+    {
+        [[NSFileManager defaultManager]
+            createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+            withIntermediateDirectories:YES
+            attributes:nil
+            error:0];
+        DockSnapshotWrite(path.fileSystemRepresentation, snapshotData.bytes, snapshotData.length);
+    });
+}
+
+- (void)settingsChange:(Settings *)settings
+{
+    if (nil == self.view.window)
+        return;
+
+    /* display settings apply to the current apps now; the rebuilt model follows */
+    NSScrubber *scrubber = [self.view viewWithTag:'dock'];
+    self.runningApps = nil;
+    [scrubber reloadData];
+
+    [self reset];
+    [self scheduleBadgeTimer];
 }
 
 - (void)resetDrag
 {
-    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"acceptsDraggedItems"])
+    if (GetSettings()->acceptsDraggedItems)
     {
         self.edgeWindowController = [EdgeWindowController controller];
         self.edgeWindowController.delegate = self;
@@ -890,71 +2052,70 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         self.edgeWindowController = nil;
 }
 
-- (void)resetDefaultApps
+- (void)resetDefaultApps:(NSArray *)defaultApps
 {
+    /*
+     * Same apps in the same order with the same icons: keep the current objects and views,
+     * just diff running apps. An app updated in place keeps its path but gets a new icon key.
+     */
+    NSArray *oldDefaultApps = self.defaultApps;
+    BOOL same = oldDefaultApps.count == defaultApps.count;
+    for (NSUInteger i = 0; same && defaultApps.count > i; i++)
+    {
+        DockWidgetApplication *oldApp = [oldDefaultApps objectAtIndex:i];
+        DockWidgetApplication *app = [defaultApps objectAtIndex:i];
+        same = [oldApp.path isEqualToString:app.path] &&
+            (oldApp.iconKey == app.iconKey || [oldApp.iconKey isEqualToString:app.iconKey]);
+    }
+    if (same)
+    {
+        [self resetRunningApps:nil];
+        return;
+    }
+
     NSScrubber *scrubber = [self.view viewWithTag:'dock'];
-    self.defaultApps = nil;
+    self.defaultApps = [[defaultApps copy] autorelease];
+    self.runningApps = nil;
     [scrubber reloadData];
 }
 
-- (void)resetPersistentItems
+- (void)resetPersistentItems:(NSArray *)items
 {
+    BOOL atlasChanged = NO;
+    if (nil != _atlas)
+    {
+        for (DockWidgetPersistentItem *item in items)
+            [_atlas addIcon:item.icon key:iconKeyAtlasKey(item.iconKey, item.url.path)];
+        atlasChanged = [_atlas commit];
+    }
+
     NSMutableArray *leftViews = [NSMutableArray array];
     NSMutableArray *rightViews = [NSMutableArray array];
-    [self enumerateDefaultAppsFolder:^(NSURL *url, NSStackViewGravity gravity)
+    for (DockWidgetPersistentItem *item in items)
     {
-        switch (gravity)
-        {
-        case NSStackViewGravityLeading:
-            if (maxPersistentItemCount < leftViews.count)
-                return;
-            break;
-        case NSStackViewGravityTrailing:
-            if (maxPersistentItemCount < rightViews.count)
-                return;
-            break;
-        default:
-            return;
-        }
-
-        NSSize iconSize = NSMakeSize(dockItemSize.height, dockItemSize.height); // square!
-        NSRect iconRect = NSMakeRect(dockDotHeight / 2, dockDotHeight,
-            iconSize.height - dockDotHeight, iconSize.height - dockDotHeight);  // square!
-        NSRect prominentIconRect = NSMakeRect(0, dockDotHeight,
-            iconSize.height, iconSize.height);  // square!
-        NSImage *image = [self
-            makeImageWithSize:iconSize
-            drawImage:[[NSWorkspace sharedWorkspace] iconForFile:url.path]
-            inRect:iconRect];
-        NSImage *prominentImage = [self
-            makeImageWithSize:iconSize
-            drawImage:[[NSWorkspace sharedWorkspace] iconForFile:url.path]
-            inRect:prominentIconRect];
         DockWidgetButton *button = [DockWidgetButton
             buttonWithTitle:@""
             target:self
             action:@selector(persistentItemClick:)];
-        button.regularImage = image;
-        button.prominentImage = prominentImage;
         button.translatesAutoresizingMaskIntoConstraints = NO;
         button.bordered = NO;
-        button.url = url;
-        [button resetImage];
-
-        switch (gravity)
+        button.url = item.url;
+        if (nil != _atlas)
+            [button setAtlas:_atlas icon:item.icon key:item.iconKey];
+        else
         {
-        case NSStackViewGravityLeading:
+            button.regularImage = item.image;
+            button.prominentImage = item.prominentImage;
+            [button resetImage];
+        }
+
+        if (NSStackViewGravityLeading == item.gravity)
             [leftViews addObject:button];
-            break;
-        case NSStackViewGravityTrailing:
+        else
             [rightViews addObject:button];
-            break;
-        default:
-            break;
-        }
-    }];
+    }
 
-    BOOL showsTrash = [[NSUserDefaults standardUserDefaults] boolForKey:@"showsTrash"];
+    BOOL showsTrash = GetSettings()->showsTrash;
     [self.view viewWithTag:'sep '].hidden = !(showsTrash || 0 < rightViews.count);
     [self.view viewWithTag:'trsh'].hidden = !showsTrash;
 
@@ -964,11 +2125,35 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
     [leftItemView setViews:leftViews inGravity:NSStackViewGravityTrailing];
     [rightItemView setViews:rightViews inGravity:NSStackViewGravityTrailing];
+    [view invalidateDragIndex];
+
+    if (atlasChanged)
+        [self resetAtlasContents];
+}
+
+- (void)activateNotify:(NSNotification *)notification
+{
+    /* activations come in bursts when switching between apps; unless on AC power
+     * rescan the running apps once per burst rather than once per activation */
+    NSTimeInterval delay = RefreshPolicyCoalesceDelay();
+    if (0 >= delay)
+    {
+        [self resetRunningApps:notification];
+        return;
+    }
+
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(resetRunningApps:)
+        object:nil];
+    [self performSelector:@selector(resetRunningApps:) withObject:nil afterDelay:delay];
 }
 
 - (void)resetRunningApps:(NSNotification *)notification
 {
     //NSLog(@"%s %@", __func__, notification);
+    ResourceSpan span;
+    ResourceAccountBegin(ResourceAccountGet("Dock"), &span);
     @try
     {
         NSScrubber *scrubber = [self.view viewWithTag:'dock'];
@@ -1130,6 +2315,100 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         self.runningApps = nil;
         [scrubber reloadData];
     }
+    ResourceAccountEnd(&span);
+}
+
+- (void)scheduleBadgeTimer
+{
+    [_badgeTimer invalidate];
+    [_badgeTimer release];
+    _badgeTimer = nil;
+
+    /* badges sample every running app; they are off unless dockBadgeInterval is set */
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSTimeInterval baseInterval = [defaults doubleForKey:@"dockBadgeInterval"];
+    if (0 > baseInterval || 0 == _processMetrics || !GetSettings()->showsRunningApps)
+        baseInterval = 0;
+    if (0 == baseInterval)
+    {
+        RefreshPolicyTimerClear("DockBadges");
+        return;
+    }
+
+    ProcessMetricsSetThresholds(_processMetrics, &(ProcessMetricsThresholds)
+    {
+        .cpu = [defaults doubleForKey:@"dockBadgeCpuThreshold"],
+        .memory = (uint64_t)[defaults integerForKey:@"dockBadgeMemoryThreshold"] << 20,
+    });
+
+    NSTimeInterval interval = RefreshPolicyInterval(baseInterval);
+    _badgeTimer = [[NSTimer
+        timerWithTimeInterval:interval
+        target:self
+        selector:@selector(badgeTick:)
+        userInfo:nil
+        repeats:YES] retain];
+    _badgeTimer.tolerance = interval / 10;
+    [[NSRunLoop currentRunLoop] addTimer:_badgeTimer forMode:NSDefaultRunLoopMode];
+    RefreshPolicyTimerSet("DockBadges", baseInterval, 0, true);
+}
+
+- (void)refreshPolicyChange:(NSNotification *)notification
+{
+    if (nil == _badgeTimer)
+        return;
+
+    [self scheduleBadgeTimer];
+}
+
+- (void)badgeTick:(NSTimer *)sender
+{
+    ResourceAccount *account = ResourceAccountGet("DockBadges");
+    if (!ResourceAccountShouldRun(account))
+        return;
+
+    ResourceSpan span;
+    ResourceAccountBegin(account, &span);
+
+    /* one sweep over every running app; only views whose badge changed are touched */
+    NSScrubber *scrubber = [self.view viewWithTag:'dock'];
+    NSArray *apps = self.apps;
+    NSUInteger count = 0;
+    pid_t *pids = scratchBuffer(&_badgePids, &_badgePidsCapacity,
+        apps.count + 1, sizeof *pids);
+    NSUInteger *indexes = scratchBuffer(&_badgeIndexes, &_badgeIndexesCapacity,
+        apps.count + 1, sizeof *indexes);
+    ProcessMetricsEntry *entries = scratchBuffer(&_badgeEntries, &_badgeEntriesCapacity,
+        apps.count + 1, sizeof *entries);
+    if (0 == pids || 0 == indexes || 0 == entries)
+        goto exit;
+
+    for (NSUInteger i = 0, n = apps.count; n > i; i++)
+    {
+        DockWidgetApplication *app = [apps objectAtIndex:i];
+        if (0 != app.pid)
+        {
+            pids[count] = app.pid;
+            indexes[count] = i;
+            count++;
+        }
+    }
+
+    if (0 == ProcessMetricsSample(_processMetrics, pids, count, entries))
+        goto exit;
+
+    /* views off screen get their badge when the scrubber asks for them again */
+    for (NSUInteger i = 0; count > i; i++)
+    {
+        if (!entries[i].changed)
+            continue;
+
+        DockWidgetItemView *view = (id)[scrubber itemViewForItemAtIndex:indexes[i]];
+        view.appBadge = entries[i].badge;
+    }
+
+exit:
+    ResourceAccountEnd(&span);
 }
 
 - (void)launchApp:(NSString *)path pid:(pid_t)pid
@@ -1147,10 +2426,8 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
             activated = [runningApp activateWithOptions:NSApplicationActivateIgnoringOtherApps];
         else
         {
-            NSNumber *value;
-            BOOL isApp =
-                [runningApp.bundleURL getResourceValue:&value forKey:NSURLIsApplicationKey error:0] &&
-                [value boolValue];
+            BOOL isApp = 0 != ([[MetadataStore sharedInstance] flagsForURL:runningApp.bundleURL] &
+                MetadataIndexApplication);
             if (!isApp)
                 activated = [[NSWorkspace sharedWorkspace] launchAppWithBundleIdentifier:runningApp.bundleIdentifier
                     options:NSWorkspaceLaunchDefault
@@ -1167,14 +2444,11 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     NSURL *url = [sender url];
     if (nil != url)
     {
-        NSNumber *value;
-        BOOL isDir = [url getResourceValue:&value forKey:NSURLIsDirectoryKey error:0] &&
-            [value boolValue];
-        BOOL isPkg = [url getResourceValue:&value forKey:NSURLIsPackageKey error:0] &&
-            [value boolValue];
-        BOOL isApp = [url getResourceValue:&value forKey:NSURLIsApplicationKey error:0] &&
-            [value boolValue];
-        BOOL open = ![[NSUserDefaults standardUserDefaults] boolForKey:@"showsFoldersInTouchBar"];
+        NSUInteger flags = [[MetadataStore sharedInstance] flagsForURL:url];
+        BOOL isDir = 0 != (flags & MetadataIndexDirectory);
+        BOOL isPkg = 0 != (flags & MetadataIndexPackage);
+        BOOL isApp = 0 != (flags & MetadataIndexApplication);
+        BOOL open = !GetSettings()->showsFoldersInTouchBar;
         if (!isDir || isPkg || isApp)
             [[NSWorkspace sharedWorkspace] openURL:url];
         else if (open)
@@ -1194,19 +2468,71 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
     }
 }
 
+- (DockWidgetButton *)persistentButtonForURL:(NSURL *)url
+{
+    DockWidgetView *view = self.view;
+    for (NSStackView *itemView in
+        [NSArray arrayWithObjects:[view.views objectAtIndex:0], [view.views objectAtIndex:3], nil])
+        for (DockWidgetButton *button in itemView.views)
+            if ([button.url isEqual:url])
+                return button;
+
+    return nil;
+}
+
+- (void)fileOperationProgress:(NSNotification *)notification
+{
+    NSNumber *fraction = [notification.userInfo objectForKey:NSWorkspaceFileOperationProgressKey];
+    [self persistentButtonForURL:notification.object].progress = fraction.doubleValue;
+}
+
+- (void)fileOperationDidEnd:(NSNotification *)notification
+{
+    NSURL *url = notification.object;
+    NSDictionary *userInfo = notification.userInfo;
+    NSError *error = [userInfo objectForKey:NSWorkspaceFileOperationErrorKey];
+
+    [self persistentButtonForURL:url].progress = -1;
+
+    /* Finder reports the errors of the operations that it retries */
+    if (nil == error || ECANCELED == error.code ||
+        [[userInfo objectForKey:NSWorkspaceFileOperationRetriedKey] boolValue])
+        return;
+
+    NSAlert *alert = [[[NSAlert alloc] init] autorelease];
+    alert.alertStyle = NSAlertStyleWarning;
+    alert.messageText = [[userInfo objectForKey:NSWorkspaceFileOperationCompletedKey] boolValue] ?
+        [NSString stringWithFormat:
+            @"The items were moved to \"%@\", but some originals could not be removed.",
+            url.lastPathComponent] :
+        [NSString stringWithFormat:
+            @"The items could not be copied or moved to \"%@\".",
+            url.lastPathComponent];
+    alert.informativeText = error.localizedDescription;
+    [alert addButtonWithTitle:@"OK"];
+    [alert runModal];
+}
+
+- (BOOL)isTrashFull
+{
+    NSWorkspaceTrashState state;
+    [[[NSWorkspace sharedWorkspace] trashState] read:&state];
+    return state.full;
+}
+
 - (NSImage *)trashImage
 {
-    BOOL full = [[NSWorkspace sharedWorkspace] isTrashFull];
+    BOOL full = [self isTrashFull];
     return [NSImage imageNamed:full ? @"TrashFull" : @"TrashEmpty"];
 }
 
 - (NSImage *)trashProminentImage
 {
-    BOOL full = [[NSWorkspace sharedWorkspace] isTrashFull];
+    BOOL full = [self isTrashFull];
     return [NSImage imageNamed:full ? @"TrashProminentFull" : @"TrashProminentEmpty"];
 }
 
-- (void)trashNotify:(NSNotification *)notification
+- (void)trashNotify:(ServiceState *)state
 {
     DockWidgetButton *button = [self.view viewWithTag:'trsh'];
     button.regularImage = [self trashImage];
@@ -1216,7 +2542,7 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
 
 - (void)trashClick:(id)sender
 {
-    BOOL open = ![[NSUserDefaults standardUserDefaults] boolForKey:@"showsFoldersInTouchBar"];
+    BOOL open = !GetSettings()->showsFoldersInTouchBar;
     if (open)
         [[NSWorkspace sharedWorkspace] openTrash];
     else
@@ -1227,24 +2553,8 @@ static NSShadow *shadowWithOffset(NSSize shadowOffset)
         self.folderController.sortKey = nil;
         self.folderController.imagePosition = NSImageLeft;
         self.folderController.showsEmptyButton = YES;
-        self.folderController.emptyButtonEnabled = [[NSWorkspace sharedWorkspace] isTrashFull];
+        self.folderController.emptyButtonEnabled = [self isTrashFull];
         [self.folderController present];
     }
 }
-
-- (NSImage *)makeImageWithSize:(NSSize)newSize
-    drawImage:(NSImage *)oldImage inRect:(NSRect)newRect
-{
-    NSSize oldSize = oldImage.size;
-    NSImage *newImage = [[[NSImage alloc] initWithSize:newSize] autorelease];
-    [newImage lockFocus];
-    [[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
-    [oldImage
-        drawInRect:newRect
-        fromRect:NSMakeRect(0, 0, oldSize.width, oldSize.height)
-        operation:NSCompositingOperationSourceOver
-        fraction:1.0];
-    [newImage unlockFocus];
-    return newImage;
-}
 @end
@@ -0,0 +1,223 @@
+/**
+ * @file MetricsFeedWidget.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "MetricsFeedWidget.h"
+#import "ImageTitleView.h"
+#import "MetricsRing.h"
+#import "RefreshPolicy.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
+
+/*
+ * Producers may publish much faster than the Touch Bar can show. The ring is
+ * drained at most once per display frame and only the latest record for each
+ * metric name is kept; the view is updated only when something changed. At most
+ * MetricsFeedMaxNames metrics are kept: a new name evicts the oldest one, so a
+ * producer that invents names cannot grow the widget without bound.
+ */
+static const NSTimeInterval MetricsFeedFrameInterval = 1.0 / 30;
+static const NSTimeInterval MetricsFeedOpenInterval = 1.0;
+#define MetricsFeedBatchCount           64
+#define MetricsFeedMaxNames             16
+
+@interface MetricsFeedWidgetView : ImageTitleView
+@end
+
+@implementation MetricsFeedWidgetView
+- (NSSize)intrinsicContentSize
+{
+    return NSMakeSize(180, NSViewNoIntrinsicMetric);
+}
+@end
+
+@interface MetricsFeedWidget ()
+@property (copy) NSString *ringName;
+@property (retain) NSTimer *timer;
+@property (retain) NSDate *openDate;
+@end
+
+@implementation MetricsFeedWidget
+{
+    MetricsRing *_ring;
+    NSMutableArray *_names;
+    NSMutableDictionary *_values;
+}
+
+- (void)commonInit
+{
+    self.customizationLabel = @"Metrics Feed";
+
+    ImageTitleView *imageTitleView = [[[MetricsFeedWidgetView alloc]
+        initWithFrame:NSZeroRect] autorelease];
+    imageTitleView.wantsLayer = YES;
+    imageTitleView.layer.cornerRadius = 8.0;
+    imageTitleView.layer.backgroundColor = [[NSColor colorWithWhite:0.0 alpha:0.5] CGColor];
+    imageTitleView.titleFont = [NSFont systemFontOfSize:[NSFont
+        systemFontSizeForControlSize:NSControlSizeSmall]];
+    imageTitleView.titleLineBreakMode = NSLineBreakByTruncatingTail;
+    imageTitleView.layoutOptions = ImageTitleViewLayoutOptionTitle;
+    imageTitleView.title = @"--";
+    self.view = imageTitleView;
+
+    NSString *ringName = [[NSUserDefaults standardUserDefaults] stringForKey:@"metricsFeedName"];
+    self.ringName = 0 < ringName.length ? ringName : @MetricsRingDefaultName;
+
+    _names = [[NSMutableArray alloc] init];
+    _values = [[NSMutableDictionary alloc] init];
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [self.timer invalidate];
+    self.timer = nil;
+
+    MetricsRingClose(_ring);
+    [_names release];
+    [_values release];
+
+    self.ringName = nil;
+    self.openDate = nil;
+
+    [super dealloc];
+}
+
+- (void)viewWillAppear
+{
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(refreshPolicyChange:)
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self scheduleTimer];
+
+    [self tick:nil];
+}
+
+- (void)viewDidDisappear
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self.timer invalidate];
+    self.timer = nil;
+    RefreshPolicyTimerClear("MetricsFeed");
+
+    /* reopen on the next appearance; the producer may have recreated the segment */
+    MetricsRingClose(_ring);
+    _ring = 0;
+    self.openDate = nil;
+}
+
+- (void)scheduleTimer
+{
+    NSTimeInterval interval = RefreshPolicyInterval(MetricsFeedFrameInterval);
+
+    [self.timer invalidate];
+    self.timer = [NSTimer
+        timerWithTimeInterval:interval
+        target:self
+        selector:@selector(tick:)
+        userInfo:nil
+        repeats:YES];
+    self.timer.tolerance = interval / 2;
+    [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
+    RefreshPolicyTimerSet("MetricsFeed", MetricsFeedFrameInterval, 0, true);
+}
+
+- (void)refreshPolicyChange:(NSNotification *)notification
+{
+    if (nil == self.timer)
+        return;
+
+    [self scheduleTimer];
+}
+
+- (void)tick:(NSTimer *)sender
+{
+    if (0 == _ring)
+    {
+        NSDate *now = [NSDate date];
+        if (nil != self.openDate &&
+            MetricsFeedOpenInterval > [now timeIntervalSinceDate:self.openDate])
+            return;
+        self.openDate = now;
+
+        _ring = MetricsRingOpen(self.ringName.fileSystemRepresentation);
+        if (0 == _ring)
+            return;
+    }
+
+    /* idle frames cost a single load of the ring head; only frames with data are accounted */
+    if (MetricsRingIsEmpty(_ring))
+        return;
+
+    ResourceSpan span;
+    ResourceAccountBegin(ResourceAccountGet("MetricsFeed"), &span);
+
+    MetricsRingRecord records[MetricsFeedBatchCount];
+    size_t count;
+    BOOL changed = NO;
+    while (0 != (count = MetricsRingConsume(_ring, records, MetricsFeedBatchCount)))
+    {
+        for (size_t i = 0; count > i; i++)
+        {
+            NSString *name = [NSString stringWithUTF8String:records[i].name];
+            NSString *value = '\0' != records[i].text[0] ?
+                [NSString stringWithUTF8String:records[i].text] :
+                [NSString stringWithFormat:@"%g", records[i].value];
+            if (nil == name || nil == value)
+                continue; /* not UTF-8 */
+
+            NSString *oldValue = [_values objectForKey:name];
+            if ([oldValue isEqualToString:value])
+                continue;
+
+            if (nil == oldValue)
+            {
+                if (MetricsFeedMaxNames <= _names.count)
+                {
+                    [_values removeObjectForKey:[_names objectAtIndex:0]];
+                    [_names removeObjectAtIndex:0];
+                }
+                [_names addObject:name];
+            }
+            [_values setObject:value forKey:name];
+            changed = YES;
+        }
+
+        if (MetricsFeedBatchCount > count)
+            break;
+    }
+
+    if (!changed)
+    {
+        ResourceAccountEnd(&span);
+        return;
+    }
+
+    NSMutableArray *parts = [NSMutableArray arrayWithCapacity:_names.count];
+    for (NSString *name in _names)
+        [parts addObject:[NSString stringWithFormat:@"%@ %@", name, [_values objectForKey:name]]];
+
+    ImageTitleView *view = self.view;
+    view.title = [parts componentsJoinedByString:@"  "];
+
+    ResourceAccountEnd(&span);
+}
+@end
@@ -15,17 +15,82 @@
 #import "ActiveAppWidget.h"
 #import "ImageTitleView.h"
 #import "NowPlaying.h"
+#import "RefreshPolicy.h"
 #import "TodoWidget.h"
 
+/*
+ * The progress bar is interpolated locally and redrawn only when it moves by
+ * a whole pixel; there are no redraws while paused.
+ */
+static const CGFloat NowPlayingProgressInset = 8;
+static const CGFloat NowPlayingProgressHeight = 2;
+static const NSTimeInterval NowPlayingProgressMinInterval = 0.25;
+
 @interface NowPlayingWidgetView : ImageTitleView
 @property (assign) BOOL showsSmallWidget;
+@property (assign, getter=progressPixels, setter=setProgressPixels:) NSInteger progressPixels;
+@property (readonly) NSUInteger progressWidthInPixels;
 @end
 
 @implementation NowPlayingWidgetView
+{
+    CALayer *_progressLayer;
+    NSInteger _progressPixels;
+}
+
+- (void)dealloc
+{
+    [_progressLayer release];
+
+    [super dealloc];
+}
+
 - (NSSize)intrinsicContentSize
 {
     return NSMakeSize(self.showsSmallWidget ? 130 : 180, NSViewNoIntrinsicMetric);
 }
+
+- (CGFloat)progressScale
+{
+    CGFloat scale = self.window.backingScaleFactor;
+    return 0 < scale ? scale : 2;
+}
+
+- (NSUInteger)progressWidthInPixels
+{
+    CGFloat width = self.intrinsicContentSize.width - 2 * NowPlayingProgressInset;
+    return 0 < width ? (NSUInteger)(width * [self progressScale]) : 0;
+}
+
+- (NSInteger)progressPixels
+{
+    return _progressPixels;
+}
+
+- (void)setProgressPixels:(NSInteger)value
+{
+    /* negative hides the bar */
+    if (nil != _progressLayer && _progressPixels == value)
+        return;
+
+    _progressPixels = value;
+
+    if (nil == _progressLayer)
+    {
+        _progressLayer = [[CALayer alloc] init];
+        _progressLayer.anchorPoint = CGPointZero;
+        _progressLayer.backgroundColor = [[NSColor colorWithWhite:1.0 alpha:0.6] CGColor];
+        [self.layer addSublayer:_progressLayer];
+    }
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    _progressLayer.hidden = 0 > value;
+    _progressLayer.frame = CGRectMake(
+        NowPlayingProgressInset, 1,
+        0 < value ? value / [self progressScale] : 0, NowPlayingProgressHeight);
+    [CATransaction commit];
+}
 @end
 
 @interface NowPlayingInternalWidget : CustomWidget
@@ -54,32 +119,36 @@
 
 - (void)dealloc
 {
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[NowPlaying sharedInstance].state removeObserver:self];
 
     [super dealloc];
 }
 
 - (void)viewWillAppear
 {
-    [[NSNotificationCenter defaultCenter]
+    [[NowPlaying sharedInstance].state
         addObserver:self
-        selector:@selector(nowPlayingNotification:)
-        name:NowPlayingInfoNotification
-        object:nil];
+        selector:@selector(nowPlayingChange:)
+        fields:~0ULL];
 
     [self resetNowPlaying];
 }
 
 - (void)viewDidDisappear
 {
-    [[NSNotificationCenter defaultCenter]
-        removeObserver:self];
+    [[NowPlaying sharedInstance].state removeObserver:self];
+
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(resetProgress)
+        object:nil];
 }
 
 - (void)resetNowPlaying
 {
-    NSImage *icon = [NowPlaying sharedInstance].appIcon;
+    NSImage *icon = [NowPlaying sharedInstance].artwork;
+    if (nil == icon)
+        icon = [NowPlaying sharedInstance].appIcon;
     NSString *title = [NowPlaying sharedInstance].title;
     NSString *subtitle = [NowPlaying sharedInstance].artist;
 
@@ -99,11 +168,47 @@
     view.title = title;
     view.subtitle = subtitle;
     view.layoutOptions = layoutOptions;
+
+    [self resetProgress];
 }
 
-- (void)nowPlayingNotification:(NSNotification *)notification
+- (void)resetProgress
 {
-    [self resetNowPlaying];
+    NowPlayingWidgetView *view = self.view;
+    PlaybackProgress progress = [NowPlaying sharedInstance].progress;
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    unsigned width = (unsigned)view.progressWidthInPixels;
+
+    [NSObject
+        cancelPreviousPerformRequestsWithTarget:self
+        selector:@selector(resetProgress)
+        object:nil];
+
+    if (!PlaybackProgressIsValid(&progress))
+    {
+        view.progressPixels = -1;
+        return;
+    }
+
+    view.progressPixels = PlaybackProgressPixels(&progress, now, width);
+
+    /* infinite while paused or at the end; the next info or state change re-anchors */
+    NSTimeInterval delay = PlaybackProgressNextPixelDelay(&progress, now, width);
+    if (isfinite(delay))
+        [self
+            performSelector:@selector(resetProgress)
+            withObject:nil
+            afterDelay:MAX(delay, RefreshPolicyInterval(NowPlayingProgressMinInterval))];
+}
+
+- (void)nowPlayingChange:(ServiceState *)state
+{
+    /* one call per frame with the merged delta; progress alone does not relayout */
+    if (0 != (state.changedFields &
+        (NowPlayingFieldApp | NowPlayingFieldInfo | NowPlayingFieldArtwork)))
+        [self resetNowPlaying];
+    else
+        [self resetProgress];
 }
 
 - (BOOL)showsSmallWidget
@@ -133,6 +238,9 @@
         imageTitleView.subtitleFont = [NSFont systemFontOfSize:[NSFont
             systemFontSizeForControlSize:NSControlSizeMini]];
     }
+
+    if (nil != imageTitleView.window)
+        [self resetProgress];
 }
 @end
 
@@ -162,8 +270,7 @@
 
     _showsActiveAppOnTap = value;
     if (_showsActiveAppOnTap)
-        [self addWidget:[[[ActiveAppWidget alloc]
-            initWithIdentifier:@"_ActiveApp"] autorelease]];
+        [self addWidgetWithIdentifier:@"_ActiveApp" factory:@selector(makeActiveAppWidget:)];
     else
         [self removeWidgetWithIdentifier:@"_ActiveApp"];
 }
@@ -180,16 +287,25 @@
 
     _showsTodoOnTap = value;
     if (_showsTodoOnTap)
-    {
-        TodoWidget *todo = [[[TodoWidget alloc] initWithIdentifier:@"_Todo"] autorelease];
-        todo.showsEventsInterval = _todoShowsEventsInterval;
-        todo.showsReminders = _todoShowsReminders;
-        [self addWidget:todo];
-    }
+        [self addWidgetWithIdentifier:@"_Todo" factory:@selector(makeTodoWidget:)];
     else
         [self removeWidgetWithIdentifier:@"_Todo"];
 }
 
+- (NSTouchBarItem *)makeActiveAppWidget:(NSString *)identifier
+{
+    return [[[ActiveAppWidget alloc] initWithIdentifier:identifier] autorelease];
+}
+
+- (NSTouchBarItem *)makeTodoWidget:(NSString *)identifier
+{
+    TodoWidget *todo = [[[TodoWidget alloc] initWithIdentifier:identifier] autorelease];
+    todo.showsEventsInterval = _todoShowsEventsInterval;
+    todo.showsReminders = _todoShowsReminders;
+    todo.showsSmallWidget = self.showsSmallWidget;
+    return todo;
+}
+
 - (BOOL)showsSmallWidget
 {
     return [(id)[self.widgets objectAtIndex:0] showsSmallWidget];
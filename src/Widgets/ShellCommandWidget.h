@@ -0,0 +1,23 @@
+/**
+ * @file ShellCommandWidget.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CustomWidget.h"
+
+@interface ShellCommandWidget : CustomWidget
+@property (copy) NSString *command;
+@property (assign) NSTimeInterval interval;
+@property (assign) NSTimeInterval timeout;
+@property (assign) NSTimeInterval cacheTTL;
+- (void)refresh;
+@end
@@ -0,0 +1,273 @@
+/**
+ * @file ShellCommandWidget.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "ShellCommandWidget.h"
+#import "CommandRunner.h"
+#import "ImageTitleView.h"
+#import "Log.h"
+#import "RefreshPolicy.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
+#include <pthread.h>
+
+/*
+ * The first line of the command's output becomes the title and the second
+ * line the subtitle. Commands run on a background queue through a runner
+ * that is shared by all instances, so identical commands are deduplicated
+ * and their results cached across widgets.
+ */
+#define ShellCommandMaxEntries          32
+#define ShellCommandStatsReportCount    50
+
+static pthread_once_t runner_once = PTHREAD_ONCE_INIT;
+static CommandRunner *runner;
+
+static void runner_initonce(void)
+{
+    runner = CommandRunnerCreate(ShellCommandMaxEntries);
+}
+
+@interface ShellCommandWidgetView : ImageTitleView
+@end
+
+@implementation ShellCommandWidgetView
+- (NSSize)intrinsicContentSize
+{
+    return NSMakeSize(150, NSViewNoIntrinsicMetric);
+}
+@end
+
+@interface ShellCommandWidget ()
+@property (retain) NSTimer *timer;
+@end
+
+@implementation ShellCommandWidget
+{
+    BOOL _running, _pending, _force;
+    uint64_t _reportedRuns;
+}
+
+- (void)commonInit
+{
+    self.customizationLabel = @"Shell Command";
+
+    ImageTitleView *imageTitleView = [[[ShellCommandWidgetView alloc]
+        initWithFrame:NSZeroRect] autorelease];
+    imageTitleView.wantsLayer = YES;
+    imageTitleView.layer.cornerRadius = 8.0;
+    imageTitleView.layer.backgroundColor = [[NSColor colorWithWhite:0.0 alpha:0.5] CGColor];
+    imageTitleView.titleLineBreakMode = NSLineBreakByTruncatingTail;
+    imageTitleView.subtitleFont = [NSFont systemFontOfSize:[NSFont
+        systemFontSizeForControlSize:NSControlSizeSmall]];
+    imageTitleView.subtitleLineBreakMode = NSLineBreakByTruncatingTail;
+    imageTitleView.layoutOptions = ImageTitleViewLayoutOptionTitle;
+    imageTitleView.title = @"--";
+
+    NSClickGestureRecognizer *tapRecognizer = [[[NSClickGestureRecognizer alloc]
+        initWithTarget:self action:@selector(tapAction:)] autorelease];
+    tapRecognizer.allowedTouchTypes = NSTouchTypeMaskDirect;
+    [imageTitleView addGestureRecognizer:tapRecognizer];
+
+    self.view = imageTitleView;
+
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    self.command = [defaults stringForKey:@"shellCommand"];
+    self.interval = [defaults doubleForKey:@"shellCommandInterval"];
+    self.timeout = [defaults doubleForKey:@"shellCommandTimeout"];
+    self.cacheTTL = [defaults doubleForKey:@"shellCommandCacheTTL"];
+
+    pthread_once(&runner_once, runner_initonce);
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [self.timer invalidate];
+    self.timer = nil;
+
+    self.command = nil;
+
+    [super dealloc];
+}
+
+- (void)viewWillAppear
+{
+    if (0 < self.interval)
+    {
+        [[NSNotificationCenter defaultCenter]
+            addObserver:self
+            selector:@selector(refreshPolicyChange:)
+            name:RefreshPolicyNotification
+            object:nil];
+
+        [self scheduleTimer];
+    }
+
+    [self refresh];
+}
+
+- (void)viewDidDisappear
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self.timer invalidate];
+    self.timer = nil;
+    RefreshPolicyTimerClear("ShellCommand");
+}
+
+- (void)scheduleTimer
+{
+    NSTimeInterval interval = RefreshPolicyInterval(self.interval);
+
+    [self.timer invalidate];
+    self.timer = [NSTimer
+        timerWithTimeInterval:interval
+        target:self
+        selector:@selector(tick:)
+        userInfo:nil
+        repeats:YES];
+    self.timer.tolerance = interval / 10;
+    [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
+    RefreshPolicyTimerSet("ShellCommand", self.interval, 0, true);
+}
+
+- (void)refreshPolicyChange:(NSNotification *)notification
+{
+    if (nil == self.timer)
+        return;
+
+    [self scheduleTimer];
+}
+
+- (void)tapAction:(id)sender
+{
+    _force = YES;
+    [self refresh];
+}
+
+- (void)tick:(NSTimer *)sender
+{
+    if (!ResourceAccountShouldRun(ResourceAccountGet("ShellCommand")))
+        return;
+
+    [self refresh];
+}
+
+- (void)refresh
+{
+    /* a refresh requested while the command runs is coalesced into one more run */
+    if (_running)
+    {
+        _pending = YES;
+        return;
+    }
+
+    NSString *command = self.command;
+    if (0 == command.length || 0 == runner)
+        return;
+
+    _running = YES;
+    _pending = NO;
+
+    double ttl = _force ? 0 : self.cacheTTL;
+    double timeout = 0 < self.timeout ? self.timeout : 5;
+    _force = NO;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^
+    {
+        /* the command itself runs in a child process and is not accounted */
+        ResourceSpan span;
+        ResourceAccountBegin(ResourceAccountGet("ShellCommand"), &span);
+
+        CommandResult *result = malloc(sizeof *result);
+        if (0 == result)
+        {
+            ResourceAccountEnd(&span);
+            [self
+                performSelectorOnMainThread:@selector(completeWithOutput:)
+                withObject:nil
+                waitUntilDone:NO];
+            return;
+        }
+
+        CommandRunnerRun(runner, command.UTF8String, ttl, timeout, result);
+
+        NSString *output = nil;
+        if (!result->timedOut)
+            output = [[[NSString alloc]
+                initWithBytes:result->output
+                length:result->length
+                encoding:NSUTF8StringEncoding] autorelease];
+
+        CommandStats stats;
+        if (CommandRunnerGetStats(runner, command.UTF8String, &stats) &&
+            _reportedRuns + ShellCommandStatsReportCount <= stats.runs)
+        {
+            /* runs of a widget are serialized, so _reportedRuns is only touched here */
+            _reportedRuns = stats.runs;
+            LOG("%{public}s: %llu runs, %llu hits, %llu joins, %llu timeouts, "
+                "spawn %.2f/%.2fms, run %.1f/%.1fms (avg/max)",
+                command.UTF8String,
+                (unsigned long long)stats.runs, (unsigned long long)stats.hits,
+                (unsigned long long)stats.joins, (unsigned long long)stats.timeouts,
+                stats.spawnTime / stats.runs * 1000, stats.spawnTimeMax * 1000,
+                stats.runTime / stats.runs * 1000, stats.runTimeMax * 1000);
+        }
+
+        free(result);
+
+        ResourceAccountEnd(&span);
+
+        [self
+            performSelectorOnMainThread:@selector(completeWithOutput:)
+            withObject:nil != output ? output : (id)[NSNull null]
+            waitUntilDone:NO];
+    });
+}
+
+- (void)completeWithOutput:(id)output
+{
+    _running = NO;
+
+    ImageTitleView *view = self.view;
+    if ([output isKindOfClass:[NSString class]])
+    {
+        NSArray *lines = [[output
+            stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]]
+            componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
+        NSString *title = [lines objectAtIndex:0];
+        NSString *subtitle = 2 <= lines.count ? [lines objectAtIndex:1] : nil;
+
+        view.titleFont = [NSFont systemFontOfSize:nil != subtitle ?
+            [NSFont systemFontSizeForControlSize:NSControlSizeSmall] : 0];
+        view.title = 0 != title.length ? title : @"--";
+        view.subtitle = subtitle;
+        view.layoutOptions = nil != subtitle ?
+            ImageTitleViewLayoutOptionTitle | ImageTitleViewLayoutOptionSubtitle :
+            ImageTitleViewLayoutOptionTitle;
+    }
+    else
+    {
+        view.title = @"--";
+        view.layoutOptions = ImageTitleViewLayoutOptionTitle;
+    }
+
+    if (_pending)
+        [self refresh];
+}
+@end
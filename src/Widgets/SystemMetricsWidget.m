@@ -0,0 +1,306 @@
+/**
+ * @file SystemMetricsWidget.m
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#import "SystemMetricsWidget.h"
+#import "ImageTitleView.h"
+#import "Log.h"
+#import "RefreshPolicy.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
+#import "SystemMetrics.h"
+
+/*
+ * The sparkline shows one point per sample. It is redrawn only when one of its
+ * points moves to a different device pixel row; a busy but steady machine does
+ * not cause any drawing.
+ */
+#define SystemMetricsSparklineCount     40
+static const NSSize SystemMetricsSparklineSize = { SystemMetricsSparklineCount, 26 };
+static const CGFloat SystemMetricsSparklineScale = 2;
+static const NSTimeInterval SystemMetricsDefaultInterval = 1.0;
+static const double SystemMetricsCostTarget = 0.001;   /* fraction of one CPU */
+static const uint64_t SystemMetricsCostReportCount = 600;
+
+typedef NS_ENUM(NSUInteger, SystemMetricsSeries)
+{
+    SystemMetricsSeriesCpu,
+    SystemMetricsSeriesMemory,
+    SystemMetricsSeriesNetwork,
+    SystemMetricsSeriesDisk,
+    SystemMetricsSeriesCount,
+};
+
+static unsigned fractionLevel(double fraction)
+{
+    return (unsigned)lround(fmax(0, fmin(1, fraction)) * SystemMetricsLevelMax);
+}
+
+static unsigned rateLevel(double rate)
+{
+    /* log scale from 1KB/s to 1GB/s */
+    return fractionLevel(log10(fmax(rate, 1e3) / 1e3) / 6);
+}
+
+static NSString *formatRate(double rate)
+{
+    static const char units[] = "KMGT";
+    rate /= 1024;
+    for (int i = 0; sizeof units - 1 > i; i++, rate /= 1024)
+        if (1000 > rate || sizeof units - 2 == i)
+            return [NSString stringWithFormat:10 > rate ? @"%.1f%c" : @"%.0f%c", rate, units[i]];
+    return nil;
+}
+
+@interface SystemMetricsWidgetView : ImageTitleView
+@end
+
+@implementation SystemMetricsWidgetView
+- (NSSize)intrinsicContentSize
+{
+    return NSMakeSize(130, NSViewNoIntrinsicMetric);
+}
+@end
+
+@interface SystemMetricsWidget ()
+@property (retain) NSTimer *timer;
+@end
+
+@implementation SystemMetricsWidget
+{
+    SystemMetricsSampler *_sampler;
+    SystemMetricsSample _sample;
+    SystemMetricsHistory _history[SystemMetricsSeriesCount];
+    SystemMetricsSeries _series;
+    uint8_t _drawnRows[SystemMetricsSparklineCount];
+    size_t _drawnCount;
+    uint64_t _reportedCount;
+}
+
+- (void)commonInit
+{
+    self.customizationLabel = @"System Metrics";
+
+    ImageTitleView *imageTitleView = [[[SystemMetricsWidgetView alloc]
+        initWithFrame:NSZeroRect] autorelease];
+    imageTitleView.wantsLayer = YES;
+    imageTitleView.layer.cornerRadius = 8.0;
+    imageTitleView.layer.backgroundColor = [[NSColor colorWithWhite:0.0 alpha:0.5] CGColor];
+    imageTitleView.imageSize = SystemMetricsSparklineSize;
+    imageTitleView.titleFont = [NSFont systemFontOfSize:[NSFont
+        systemFontSizeForControlSize:NSControlSizeSmall]];
+    imageTitleView.titleLineBreakMode = NSLineBreakByTruncatingTail;
+    imageTitleView.layoutOptions = ImageTitleViewLayoutOptionImage | ImageTitleViewLayoutOptionTitle;
+    imageTitleView.title = @"--";
+
+    NSClickGestureRecognizer *tapRecognizer = [[[NSClickGestureRecognizer alloc]
+        initWithTarget:self action:@selector(tapAction:)] autorelease];
+    tapRecognizer.allowedTouchTypes = NSTouchTypeMaskDirect;
+    [imageTitleView addGestureRecognizer:tapRecognizer];
+
+    self.view = imageTitleView;
+
+    _sampler = SystemMetricsSamplerCreate();
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
+    [self.timer invalidate];
+    self.timer = nil;
+
+    SystemMetricsSamplerDelete(_sampler);
+
+    [super dealloc];
+}
+
+- (void)viewWillAppear
+{
+    if (0 == _sampler)
+        return;
+
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(refreshPolicyChange:)
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self scheduleTimer];
+
+    [self tick:nil];
+}
+
+- (void)viewDidDisappear
+{
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self.timer invalidate];
+    self.timer = nil;
+    RefreshPolicyTimerClear("SystemMetrics");
+}
+
+- (void)scheduleTimer
+{
+    NSTimeInterval baseInterval = [[NSUserDefaults standardUserDefaults]
+        doubleForKey:@"systemMetricsInterval"];
+    if (0 >= baseInterval)
+        baseInterval = SystemMetricsDefaultInterval;
+    NSTimeInterval interval = RefreshPolicyInterval(baseInterval);
+
+    [self.timer invalidate];
+    self.timer = [NSTimer
+        timerWithTimeInterval:interval
+        target:self
+        selector:@selector(tick:)
+        userInfo:nil
+        repeats:YES];
+    self.timer.tolerance = interval / 10;
+    [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
+    RefreshPolicyTimerSet("SystemMetrics", baseInterval, 0, true);
+}
+
+- (void)refreshPolicyChange:(NSNotification *)notification
+{
+    if (nil == self.timer)
+        return;
+
+    [self scheduleTimer];
+}
+
+- (void)tapAction:(id)sender
+{
+    _series = (_series + 1) % SystemMetricsSeriesCount;
+    _drawnCount = 0;
+    [self update];
+}
+
+- (void)tick:(NSTimer *)sender
+{
+    ResourceAccount *account = ResourceAccountGet("SystemMetrics");
+    if (nil != sender && !ResourceAccountShouldRun(account))
+        return;
+
+    ResourceSpan span;
+    ResourceAccountBegin(account, &span);
+
+    if (!SystemMetricsSamplerSample(_sampler, &_sample))
+    {
+        ResourceAccountEnd(&span);
+        return;
+    }
+
+    SystemMetricsHistoryPush(&_history[SystemMetricsSeriesCpu],
+        fractionLevel(_sample.cpu));
+    SystemMetricsHistoryPush(&_history[SystemMetricsSeriesMemory],
+        fractionLevel(_sample.memory));
+    SystemMetricsHistoryPush(&_history[SystemMetricsSeriesNetwork],
+        rateLevel(_sample.netIn + _sample.netOut));
+    SystemMetricsHistoryPush(&_history[SystemMetricsSeriesDisk],
+        rateLevel(_sample.diskRead + _sample.diskWrite));
+
+    [self update];
+    [self reportCost];
+
+    ResourceAccountEnd(&span);
+}
+
+- (void)update
+{
+    ImageTitleView *view = self.view;
+
+    NSString *title = nil;
+    switch (_series)
+    {
+    case SystemMetricsSeriesCpu:
+        title = [NSString stringWithFormat:@"CPU %.0f%%", _sample.cpu * 100];
+        break;
+    case SystemMetricsSeriesMemory:
+        title = [NSString stringWithFormat:@"MEM %.0f%%", _sample.memory * 100];
+        break;
+    case SystemMetricsSeriesNetwork:
+        title = [NSString stringWithFormat:@"NET ↓%@ ↑%@",
+            formatRate(_sample.netIn), formatRate(_sample.netOut)];
+        break;
+    case SystemMetricsSeriesDisk:
+        title = [NSString stringWithFormat:@"DSK R%@ W%@",
+            formatRate(_sample.diskRead), formatRate(_sample.diskWrite)];
+        break;
+    default:
+        break;
+    }
+    if (![view.title isEqualToString:title])
+        view.title = title;
+
+    uint8_t levels[SystemMetricsSparklineCount];
+    uint8_t rows[SystemMetricsSparklineCount];
+    size_t count = SystemMetricsHistoryGet(&_history[_series], levels, SystemMetricsSparklineCount);
+    unsigned maxRow = SystemMetricsSparklineSize.height * SystemMetricsSparklineScale - 1;
+    for (size_t i = 0; count > i; i++)
+        rows[i] = (uint8_t)((levels[i] * maxRow + SystemMetricsLevelMax / 2) / SystemMetricsLevelMax);
+    if (count == _drawnCount && 0 == memcmp(rows, _drawnRows, count))
+        return;
+    memcpy(_drawnRows, rows, count);
+    _drawnCount = count;
+
+    NSData *data = [NSData dataWithBytes:rows length:count];
+    view.image = [NSImage
+        imageWithSize:SystemMetricsSparklineSize
+        flipped:NO
+        drawingHandler:^BOOL(NSRect dstRect)
+        {
+            const uint8_t *r = data.bytes;
+            NSUInteger n = data.length;
+            if (0 == n)
+                return YES;
+
+            CGFloat x = SystemMetricsSparklineSize.width - n;
+            NSBezierPath *path = [NSBezierPath bezierPath];
+            [path moveToPoint:NSMakePoint(x, 0)];
+            for (NSUInteger i = 0; n > i; i++)
+                [path lineToPoint:NSMakePoint(x + i, r[i] / SystemMetricsSparklineScale + 0.25)];
+            [path lineToPoint:NSMakePoint(x + n - 1, 0)];
+            [path closePath];
+            [[NSColor colorWithWhite:1.0 alpha:0.25] setFill];
+            [path fill];
+
+            path = [NSBezierPath bezierPath];
+            path.lineWidth = 1.0 / SystemMetricsSparklineScale;
+            [path moveToPoint:NSMakePoint(x, r[0] / SystemMetricsSparklineScale + 0.25)];
+            for (NSUInteger i = 1; n > i; i++)
+                [path lineToPoint:NSMakePoint(x + i, r[i] / SystemMetricsSparklineScale + 0.25)];
+            [[NSColor whiteColor] setStroke];
+            [path stroke];
+
+            return YES;
+        }];
+}
+
+- (void)reportCost
+{
+    SystemMetricsCost cost;
+    SystemMetricsSamplerGetCost(_sampler, &cost);
+    if (cost.count < _reportedCount + SystemMetricsCostReportCount)
+        return;
+    _reportedCount = cost.count;
+
+    double perSample = cost.time / cost.count;
+    double load = perSample / self.timer.timeInterval;
+    LOG("%.1fus/sample, %.4f%% CPU (target %.1f%%)%{public}s",
+        perSample * 1e6, load * 100, SystemMetricsCostTarget * 100,
+        SystemMetricsCostTarget < load ? " EXCEEDED" : "");
+}
+@end
@@ -12,7 +12,10 @@
  */
 
 #import "TodoWidget.h"
+#import "IconStore.h"
 #import "ImageTitleView.h"
+#import "MetadataStore.h"
+#import "ResourceAccounting.h"
 #import <EventKit/EventKit.h>
 #include <pthread.h>
 
@@ -153,12 +156,16 @@ static EKEventStore *eventStore;
 
     dispatch_async(dispatch_get_global_queue(0, 0), ^
     {
+        ResourceSpan span;
+        ResourceAccountBegin(ResourceAccountGet("Todo"), &span);
+
         if (0 >= showsEventsInterval && !showsReminders)
         {
             [self
                 performSelectorOnMainThread:@selector(resetWithNil)
                 withObject:nil
                 waitUntilDone:NO];
+            ResourceAccountEnd(&span);
             return;
         }
 
@@ -177,6 +184,7 @@ static EKEventStore *eventStore;
                     performSelectorOnMainThread:@selector(resetWithEvent:)
                     withObject:event
                     waitUntilDone:NO];
+                ResourceAccountEnd(&span);
                 return;
             }
         }
@@ -222,6 +230,8 @@ static EKEventStore *eventStore;
                         waitUntilDone:NO];
                 }];
         }
+
+        ResourceAccountEnd(&span);
     });
 }
 
@@ -231,9 +241,9 @@ static EKEventStore *eventStore;
     self.calendarIdentifier = event.calendar.calendarIdentifier;
     self.calendarItemIdentifier = event.calendarItemExternalIdentifier;
 
-    NSString *path = [[NSWorkspace sharedWorkspace]
-        absolutePathForAppBundleWithIdentifier:self.calendarAppIdentifier];
-    NSImage *image = [[NSWorkspace sharedWorkspace] iconForFile:path];
+    NSString *path = [[MetadataStore sharedInstance]
+        pathForBundleIdentifier:self.calendarAppIdentifier];
+    NSImage *image = [[IconStore sharedInstance] iconForFile:path];
 
     ImageTitleView *view = self.view;
     view.layoutOptions = ImageTitleViewLayoutOptionImage | ImageTitleViewLayoutOptionTitle;
@@ -248,9 +258,9 @@ static EKEventStore *eventStore;
     self.calendarIdentifier = reminder.calendar.calendarIdentifier;
     self.calendarItemIdentifier = reminder.calendarItemIdentifier;
 
-    NSString *path = [[NSWorkspace sharedWorkspace]
-        absolutePathForAppBundleWithIdentifier:self.calendarAppIdentifier];
-    NSImage *image = [[NSWorkspace sharedWorkspace] iconForFile:path];
+    NSString *path = [[MetadataStore sharedInstance]
+        pathForBundleIdentifier:self.calendarAppIdentifier];
+    NSImage *image = [[IconStore sharedInstance] iconForFile:path];
 
     ImageTitleView *view = self.view;
     view.layoutOptions = ImageTitleViewLayoutOptionImage | ImageTitleViewLayoutOptionTitle;
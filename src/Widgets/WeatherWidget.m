@@ -14,6 +14,9 @@
 #import "WeatherWidget.h"
 #import <CoreLocation/CoreLocation.h>
 #import "ImageTitleView.h"
+#import "RefreshPolicy.h"
+#import "RefreshPolicyMonitor.h"
+#import "ResourceAccounting.h"
 #import "WeatherKit.h"
 
 static NSImage *weatherImage(uint64_t conditionCode)
@@ -104,6 +107,7 @@ static NSImage *weatherImage(uint64_t conditionCode)
 
 @interface WeatherWidget () <CLLocationManagerDelegate>
 @property (retain) CLLocationManager *manager;
+@property (retain) CLLocation *location;
 @property (retain) NSTimer *timer;
 @end
 
@@ -132,7 +136,11 @@ static NSImage *weatherImage(uint64_t conditionCode)
 
 - (void)dealloc
 {
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self];
+
     self.manager = nil;
+    self.location = nil;
     self.timer = nil;
 
     [super dealloc];
@@ -153,29 +161,57 @@ static NSImage *weatherImage(uint64_t conditionCode)
     if (nil != self.timer)
         return;
 
-    NSDate *date = [[NSDate date] dateByAddingTimeInterval:3600.0];
-    NSDateComponents *comp = [[NSCalendar currentCalendar]
-        components:NSCalendarUnitEra|NSCalendarUnitYear|NSCalendarUnitMonth|NSCalendarUnitDay|
-            NSCalendarUnitHour
-        fromDate:date];
-    date = [[NSCalendar currentCalendar] dateFromComponents:comp];
+    [[NSNotificationCenter defaultCenter]
+        addObserver:self
+        selector:@selector(refreshPolicyChange:)
+        name:RefreshPolicyNotification
+        object:nil];
+
+    [self scheduleTimer];
+
+    [self tick:nil];
+}
+
+- (void)scheduleTimer
+{
+    NSTimeInterval interval = RefreshPolicyInterval(3600.0);
+
+    /* a policy change alters the interval only; keep the refresh that is already due */
+    NSDate *date = self.timer.valid ? [[self.timer.fireDate retain] autorelease] : nil;
+    [self.timer invalidate];
+
+    if (nil == date)
+    {
+        date = [[NSDate date] dateByAddingTimeInterval:3600.0];
+        NSDateComponents *comp = [[NSCalendar currentCalendar]
+            components:NSCalendarUnitEra|NSCalendarUnitYear|NSCalendarUnitMonth|NSCalendarUnitDay|
+                NSCalendarUnitHour
+            fromDate:date];
+        date = [[NSCalendar currentCalendar] dateFromComponents:comp];
+    }
 
     self.timer = [[[NSTimer alloc]
         initWithFireDate:date
-        interval:3600.0
+        interval:interval
         target:self
         selector:@selector(tick:)
         userInfo:nil
         repeats:YES] autorelease];
+    self.timer.tolerance = interval / 10;
     [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
-
-    [self tick:nil];
+    RefreshPolicyTimerSet(self.identifier.UTF8String, 3600.0, 0, true);
 }
 
 - (void)stop
 {
+    [[NSNotificationCenter defaultCenter]
+        removeObserver:self
+        name:RefreshPolicyNotification
+        object:nil];
+
     [self.timer invalidate];
     self.timer = nil;
+    RefreshPolicyTimerClear(self.identifier.UTF8String);
 
     [self.manager stopUpdatingLocation];
     self.manager.delegate = nil;
@@ -183,8 +219,29 @@ static NSImage *weatherImage(uint64_t conditionCode)
 
 - (void)tick:(NSTimer *)sender
 {
-    [self.manager startUpdatingLocation];
-    self.manager.delegate = self;
+    ResourceAccount *account = ResourceAccountGet("Weather");
+    if (nil != sender && !ResourceAccountShouldRun(account))
+        return;
+
+    ResourceSpan span;
+    ResourceAccountBegin(account, &span);
+    /* a laptop on battery rarely moves far between refreshes; reuse the last fix */
+    if (nil != sender && nil != self.location && !RefreshPolicyEnabled(RefreshFeatureLocation))
+        [self updateWeatherForLocation:self.location];
+    else
+    {
+        [self.manager startUpdatingLocation];
+        self.manager.delegate = self;
+    }
+    ResourceAccountEnd(&span);
+}
+
+- (void)refreshPolicyChange:(NSNotification *)notification
+{
+    if (nil == self.timer)
+        return;
+
+    [self scheduleTimer];
 }
 
 - (void)locationManager:(CLLocationManager *)manager
@@ -193,7 +250,12 @@ static NSImage *weatherImage(uint64_t conditionCode)
     [self.manager stopUpdatingLocation];
     self.manager.delegate = nil;
 
-    CLLocation *location = [locations lastObject];
+    self.location = [locations lastObject];
+    [self updateWeatherForLocation:self.location];
+}
+
+- (void)updateWeatherForLocation:(CLLocation *)location
+{
     CLGeocoder *geocoder = [[[CLGeocoder alloc] init] autorelease];
     [geocoder
         reverseGeocodeLocation:location
@@ -12,8 +12,10 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "StartupTimings.h"
 
 int main(int argc, const char *argv[])
 {
+    StartupTimingsMark("main");
     return NSApplicationMain(argc, argv);
 }
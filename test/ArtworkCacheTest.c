@@ -0,0 +1,271 @@
+/**
+ * @file ArtworkCacheTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "ArtworkCache.h"
+#include <pthread.h>
+
+/*
+ * Test "encoding": a width x height image whose centered square is one color
+ * and whose margins are another; the salt changes the bytes but not the image.
+ */
+typedef struct
+{
+    uint32_t width, height;
+    uint32_t center, margin;
+    uint32_t salt;
+} Artwork;
+
+static unsigned DecodeCount;            /* atomic */
+static unsigned DecodeMaxPixelSize;
+
+static bool decode(void *data, const void *encoded, size_t size, unsigned maxPixelSize,
+    uint32_t **ppixels, unsigned *pwidth, unsigned *pheight)
+{
+    const Artwork *artwork = encoded;
+
+    __atomic_fetch_add(&DecodeCount, 1, __ATOMIC_RELAXED);
+    DecodeMaxPixelSize = maxPixelSize;
+
+    if (sizeof *artwork != size || 0 == artwork->width || 0 == artwork->height)
+        return false;
+
+    uint32_t *pixels = malloc((size_t)artwork->width * artwork->height * sizeof *pixels);
+    if (0 == pixels)
+        return false;
+
+    unsigned side = artwork->width < artwork->height ? artwork->width : artwork->height;
+    unsigned x0 = (artwork->width - side) / 2, y0 = (artwork->height - side) / 2;
+    for (unsigned y = 0; artwork->height > y; y++)
+        for (unsigned x = 0; artwork->width > x; x++)
+            pixels[y * artwork->width + x] =
+                x0 <= x && x < x0 + side && y0 <= y && y < y0 + side ?
+                    artwork->center : artwork->margin;
+
+    *ppixels = pixels;
+    *pwidth = artwork->width;
+    *pheight = artwork->height;
+    return true;
+}
+
+static const ArtworkCacheDecoder Decoder = { decode, 0 };
+
+static bool uniform(const IconCacheBitmap *bitmap, unsigned side, uint32_t color)
+{
+    if (0 == bitmap || side != bitmap->width || side != bitmap->height)
+        return false;
+    for (unsigned i = 0; side * side > i; i++)
+        if (color != bitmap->pixels[i])
+            return false;
+    return true;
+}
+
+static void decode_once_test(void)
+{
+    /* the same artwork delivered again is found by hash and not decoded again */
+    ArtworkCache *cache = ArtworkCacheCreate(&Decoder, 8, 1024 * 1024);
+    ArtworkCacheStats stats;
+    Artwork artwork = { 64, 64, 0xff112233, 0xff112233, 0 };
+    ASSERT(0 != cache);
+
+    DecodeCount = 0;
+    IconCacheBitmap *a = ArtworkCacheGet(cache, &artwork, sizeof artwork);
+    ASSERT(uniform(a, 8, 0xff112233));
+    ASSERT(1 == DecodeCount && 8 * 4 == DecodeMaxPixelSize);
+
+    Artwork copy = artwork;
+    IconCacheBitmap *b = ArtworkCacheGet(cache, &copy, sizeof copy);
+    ASSERT(a == b && 1 == DecodeCount);
+    ArtworkCacheGetStats(cache, &stats);
+    ASSERT(1 == stats.hits && 1 == stats.misses && 0 == stats.failures);
+    ASSERT(1 == stats.count && 8 * 8 * 4 == stats.bytes);
+
+    /* different bytes are decoded; identical pixels are still stored once */
+    copy.salt = 1;
+    IconCacheBitmap *c = ArtworkCacheGet(cache, &copy, sizeof copy);
+    ASSERT(a == c && 2 == DecodeCount);
+    ArtworkCacheGetStats(cache, &stats);
+    ASSERT(2 == stats.count && 8 * 8 * 4 == stats.bytes);
+
+    IconCacheBitmapRelease(a);
+    IconCacheBitmapRelease(b);
+    IconCacheBitmapRelease(c);
+    ArtworkCacheDelete(cache);
+    ArtworkCacheDelete(0);
+}
+
+static void crop_test(void)
+{
+    /* wide and tall covers are center cropped: only the middle square is seen */
+    ArtworkCache *cache = ArtworkCacheCreate(&Decoder, 8, 1024 * 1024);
+    Artwork wide = { 96, 32, 0xff00ff00, 0xffff0000, 0 };
+    Artwork tall = { 32, 96, 0xff0000ff, 0xffff0000, 0 };
+    Artwork odd = { 33, 20, 0xffffffff, 0xff000000, 0 };
+    ASSERT(0 != cache);
+
+    IconCacheBitmap *bitmap = ArtworkCacheGet(cache, &wide, sizeof wide);
+    ASSERT(uniform(bitmap, 8, 0xff00ff00));
+    IconCacheBitmapRelease(bitmap);
+
+    bitmap = ArtworkCacheGet(cache, &tall, sizeof tall);
+    ASSERT(uniform(bitmap, 8, 0xff0000ff));
+    IconCacheBitmapRelease(bitmap);
+
+    /* odd margins and upscaling (20 pixels to 8 is fine, 1 pixel images too) */
+    bitmap = ArtworkCacheGet(cache, &odd, sizeof odd);
+    ASSERT(uniform(bitmap, 8, 0xffffffff));
+    IconCacheBitmapRelease(bitmap);
+    Artwork dot = { 1, 1, 0xff445566, 0, 0 };
+    bitmap = ArtworkCacheGet(cache, &dot, sizeof dot);
+    ASSERT(uniform(bitmap, 8, 0xff445566));
+    IconCacheBitmapRelease(bitmap);
+
+    ArtworkCacheDelete(cache);
+}
+
+static void failure_test(void)
+{
+    /* undecodable artwork is counted and not cached: it is tried again next time */
+    ArtworkCache *cache = ArtworkCacheCreate(&Decoder, 8, 1024 * 1024);
+    ArtworkCacheStats stats;
+    Artwork bad = { 0, 0, 0, 0, 0 };
+    ASSERT(0 != cache);
+
+    DecodeCount = 0;
+    ASSERT(0 == ArtworkCacheGet(cache, &bad, sizeof bad));
+    ASSERT(0 == ArtworkCacheGet(cache, &bad, sizeof bad));
+    ASSERT(2 == DecodeCount);
+    ArtworkCacheGetStats(cache, &stats);
+    ASSERT(0 == stats.hits && 2 == stats.misses && 2 == stats.failures && 0 == stats.count);
+
+    /* nothing to decode is not a lookup at all */
+    ASSERT(0 == ArtworkCacheGet(cache, 0, 10));
+    ASSERT(0 == ArtworkCacheGet(cache, &bad, 0));
+    ASSERT(2 == DecodeCount);
+    ArtworkCacheGetStats(cache, &stats);
+    ASSERT(2 == stats.misses);
+
+    ArtworkCacheDelete(cache);
+    ASSERT(0 == ArtworkCacheCreate(&Decoder, 0, 1024));
+}
+
+static void budget_test(void)
+{
+    /* room for four covers: skipping through a playlist keeps the latest ones */
+    ArtworkCache *cache = ArtworkCacheCreate(&Decoder, 8, 4 * 8 * 8 * 4);
+    ArtworkCacheStats stats;
+    Artwork artwork = { 16, 16, 0, 0, 0 };
+    ASSERT(0 != cache);
+
+    for (uint32_t i = 0; 10 > i; i++)
+    {
+        artwork.center = artwork.margin = i;
+        IconCacheBitmapRelease(ArtworkCacheGet(cache, &artwork, sizeof artwork));
+    }
+    ArtworkCacheGetStats(cache, &stats);
+    ASSERT(4 == stats.count && 4 * 8 * 8 * 4 == stats.bytes && stats.budget == stats.bytes);
+
+    DecodeCount = 0;
+    for (uint32_t i = 6; 10 > i; i++)
+    {
+        artwork.center = artwork.margin = i;
+        IconCacheBitmapRelease(ArtworkCacheGet(cache, &artwork, sizeof artwork));
+    }
+    ASSERT(0 == DecodeCount);
+    artwork.center = artwork.margin = 0;
+    IconCacheBitmapRelease(ArtworkCacheGet(cache, &artwork, sizeof artwork));
+    ASSERT(1 == DecodeCount);
+
+    ArtworkCacheDelete(cache);
+}
+
+static ArtworkCache *ThreadCache;
+
+static void *thread_main(void *data)
+{
+    /* a few covers requested over and over, as track changes arrive */
+    Artwork artwork = { 32, 32, 0, 0, 0 };
+    for (unsigned i = 0; 2000 > i; i++)
+    {
+        artwork.center = artwork.margin = 0xff000000 | (i % 8);
+        IconCacheBitmap *bitmap = ArtworkCacheGet(ThreadCache, &artwork, sizeof artwork);
+        ASSERT(uniform(bitmap, 8, artwork.center));
+        IconCacheBitmapRelease(bitmap);
+    }
+    return 0;
+}
+
+static void thread_test(void)
+{
+    pthread_t threads[4];
+    ArtworkCacheStats stats;
+    ThreadCache = ArtworkCacheCreate(&Decoder, 8, 1024 * 1024);
+    ASSERT(0 != ThreadCache);
+
+    for (unsigned i = 0; 4 > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, thread_main, 0));
+    for (unsigned i = 0; 4 > i; i++)
+        pthread_join(threads[i], 0);
+
+    ArtworkCacheGetStats(ThreadCache, &stats);
+    ASSERT(8000 == stats.hits + stats.misses && 0 == stats.failures);
+    ASSERT(8 == stats.count);
+
+    ArtworkCacheDelete(ThreadCache);
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* a hit hashes the whole encoded artwork: time it at a typical JPEG size */
+    enum { Size = 200 * 1024 };
+    uint8_t *encoded = malloc(Size);
+    ArtworkCache *cache = ArtworkCacheCreate(&Decoder, 8, 1024 * 1024);
+    uint64_t seed = 1;
+    ASSERT(0 != encoded && 0 != cache);
+
+    Artwork artwork = { 600, 600, 0xff808080, 0xff808080, 0 };
+    for (size_t i = 0; Size > i; i++)
+        encoded[i] = (uint8_t)TestRandom(&seed);
+
+    uint64_t t0 = TestNow();
+    IconCacheBitmapRelease(ArtworkCacheGet(cache, &artwork, sizeof artwork));
+    uint64_t t1 = TestNow();
+
+    unsigned lookups = 1000;
+    for (unsigned n = 0; lookups > n; n++)
+        ArtworkCacheGet(cache, encoded, Size);     /* misses; the decoder refuses them */
+    uint64_t t2 = TestNow();
+
+    printf("decode + downsample: %.1f us per 600x600\n", (double)(t1 - t0) / 1e3);
+    printf("hash + lookup: %.1f us per %u KB\n", (double)(t2 - t1) / lookups / 1e3, (unsigned)(Size / 1024));
+
+    ArtworkCacheDelete(cache);
+    free(encoded);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(decode_once_test);
+    TEST(crop_test);
+    TEST(failure_test);
+    TEST(budget_test);
+    TEST(thread_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file CommandRunnerTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "CommandRunner.h"
+#include <pthread.h>
+
+static void spawn_test(void)
+{
+    CommandResult result;
+
+    ASSERT(CommandSpawn("echo hello; echo error >&2; exit 3", 5, &result));
+    ASSERT(3 == result.status && !result.timedOut);
+    ASSERT(0 == strcmp("hello\n", result.output) && 6 == result.length);
+
+    /* output past the limit is drained and truncated */
+    ASSERT(CommandSpawn("yes x | head -c 100000", 5, &result));
+    ASSERT(0 == result.status);
+    ASSERT(CommandRunnerOutputMax - 1 == result.length);
+    ASSERT(CommandRunnerOutputMax - 1 == strlen(result.output));
+}
+
+static void timeout_test(void)
+{
+    /* the whole process group goes, including a child that holds the pipe open */
+    CommandResult result;
+    uint64_t t0 = TestNow();
+    ASSERT(!CommandSpawn("sleep 10 & echo started; wait", 0.2, &result));
+    ASSERT(result.timedOut && -1 == result.status);
+    ASSERT(0 == strcmp("started\n", result.output));
+    ASSERT(2e9 > TestNow() - t0);
+}
+
+#define SpawnThreadCount                4
+#define SpawnIterations                 25
+
+static char ExpectedDescriptors[CommandRunnerOutputMax];
+
+static void *spawn_main(void *data)
+{
+    CommandResult result;
+    for (unsigned i = 0; SpawnIterations > i; i++)
+    {
+        ASSERT(CommandSpawn("ls /dev/fd", 5, &result));
+        ASSERT(0 == strcmp(ExpectedDescriptors, result.output));
+    }
+    return 0;
+}
+
+static void descriptor_test(void)
+{
+    /*
+     * Concurrent spawns: no child may inherit the pipe of another spawn. A
+     * child sees stdin, stdout, stderr and the directory ls is reading, exactly
+     * as when it runs alone.
+     */
+    CommandResult result;
+    pthread_t threads[SpawnThreadCount];
+
+    ASSERT(CommandSpawn("ls /dev/fd", 5, &result));
+    strcpy(ExpectedDescriptors, result.output);
+
+    for (unsigned i = 0; SpawnThreadCount > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, spawn_main, 0));
+    for (unsigned i = 0; SpawnThreadCount > i; i++)
+        pthread_join(threads[i], 0);
+}
+
+static CommandRunner *Runner;
+
+static void *run_main(void *data)
+{
+    CommandResult result;
+    CommandRunnerRun(Runner, "sleep 0.2; echo joined", 0, 5, &result);
+    ASSERT(0 == strcmp("joined\n", result.output));
+    return 0;
+}
+
+static void runner_test(void)
+{
+    CommandResult result;
+    CommandStats stats;
+    pthread_t threads[4];
+
+    Runner = CommandRunnerCreate(2);
+    ASSERT(0 != Runner);
+
+    /* a result younger than the TTL is returned without spawning */
+    CommandRunnerRun(Runner, "echo $$", 60, 5, &result);
+    char pid[32];
+    strcpy(pid, result.output);
+    CommandRunnerRun(Runner, "echo $$", 60, 5, &result);
+    ASSERT(0 == strcmp(pid, result.output));
+    CommandRunnerRun(Runner, "echo $$", 0, 5, &result);
+    ASSERT(0 != strcmp(pid, result.output));
+    ASSERT(CommandRunnerGetStats(Runner, "echo $$", &stats));
+    ASSERT(2 == stats.runs && 1 == stats.hits && 0 == stats.joins);
+
+    /* callers of a running command join it */
+    for (unsigned i = 0; 4 > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, run_main, 0));
+    for (unsigned i = 0; 4 > i; i++)
+        pthread_join(threads[i], 0);
+    ASSERT(CommandRunnerGetStats(Runner, "sleep 0.2; echo joined", &stats));
+    ASSERT(4 == stats.runs + stats.joins && 1 <= stats.joins);
+
+    /* the least recently completed entry is evicted */
+    CommandRunnerRun(Runner, "true", 0, 5, &result);
+    ASSERT(!CommandRunnerGetStats(Runner, "echo $$", &stats));
+
+    CommandRunnerDelete(Runner);
+}
+
+static void spawn_bench(void)
+{
+    if (!TestBench)
+        return;
+
+    CommandResult result;
+    unsigned iterations = 200;
+    double spawnTime = 0;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+    {
+        ASSERT(CommandSpawn("true", 5, &result));
+        spawnTime += result.spawnTime;
+    }
+    uint64_t t1 = TestNow();
+    printf("spawn: %.1f us per run, %.1f us in posix_spawn\n",
+        (double)(t1 - t0) / iterations / 1e3, spawnTime / iterations * 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(spawn_test);
+    TEST(timeout_test);
+    TEST(descriptor_test);
+    TEST(runner_test);
+    TEST(spawn_bench);
+
+    return 0;
+}
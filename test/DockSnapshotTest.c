@@ -0,0 +1,162 @@
+/**
+ * @file DockSnapshotTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "DockSnapshot.h"
+#include <unistd.h>
+
+#define ItemCount                       48
+#define IconSize                        60
+
+static char Path[] = "/tmp/DockSnapshotTest.XXXXXX";
+
+static uint32_t pixel(unsigned item, unsigned i)
+{
+    return (uint32_t)(item * 2654435761u + i * 40503u);
+}
+
+static void build(void)
+{
+    static uint32_t pixels[IconSize * IconSize];
+    char path[64], key[96];
+
+    DockSnapshotBuilder *builder = DockSnapshotBuilderCreate("/Users/user/Dock");
+    ASSERT(0 != builder);
+    for (unsigned i = 0; ItemCount > i; i++)
+    {
+        snprintf(path, sizeof path, "/Applications/Application %u.app", i);
+        ASSERT(DockSnapshotBuilderAdd(builder, path, (uint8_t)(i % 3), (uint8_t)(i % 2)));
+
+        /* every third item has no icon */
+        if (0 == i % 3)
+            continue;
+        snprintf(key, sizeof key, "%s:%u", path, i);
+        for (unsigned j = 0; IconSize * IconSize > j; j++)
+            pixels[j] = pixel(i, j);
+        ASSERT(DockSnapshotBuilderSetIcon(builder, i, key, pixels, IconSize, IconSize));
+    }
+    ASSERT(!DockSnapshotBuilderSetIcon(builder, ItemCount, "key", pixels, IconSize, IconSize));
+    ASSERT(!DockSnapshotBuilderSetIcon(builder, 0, "key", pixels, 0, IconSize));
+
+    size_t size;
+    const void *data = DockSnapshotBuilderData(builder, &size);
+    ASSERT(0 != data);
+    ASSERT(DockSnapshotWrite(Path, data, size));
+    DockSnapshotBuilderDelete(builder);
+}
+
+static void verify(DockSnapshot *snapshot)
+{
+    DockSnapshotItem item;
+    char path[64], key[96];
+
+    ASSERT(0 == strcmp("/Users/user/Dock", DockSnapshotRoot(snapshot)));
+    ASSERT(ItemCount == DockSnapshotCount(snapshot));
+    for (unsigned i = 0; ItemCount > i; i++)
+    {
+        ASSERT(DockSnapshotItemAtIndex(snapshot, i, &item));
+        snprintf(path, sizeof path, "/Applications/Application %u.app", i);
+        ASSERT(0 == strcmp(path, item.path));
+        ASSERT(i % 3 == item.group && i % 2 == item.flags);
+        if (0 == i % 3)
+        {
+            ASSERT(0 == item.iconKey && 0 == item.iconPixels);
+            continue;
+        }
+        snprintf(key, sizeof key, "%s:%u", path, i);
+        ASSERT(0 != item.iconKey && 0 == strcmp(key, item.iconKey));
+        ASSERT(IconSize == item.iconWidth && IconSize == item.iconHeight);
+        for (unsigned j = 0; IconSize * IconSize > j; j++)
+            ASSERT(pixel(i, j) == item.iconPixels[j]);
+    }
+    ASSERT(!DockSnapshotItemAtIndex(snapshot, ItemCount, &item));
+}
+
+static void roundtrip_test(void)
+{
+    build();
+
+    DockSnapshot *snapshot = DockSnapshotOpen(Path);
+    ASSERT(0 != snapshot);
+    verify(snapshot);
+    DockSnapshotClose(snapshot);
+}
+
+static void corrupt_test(void)
+{
+    /* any truncation or an icon that points outside the pixels fails the open */
+    build();
+    FILE *file = fopen(Path, "r+");
+    ASSERT(0 != file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    ASSERT(0 == ftruncate(fileno(file), size - 1));
+    fclose(file);
+    ASSERT(0 == DockSnapshotOpen(Path));
+
+    build();
+    file = fopen(Path, "r+");
+    ASSERT(0 != file);
+    uint32_t icon = UINT32_MAX - 1;
+    fseek(file, 24 + 20 * 1 + 12, SEEK_SET);    /* header, entries[1].icon */
+    fwrite(&icon, sizeof icon, 1, file);
+    fclose(file);
+    ASSERT(0 == DockSnapshotOpen(Path));
+}
+
+static void warm_start_test(void)
+{
+    /*
+     * The warm start budget: mapping and walking a full Dock snapshot, icons
+     * included, must stay far below a frame, so that the first paint does not
+     * wait on it.
+     */
+    unsigned iterations = TestBench ? 10000 : 100;
+    uint64_t sum = 0;
+
+    build();
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; iterations > n; n++)
+    {
+        DockSnapshot *snapshot = DockSnapshotOpen(Path);
+        DockSnapshotItem item;
+        ASSERT(0 != snapshot);
+        for (size_t i = 0; DockSnapshotItemAtIndex(snapshot, i, &item); i++)
+            if (0 != item.iconPixels)
+                sum += item.iconPixels[IconSize * IconSize - 1];
+        DockSnapshotClose(snapshot);
+    }
+    uint64_t t1 = TestNow();
+    double perOpen = (double)(t1 - t0) / iterations;
+
+    ASSERT(0 != sum);
+    ASSERT(2e6 > perOpen);
+    if (TestBench)
+        printf("warm start: %.1f us per open and walk of %u items\n", perOpen / 1e3, ItemCount);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+    int fd = mkstemp(Path);
+    ASSERT(-1 != fd);
+    close(fd);
+
+    TEST(roundtrip_test);
+    TEST(corrupt_test);
+    TEST(warm_start_test);
+
+    unlink(Path);
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * @file FileOperationTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "FileOperation.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/xattr.h>
+#endif
+
+static char Root[] = "/tmp/FileOperationTest.XXXXXX";
+
+static int sh(const char *format, ...)
+{
+    char command[4096];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(command, sizeof command, format, ap);
+    va_end(ap);
+    return system(command);
+}
+
+static mode_t mode_of(const char *format, ...)
+{
+    char path[4096];
+    struct stat st;
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(path, sizeof path, format, ap);
+    va_end(ap);
+    ASSERT(0 == lstat(path, &st));
+    return st.st_mode & 07777;
+}
+
+static time_t mtime_of(const char *format, ...)
+{
+    char path[4096];
+    struct stat st;
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(path, sizeof path, format, ap);
+    va_end(ap);
+    ASSERT(0 == lstat(path, &st));
+    return st.st_mtime;
+}
+
+static int run(FileOperationKind kind, const char *dstdir, const char *src)
+{
+    char path[4096];
+    int res;
+
+    FileOperation *op = FileOperationCreate(kind, dstdir, 4, 0, 0, 0);
+    ASSERT(0 != op);
+    snprintf(path, sizeof path, "%s/%s", Root, src);
+    ASSERT(FileOperationAdd(op, path));
+    ASSERT(FileOperationStart(op));
+    res = FileOperationWait(op);
+    FileOperationDelete(op);
+
+    return res;
+}
+
+static void setup(void)
+{
+    sh("chmod -R u+w %s 2>/dev/null", Root);
+    ASSERT(0 == sh("rm -rf %s/src %s/dst && mkdir -p %s/src/tree/sub/ro %s/dst", Root, Root, Root, Root));
+    ASSERT(0 == sh("cd %s/src/tree && for i in $(seq 1 64); do head -c $((i * 4096)) /dev/urandom > f$i; done",
+        Root));
+    ASSERT(0 == sh("cd %s/src/tree && ln -s f1 link && echo x > sub/ro/x && chmod 555 sub/ro && chmod 750 sub",
+        Root));
+}
+
+static void copy_test(void)
+{
+    char dst[4096];
+    setup();
+    snprintf(dst, sizeof dst, "%s/dst", Root);
+
+    ASSERT(0 == run(FileOperationCopy, dst, "src/tree"));
+    ASSERT(0 == sh("diff -r %s/src/tree %s/dst/tree", Root, Root));
+    ASSERT(0 == sh("test -L %s/dst/tree/link", Root));
+
+    /* directories end up with the mode of their source, read-only ones included */
+    ASSERT(0555 == mode_of("%s/dst/tree/sub/ro", Root));
+    ASSERT(0750 == mode_of("%s/dst/tree/sub", Root));
+    ASSERT(mode_of("%s/src/tree", Root) == mode_of("%s/dst/tree", Root));
+
+    /* an existing destination is never replaced */
+    ASSERT(EEXIST == run(FileOperationCopy, dst, "src/tree"));
+    ASSERT(0 == sh("diff -r %s/src/tree %s/dst/tree", Root, Root));
+}
+
+static void metadata_test(void)
+{
+    char dst[4096], path[4096];
+    setup();
+    snprintf(dst, sizeof dst, "%s/dst", Root);
+
+    /* modification times survive the copy: files, links and directories filled later */
+    ASSERT(0 == sh("cd %s/src/tree && touch -h -d '2001-02-03 04:05:06' f1 link sub/ro sub . && "
+        "chmod u+w sub/ro && touch -d '2001-02-03 04:05:06' sub/ro && chmod u-w sub/ro", Root));
+#if defined(__linux__)
+    /* extended attributes too, where the file system has them */
+    snprintf(path, sizeof path, "%s/src/tree/f1", Root);
+    bool xattrs = 0 == setxattr(path, "user.test", "file", 4, 0);
+    snprintf(path, sizeof path, "%s/src/tree/sub", Root);
+    xattrs = xattrs && 0 == setxattr(path, "user.test", "dir", 3, 0);
+#endif
+
+    ASSERT(0 == run(FileOperationCopy, dst, "src/tree"));
+    ASSERT(0 == sh("diff -r %s/src/tree %s/dst/tree", Root, Root));
+    static const char *names[] = { "f1", "link", "sub/ro", "sub", "." };
+    for (size_t i = 0; sizeof names / sizeof names[0] > i; i++)
+        ASSERT(mtime_of("%s/src/tree/%s", Root, names[i]) == mtime_of("%s/dst/tree/%s", Root, names[i]));
+    ASSERT(mtime_of("%s/src/tree/f2", Root) == mtime_of("%s/dst/tree/f2", Root));
+
+#if defined(__linux__)
+    if (xattrs)
+    {
+        char value[16];
+        snprintf(path, sizeof path, "%s/dst/tree/f1", Root);
+        ASSERT(4 == getxattr(path, "user.test", value, sizeof value) && 0 == memcmp("file", value, 4));
+        snprintf(path, sizeof path, "%s/dst/tree/sub", Root);
+        ASSERT(3 == getxattr(path, "user.test", value, sizeof value) && 0 == memcmp("dir", value, 3));
+    }
+#endif
+    (void)path;
+}
+
+static void rollback_test(void)
+{
+    char dst[4096];
+    setup();
+    snprintf(dst, sizeof dst, "%s/dst", Root);
+
+    /* a failed copy leaves nothing behind, read-only directories included */
+    ASSERT(0 == sh("chmod u+w %s/src/tree/sub/ro && mkfifo %s/src/tree/sub/ro/fifo", Root, Root));
+    ASSERT(ENOTSUP == run(FileOperationCopy, dst, "src/tree"));
+    ASSERT(0 != sh("test -e %s/dst/tree", Root));
+}
+
+static void move_test(void)
+{
+    char dst[4096];
+    setup();
+    snprintf(dst, sizeof dst, "%s/dst", Root);
+
+    ASSERT(0 == sh("cp -a %s/src/tree %s/src/copy", Root, Root));
+    ASSERT(0 == run(FileOperationMove, dst, "src/tree"));
+    ASSERT(0 != sh("test -e %s/src/tree", Root));
+    ASSERT(0 == sh("diff -r %s/src/copy %s/dst/tree", Root, Root));
+
+    /* an item that is in the way fails the move and nothing is changed */
+    ASSERT(0 == sh("mkdir %s/src/tree", Root));
+    ASSERT(EEXIST == run(FileOperationMove, dst, "src/tree"));
+    ASSERT(0 == sh("test -d %s/src/tree && diff -r %s/src/copy %s/dst/tree", Root, Root, Root));
+
+    /* moving a directory into itself is refused */
+    snprintf(dst, sizeof dst, "%s/dst/tree/sub", Root);
+    ASSERT(EINVAL == run(FileOperationMove, dst, "dst/tree"));
+}
+
+static void cross_volume_move_test(void)
+{
+    /* needs a second file system and permissions that apply to us */
+    struct stat st0, st1;
+    char dst[] = "/dev/shm/FileOperationTest.XXXXXX";
+    if (0 == geteuid() || 0 != stat(Root, &st0) || 0 != stat("/dev/shm", &st1) ||
+        st0.st_dev == st1.st_dev || 0 == mkdtemp(dst))
+    {
+        printf("cross_volume_move_test: skipped\n");
+        return;
+    }
+
+    /* the copy completes but a source in a read-only directory cannot be removed */
+    setup();
+    FileOperation *op = FileOperationCreate(FileOperationMove, dst, 4, 0, 0, 0);
+    char path[4096];
+    snprintf(path, sizeof path, "%s/src/tree", Root);
+    ASSERT(FileOperationAdd(op, path));
+    ASSERT(FileOperationStart(op));
+    ASSERT(EACCES == FileOperationWait(op));
+    ASSERT(FileOperationCompleted(op));
+    FileOperationDelete(op);
+    ASSERT(0 == sh("test -f %s/tree/sub/ro/x && test -f %s/src/tree/sub/ro/x", dst, Root));
+
+    sh("chmod -R u+w %s %s/src && rm -rf %s", dst, Root, dst);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+    ASSERT(0 != mkdtemp(Root));
+
+    TEST(copy_test);
+    TEST(metadata_test);
+    TEST(rollback_test);
+    TEST(move_test);
+    TEST(cross_volume_move_test);
+
+    sh("chmod -R u+w %s; rm -rf %s", Root, Root);
+
+    return 0;
+}
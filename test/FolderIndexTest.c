@@ -0,0 +1,380 @@
+/**
+ * @file FolderIndexTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "FolderIndex.h"
+
+static int compare_entries(const FolderIndexEntry *entry1, const FolderIndexEntry *entry2)
+{
+    /* the documented order: key descending, keyless last, natural name order, then bytes */
+    if (entry1->hasKey != entry2->hasKey)
+        return entry1->hasKey ? -1 : +1;
+    if (entry1->hasKey && entry1->key != entry2->key)
+        return entry1->key > entry2->key ? -1 : +1;
+    int result = FolderIndexCompareNames(entry1->name, entry2->name);
+    return 0 != result ? result : strcmp(entry1->name, entry2->name);
+}
+
+static void check_sorted(FolderIndex *index)
+{
+    FolderIndexEntry prev, entry;
+    size_t count = FolderIndexCount(index);
+    for (size_t i = 0; count > i; i++)
+    {
+        ASSERT(FolderIndexGet(index, i, &entry));
+        if (0 < i)
+            ASSERT(0 > compare_entries(&prev, &entry));
+        ASSERT(i == FolderIndexFind(index, entry.name));
+        prev = entry;
+    }
+    ASSERT(!FolderIndexGet(index, count, &entry));
+}
+
+static void compare_names_test(void)
+{
+    static const char *ordered[] =
+    {
+        "", "1", "01", "2", "9", "10", "010", "a", "A", "a1", "a2", "a10", "a10b", "a11",
+        "file 2.txt", "file 10.txt", "file10.txt", "image99999999999999999999.png",
+        "image100000000000000000000.png", "Zebra", "é",
+    };
+    size_t count = sizeof ordered / sizeof ordered[0];
+    for (size_t i = 0; count > i; i++)
+        for (size_t j = 0; count > j; j++)
+        {
+            int result = FolderIndexCompareNames(ordered[i], ordered[j]);
+            int bytes = strcmp(ordered[i], ordered[j]);
+            /* case and leading zeros compare equal; the index breaks those ties by bytes */
+            if (0 == result)
+                continue;
+            ASSERT((i < j ? -1 : +1) == result);
+            ASSERT(0 != bytes);
+        }
+    ASSERT(0 == FolderIndexCompareNames("a", "A"));
+    ASSERT(0 == FolderIndexCompareNames("1", "01"));
+}
+
+static void basic_test(void)
+{
+    FolderIndex *index = FolderIndexCreate();
+    FolderIndexEntry entry;
+    size_t from, to;
+    ASSERT(0 != index);
+
+    FolderIndexEntry entries[] =
+    {
+        { .name = "b.txt" },
+        { .name = "new.txt", .hasKey = true, .key = 200, .flags = 1 },
+        { .name = "old.txt", .hasKey = true, .key = 100 },
+        { .name = "a.txt" },
+    };
+    for (size_t i = 0; 4 > i; i++)
+        ASSERT(FolderIndexAdd(index, &entries[i]));
+    ASSERT(!FolderIndexAdd(index, &entries[0]));   /* names are unique */
+    FolderIndexSort(index);
+    ASSERT(4 == FolderIndexCount(index));
+    ASSERT(FolderIndexGet(index, 0, &entry) && 0 == strcmp("new.txt", entry.name) && 1 == entry.flags);
+    ASSERT(FolderIndexGet(index, 1, &entry) && 0 == strcmp("old.txt", entry.name));
+    ASSERT(FolderIndexGet(index, 2, &entry) && 0 == strcmp("a.txt", entry.name));
+    ASSERT(FolderIndexGet(index, 3, &entry) && 0 == strcmp("b.txt", entry.name));
+    ASSERT(FolderIndexNotFound == FolderIndexFind(index, "c.txt"));
+
+    /* touched: moves to the front */
+    FolderIndexEntry touched = { .name = "b.txt", .hasKey = true, .key = 300 };
+    ASSERT(FolderIndexUpdate(index, "b.txt", &touched, &from, &to));
+    ASSERT(3 == from && 0 == to);
+
+    /* removed, then removed again */
+    ASSERT(FolderIndexUpdate(index, "old.txt", 0, &from, &to));
+    ASSERT(2 == from && FolderIndexNotFound == to);
+    ASSERT(FolderIndexUpdate(index, "old.txt", 0, &from, &to));
+    ASSERT(FolderIndexNotFound == from && FolderIndexNotFound == to);
+
+    /* created */
+    FolderIndexEntry created = { .name = "c.txt" };
+    ASSERT(FolderIndexUpdate(index, "c.txt", &created, &from, &to));
+    ASSERT(FolderIndexNotFound == from && 3 == to);
+
+    check_sorted(index);
+    FolderIndexDelete(index);
+}
+
+static void merge_test(void)
+{
+    FolderIndex *index = FolderIndexCreate(), *other = FolderIndexCreate();
+    FolderIndexEntry entry;
+    FolderIndexStats stats;
+    size_t from, to;
+    ASSERT(0 != index && 0 != other);
+
+    /* merging into an empty index */
+    FolderIndexEntry first[] =
+    {
+        { .name = "b.txt" },
+        { .name = "new.txt", .hasKey = true, .key = 200 },
+    };
+    for (size_t i = 0; 2 > i; i++)
+        ASSERT(FolderIndexAdd(other, &first[i]));
+    ASSERT(FolderIndexMerge(index, other));
+    ASSERT(2 == FolderIndexCount(index) && 0 == FolderIndexCount(other));
+
+    /* a change that arrived before the page: the index keeps its entry */
+    FolderIndexEntry changed = { .name = "a.txt", .hasKey = true, .key = 300, .flags = 2 };
+    ASSERT(FolderIndexUpdate(index, "a.txt", &changed, &from, &to));
+    ASSERT(FolderIndexUpdate(index, "b.txt", 0, &from, &to));
+
+    /* the other index is reused for the next page */
+    FolderIndexEntry second[] =
+    {
+        { .name = "a.txt", .flags = 1 },
+        { .name = "c.txt" },
+        { .name = "old.txt", .hasKey = true, .key = 100 },
+    };
+    for (size_t i = 0; 3 > i; i++)
+        ASSERT(FolderIndexAdd(other, &second[i]));
+    ASSERT(FolderIndexMerge(index, other));
+    ASSERT(4 == FolderIndexCount(index) && 0 == FolderIndexCount(other));
+    ASSERT(FolderIndexGet(index, 0, &entry) && 0 == strcmp("a.txt", entry.name) && 2 == entry.flags);
+    ASSERT(FolderIndexGet(index, 1, &entry) && 0 == strcmp("new.txt", entry.name));
+    ASSERT(FolderIndexGet(index, 2, &entry) && 0 == strcmp("old.txt", entry.name));
+    ASSERT(FolderIndexGet(index, 3, &entry) && 0 == strcmp("c.txt", entry.name));
+    ASSERT(FolderIndexNotFound == FolderIndexFind(other, "c.txt"));
+    check_sorted(index);
+
+    /* merged entries update like any other */
+    ASSERT(FolderIndexUpdate(index, "c.txt", 0, &from, &to));
+    ASSERT(3 == from && FolderIndexNotFound == to);
+
+    /* the other keeps no memory but its arrays */
+    FolderIndexGetStats(other, &stats);
+    ASSERT(0 == stats.count && 0 == stats.garbage);
+
+    FolderIndexDelete(other);
+    FolderIndexDelete(index);
+}
+
+#define ChurnNames                      2000
+
+static void random_entry(uint64_t *seed, char *name, size_t size, FolderIndexEntry *entry)
+{
+    /* collisions on purpose: case, leading zeros, equal keys, keyless entries */
+    static const char *prefixes[] = { "file", "File", "IMG_", "img_", "report " };
+    unsigned n = (unsigned)(TestRandom(seed) % ChurnNames);
+    snprintf(name, size, "%s%s%u.%s", prefixes[n % 5], 0 == n % 7 ? "0" : "", n / 5,
+        0 == n % 3 ? "png" : "txt");
+    entry->name = name;
+    entry->hasKey = 0 != TestRandom(seed) % 4;
+    entry->key = (double)(TestRandom(seed) % 50);
+    entry->flags = (uint8_t)TestRandom(seed);
+}
+
+static void churn_test(void)
+{
+    /*
+     * The live folder bar applies each change as remove-at-from and insert-at-to
+     * (a move when both are set). Replaying the reported steps on a plain array
+     * must give the order of the index after any sequence of creates, deletes,
+     * renames and touches.
+     */
+    FolderIndex *index = FolderIndexCreate();
+    static char mirror[ChurnNames * 4][64];
+    size_t mirrorCount = 0;
+    uint64_t seed = 0x853c49e6748fea9bULL;
+    char name[64];
+    FolderIndexEntry entry;
+    FolderIndexStats stats;
+    size_t maxBytes = 0;
+    ASSERT(0 != index);
+
+    for (unsigned n = 0; 300000 > n; n++)
+    {
+        random_entry(&seed, name, sizeof name, &entry);
+        bool remove = 0 == TestRandom(&seed) % 3;
+        size_t from, to;
+
+        ASSERT(FolderIndexUpdate(index, name, remove ? 0 : &entry, &from, &to));
+        if (FolderIndexNotFound != from)
+        {
+            ASSERT(mirrorCount > from);
+            ASSERT(0 == strcmp(name, mirror[from]));
+            memmove(mirror[from], mirror[from + 1], (mirrorCount - from - 1) * sizeof mirror[0]);
+            mirrorCount--;
+        }
+        if (FolderIndexNotFound != to)
+        {
+            ASSERT(!remove && mirrorCount >= to);
+            memmove(mirror[to + 1], mirror[to], (mirrorCount - to) * sizeof mirror[0]);
+            strcpy(mirror[to], name);
+            mirrorCount++;
+        }
+        else
+            ASSERT(remove);
+        ASSERT(mirrorCount == FolderIndexCount(index));
+
+        /* the entry reads back as written */
+        if (!remove)
+        {
+            FolderIndexEntry read;
+            ASSERT(FolderIndexGet(index, to, &read));
+            ASSERT(0 == strcmp(name, read.name) && entry.flags == read.flags);
+            ASSERT(entry.hasKey == read.hasKey && (!entry.hasKey || entry.key == read.key));
+        }
+
+        /* removed records are reclaimed: memory follows the live entries */
+        FolderIndexGetStats(index, &stats);
+        if (maxBytes < stats.bytes)
+            maxBytes = stats.bytes;
+
+        if (0 == n % 10000)
+        {
+            for (size_t i = 0; mirrorCount > i; i++)
+            {
+                ASSERT(FolderIndexGet(index, i, &entry));
+                ASSERT(0 == strcmp(mirror[i], entry.name));
+            }
+            check_sorted(index);
+        }
+    }
+    ASSERT(ChurnNames >= FolderIndexCount(index));
+    ASSERT(1024 * 1024 > maxBytes);
+
+    FolderIndexDelete(index);
+}
+
+static void large_test(void)
+{
+    /*
+     * Presenting a folder of 100k entries: build (add all, sort once), then
+     * fetch pages the way the scrubber does, and apply single changes. The
+     * folder bar builds its index from pages merged in as the enumeration
+     * delivers them; that must end up with the same order at a similar cost.
+     */
+    enum { Count = 100000, PageSize = 40 };
+    FolderIndex *index = FolderIndexCreate(), *paged = FolderIndexCreate(), *page = FolderIndexCreate();
+    FolderIndexEntry entry;
+    FolderIndexStats stats;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    char name[64];
+    ASSERT(0 != index && 0 != paged && 0 != page);
+
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; Count > i; i++)
+    {
+        snprintf(name, sizeof name, "Document %u (%u).pdf",
+            (unsigned)(TestRandom(&seed) % 100000), i);
+        entry.name = name;
+        entry.hasKey = true;
+        entry.key = (double)(TestRandom(&seed) % 1000000);
+        entry.flags = 0;
+        ASSERT(FolderIndexAdd(index, &entry));
+    }
+    FolderIndexSort(index);
+    uint64_t t1 = TestNow();
+    ASSERT(Count == FolderIndexCount(index));
+    check_sorted(index);
+
+    seed = 0x9e3779b97f4a7c15ULL;
+    size_t pageCount = 64, merges = 0;
+    uint64_t t6 = TestNow();
+    for (unsigned i = 0; Count > i; i++)
+    {
+        snprintf(name, sizeof name, "Document %u (%u).pdf",
+            (unsigned)(TestRandom(&seed) % 100000), i);
+        entry.name = name;
+        entry.hasKey = true;
+        entry.key = (double)(TestRandom(&seed) % 1000000);
+        entry.flags = 0;
+        ASSERT(FolderIndexAdd(page, &entry));
+        if (pageCount <= FolderIndexCount(page) || Count == i + 1)
+        {
+            ASSERT(FolderIndexMerge(paged, page));
+            ASSERT(0 == FolderIndexCount(page));
+            if (4096 > pageCount)
+                pageCount *= 2;
+            merges++;
+        }
+    }
+    uint64_t t7 = TestNow();
+    ASSERT(Count == FolderIndexCount(paged));
+    for (size_t i = 0; Count > i; i++)
+    {
+        FolderIndexEntry pagedEntry;
+        ASSERT(FolderIndexGet(index, i, &entry) && FolderIndexGet(paged, i, &pagedEntry));
+        ASSERT(0 == strcmp(entry.name, pagedEntry.name));
+    }
+    FolderIndexDelete(page);
+    FolderIndexDelete(paged);
+
+    unsigned pages = TestBench ? 100000 : 1000;
+    size_t sum = 0;
+    uint64_t t2 = TestNow();
+    for (unsigned n = 0; pages > n; n++)
+    {
+        size_t first = TestRandom(&seed) % (Count - PageSize);
+        for (size_t i = first; first + PageSize > i; i++)
+        {
+            ASSERT(FolderIndexGet(index, i, &entry));
+            sum += (size_t)entry.name[0];
+        }
+    }
+    uint64_t t3 = TestNow();
+    ASSERT(0 != sum);
+
+    unsigned updates = 1000;
+    uint64_t t4 = TestNow();
+    for (unsigned n = 0; updates > n; n++)
+    {
+        size_t from, to;
+        ASSERT(FolderIndexGet(index, TestRandom(&seed) % Count, &entry));
+        snprintf(name, sizeof name, "%s", entry.name);
+        entry.name = name;
+        entry.key = (double)(TestRandom(&seed) % 1000000);
+        ASSERT(FolderIndexUpdate(index, name, &entry, &from, &to));
+        ASSERT(FolderIndexNotFound != from && FolderIndexNotFound != to);
+    }
+    uint64_t t5 = TestNow();
+    ASSERT(Count == FolderIndexCount(index));
+
+    FolderIndexGetStats(index, &stats);
+    ASSERT(16 * 1024 * 1024 > stats.bytes);
+
+    /* generous bounds; they catch quadratic behavior, not small regressions */
+    ASSERT(2e9 > t1 - t0);
+    ASSERT(2e9 > t7 - t6);
+    ASSERT(100e3 > (double)(t3 - t2) / pages);
+
+    if (TestBench)
+    {
+        printf("build: %.1f ms for %u entries, %.1f MB\n",
+            (double)(t1 - t0) / 1e6, (unsigned)Count, stats.bytes / 1048576.0);
+        printf("paged build: %.1f ms in %u merges\n",
+            (double)(t7 - t6) / 1e6, (unsigned)merges);
+        printf("page: %.2f us per %u entries\n", (double)(t3 - t2) / pages / 1e3, PageSize);
+        printf("update: %.2f us per change\n", (double)(t5 - t4) / updates / 1e3);
+    }
+
+    FolderIndexDelete(index);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(compare_names_test);
+    TEST(basic_test);
+    TEST(merge_test);
+    TEST(churn_test);
+    TEST(large_test);
+
+    return 0;
+}
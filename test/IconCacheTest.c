@@ -0,0 +1,241 @@
+/**
+ * @file IconCacheTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "IconCache.h"
+
+enum { Side = 16, Size = Side * Side * 4 };
+
+static void fill(uint32_t *pixels, uint32_t value)
+{
+    for (unsigned i = 0; Side * Side > i; i++)
+        pixels[i] = value;
+}
+
+static void dedup_test(void)
+{
+    /* identical contents are stored and counted once, whatever the key */
+    IconCache *cache = IconCacheCreate(1024 * 1024);
+    IconCacheStats stats;
+    uint32_t pixels[Side * Side];
+    ASSERT(0 != cache);
+
+    fill(pixels, 0xff0000ff);
+    IconCacheBitmap *a = IconCacheInsert(cache, "a", pixels, Side, Side);
+    IconCacheBitmap *b = IconCacheInsert(cache, "b", pixels, Side, Side);
+    ASSERT(0 != a && a == b);
+    ASSERT(a->pixels != pixels && 0 == memcmp(a->pixels, pixels, sizeof pixels));
+    IconCacheGetStats(cache, &stats);
+    ASSERT(2 == stats.count && 1 == stats.bitmapCount);
+    ASSERT(Size == stats.bytes && 1 == stats.dedups);
+
+    /* the same pixels at a different shape are a different bitmap */
+    IconCacheBitmap *c = IconCacheInsert(cache, "c", pixels, Side * 2, Side / 2);
+    ASSERT(0 != c && a != c);
+    IconCacheGetStats(cache, &stats);
+    ASSERT(3 == stats.count && 2 == stats.bitmapCount && 2 * Size == stats.bytes);
+    IconCacheBitmapRelease(c);
+
+    /* the shared bitmap goes with its last key */
+    IconCacheRemove(cache, "a");
+    IconCacheRemove(cache, "c");
+    IconCacheGetStats(cache, &stats);
+    ASSERT(1 == stats.count && 1 == stats.bitmapCount && Size == stats.bytes);
+    IconCacheBitmap *l = IconCacheLookup(cache, "b");
+    ASSERT(a == l);
+    IconCacheBitmapRelease(l);
+    IconCacheRemove(cache, "b");
+    IconCacheRemove(cache, "missing");
+    IconCacheGetStats(cache, &stats);
+    ASSERT(0 == stats.count && 0 == stats.bitmapCount && 0 == stats.bytes);
+    ASSERT(0 == IconCacheLookup(cache, "b"));
+
+    /* references outlive the cache entries and the cache itself */
+    ASSERT(0xff0000ff == a->pixels[0] && 0xff0000ff == b->pixels[Side * Side - 1]);
+    IconCacheDelete(cache);
+    ASSERT(0xff0000ff == a->pixels[Side]);
+    IconCacheBitmapRetain(a);
+    IconCacheBitmapRelease(a);
+    IconCacheBitmapRelease(a);
+    IconCacheBitmapRelease(b);
+    IconCacheBitmapRelease(0);
+}
+
+static void replace_test(void)
+{
+    /* inserting an existing key replaces its bitmap; holders of the old one keep it */
+    IconCache *cache = IconCacheCreate(1024 * 1024);
+    IconCacheStats stats;
+    uint32_t pixels[Side * Side];
+    ASSERT(0 != cache);
+
+    fill(pixels, 1);
+    IconCacheBitmap *old = IconCacheInsert(cache, "key", pixels, Side, Side);
+    fill(pixels, 2);
+    IconCacheBitmap *new = IconCacheInsert(cache, "key", pixels, Side, Side);
+    ASSERT(0 != old && 0 != new && old != new);
+    ASSERT(1 == old->pixels[0] && 2 == new->pixels[0]);
+    IconCacheGetStats(cache, &stats);
+    ASSERT(1 == stats.count && 1 == stats.bitmapCount && Size == stats.bytes);
+
+    IconCacheBitmap *l = IconCacheLookup(cache, "key");
+    ASSERT(new == l);
+    IconCacheBitmapRelease(l);
+    IconCacheBitmapRelease(old);
+    IconCacheBitmapRelease(new);
+
+    IconCacheDelete(cache);
+}
+
+static void evict_test(void)
+{
+    /* room for three bitmaps: the least recently used key goes first */
+    IconCache *cache = IconCacheCreate(3 * Size);
+    IconCacheStats stats;
+    uint32_t pixels[Side * Side];
+    char key[16];
+    ASSERT(0 != cache);
+
+    for (uint32_t i = 0; 3 > i; i++)
+    {
+        snprintf(key, sizeof key, "k%u", i);
+        fill(pixels, i);
+        IconCacheBitmapRelease(IconCacheInsert(cache, key, pixels, Side, Side));
+    }
+    IconCacheBitmapRelease(IconCacheLookup(cache, "k0"));
+
+    fill(pixels, 3);
+    IconCacheBitmap *held = IconCacheInsert(cache, "k3", pixels, Side, Side);
+    IconCacheGetStats(cache, &stats);
+    ASSERT(3 == stats.count && 3 * Size == stats.bytes && 1 == stats.evictions);
+    IconCacheBitmap *l;
+    ASSERT(0 == IconCacheLookup(cache, "k1"));
+    ASSERT(0 != (l = IconCacheLookup(cache, "k0")));
+    IconCacheBitmapRelease(l);
+    ASSERT(0 != (l = IconCacheLookup(cache, "k2")));
+    IconCacheBitmapRelease(l);
+
+    /* keys that share a bitmap cost nothing extra and evict nothing */
+    IconCacheBitmapRelease(IconCacheInsert(cache, "k3-alias", pixels, Side, Side));
+    IconCacheGetStats(cache, &stats);
+    ASSERT(4 == stats.count && 1 == stats.evictions);
+
+    /* a smaller budget evicts right away; the newest entry survives even alone over budget */
+    IconCacheSetBudget(cache, Size / 2);
+    IconCacheGetStats(cache, &stats);
+    ASSERT(0 == stats.count && 0 == stats.bytes);
+    ASSERT(3 == held->pixels[0]);
+    IconCacheBitmapRelease(held);
+
+    fill(pixels, 4);
+    held = IconCacheInsert(cache, "big", pixels, Side, Side);
+    ASSERT(0 != held);
+    IconCacheGetStats(cache, &stats);
+    ASSERT(1 == stats.count && Size == stats.bytes);
+    IconCacheBitmapRelease(held);
+
+    IconCacheDelete(cache);
+}
+
+static void downsample_test(void)
+{
+    static uint32_t src[128 * 128], dst[64 * 64];
+
+    /* a constant image stays constant at any ratio: the weights sum to one */
+    for (unsigned i = 0; 128 * 128 > i; i++)
+        src[i] = 0xddccbbaa;
+    ASSERT(IconCacheDownsample(src, 128, 128, 128, dst, 60, 60));
+    for (unsigned i = 0; 60 * 60 > i; i++)
+        ASSERT(0xddccbbaa == dst[i]);
+
+    /* a one pixel checkerboard averages to mid gray (rounded up) at half size */
+    for (unsigned y = 0; 128 > y; y++)
+        for (unsigned x = 0; 128 > x; x++)
+            src[y * 128 + x] = (x ^ y) & 1 ? 0xffffffff : 0;
+    ASSERT(IconCacheDownsample(src, 128, 128, 128, dst, 64, 64));
+    for (unsigned i = 0; 64 * 64 > i; i++)
+        ASSERT(0x80808080 == dst[i]);
+
+    /* 2x2 blocks of distinct colors come out exactly; channels do not bleed */
+    for (unsigned y = 0; 4 > y; y++)
+        for (unsigned x = 0; 4 > x; x++)
+            src[y * 8 + x] = 0x01020304u * (1 + (y / 2) * 2 + x / 2);
+    ASSERT(IconCacheDownsample(src, 4, 4, 8, dst, 2, 2));
+    ASSERT(0x01020304u * 1 == dst[0] && 0x01020304u * 2 == dst[1]);
+    ASSERT(0x01020304u * 3 == dst[2] && 0x01020304u * 4 == dst[3]);
+
+    /* three to two: the middle pixel is split between both outputs */
+    src[0] = 0, src[1] = 0x000000c0, src[2] = 0x000000f0;
+    ASSERT(IconCacheDownsample(src, 3, 1, 3, dst, 2, 1));
+    ASSERT(0x40 == dst[0] && 0xe0 == dst[1]);
+
+    /* refused: empty sizes and short strides */
+    ASSERT(!IconCacheDownsample(src, 0, 4, 4, dst, 2, 2));
+    ASSERT(!IconCacheDownsample(src, 4, 4, 4, dst, 0, 2));
+    ASSERT(!IconCacheDownsample(src, 4, 4, 3, dst, 2, 2));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* a Dock's worth of icons, looked up per reset; one downsample per new icon */
+    static uint32_t src[128 * 128], dst[60 * 60];
+    IconCache *cache = IconCacheCreate(8 * 1024 * 1024);
+    uint64_t seed = 1;
+    char key[32];
+    ASSERT(0 != cache);
+
+    for (unsigned i = 0; 128 * 128 > i; i++)
+        src[i] = (uint32_t)TestRandom(&seed);
+    for (unsigned i = 0; 64 > i; i++)
+    {
+        snprintf(key, sizeof key, "/Applications/App%u.app:%u", i, i);
+        src[0] = i;
+        ASSERT(IconCacheDownsample(src, 128, 128, 128, dst, 60, 60));
+        IconCacheBitmapRelease(IconCacheInsert(cache, key, dst, 60, 60));
+    }
+
+    unsigned downsamples = 2000;
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; downsamples > n; n++)
+        IconCacheDownsample(src, 128, 128, 128, dst, 60, 60);
+    uint64_t t1 = TestNow();
+
+    unsigned lookups = 1000000;
+    for (unsigned n = 0; lookups > n; n++)
+    {
+        snprintf(key, sizeof key, "/Applications/App%u.app:%u", n % 64, n % 64);
+        IconCacheBitmapRelease(IconCacheLookup(cache, key));
+    }
+    uint64_t t2 = TestNow();
+
+    printf("downsample: %.1f us per 128x128 to 60x60\n", (double)(t1 - t0) / downsamples / 1e3);
+    printf("lookup: %.1f ns\n", (double)(t2 - t1) / lookups);
+
+    IconCacheDelete(cache);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(dedup_test);
+    TEST(replace_test);
+    TEST(evict_test);
+    TEST(downsample_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file IntervalIndexTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "IntervalIndex.h"
+#include <math.h>
+
+static void empty_test(void)
+{
+    IntervalIndex *index = IntervalIndexCreate();
+    intptr_t value = -1;
+    ASSERT(0 != index);
+
+    ASSERT(!IntervalIndexLookup(index, 0, &value));
+    ASSERT(!IntervalIndexLookup(index, -1e9, &value));
+    ASSERT(-1 == value);
+
+    /* empty and inverted intervals are refused */
+    ASSERT(!IntervalIndexAdd(index, 10, 10, 1));
+    ASSERT(!IntervalIndexAdd(index, 10, 5, 1));
+    ASSERT(!IntervalIndexAdd(index, NAN, 5, 1));
+    ASSERT(!IntervalIndexLookup(index, 10, &value));
+
+    IntervalIndexDelete(index);
+    IntervalIndexDelete(0);
+}
+
+static void boundary_test(void)
+{
+    /* adjacent [lo,hi) intervals: a shared edge belongs to the interval that starts there */
+    IntervalIndex *index = IntervalIndexCreate();
+    intptr_t value;
+    ASSERT(0 != index);
+
+    ASSERT(IntervalIndexAdd(index, 50, 100, 2));
+    ASSERT(IntervalIndexAdd(index, 0, 50, 1));
+    ASSERT(IntervalIndexAdd(index, 100, 150, 3));
+    IntervalIndexBuild(index);
+
+    ASSERT(IntervalIndexLookup(index, 0, &value) && 1 == value);
+    ASSERT(IntervalIndexLookup(index, 49.999, &value) && 1 == value);
+    ASSERT(IntervalIndexLookup(index, 50, &value) && 2 == value);
+    ASSERT(IntervalIndexLookup(index, 100, &value) && 3 == value);
+    ASSERT(IntervalIndexLookup(index, nextafter(150, 0), &value) && 3 == value);
+    ASSERT(!IntervalIndexLookup(index, 150, &value));
+    ASSERT(!IntervalIndexLookup(index, nextafter(0, -1), &value));
+
+    /* a value is optional */
+    ASSERT(IntervalIndexLookup(index, 75, 0));
+
+    IntervalIndexDelete(index);
+}
+
+static void gap_test(void)
+{
+    /* segments with spacing between them: points in the gaps hit nothing */
+    IntervalIndex *index = IntervalIndexCreate();
+    intptr_t value;
+    ASSERT(0 != index);
+
+    for (intptr_t i = 9; 0 <= i; i--)
+        ASSERT(IntervalIndexAdd(index, i * 40.0, i * 40.0 + 30.0, i));
+
+    for (intptr_t i = 0; 10 > i; i++)
+    {
+        ASSERT(IntervalIndexLookup(index, i * 40.0 + 15.0, &value) && i == value);
+        ASSERT(!IntervalIndexLookup(index, i * 40.0 + 30.0, &value));
+        ASSERT(!IntervalIndexLookup(index, i * 40.0 + 35.0, &value));
+    }
+    ASSERT(!IntervalIndexLookup(index, -5, &value));
+    ASSERT(!IntervalIndexLookup(index, 1000, &value));
+
+    /* lookups sort on demand after adds without a build */
+    ASSERT(IntervalIndexAdd(index, -20, -10, 100));
+    ASSERT(IntervalIndexLookup(index, -15, &value) && 100 == value);
+    ASSERT(IntervalIndexLookup(index, 15, &value) && 0 == value);
+
+    /* a reset keeps nothing but the memory */
+    IntervalIndexReset(index);
+    ASSERT(!IntervalIndexLookup(index, 15, &value));
+    ASSERT(IntervalIndexAdd(index, 10, 20, 7));
+    ASSERT(IntervalIndexLookup(index, 15, &value) && 7 == value);
+
+    IntervalIndexDelete(index);
+}
+
+static void model_test(void)
+{
+    /* random layouts against a linear scan */
+    IntervalIndex *index = IntervalIndexCreate();
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    double los[64], his[64];
+    ASSERT(0 != index);
+
+    for (unsigned n = 0; 1000 > n; n++)
+    {
+        unsigned count = (unsigned)(TestRandom(&seed) % 64);
+        double x = 0;
+        IntervalIndexReset(index);
+        for (unsigned i = 0; count > i; i++)
+        {
+            x += (double)(TestRandom(&seed) % 3);       /* gap, possibly none */
+            los[i] = x;
+            x += 1 + (double)(TestRandom(&seed) % 50);
+            his[i] = x;
+        }
+        for (unsigned i = count; 0 < i; i--)
+            ASSERT(IntervalIndexAdd(index, los[i - 1], his[i - 1], (intptr_t)(i - 1)));
+        IntervalIndexBuild(index);
+
+        for (unsigned k = 0; 100 > k; k++)
+        {
+            double p = (double)(TestRandom(&seed) % (unsigned)(x + 10) * 4) / 4 - 5;
+            intptr_t expect = -1, value = -1;
+            for (unsigned i = 0; count > i; i++)
+                if (los[i] <= p && p < his[i])
+                    expect = (intptr_t)i;
+            ASSERT((-1 != expect) == IntervalIndexLookup(index, p, &value));
+            ASSERT(expect == value);
+        }
+    }
+
+    IntervalIndexDelete(index);
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* a Dock strip with room to spare, hit at hover rate many times over */
+    enum { Count = 64 };
+    IntervalIndex *index = IntervalIndexCreate();
+    uint64_t seed = 1;
+    intptr_t sum = 0, value;
+    ASSERT(0 != index);
+
+    unsigned builds = 100000;
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; builds > n; n++)
+    {
+        IntervalIndexReset(index);
+        for (intptr_t i = Count - 1; 0 <= i; i--)
+            IntervalIndexAdd(index, i * 50.0, i * 50.0 + 50.0, i);
+        IntervalIndexBuild(index);
+    }
+    uint64_t t1 = TestNow();
+
+    unsigned lookups = 10000000;
+    for (unsigned n = 0; lookups > n; n++)
+        if (IntervalIndexLookup(index, (double)(TestRandom(&seed) % (Count * 50)), &value))
+            sum += value;
+    uint64_t t2 = TestNow();
+    ASSERT(0 != sum);
+
+    printf("build: %.2f us per %u intervals\n", (double)(t1 - t0) / builds / 1e3, (unsigned)Count);
+    printf("lookup: %.1f ns\n", (double)(t2 - t1) / lookups);
+
+    IntervalIndexDelete(index);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(empty_test);
+    TEST(boundary_test);
+    TEST(gap_test);
+    TEST(model_test);
+    TEST(bench);
+
+    return 0;
+}
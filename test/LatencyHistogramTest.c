@@ -0,0 +1,200 @@
+/**
+ * @file LatencyHistogramTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "LatencyHistogram.h"
+#include <math.h>
+#include <pthread.h>
+
+static int compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void exact_test(void)
+{
+    /* values under 64us are kept exactly */
+    LatencyHistogram *histogram = LatencyHistogramGet("exact");
+    ASSERT(0 != histogram);
+    ASSERT(histogram == LatencyHistogramGet("exact"));
+
+    for (unsigned us = 0; 64 > us; us++)
+        LatencyHistogramRecord(histogram, us * 1e-6);
+    for (unsigned us = 0; 64 > us; us++)
+    {
+        double p = 100.0 * (us + 1) / 64;
+        ASSERT(fabs(us * 1e-6 - LatencyHistogramPercentile(histogram, p)) < 1e-9);
+    }
+
+    LatencyHistogramReset(histogram);
+    ASSERT(0 == LatencyHistogramPercentile(histogram, 50));
+}
+
+static void model_test(void)
+{
+    /* percentiles against a sorted array: never below, at most 1/32 above */
+    enum { Count = 100000 };
+    static uint64_t values[Count];
+    LatencyHistogram *histogram = LatencyHistogramGet("model");
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    ASSERT(0 != histogram);
+
+    for (unsigned i = 0; Count > i; i++)
+    {
+        /* log-uniform from 1us to about 17min */
+        unsigned bits = (unsigned)(TestRandom(&seed) % 30);
+        values[i] = (1ULL << bits) + TestRandom(&seed) % (1ULL << bits);
+        LatencyHistogramRecord(histogram, (double)values[i] * 1e-6);
+    }
+    qsort(values, Count, sizeof values[0], compare);
+
+    static const double percentiles[] = { 0, 1, 10, 25, 50, 75, 90, 99, 99.9, 99.99, 100 };
+    for (size_t i = 0; sizeof percentiles / sizeof percentiles[0] > i; i++)
+    {
+        uint64_t target = (uint64_t)ceil(percentiles[i] / 100 * Count);
+        double expect = (double)values[0 != target ? target - 1 : 0] * 1e-6;
+        double value = LatencyHistogramPercentile(histogram, percentiles[i]);
+        ASSERT(expect <= value + 1e-9);
+        ASSERT(value <= expect * (1 + 1.0 / 32) + 1e-9);
+    }
+    ASSERT(fabs((double)values[Count - 1] * 1e-6 - LatencyHistogramPercentile(histogram, 100)) < 1e-9);
+
+    LatencyHistogramStats stats[16];
+    size_t count = LatencyHistogramGetStats(stats, 16);
+    for (size_t i = 0; count > i; i++)
+        if (0 == strcmp("model", stats[i].name))
+        {
+            uint64_t sum = 0;
+            for (unsigned j = 0; Count > j; j++)
+                sum += values[j];
+            ASSERT(Count == stats[i].count);
+            ASSERT(fabs((double)sum / Count * 1e-6 - stats[i].mean) < 1e-6);
+            ASSERT(stats[i].p50 <= stats[i].p90 && stats[i].p90 <= stats[i].p99);
+            ASSERT(stats[i].p99 <= stats[i].p999 && stats[i].p999 <= stats[i].max);
+            count = 0;
+        }
+    ASSERT(0 == count);
+}
+
+static void clamp_test(void)
+{
+    LatencyHistogram *histogram = LatencyHistogramGet("clamp");
+    ASSERT(0 != histogram);
+
+    LatencyHistogramRecord(histogram, NAN);
+    LatencyHistogramRecord(histogram, -1);
+    ASSERT(0 == LatencyHistogramPercentile(histogram, 100));
+
+    /* past about 71 minutes values are clamped, not lost */
+    LatencyHistogramRecord(histogram, 1e9);
+    LatencyHistogramRecord(histogram, INFINITY);
+    double max = LatencyHistogramPercentile(histogram, 100);
+    ASSERT(4294 < max && 4295 > max);
+    ASSERT(0 == LatencyHistogramPercentile(histogram, 50));
+}
+
+static LatencyHistogram *ThreadHistogram;
+
+static void *thread_main(void *data)
+{
+    for (unsigned i = 0; 250000 > i; i++)
+        LatencyHistogramRecord(ThreadHistogram, (double)(i % 1000) * 1e-6);
+    return 0;
+}
+
+static void thread_test(void)
+{
+    /* recording is lock free and loses nothing; reports may run concurrently */
+    pthread_t threads[4];
+    LatencyHistogramStats stats[16];
+    ThreadHistogram = LatencyHistogramGet("threads");
+    ASSERT(0 != ThreadHistogram);
+
+    for (unsigned i = 0; 4 > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, thread_main, 0));
+    for (unsigned n = 0; 100 > n; n++)
+    {
+        char buf[4096];
+        ASSERT(LatencyHistogramFormat(buf, sizeof buf) < sizeof buf);
+    }
+    for (unsigned i = 0; 4 > i; i++)
+        pthread_join(threads[i], 0);
+
+    size_t count = LatencyHistogramGetStats(stats, 16);
+    for (size_t i = 0; count > i; i++)
+        if (0 == strcmp("threads", stats[i].name))
+        {
+            ASSERT(1000000 == stats[i].count);
+            ASSERT(fabs(999e-6 - stats[i].max) < 1e-9);
+        }
+}
+
+static void format_test(void)
+{
+    /* sizing: a call with no buffer returns the length; short buffers are truncated */
+    size_t length = LatencyHistogramFormat(0, 0);
+    char *buf = malloc(length + 1), small[16];
+    ASSERT(0 != buf);
+    ASSERT(length == LatencyHistogramFormat(buf, length + 1));
+    ASSERT(length == strlen(buf));
+    ASSERT(0 == strncmp("Interaction", buf, 11));
+    ASSERT(0 != strstr(buf, "\nmodel "));
+    ASSERT(length == LatencyHistogramFormat(small, sizeof small));
+    ASSERT(sizeof small - 1 == strlen(small));
+    free(buf);
+
+    /* past the limit histograms share the last slot */
+    char name[32];
+    for (unsigned i = 0; 32 > i; i++)
+    {
+        snprintf(name, sizeof name, "extra%u", i);
+        ASSERT(0 != LatencyHistogramGet(name));
+    }
+    ASSERT(LatencyHistogramGet("extra30") == LatencyHistogramGet("extra31"));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    LatencyHistogram *histogram = LatencyHistogramGet("bench");
+    unsigned iterations = 10000000;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        LatencyHistogramRecord(histogram, (double)(i & 0xffff) * 1e-6);
+    uint64_t t1 = TestNow();
+    double sum = 0;
+    for (unsigned i = 0; 10000 > i; i++)
+        sum += LatencyHistogramPercentile(histogram, 99);
+    uint64_t t2 = TestNow();
+    ASSERT(0 < sum);
+
+    printf("record: %.1f ns\n", (double)(t1 - t0) / iterations);
+    printf("percentile: %.1f us\n", (double)(t2 - t1) / 10000 / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(exact_test);
+    TEST(model_test);
+    TEST(clamp_test);
+    TEST(thread_test);
+    TEST(format_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * @file MetadataIndexTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "MetadataIndex.h"
+#include <pthread.h>
+
+/*
+ * Stub resolver: paths ending in ".app" are applications whose bundle ID is
+ * derived from the name; paths under /Uncached are resolved but not cacheable;
+ * paths under /Missing do not exist.
+ */
+static unsigned ResolveCount, ResolveIDCount;
+static MetadataIndex *RaceIndex;
+
+static bool resolve_path(void *data, MetadataIndexEntry *entry)
+{
+    __atomic_add_fetch(&ResolveCount, 1, __ATOMIC_RELAXED);
+
+    if (0 == strncmp(entry->path, "/Missing/", 9))
+        return true;
+
+    entry->flags = MetadataIndexExists;
+    size_t len = strlen(entry->path);
+    if (4 < len && 0 == strcmp(entry->path + len - 4, ".app"))
+    {
+        const char *name = strrchr(entry->path, '/') + 1;
+        entry->flags |= MetadataIndexDirectory | MetadataIndexPackage | MetadataIndexApplication;
+        snprintf(entry->bundleID, sizeof entry->bundleID, "com.example.%.*s",
+            (int)(strlen(name) - 4), name);
+        snprintf(entry->name, sizeof entry->name, "%.*s", (int)(strlen(name) - 4), name);
+    }
+
+    /* an invalidation that arrives while resolving */
+    if (0 != RaceIndex)
+        MetadataIndexInvalidate(RaceIndex, entry->path);
+
+    return 0 != strncmp(entry->path, "/Uncached/", 10);
+}
+
+static bool resolve_bundle_id(void *data, const char *bundleID, char *path, size_t size)
+{
+    __atomic_add_fetch(&ResolveIDCount, 1, __ATOMIC_RELAXED);
+
+    if (0 != strncmp(bundleID, "com.example.", 12))
+        return false;
+    return size > (size_t)snprintf(path, size, "/Applications/%s.app", bundleID + 12);
+}
+
+static const MetadataIndexResolver Resolver =
+{
+    .resolvePath = resolve_path,
+    .resolveBundleID = resolve_bundle_id,
+};
+
+static void lookup_test(void)
+{
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, 64);
+    MetadataIndexEntry entry;
+    MetadataIndexStats stats;
+    ASSERT(0 != index);
+    ResolveCount = 0;
+
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/Safari.app", &entry));
+    ASSERT(0 != (entry.flags & MetadataIndexApplication));
+    ASSERT(0 == strcmp("com.example.Safari", entry.bundleID));
+    ASSERT(0 == strcmp("Safari", entry.name));
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/Safari.app", &entry));
+    ASSERT(0 == strcmp("Safari", entry.name));
+    ASSERT(1 == ResolveCount);
+
+    /* files that do not exist are cached with no flags */
+    ASSERT(MetadataIndexLookupPath(index, "/Missing/file", &entry));
+    ASSERT(0 == entry.flags);
+    ASSERT(MetadataIndexLookupPath(index, "/Missing/file", &entry));
+    ASSERT(2 == ResolveCount);
+
+    /* results the resolver cannot watch are returned but not cached */
+    ASSERT(MetadataIndexLookupPath(index, "/Uncached/file", &entry));
+    ASSERT(MetadataIndexExists == entry.flags);
+    ASSERT(MetadataIndexLookupPath(index, "/Uncached/file", &entry));
+    ASSERT(4 == ResolveCount);
+
+    /* paths that do not fit are refused */
+    char path[MetadataIndexPathMax + 1];
+    memset(path, 'a', sizeof path - 1);
+    path[0] = '/';
+    path[sizeof path - 1] = '\0';
+    ASSERT(!MetadataIndexLookupPath(index, path, &entry));
+
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(2 == stats.hits && 5 == stats.misses && 2 == stats.count);
+
+    MetadataIndexDelete(index);
+}
+
+static void bundle_id_test(void)
+{
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, 64);
+    MetadataIndexEntry entry;
+    ASSERT(0 != index);
+    ResolveCount = ResolveIDCount = 0;
+
+    ASSERT(MetadataIndexLookupBundleID(index, "com.example.Mail", &entry));
+    ASSERT(0 == strcmp("/Applications/Mail.app", entry.path));
+    ASSERT(0 == strcmp("Mail", entry.name));
+    ASSERT(MetadataIndexLookupBundleID(index, "com.example.Mail", &entry));
+    ASSERT(1 == ResolveIDCount && 1 == ResolveCount);
+
+    /* applications that are not installed are looked up again next time */
+    ASSERT(!MetadataIndexLookupBundleID(index, "org.other.App", &entry));
+    ASSERT(!MetadataIndexLookupBundleID(index, "org.other.App", &entry));
+    ASSERT(3 == ResolveIDCount);
+
+    /* a change to the bundle drops both the path and the identifier */
+    MetadataIndexInvalidate(index, "/Applications/Mail.app/Contents");
+    ASSERT(MetadataIndexLookupBundleID(index, "com.example.Mail", &entry));
+    ASSERT(4 == ResolveIDCount && 2 == ResolveCount);
+
+    MetadataIndexDelete(index);
+}
+
+static void invalidate_test(void)
+{
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, 64);
+    MetadataIndexEntry entry;
+    MetadataIndexStats stats;
+    ASSERT(0 != index);
+
+    static const char *paths[] =
+    {
+        "/Applications/Safari.app",
+        "/Applications/Utilities/Terminal.app",
+        "/Applications/Utilities.old/Console.app",
+        "/Users/user/Downloads",
+        "/Users/user/Downloads/file.txt",
+    };
+    size_t count = sizeof paths / sizeof paths[0];
+    for (size_t i = 0; count > i; i++)
+        ASSERT(MetadataIndexLookupPath(index, paths[i], &entry));
+
+    /* a changed directory drops what is at, under and above it, not its siblings */
+    MetadataIndexInvalidate(index, "/Applications/Utilities/");
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(count - 1 == stats.count);
+    ResolveCount = 0;
+    for (size_t i = 0; count > i; i++)
+        ASSERT(MetadataIndexLookupPath(index, paths[i], &entry));
+    ASSERT(1 == ResolveCount);
+
+    /* a change inside a bundle drops the bundle */
+    MetadataIndexInvalidate(index, "/Applications/Safari.app/Contents/Resources");
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(count - 1 == stats.count);
+
+    /* a change above drops everything under it */
+    MetadataIndexInvalidate(index, "/Users");
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(count - 3 == stats.count);
+
+    MetadataIndexInvalidateAll(index);
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(0 == stats.count);
+
+    MetadataIndexDelete(index);
+}
+
+static void race_test(void)
+{
+    /* a resolution that races with an invalidation of its path is not cached */
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, 64);
+    MetadataIndexEntry entry;
+    MetadataIndexStats stats;
+    ASSERT(0 != index);
+
+    RaceIndex = index;
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/Safari.app", &entry));
+    RaceIndex = 0;
+    ASSERT(0 != (entry.flags & MetadataIndexApplication));
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(0 == stats.count);
+
+    MetadataIndexDelete(index);
+}
+
+static void eviction_test(void)
+{
+    /* the least recently used entry goes first */
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, 4);
+    MetadataIndexEntry entry;
+    MetadataIndexStats stats;
+    char path[64];
+    ASSERT(0 != index);
+
+    for (unsigned i = 0; 4 > i; i++)
+    {
+        snprintf(path, sizeof path, "/Applications/App%u.app", i);
+        ASSERT(MetadataIndexLookupPath(index, path, &entry));
+    }
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/App0.app", &entry));
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/App4.app", &entry));
+    MetadataIndexGetStats(index, &stats);
+    ASSERT(4 == stats.count && 1 == stats.evictions);
+
+    ResolveCount = 0;
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/App0.app", &entry));
+    ASSERT(0 == ResolveCount);
+    ASSERT(MetadataIndexLookupPath(index, "/Applications/App1.app", &entry));
+    ASSERT(1 == ResolveCount);
+
+    MetadataIndexDelete(index);
+}
+
+static MetadataIndex *ThreadIndex;
+
+static void *thread_main(void *data)
+{
+    uint64_t seed = (uintptr_t)data | 1;
+    MetadataIndexEntry entry;
+    char path[64];
+    for (unsigned n = 0; 50000 > n; n++)
+    {
+        unsigned i = (unsigned)(TestRandom(&seed) % 256);
+        snprintf(path, sizeof path, "/Applications/Dir%u/App%u.app", i % 8, i);
+        if (0 == TestRandom(&seed) % 64)
+        {
+            snprintf(path, sizeof path, "/Applications/Dir%u", i % 8);
+            MetadataIndexInvalidate(ThreadIndex, path);
+            continue;
+        }
+        ASSERT(MetadataIndexLookupPath(ThreadIndex, path, &entry));
+        ASSERT(0 != (entry.flags & MetadataIndexApplication));
+        ASSERT(0 == strcmp(path, entry.path));
+    }
+    return 0;
+}
+
+static void thread_test(void)
+{
+    pthread_t threads[4];
+    MetadataIndexStats stats;
+
+    ThreadIndex = MetadataIndexCreate(&Resolver, 128);
+    ASSERT(0 != ThreadIndex);
+    for (uintptr_t i = 0; 4 > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, thread_main, (void *)(i * 0x9e3779b9)));
+    for (unsigned i = 0; 4 > i; i++)
+        pthread_join(threads[i], 0);
+    MetadataIndexGetStats(ThreadIndex, &stats);
+    ASSERT(128 >= stats.count);
+
+    MetadataIndexDelete(ThreadIndex);
+}
+
+static void bench(void)
+{
+    /* lookups and invalidations of a full index, the size MetadataStore uses */
+    if (!TestBench)
+        return;
+
+    enum { Count = 4096, Iterations = 1000000 };
+    MetadataIndex *index = MetadataIndexCreate(&Resolver, Count);
+    MetadataIndexEntry entry;
+    static char paths[Count][64];
+    ASSERT(0 != index);
+
+    for (unsigned i = 0; Count > i; i++)
+    {
+        snprintf(paths[i], sizeof paths[i], "/Applications/Dir%u/App%u.app", i % 64, i);
+        ASSERT(MetadataIndexLookupPath(index, paths[i], &entry));
+    }
+
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; Iterations > n; n++)
+        MetadataIndexLookupPath(index, paths[n % Count], &entry);
+    uint64_t t1 = TestNow();
+    for (unsigned n = 0; 1000 > n; n++)
+        MetadataIndexInvalidate(index, "/Volumes/Other/Dir");
+    uint64_t t2 = TestNow();
+
+    printf("lookup: %.1f ns per hit\n", (double)(t1 - t0) / Iterations);
+    printf("invalidate: %.1f us per event with %u entries\n", (double)(t2 - t1) / 1000 / 1e3,
+        (unsigned)Count);
+
+    MetadataIndexDelete(index);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(lookup_test);
+    TEST(bundle_id_test);
+    TEST(invalidate_test);
+    TEST(race_test);
+    TEST(eviction_test);
+    TEST(thread_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file MetricsRingTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "MetricsRing.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static char Name[32];
+
+static void publish_consume_test(void)
+{
+    MetricsRing *producer = MetricsRingCreate(Name, 8);
+    MetricsRing *consumer = MetricsRingOpen(Name);
+    MetricsRingRecord records[16];
+    ASSERT(0 != producer && 0 != consumer);
+    ASSERT(8 == MetricsRingCapacity(consumer));
+    ASSERT(MetricsRingIsEmpty(consumer));
+
+    /* a full ring drops and counts */
+    for (unsigned i = 0; 10 > i; i++)
+        ASSERT((8 > i) == MetricsRingPublish(producer, "cpu", 0, i));
+    ASSERT(2 == MetricsRingDropped(consumer));
+
+    ASSERT(!MetricsRingIsEmpty(consumer));
+    ASSERT(8 == MetricsRingConsume(consumer, records, 16));
+    for (unsigned i = 0; 8 > i; i++)
+        ASSERT(0 == strcmp("cpu", records[i].name) && i == records[i].value);
+    ASSERT(MetricsRingIsEmpty(consumer));
+
+    MetricsRingClose(consumer);
+    MetricsRingClose(producer);
+    MetricsRingUnlink(Name);
+}
+
+static void hostile_capacity_test(void)
+{
+    /*
+     * The producer is another process: after the consumer has opened the ring
+     * it may rewrite the capacity in the header. The consumer keeps the capacity
+     * it validated and never indexes outside its mapping.
+     */
+    MetricsRing *producer = MetricsRingCreate(Name, 8);
+    MetricsRing *consumer = MetricsRingOpen(Name);
+    MetricsRingRecord records[64];
+    ASSERT(0 != producer && 0 != consumer);
+
+    for (unsigned i = 0; 6 > i; i++)
+        ASSERT(MetricsRingPublish(producer, "mem", "text", i));
+
+    int fd = shm_open(Name, O_RDWR, 0);
+    ASSERT(-1 != fd);
+    uint32_t *header = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT(MAP_FAILED != header);
+    close(fd);
+    header[2] = 1 << 16;                /* capacity */
+    __atomic_store_n((uint64_t *)((char *)header + 64), 1000000, __ATOMIC_RELEASE);  /* head */
+
+    ASSERT(8 == MetricsRingCapacity(consumer));
+    size_t count = MetricsRingConsume(consumer, records, 64);
+    ASSERT(8 >= count);
+    for (size_t i = 0; count > i; i++)
+        ASSERT(sizeof records[i].name > strlen(records[i].name));
+
+    /* a ring whose header was tampered with before the open is refused */
+    MetricsRingClose(consumer);
+    ASSERT(0 == MetricsRingOpen(Name));
+
+    munmap(header, 4096);
+    MetricsRingClose(producer);
+    MetricsRingUnlink(Name);
+}
+
+static void *producer_main(void *data)
+{
+    MetricsRing *producer = data;
+    for (unsigned i = 1; 1000000 >= i;)
+        if (MetricsRingPublish(producer, "n", 0, i))
+            i++;
+        else
+            sched_yield();
+    return 0;
+}
+
+static void spsc_test(void)
+{
+    /* records arrive in order and none is lost when the producer retries */
+    MetricsRing *producer = MetricsRingCreate(Name, 256);
+    MetricsRing *consumer = MetricsRingOpen(Name);
+    MetricsRingRecord records[64];
+    pthread_t thread;
+    double expect = 1;
+    ASSERT(0 != producer && 0 != consumer);
+
+    uint64_t t0 = TestNow();
+    ASSERT(0 == pthread_create(&thread, 0, producer_main, producer));
+    while (1000000 >= expect)
+    {
+        size_t count = MetricsRingConsume(consumer, records, 64);
+        if (0 == count)
+            sched_yield();
+        for (size_t i = 0; count > i; i++)
+            ASSERT(expect++ == records[i].value);
+    }
+    pthread_join(thread, 0);
+    uint64_t t1 = TestNow();
+
+    if (TestBench)
+        printf("spsc: %.1f ns per record\n", (double)(t1 - t0) / 1000000);
+
+    MetricsRingClose(consumer);
+    MetricsRingClose(producer);
+    MetricsRingUnlink(Name);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+    snprintf(Name, sizeof Name, "/MetricsRingTest.%d", (int)getpid());
+    MetricsRingUnlink(Name);
+
+    TEST(publish_consume_test);
+    TEST(hostile_capacity_test);
+    TEST(spsc_test);
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file PathAtomTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "PathAtom.h"
+#include <pthread.h>
+
+#if defined(__GLIBC__) && !defined(TEST_SANITIZE)
+/* count heap allocations: glibc lets the executable replace malloc and friends */
+#define ALLOC_COUNT
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+static __thread uint64_t allocCount;
+void *malloc(size_t size) { allocCount++; return __libc_malloc(size); }
+void *calloc(size_t count, size_t size) { allocCount++; return __libc_calloc(count, size); }
+void *realloc(void *p, size_t size) { allocCount++; return __libc_realloc(p, size); }
+void free(void *p) { __libc_free(p); }
+#endif
+
+#define PathCount                       512
+
+static char Paths[PathCount][64];
+
+static void make_paths(void)
+{
+    for (unsigned i = 0; PathCount > i; i++)
+        snprintf(Paths[i], sizeof Paths[i], "/Applications/Application %u.app", i);
+}
+
+static void intern_test(void)
+{
+    PathAtomTable *table = PathAtomTableCreate();
+    ASSERT(0 != table);
+
+    uint32_t a = PathAtomIntern(table, "/Applications/Safari.app");
+    uint32_t b = PathAtomIntern(table, "/Applications/Mail.app");
+    ASSERT(0 != a && 0 != b && a != b);
+    ASSERT(a == PathAtomIntern(table, "/Applications/Safari.app"));
+    ASSERT(a == PathAtomFind(table, "/Applications/Safari.app"));
+    ASSERT(0 == PathAtomFind(table, "/Applications/Notes.app"));
+    ASSERT(2 == PathAtomCount(table));
+
+    /* two references on a: the first release keeps it */
+    PathAtomRelease(table, a);
+    ASSERT(a == PathAtomFind(table, "/Applications/Safari.app"));
+    PathAtomRelease(table, a);
+    ASSERT(0 == PathAtomFind(table, "/Applications/Safari.app"));
+    ASSERT(1 == PathAtomCount(table));
+
+    /* a freed atom is reused */
+    ASSERT(a == PathAtomIntern(table, "/Applications/Notes.app"));
+    ASSERT(b == PathAtomFind(table, "/Applications/Mail.app"));
+
+    /* releasing unknown atoms is harmless */
+    PathAtomRelease(table, 0);
+    PathAtomRelease(table, 1000);
+
+    PathAtomTableDelete(table);
+}
+
+static void model_test(void)
+{
+    /* random interns and releases against a reference count per path */
+    PathAtomTable *table = PathAtomTableCreate();
+    uint32_t atoms[PathCount] = { 0 }, refs[PathCount] = { 0 };
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    size_t count = 0;
+    ASSERT(0 != table);
+
+    for (unsigned n = 0; 200000 > n; n++)
+    {
+        unsigned i = (unsigned)(TestRandom(&seed) % PathCount);
+        if (0 == refs[i] || 0 != TestRandom(&seed) % 2)
+        {
+            uint32_t atom = PathAtomIntern(table, Paths[i]);
+            ASSERT(0 != atom);
+            if (0 == refs[i])
+            {
+                /* a new atom is not held by any other path */
+                for (unsigned j = 0; PathCount > j; j++)
+                    ASSERT(0 == refs[j] || atoms[j] != atom);
+                atoms[i] = atom;
+                count++;
+            }
+            refs[i]++;
+            ASSERT(atoms[i] == atom);
+        }
+        else
+        {
+            PathAtomRelease(table, atoms[i]);
+            if (0 == --refs[i])
+                count--;
+        }
+
+        unsigned k = (unsigned)(TestRandom(&seed) % PathCount);
+        ASSERT((0 != refs[k] ? atoms[k] : 0) == PathAtomFind(table, Paths[k]));
+        ASSERT(count == PathAtomCount(table));
+    }
+
+    /* drop everything: the table forgets all paths */
+    for (unsigned i = 0; PathCount > i; i++)
+        while (0 < refs[i]--)
+            PathAtomRelease(table, atoms[i]);
+    ASSERT(0 == PathAtomCount(table));
+    for (unsigned i = 0; PathCount > i; i++)
+        ASSERT(0 == PathAtomFind(table, Paths[i]));
+
+    PathAtomTableDelete(table);
+}
+
+static void *thread_main(void *data)
+{
+    PathAtomTable *table = data;
+    uint64_t seed = (uintptr_t)&seed | 1;
+    for (unsigned n = 0; 100000 > n; n++)
+    {
+        const char *path = Paths[TestRandom(&seed) % 64];
+        uint32_t atom = PathAtomIntern(table, path);
+        ASSERT(0 != atom);
+        ASSERT(atom == PathAtomFind(table, path));
+        PathAtomRelease(table, atom);
+    }
+    return 0;
+}
+
+static void thread_test(void)
+{
+    /* the Dock interns on its model queue while the main thread releases */
+    PathAtomTable *table = PathAtomTableCreate();
+    pthread_t threads[4];
+    ASSERT(0 != table);
+
+    for (unsigned i = 0; 4 > i; i++)
+        ASSERT(0 == pthread_create(&threads[i], 0, thread_main, table));
+    for (unsigned i = 0; 4 > i; i++)
+        pthread_join(threads[i], 0);
+    ASSERT(0 == PathAtomCount(table));
+
+    PathAtomTableDelete(table);
+}
+
+static void steady_state_test(void)
+{
+    /* a Dock of 64 apps: once interned, rebuilds and lookups must not allocate */
+    PathAtomTable *table = PathAtomTableCreate();
+    uint32_t atoms[64];
+    unsigned iterations = TestBench ? 10000000 : 100000;
+    uint64_t sum = 0;
+    ASSERT(0 != table);
+
+    for (unsigned i = 0; 64 > i; i++)
+        atoms[i] = PathAtomIntern(table, Paths[i]);
+
+#if defined(ALLOC_COUNT)
+    /* the counter works: a new path is copied */
+    uint64_t allocs = allocCount;
+    PathAtomRelease(table, PathAtomIntern(table, Paths[64]));
+    ASSERT(allocs < allocCount);
+    allocs = allocCount;
+#endif
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; iterations > n; n++)
+    {
+        unsigned i = n & 63;
+        uint32_t atom = PathAtomIntern(table, Paths[i]);
+        sum += PathAtomFind(table, Paths[i]);
+        PathAtomRelease(table, atom);
+    }
+    uint64_t t1 = TestNow();
+#if defined(ALLOC_COUNT)
+    allocs = allocCount - allocs;
+    ASSERT(0 == allocs);
+#endif
+    ASSERT(0 != sum);
+
+    if (TestBench)
+        printf("steady state: %.1f ns per intern+find+release, %s allocations\n",
+            (double)(t1 - t0) / iterations,
+#if defined(ALLOC_COUNT)
+            "0"
+#else
+            "uncounted"
+#endif
+            );
+
+    for (unsigned i = 0; 64 > i; i++)
+    {
+        ASSERT(atoms[i] == PathAtomFind(table, Paths[i]));
+        PathAtomRelease(table, atoms[i]);
+    }
+
+    PathAtomTableDelete(table);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+    make_paths();
+
+    TEST(intern_test);
+    TEST(model_test);
+    TEST(thread_test);
+    TEST(steady_state_test);
+
+    return 0;
+}
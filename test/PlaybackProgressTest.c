@@ -0,0 +1,178 @@
+/**
+ * @file PlaybackProgressTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "PlaybackProgress.h"
+#include <math.h>
+
+static bool near(double a, double b)
+{
+    return fabs(a - b) < 1e-9;
+}
+
+static void interpolate_test(void)
+{
+    /* a four minute track: playing, paused, seeked, at double speed, resumed */
+    PlaybackProgress progress;
+
+    PlaybackProgressAnchor(&progress, 240, 10, 100, 1);
+    ASSERT(PlaybackProgressIsValid(&progress));
+    ASSERT(near(10, PlaybackProgressElapsed(&progress, 100)));
+    ASSERT(near(40, PlaybackProgressElapsed(&progress, 130)));
+    ASSERT(near(40.0 / 240, PlaybackProgressFraction(&progress, 130)));
+
+    /* pausing freezes the position where it was; time passing changes nothing */
+    PlaybackProgressPause(&progress, 130);
+    ASSERT(0 == progress.rate);
+    ASSERT(near(40, PlaybackProgressElapsed(&progress, 130)));
+    ASSERT(near(40, PlaybackProgressElapsed(&progress, 1000)));
+
+    /* a seek while paused re-anchors without moving */
+    PlaybackProgressAnchor(&progress, 240, 120, 1000, 0);
+    ASSERT(near(120, PlaybackProgressElapsed(&progress, 1010)));
+
+    /* a rate change: the new anchor applies from its timestamp on */
+    PlaybackProgressAnchor(&progress, 240, 120, 1010, 2);
+    ASSERT(near(140, PlaybackProgressElapsed(&progress, 1020)));
+    PlaybackProgressPause(&progress, 1020);
+    PlaybackProgressAnchor(&progress, 240, 140, 1030, 1);
+    ASSERT(near(145, PlaybackProgressElapsed(&progress, 1035)));
+
+    /* an anchor stamped a little after now (clocks read in a different order) holds still */
+    ASSERT(near(140, PlaybackProgressElapsed(&progress, 1029)));
+
+    /* rewinding counts down */
+    PlaybackProgressAnchor(&progress, 240, 60, 0, -4);
+    ASSERT(near(20, PlaybackProgressElapsed(&progress, 10)));
+}
+
+static void clamp_test(void)
+{
+    /* interpolation never runs past either end of the track */
+    PlaybackProgress progress;
+
+    PlaybackProgressAnchor(&progress, 240, 230, 0, 1);
+    ASSERT(near(240, PlaybackProgressElapsed(&progress, 60)));
+    ASSERT(1 == PlaybackProgressFraction(&progress, 60));
+    ASSERT(100 == PlaybackProgressPixels(&progress, 60, 100));
+
+    PlaybackProgressAnchor(&progress, 240, 10, 0, -1);
+    ASSERT(0 == PlaybackProgressElapsed(&progress, 60));
+    ASSERT(0 == PlaybackProgressPixels(&progress, 60, 100));
+
+    /* a reported position past the duration is shown as the end */
+    PlaybackProgressAnchor(&progress, 240, 300, 0, 0);
+    ASSERT(near(240, PlaybackProgressElapsed(&progress, 0)));
+
+    /* unknown or bogus durations: elapsed still counts, there is no bar */
+    PlaybackProgressAnchor(&progress, 0, 10, 0, 1);
+    ASSERT(!PlaybackProgressIsValid(&progress));
+    ASSERT(near(70, PlaybackProgressElapsed(&progress, 60)));
+    ASSERT(0 == PlaybackProgressFraction(&progress, 60));
+    ASSERT(0 == PlaybackProgressPixels(&progress, 60, 100));
+    ASSERT(isinf(PlaybackProgressNextPixelDelay(&progress, 60, 100)));
+
+    PlaybackProgressAnchor(&progress, NAN, -5, 0, INFINITY);
+    ASSERT(0 == progress.duration && 0 == progress.elapsed && 0 == progress.rate);
+    PlaybackProgressAnchor(&progress, INFINITY, NAN, 0, NAN);
+    ASSERT(0 == progress.duration && 0 == progress.elapsed && 0 == progress.rate);
+}
+
+static void pixel_test(void)
+{
+    /* waking after the reported delay always finds exactly one more (or less) pixel */
+    static const struct
+    {
+        double duration, elapsed, rate;
+        unsigned width;
+    } cases[] =
+    {
+        { 240, 0, 1, 100 },
+        { 240, 17.3, 1.5, 37 },
+        { 3.7, 0.1, 1, 250 },
+        { 240, 240, -2, 64 },
+        { 7200, 3599.9, 0.5, 1 },
+    };
+
+    for (size_t i = 0; sizeof cases / sizeof cases[0] > i; i++)
+    {
+        PlaybackProgress progress;
+        PlaybackProgressAnchor(&progress,
+            cases[i].duration, cases[i].elapsed, 50, cases[i].rate);
+
+        double now = 50;
+        unsigned width = cases[i].width, wakeups = 0;
+        unsigned pixels = PlaybackProgressPixels(&progress, now, width);
+        for (;;)
+        {
+            double delay = PlaybackProgressNextPixelDelay(&progress, now, width);
+            if (isinf(delay))
+                break;
+            ASSERT(0 <= delay);
+            now += delay + 1e-9;
+            unsigned next = PlaybackProgressPixels(&progress, now, width);
+            ASSERT((0 < cases[i].rate ? pixels + 1 : pixels - 1) == next);
+            pixels = next;
+            ASSERT(width + 1 > ++wakeups);
+        }
+
+        /* the loop ends at the end of the bar, not before */
+        ASSERT((0 < cases[i].rate ? width : 0) == pixels);
+    }
+
+    /* nothing to wait for while paused or without a bar */
+    PlaybackProgress progress;
+    PlaybackProgressAnchor(&progress, 240, 10, 0, 0);
+    ASSERT(isinf(PlaybackProgressNextPixelDelay(&progress, 0, 100)));
+    PlaybackProgressAnchor(&progress, 240, 10, 0, 1);
+    ASSERT(isinf(PlaybackProgressNextPixelDelay(&progress, 0, 0)));
+
+    /* an anchor in the future: the wait includes the time until it starts */
+    PlaybackProgressAnchor(&progress, 100, 0, 10, 1);
+    ASSERT(near(11, PlaybackProgressNextPixelDelay(&progress, 0, 100)));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* what a progress bar does per wakeup */
+    PlaybackProgress progress;
+    PlaybackProgressAnchor(&progress, 240, 0, 0, 1);
+    unsigned iterations = 10000000;
+    double sum = 0;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+    {
+        double now = i * (240.0 / iterations);
+        sum += PlaybackProgressPixels(&progress, now, 200) +
+            PlaybackProgressNextPixelDelay(&progress, now, 200);
+    }
+    uint64_t t1 = TestNow();
+    ASSERT(0 < sum);
+
+    printf("pixels + next delay: %.1f ns\n", (double)(t1 - t0) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(interpolate_test);
+    TEST(clamp_test);
+    TEST(pixel_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file ProcessMetricsTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "ProcessMetrics.h"
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void idle(double seconds)
+{
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, 0);
+}
+
+static pid_t spawn(bool busy)
+{
+    /*
+     * A child that spins or one that sleeps until killed; returns once it runs.
+     * Children also go when the test does, so that a failed ASSERT leaves no spinner.
+     */
+    int fds[2];
+    char c = 0;
+    pid_t parent = getpid();
+    ASSERT(0 == pipe(fds));
+    pid_t pid = fork();
+    ASSERT(-1 != pid);
+    if (0 == pid)
+    {
+        volatile uint64_t sink = 0;
+        close(fds[0]);
+        write(fds[1], &c, 1);
+        close(fds[1]);
+        while (parent == getppid())
+            if (busy)
+                for (unsigned i = 0; 10000000 > i; i++)
+                    sink += 1;
+            else
+                idle(0.1);
+        _exit(0);
+    }
+    close(fds[1]);
+    ASSERT(1 == read(fds[0], &c, 1));
+    close(fds[0]);
+    return pid;
+}
+
+static void reap(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, 0, 0);
+}
+
+static ProcessMetricsEntry *entry_of(ProcessMetricsEntry *entries, size_t count, pid_t pid)
+{
+    for (size_t i = 0; count > i; i++)
+        if (pid == entries[i].pid)
+            return &entries[i];
+    ASSERT(0);
+    return 0;
+}
+
+static void cpu_test(void)
+{
+    /* a spinning child gets the CPU badge; the hysteresis keeps it until usage really drops */
+    ProcessMetrics *metrics = ProcessMetricsCreate(&(ProcessMetricsThresholds){ 0.2, 0 });
+    ProcessMetricsEntry entries[3];
+    SystemMetricsCost cost;
+    ASSERT(0 != metrics);
+
+    pid_t pids[3] = { getpid(), spawn(true), spawn(false) };
+
+    /* first sight: no CPU figure, no badge, nothing changed; memory is known */
+    ASSERT(0 == ProcessMetricsSample(metrics, pids, 3, entries));
+    for (size_t i = 0; 3 > i; i++)
+        ASSERT(pids[i] == entries[i].pid && 0 == entries[i].cpu && 0 < entries[i].memory &&
+            ProcessMetricsBadgeNone == entries[i].badge && !entries[i].changed);
+    ASSERT(0 == ProcessMetricsHistory(metrics, pids[1], (uint8_t[4]){ 0 }, 4));
+
+    idle(0.3);
+    ASSERT(1 == ProcessMetricsSample(metrics, pids, 3, entries));
+    double busy = entries[1].cpu;
+    ASSERT(0.2 <= busy && ProcessMetricsBadgeCpu == entries[1].badge && entries[1].changed);
+    ASSERT(0.05 > entries[2].cpu && ProcessMetricsBadgeNone == entries[2].badge);
+    ASSERT(ProcessMetricsBadgeCpu == ProcessMetricsBadge(metrics, pids[1]));
+
+    uint8_t levels[4];
+    ASSERT(1 == ProcessMetricsHistory(metrics, pids[1], levels, 4));
+    ASSERT(0 < levels[0]);
+
+    /* above half the threshold the badge stays up, though usage is under the threshold */
+    ProcessMetricsSetThresholds(metrics, &(ProcessMetricsThresholds){ busy / 0.7, 0 });
+    idle(0.3);
+    ASSERT(0 == ProcessMetricsSample(metrics, pids, 3, entries));
+    ASSERT(ProcessMetricsBadgeCpu == entries[1].badge && !entries[1].changed);
+
+    /* below half it comes down, once */
+    ProcessMetricsSetThresholds(metrics, &(ProcessMetricsThresholds){ busy / 0.3, 0 });
+    idle(0.3);
+    ASSERT(1 == ProcessMetricsSample(metrics, pids, 3, entries));
+    ASSERT(ProcessMetricsBadgeNone == entries[1].badge && entries[1].changed);
+    idle(0.1);
+    ASSERT(0 == ProcessMetricsSample(metrics, pids, 3, entries));
+    ASSERT(4 == ProcessMetricsHistory(metrics, pids[1], levels, 4));
+
+    ProcessMetricsGetCost(metrics, &cost);
+    ASSERT(5 == cost.count && 0 < cost.time);
+
+    reap(pids[1]);
+    reap(pids[2]);
+    ProcessMetricsDelete(metrics);
+    ProcessMetricsDelete(0);
+}
+
+static void memory_test(void)
+{
+    /* memory badges, with their own (smaller) hysteresis */
+    ProcessMetrics *metrics = ProcessMetricsCreate(&(ProcessMetricsThresholds){ 0, 1 });
+    ProcessMetricsEntry entry;
+    pid_t pid = getpid();
+    ASSERT(0 != metrics);
+
+    ASSERT(1 == ProcessMetricsSample(metrics, &pid, 1, &entry));
+    ASSERT(ProcessMetricsBadgeMemory == entry.badge && entry.changed);
+    uint64_t memory = entry.memory;
+
+    ProcessMetricsSetThresholds(metrics, &(ProcessMetricsThresholds){ 0, memory + memory / 20 });
+    ASSERT(0 == ProcessMetricsSample(metrics, &pid, 1, &entry));
+    ASSERT(ProcessMetricsBadgeMemory == entry.badge);
+
+    ProcessMetricsSetThresholds(metrics, &(ProcessMetricsThresholds){ 0, memory * 2 });
+    ASSERT(1 == ProcessMetricsSample(metrics, &pid, 1, &entry));
+    ASSERT(ProcessMetricsBadgeNone == entry.badge);
+
+    /* zero thresholds are off */
+    ProcessMetricsSetThresholds(metrics, &(ProcessMetricsThresholds){ 0, 0 });
+    ASSERT(0 == ProcessMetricsSample(metrics, &pid, 1, &entry));
+
+    ProcessMetricsDelete(metrics);
+}
+
+static void sweep_test(void)
+{
+    /* processes leave the sweep by exiting or by not being listed */
+    ProcessMetrics *metrics = ProcessMetricsCreate(&(ProcessMetricsThresholds){ 0, 1 });
+    ProcessMetricsEntry entries[4];
+    ASSERT(0 != metrics);
+
+    pid_t pids[4] = { spawn(false), spawn(false), 0, 0 };
+    pids[2] = pids[0];                  /* listed twice: kept once */
+    pids[3] = pids[1];
+    ASSERT(4 == ProcessMetricsSample(metrics, pids, 4, entries));
+    ASSERT(ProcessMetricsBadgeMemory == ProcessMetricsBadge(metrics, pids[0]));
+
+    /* an exited process reports its badge gone; afterwards it is unknown */
+    reap(pids[0]);
+    ASSERT(2 == ProcessMetricsSample(metrics, pids, 4, entries));
+    ASSERT(entries[0].changed && ProcessMetricsBadgeNone == entries[0].badge && 0 == entries[0].memory);
+    ASSERT(!entry_of(entries + 1, 3, pids[1])->changed);
+    ASSERT(ProcessMetricsBadgeNone == ProcessMetricsBadge(metrics, pids[0]));
+    ASSERT(0 == ProcessMetricsSample(metrics, pids, 4, entries));
+
+    /* a process dropped from the list is forgotten: seen again, it starts over */
+    ASSERT(0 == ProcessMetricsSample(metrics, pids, 0, entries));
+    ASSERT(ProcessMetricsBadgeNone == ProcessMetricsBadge(metrics, pids[1]));
+    ASSERT(1 == ProcessMetricsSample(metrics, pids + 1, 1, entries));
+    ASSERT(entries[0].changed && 0 == entries[0].cpu);
+    ASSERT(0 == ProcessMetricsHistory(metrics, pids[1], (uint8_t[4]){ 0 }, 4));
+
+    reap(pids[1]);
+    ProcessMetricsDelete(metrics);
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* a sweep over 500 processes, well past any Dock */
+    enum { Count = 500 };
+    ProcessMetrics *metrics = ProcessMetricsCreate(&(ProcessMetricsThresholds){ 0.5, 1ULL << 30 });
+    static pid_t pids[Count];
+    static ProcessMetricsEntry entries[Count];
+    SystemMetricsCost cost;
+    ASSERT(0 != metrics);
+
+    for (size_t i = 0; Count > i; i++)
+        pids[i] = spawn(false);
+    ProcessMetricsSample(metrics, pids, Count, entries);
+
+    unsigned sweeps = 100;
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; sweeps > n; n++)
+        ProcessMetricsSample(metrics, pids, Count, entries);
+    uint64_t t1 = TestNow();
+    ProcessMetricsGetCost(metrics, &cost);
+
+    printf("sweep: %.1f us wall, %.1f us CPU per %u processes\n",
+        (double)(t1 - t0) / sweeps / 1e3, cost.time / (double)cost.count * 1e6, (unsigned)Count);
+
+    for (size_t i = 0; Count > i; i++)
+        reap(pids[i]);
+    ProcessMetricsDelete(metrics);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(cpu_test);
+    TEST(memory_test);
+    TEST(sweep_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file RefreshPolicyTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "RefreshPolicy.h"
+#include <math.h>
+
+static void select_test(void)
+{
+    /* every combination of inputs: heat first, then low power, then the power source */
+    for (int thermal = RefreshThermalNominal; RefreshThermalCritical >= thermal; thermal++)
+        for (unsigned lowPower = 0; 2 > lowPower; lowPower++)
+            for (unsigned onBattery = 0; 2 > onBattery; onBattery++)
+            {
+                RefreshPolicyState state = { onBattery, lowPower, thermal };
+                RefreshProfile expect =
+                    RefreshThermalSerious <= thermal ? RefreshProfileThermal :
+                    lowPower ? RefreshProfileLowPower :
+                    onBattery ? RefreshProfileBattery :
+                    RefreshProfileAC;
+                ASSERT(expect == RefreshPolicySelect(&state));
+            }
+}
+
+static void interval_test(void)
+{
+    /* intervals, coalescing and features follow the current profile as the state changes */
+    static const struct
+    {
+        RefreshPolicyState state;
+        RefreshProfile profile;
+        double scale, coalesce;
+        unsigned features;
+    } steps[] =
+    {
+        { { false, false, RefreshThermalNominal }, RefreshProfileAC, 1, 0, RefreshFeatureAll },
+        { { true, false, RefreshThermalNominal }, RefreshProfileBattery, 2, 0.5,
+            RefreshFeatureHover | RefreshFeatureThumbnails | RefreshFeatureLocation },
+        { { true, false, RefreshThermalFair }, RefreshProfileBattery, 2, 0.5,
+            RefreshFeatureHover | RefreshFeatureThumbnails | RefreshFeatureLocation },
+        { { true, true, RefreshThermalFair }, RefreshProfileLowPower, 4, 2, 0 },
+        { { false, true, RefreshThermalCritical }, RefreshProfileThermal, 4, 2, RefreshFeatureLocation },
+        { { false, false, RefreshThermalSerious }, RefreshProfileThermal, 4, 2, RefreshFeatureLocation },
+        { { false, false, RefreshThermalNominal }, RefreshProfileAC, 1, 0, RefreshFeatureAll },
+    };
+
+    RefreshPolicyState initial = { false, false, RefreshThermalNominal };
+    RefreshPolicyUpdate(&initial);
+    RefreshProfile last = RefreshPolicyGetProfile();
+    for (size_t i = 0; sizeof steps / sizeof steps[0] > i; i++)
+    {
+        /* an update reports a change only when the profile changes */
+        ASSERT((last != steps[i].profile) == RefreshPolicyUpdate(&steps[i].state));
+        ASSERT(!RefreshPolicyUpdate(&steps[i].state));
+        last = steps[i].profile;
+
+        ASSERT(steps[i].profile == RefreshPolicyGetProfile());
+        ASSERT(steps[i].scale * 60 == RefreshPolicyInterval(60));
+        ASSERT(steps[i].scale * 0.25 == RefreshPolicyInterval(0.25));
+        ASSERT(steps[i].coalesce == RefreshPolicyCoalesceDelay());
+        for (unsigned feature = 1; RefreshFeatureAll >= feature; feature <<= 1)
+            ASSERT((0 != (steps[i].features & feature)) == RefreshPolicyEnabled(feature));
+        ASSERT((steps[i].features == RefreshFeatureAll) ==
+            RefreshPolicyEnabled(RefreshFeatureHover | RefreshFeatureBatteryPolling));
+    }
+}
+
+static void profile_test(void)
+{
+    /* profiles can be tuned; values are clamped to sane ranges */
+    RefreshProfileInfo saved, info;
+    RefreshProfileGetInfo(RefreshProfileBattery, &saved);
+
+    RefreshProfileSetInfo(RefreshProfileBattery,
+        &(RefreshProfileInfo){ 3, 1, RefreshFeatureHover | 0x100 });
+    RefreshProfileGetInfo(RefreshProfileBattery, &info);
+    ASSERT(3 == info.scale && 1 == info.coalesce && RefreshFeatureHover == info.features);
+
+    RefreshPolicyUpdate(&(RefreshPolicyState){ true, false, RefreshThermalNominal });
+    ASSERT(30 == RefreshPolicyInterval(10));
+    ASSERT(RefreshPolicyEnabled(RefreshFeatureHover));
+    ASSERT(!RefreshPolicyEnabled(RefreshFeatureThumbnails));
+
+    /* a profile never refreshes faster than the widget asks, nor coalesces negatively */
+    RefreshProfileSetInfo(RefreshProfileBattery, &(RefreshProfileInfo){ 0.5, -1, 0 });
+    RefreshProfileGetInfo(RefreshProfileBattery, &info);
+    ASSERT(1 == info.scale && 0 == info.coalesce);
+    ASSERT(10 == RefreshPolicyInterval(10));
+
+    RefreshProfileSetInfo(RefreshProfileBattery, &saved);
+    RefreshProfileSetInfo(RefreshProfileCount, &info);
+    RefreshProfileGetInfo(RefreshProfileCount, &info);      /* falls back to AC */
+    ASSERT(1 == info.scale && RefreshFeatureAll == info.features);
+
+    /* names round trip */
+    for (unsigned p = 0; RefreshProfileCount > p; p++)
+        ASSERT(p == RefreshProfileFromName(RefreshProfileName((RefreshProfile)p)));
+    ASSERT(RefreshProfileCount == RefreshProfileFromName("Turbo"));
+    ASSERT(0 == strcmp("?", RefreshProfileName(RefreshProfileCount)));
+
+    RefreshPolicyUpdate(&(RefreshPolicyState){ false, false, RefreshThermalNominal });
+}
+
+static void wakeups_test(void)
+{
+    /* estimates cover the registered timers as each profile would run them */
+    RefreshPolicyTimerSet("clock", 1, 0, false);
+    RefreshPolicyTimerSet("weather", 600, RefreshFeatureLocation, true);
+    RefreshPolicyTimerSet("battery", 60, RefreshFeatureBatteryPolling, true);
+    RefreshPolicyTimerSet("metrics", 2, 0, true);
+
+    ASSERT(fabs(3600 + 6 + 60 + 1800 - RefreshPolicyWakeupsPerHour(RefreshProfileAC)) < 1e-9);
+    ASSERT(fabs(3600 + 3 + 0 + 900 - RefreshPolicyWakeupsPerHour(RefreshProfileBattery)) < 1e-9);
+    ASSERT(fabs(3600 + 0 + 0 + 450 - RefreshPolicyWakeupsPerHour(RefreshProfileLowPower)) < 1e-9);
+    ASSERT(fabs(3600 + 1.5 + 0 + 450 - RefreshPolicyWakeupsPerHour(RefreshProfileThermal)) < 1e-9);
+    ASSERT(0 == RefreshPolicyWakeupsPerHour(RefreshProfileCount));
+
+    /* timers are replaced by name and cleared by name or by a zero interval */
+    RefreshPolicyTimerSet("metrics", 4, 0, true);
+    RefreshPolicyTimerClear("clock");
+    RefreshPolicyTimerSet("battery", 0, RefreshFeatureBatteryPolling, true);
+    RefreshPolicyTimerClear("missing");
+    ASSERT(fabs(6 + 900 - RefreshPolicyWakeupsPerHour(RefreshProfileAC)) < 1e-9);
+
+    /* sizing: a call with no buffer returns the length; short buffers are truncated */
+    size_t length = RefreshPolicyFormat(0, 0);
+    char *buf = malloc(length + 1), small[16];
+    ASSERT(0 != buf);
+    ASSERT(length == RefreshPolicyFormat(buf, length + 1));
+    ASSERT(length == strlen(buf));
+    ASSERT(0 != strstr(buf, "(current: AC)"));
+    ASSERT(0 != strstr(buf, "\nweather ") && 0 != strstr(buf, "\nmetrics "));
+    ASSERT(0 == strstr(buf, "\nclock "));
+    ASSERT(length == RefreshPolicyFormat(small, sizeof small));
+    ASSERT(sizeof small - 1 == strlen(small));
+    free(buf);
+
+    RefreshPolicyTimerClear("weather");
+    RefreshPolicyTimerClear("metrics");
+    ASSERT(0 == RefreshPolicyWakeupsPerHour(RefreshProfileAC));
+
+    /* past the limit timers go unreported */
+    char name[32];
+    for (unsigned i = 0; 40 > i; i++)
+    {
+        snprintf(name, sizeof name, "timer%u", i);
+        RefreshPolicyTimerSet(name, 3600, 0, false);
+    }
+    ASSERT(32 == RefreshPolicyWakeupsPerHour(RefreshProfileAC));
+    for (unsigned i = 0; 40 > i; i++)
+    {
+        snprintf(name, sizeof name, "timer%u", i);
+        RefreshPolicyTimerClear(name);
+    }
+    ASSERT(0 == RefreshPolicyWakeupsPerHour(RefreshProfileAC));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* the per-tick queries that widgets make */
+    unsigned iterations = 10000000;
+    double sum = 0;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        sum += RefreshPolicyInterval(1) + RefreshPolicyEnabled(RefreshFeatureHover);
+    uint64_t t1 = TestNow();
+    ASSERT(0 < sum);
+
+    printf("interval + enabled: %.1f ns\n", (double)(t1 - t0) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(select_test);
+    TEST(interval_test);
+    TEST(profile_test);
+    TEST(wakeups_test);
+    TEST(bench);
+
+    return 0;
+}
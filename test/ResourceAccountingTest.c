@@ -0,0 +1,251 @@
+/**
+ * @file ResourceAccountingTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "ResourceAccounting.h"
+#include <unistd.h>
+
+/* built with a short ResourceAccountWindow, so that budgets act within the test */
+
+static void burn(double seconds)
+{
+    volatile uint64_t sink = 0;
+    uint64_t t0 = TestNow();
+    while (TestNow() - t0 < (uint64_t)(seconds * 1e9))
+        sink += 1;
+}
+
+static void idle(double seconds)
+{
+    struct timespec ts = { 0, (long)(seconds * 1e9) };
+    nanosleep(&ts, 0);
+}
+
+static ResourceAccountStats stats_named(const char *name)
+{
+    ResourceAccountStats stats[64];
+    size_t count = ResourceAccountingGetStats(stats, 64);
+    for (size_t i = 0; count > i; i++)
+        if (0 == strcmp(name, stats[i].name))
+            return stats[i];
+    ASSERT(0);
+    return stats[0];
+}
+
+static void span(ResourceAccount *account, double seconds)
+{
+    ResourceSpan span;
+    ResourceAccountBegin(account, &span);
+    burn(seconds);
+    ResourceAccountEnd(&span);
+}
+
+static void wakeup_test(void)
+{
+    /* each span is one wakeup and adds the thread CPU time it used */
+    ResourceAccount *account = ResourceAccountGet("wakeups");
+    ASSERT(0 != account);
+    ASSERT(account == ResourceAccountGet("wakeups"));
+
+    for (unsigned i = 0; 10 > i; i++)
+        span(account, 0.002);
+    ResourceAccountStats stats = stats_named("wakeups");
+    ASSERT(10 == stats.wakeups && 0 == stats.skipped);
+    ASSERT(0.005 < stats.cpuTime && 1 > stats.cpuTime);
+
+    /* without a budget every refresh runs and nothing is throttled */
+    for (unsigned i = 0; 100 > i; i++)
+        ASSERT(ResourceAccountShouldRun(account));
+    stats = stats_named("wakeups");
+    ASSERT(0 == stats.budget && 1 == stats.throttle && 0 == stats.skipped);
+
+    /* no heap probe, no heap figures */
+    ASSERT(0 == stats.allocations && 0 == stats.bytes);
+}
+
+static uint64_t ProbeBlocks, ProbeBytes;
+
+static void probe(uint64_t *blocks, uint64_t *bytes)
+{
+    *blocks = ProbeBlocks;
+    *bytes = ProbeBytes;
+}
+
+static void heap_test(void)
+{
+    /* a probe attributes the heap growth between Begin and End to the span */
+    ResourceAccount *account = ResourceAccountGet("heap");
+    ResourceSpan span;
+    ASSERT(0 != account);
+
+    ProbeBlocks = 100, ProbeBytes = 10000;
+    ResourceAccountingSetHeapProbe(probe);
+    ResourceAccountBegin(account, &span);
+    ProbeBlocks += 5, ProbeBytes += 640;
+    ResourceAccountEnd(&span);
+
+    ResourceAccountBegin(account, &span);
+    ProbeBlocks -= 2, ProbeBytes -= 1000;   /* frees: fewer bytes, no allocations */
+    ResourceAccountEnd(&span);
+
+    ResourceAccountStats stats = stats_named("heap");
+    ASSERT(2 == stats.wakeups && 5 == stats.allocations && -360 == stats.bytes);
+
+    /* a span keeps the probe it began with; turning the probe off stops the figures */
+    ResourceAccountBegin(account, &span);
+    ResourceAccountingSetHeapProbe(0);
+    ProbeBlocks += 1, ProbeBytes += 1;
+    ResourceAccountEnd(&span);
+    ResourceAccountBegin(account, &span);
+    ProbeBlocks += 1, ProbeBytes += 1;
+    ResourceAccountEnd(&span);
+    stats = stats_named("heap");
+    ASSERT(4 == stats.wakeups && 6 == stats.allocations && -359 == stats.bytes);
+
+    /* disabling always works; enabling needs a platform probe */
+    ASSERT(ResourceAccountingEnableHeapProbe(false));
+#if defined(__APPLE__)
+    ASSERT(ResourceAccountingEnableHeapProbe(true));
+    ASSERT(ResourceAccountingEnableHeapProbe(false));
+#else
+    ASSERT(!ResourceAccountingEnableHeapProbe(true));
+#endif
+}
+
+static void budget_test(void)
+{
+    /* over budget: the divisor doubles every window, up to the maximum */
+    ResourceAccount *account = ResourceAccountGet("budget");
+    ASSERT(0 != account);
+
+    ResourceAccountSetBudget(account, 0.25);
+    ASSERT(0.25 == stats_named("budget").budget);
+
+    unsigned expect = 1;
+    for (unsigned n = 0; 6 > n; n++)
+    {
+        span(account, ResourceAccountWindow * 1.2);
+        if (ResourceAccountMaxThrottle > expect)
+            expect *= 2;
+        ResourceAccountStats stats = stats_named("budget");
+        ASSERT(0.25 < stats.usage);
+        ASSERT(expect == stats.throttle);
+    }
+
+    /* a throttled account lets every Nth refresh through and counts the rest */
+    uint64_t skipped = stats_named("budget").skipped;
+    unsigned runs = 0;
+    for (unsigned i = 0; 64 * ResourceAccountMaxThrottle > i; i++)
+        runs += ResourceAccountShouldRun(account);
+    ASSERT(64 == runs);
+    ASSERT(skipped + 64 * (ResourceAccountMaxThrottle - 1) == stats_named("budget").skipped);
+
+    /* usage below half the budget halves the divisor each window */
+    while (1 < expect)
+    {
+        idle(ResourceAccountWindow * 1.2);
+        span(account, 0);
+        expect /= 2;
+        ResourceAccountStats stats = stats_named("budget");
+        ASSERT(0.125 > stats.usage);
+        ASSERT(expect == stats.throttle);
+    }
+
+    /* usage between half the budget and the budget holds the divisor */
+    span(account, ResourceAccountWindow * 1.2);
+    ASSERT(2 == stats_named("budget").throttle);
+    ResourceAccountSetBudget(account, 1.2);
+    span(account, ResourceAccountWindow * 1.2);
+    ASSERT(2 == stats_named("budget").throttle);
+
+    /* removing the budget restores the full rate at once */
+    ResourceAccountSetBudget(account, -1);
+    ResourceAccountStats stats = stats_named("budget");
+    ASSERT(0 == stats.budget && 1 == stats.throttle);
+    span(account, ResourceAccountWindow * 1.2);
+    ASSERT(1 == stats_named("budget").throttle);
+}
+
+static void format_test(void)
+{
+    /* sizing: a call with no buffer returns the length; short buffers are truncated */
+    size_t length = ResourceAccountingFormat(0, 0);
+    char *buf = malloc(length + 1), small[16];
+    ASSERT(0 != buf);
+    ASSERT(length == ResourceAccountingFormat(buf, length + 1));
+    ASSERT(length == strlen(buf));
+    ASSERT(0 == strncmp("Widget", buf, 6));
+    ASSERT(0 != strstr(buf, "\nbudget "));
+    ASSERT(length == ResourceAccountingFormat(small, sizeof small));
+    ASSERT(sizeof small - 1 == strlen(small));
+
+    char path[] = "/tmp/ResourceAccountingTest.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(-1 != fd);
+    close(fd);
+    ASSERT(ResourceAccountingDump(path));
+    FILE *file = fopen(path, "r");
+    ASSERT(0 != file);
+    char *dump = malloc(length + 2);
+    ASSERT(length == fread(dump, 1, length + 1, file));
+    ASSERT(0 == memcmp(buf, dump, length));
+    fclose(file);
+    unlink(path);
+    free(dump);
+    free(buf);
+
+    /* past the limit accounts share the last slot */
+    char name[32];
+    for (unsigned i = 0; 64 > i; i++)
+    {
+        snprintf(name, sizeof name, "extra%u", i);
+        ASSERT(0 != ResourceAccountGet(name));
+    }
+    ASSERT(ResourceAccountGet("extra62") == ResourceAccountGet("extra63"));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    ResourceAccount *account = ResourceAccountGet("bench");
+    ResourceSpan span;
+    unsigned iterations = 1000000;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+    {
+        ResourceAccountBegin(account, &span);
+        ResourceAccountEnd(&span);
+    }
+    uint64_t t1 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        ResourceAccountShouldRun(account);
+    uint64_t t2 = TestNow();
+
+    printf("span: %.1f ns\n", (double)(t1 - t0) / iterations);
+    printf("should run: %.1f ns\n", (double)(t2 - t1) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(wakeup_test);
+    TEST(heap_test);
+    TEST(budget_test);
+    TEST(format_test);
+    TEST(bench);
+
+    return 0;
+}
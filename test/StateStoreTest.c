@@ -0,0 +1,267 @@
+/**
+ * @file StateStoreTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "StateStore.h"
+#include <pthread.h>
+
+typedef struct
+{
+    double level;
+    int32_t charging;
+    int32_t minutes;
+    char source[12];
+} Battery;
+
+static const StateStoreField BatteryFields[] =
+{
+    StateStoreFieldOf(Battery, level),
+    StateStoreFieldOf(Battery, charging),
+    StateStoreFieldOf(Battery, minutes),
+    StateStoreFieldOf(Battery, source),
+};
+
+enum
+{
+    BatteryLevel = 1 << 0,
+    BatteryCharging = 1 << 1,
+    BatteryMinutes = 1 << 2,
+    BatterySource = 1 << 3,
+    BatteryAll = 0xf,
+};
+
+static unsigned ScheduleCount;
+
+static void schedule(void *data)
+{
+    ASSERT(&ScheduleCount == data);
+    ScheduleCount++;
+}
+
+static void update_test(void)
+{
+    Battery initial = { 0.5, 0, 120, "Battery" }, state, read;
+    StateStoreStats stats;
+    uint64_t version;
+
+    StateStore *store = StateStoreCreate(sizeof(Battery),
+        BatteryFields, 4, &initial, schedule, &ScheduleCount);
+    ASSERT(0 != store);
+    ScheduleCount = 0;
+
+    /* the initial state is version 0 */
+    ASSERT(0 == StateStoreRead(store, &read));
+    ASSERT(0 == memcmp(&initial, &read, sizeof read));
+    ASSERT(0 == StateStoreVersion(store));
+
+    /* only the listed fields that differ count, and only they are taken */
+    state = initial;
+    state.level = 0.6;
+    state.minutes = 90;
+    ASSERT(BatteryLevel == StateStoreUpdate(store, &state, BatteryLevel | BatteryCharging));
+    ASSERT(1 == StateStoreRead(store, &read));
+    ASSERT(0.6 == read.level && 120 == read.minutes);
+    ASSERT(1 == ScheduleCount);
+
+    /* same values: no new version, no schedule */
+    ASSERT(0 == StateStoreUpdate(store, &state, BatteryAll & ~BatteryMinutes));
+    ASSERT(1 == StateStoreVersion(store) && 1 == ScheduleCount);
+
+    /* more changes before the flush merge into one delta and one notification */
+    ASSERT(BatteryMinutes == StateStoreUpdate(store, &state, BatteryAll));
+    state.charging = 1;
+    strcpy(state.source, "AC Power");
+    ASSERT((BatteryCharging | BatterySource) == StateStoreUpdate(store, &state, BatteryAll));
+    ASSERT(1 == ScheduleCount);
+    ASSERT(BatteryAll == StateStoreFlush(store, &version));
+    ASSERT(3 == version);
+    ASSERT(3 == StateStoreRead(store, &read));
+    ASSERT(0 == memcmp(&state, &read, sizeof read));
+
+    /* an empty flush is not counted; the next change schedules again */
+    ASSERT(0 == StateStoreFlush(store, 0));
+    state.level = 0.7;
+    ASSERT(BatteryLevel == StateStoreUpdate(store, &state, BatteryAll));
+    ASSERT(2 == ScheduleCount);
+    ASSERT(BatteryLevel == StateStoreFlush(store, 0));
+
+    StateStoreGetStats(store, &stats);
+    ASSERT(5 == stats.updates && 4 == stats.changes);
+    ASSERT(2 == stats.schedules && 2 == stats.flushes && 0 == stats.retries);
+
+    StateStoreDelete(store);
+    StateStoreDelete(0);
+}
+
+static void create_test(void)
+{
+    static StateStoreField fields[StateStoreFieldMax + 1];
+    char bytes[13];
+
+    /* too many fields, or fields outside the state, are refused */
+    for (size_t i = 0; StateStoreFieldMax + 1 > i; i++)
+        fields[i] = (StateStoreField){ 0, 1 };
+    ASSERT(0 == StateStoreCreate(sizeof bytes, fields, StateStoreFieldMax + 1, 0, 0, 0));
+    ASSERT(0 == StateStoreCreate(sizeof bytes, &(StateStoreField){ 12, 2 }, 1, 0, 0, 0));
+    ASSERT(0 == StateStoreCreate(sizeof bytes, &(StateStoreField){ 14, 0 }, 1, 0, 0, 0));
+
+    /* all 64 fields; no initial state is zeros; no scheduler is fine */
+    StateStore *store = StateStoreCreate(sizeof bytes, fields, StateStoreFieldMax, 0, 0, 0);
+    ASSERT(0 != store);
+    StateStoreDelete(store);
+
+    /* a size that is not a whole number of words: reads stop at the size */
+    for (size_t i = 0; sizeof bytes > i; i++)
+        fields[i] = (StateStoreField){ i, 1 };
+    store = StateStoreCreate(sizeof bytes, fields, sizeof bytes, 0, 0, 0);
+    ASSERT(0 != store);
+
+    union { uint64_t words[2]; char bytes[16]; } buf;
+    memset(&buf, 0x55, sizeof buf);
+    ASSERT(0 == StateStoreRead(store, &buf));
+    for (size_t i = 0; sizeof bytes > i; i++)
+        ASSERT(0 == buf.bytes[i]);
+    for (size_t i = sizeof bytes; sizeof buf > i; i++)
+        ASSERT(0x55 == buf.bytes[i]);
+
+    memcpy(bytes, "hello, world", sizeof bytes);
+    /* all but the first byte; the terminator was zero already */
+    ASSERT((1ULL << (sizeof bytes - 1)) - 2 == StateStoreUpdate(store, bytes, ~1ULL));
+    ASSERT(1 == StateStoreRead(store, &buf));
+    ASSERT('\0' == buf.bytes[0] && 0 == memcmp(buf.bytes + 1, "ello, world", sizeof bytes - 1));
+    ASSERT(0x55 == buf.bytes[sizeof bytes]);
+
+    StateStoreDelete(store);
+}
+
+/*
+ * Torn reads: a writer publishes states whose every word is derived from the
+ * version; a reader checks each snapshot it gets against its version. The
+ * threads never yield: on a single CPU they interleave only when preempted,
+ * which for a large state is often in the middle of a publish or a read.
+ */
+enum { TornWords = 512, TornUpdates = 20000 };
+
+typedef struct
+{
+    uint64_t version;
+    uint64_t words[TornWords];
+    uint8_t tail;
+} Torn;
+
+static const StateStoreField TornFields[] =
+{
+    StateStoreFieldOf(Torn, version),
+    StateStoreFieldOf(Torn, words),
+    StateStoreFieldOf(Torn, tail),
+};
+
+static StateStore *TornStore;
+
+static void *torn_writer(void *data)
+{
+    static Torn state;
+    for (uint64_t n = 1; TornUpdates >= n; n++)
+    {
+        state.version = n;
+        for (size_t i = 0; TornWords > i; i++)
+            state.words[i] = n * 0x9e3779b97f4a7c15ULL + i;
+        state.tail = (uint8_t)n;
+        ASSERT(0 != StateStoreUpdate(TornStore, &state, 7));
+    }
+    return 0;
+}
+
+static void *torn_reader(void *data)
+{
+    static Torn state;
+    uint64_t last = 0;
+    while (TornUpdates > last)
+    {
+        uint64_t version = StateStoreRead(TornStore, &state);
+        ASSERT(last <= version && version == state.version);
+        for (size_t i = 0; TornWords > i; i++)
+            ASSERT(version * 0x9e3779b97f4a7c15ULL + i == state.words[i] || 0 == version);
+        ASSERT((uint8_t)version == state.tail);
+        last = version;
+    }
+    return 0;
+}
+
+static void torn_test(void)
+{
+    pthread_t writer, reader;
+    StateStoreStats stats;
+
+    TornStore = StateStoreCreate(sizeof(Torn), TornFields, 3, 0, 0, 0);
+    ASSERT(0 != TornStore);
+
+    ASSERT(0 == pthread_create(&reader, 0, torn_reader, 0));
+    ASSERT(0 == pthread_create(&writer, 0, torn_writer, 0));
+    pthread_join(writer, 0);
+    pthread_join(reader, 0);
+
+    StateStoreGetStats(TornStore, &stats);
+    ASSERT(TornUpdates == stats.updates && TornUpdates == stats.changes);
+
+    StateStoreDelete(TornStore);
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* uncontended: what a widget pays to read or publish a small state */
+    Battery state = { 0.5, 0, 120, "Battery" };
+    StateStore *store = StateStoreCreate(sizeof(Battery), BatteryFields, 4, &state, 0, 0);
+    ASSERT(0 != store);
+
+    unsigned iterations = 10000000;
+    double sum = 0;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+    {
+        StateStoreRead(store, &state);
+        sum += state.level;
+    }
+    uint64_t t1 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+    {
+        state.minutes = (int32_t)i;
+        StateStoreUpdate(store, &state, BatteryAll);
+    }
+    uint64_t t2 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        StateStoreUpdate(store, &state, BatteryAll);
+    uint64_t t3 = TestNow();
+    ASSERT(0 < sum);
+
+    printf("read: %.1f ns\n", (double)(t1 - t0) / iterations);
+    printf("update (changed): %.1f ns\n", (double)(t2 - t1) / iterations);
+    printf("update (same): %.1f ns\n", (double)(t3 - t2) / iterations);
+
+    StateStoreDelete(store);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(update_test);
+    TEST(create_test);
+    TEST(torn_test);
+    TEST(bench);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file SystemMetricsTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "SystemMetrics.h"
+#include <dirent.h>
+
+static int open_fd_count(void)
+{
+    /* -1 where the process cannot list its descriptors */
+    DIR *dir = opendir("/proc/self/fd");
+    if (0 == dir)
+        dir = opendir("/dev/fd");
+    if (0 == dir)
+        return -1;
+    int count = 0;
+    while (0 != readdir(dir))
+        count++;
+    closedir(dir);
+    return count;
+}
+
+static void sample_test(void)
+{
+    SystemMetricsSampler *sampler = SystemMetricsSamplerCreate();
+    SystemMetricsSample sample;
+    SystemMetricsCost cost;
+    ASSERT(0 != sampler);
+
+    /* the first call has no previous counters: levels only, zero rates */
+    ASSERT(SystemMetricsSamplerSample(sampler, &sample));
+    ASSERT(0 <= sample.cpu && 1 >= sample.cpu);
+    ASSERT(0 < sample.memory && 1 >= sample.memory);
+    ASSERT(0 == sample.netIn && 0 == sample.netOut);
+    ASSERT(0 == sample.diskRead && 0 == sample.diskWrite);
+
+    /* a busy interval shows up as CPU; rates are never negative */
+    uint64_t t0 = TestNow();
+    volatile uint64_t sink = 0;
+    while (TestNow() - t0 < 100000000)
+        sink += 1;
+    ASSERT(SystemMetricsSamplerSample(sampler, &sample));
+    ASSERT(0 < sample.cpu && 1 >= sample.cpu);
+    ASSERT(0 < sample.memory && 1 >= sample.memory);
+    ASSERT(0 <= sample.netIn && 0 <= sample.netOut);
+    ASSERT(0 <= sample.diskRead && 0 <= sample.diskWrite);
+
+    /* every call is counted and timed, failed or not */
+    SystemMetricsSamplerGetCost(sampler, &cost);
+    ASSERT(2 == cost.count && 0 < cost.time);
+
+    SystemMetricsSamplerDelete(sampler);
+    SystemMetricsSamplerDelete(0);
+}
+
+static void batch_test(void)
+{
+    /* a sample is one batch over sources opened once: no descriptors come or go per call */
+    int before = open_fd_count();
+    SystemMetricsSampler *sampler = SystemMetricsSamplerCreate();
+    SystemMetricsSample sample;
+    SystemMetricsCost cost;
+    ASSERT(0 != sampler);
+
+    int opened = open_fd_count();
+    for (unsigned i = 0; 1000 > i; i++)
+    {
+        ASSERT(SystemMetricsSamplerSample(sampler, &sample));
+        ASSERT(0 <= sample.cpu && 1 >= sample.cpu);
+    }
+    ASSERT(opened == open_fd_count());
+
+    /* one call per sample, however many sources it reads */
+    SystemMetricsSamplerGetCost(sampler, &cost);
+    ASSERT(1000 == cost.count);
+
+    SystemMetricsSamplerDelete(sampler);
+    ASSERT(before == open_fd_count());
+}
+
+static void history_test(void)
+{
+    /* a model of the last SystemMetricsHistoryCapacity levels, through wraps and clamping */
+    SystemMetricsHistory history = { 0 };
+    uint8_t model[SystemMetricsHistoryCapacity * 4], levels[SystemMetricsHistoryCapacity + 1];
+    uint64_t seed = 42;
+    size_t count = 0;
+
+    ASSERT(0 == SystemMetricsHistoryGet(&history, levels, SystemMetricsHistoryCapacity));
+
+    for (unsigned n = 0; SystemMetricsHistoryCapacity * 4 > n; n++)
+    {
+        /* extremes included: the largest steps still fit a byte delta */
+        unsigned level = 0 == n % 7 ? (n & 8 ? 0 : 1000) : (unsigned)(TestRandom(&seed) % 128);
+        SystemMetricsHistoryPush(&history, level);
+        model[count++] = (uint8_t)(SystemMetricsLevelMax < level ? SystemMetricsLevelMax : level);
+
+        size_t expect = SystemMetricsHistoryCapacity < count ? SystemMetricsHistoryCapacity : count;
+        ASSERT(expect == history.count);
+        ASSERT(expect == SystemMetricsHistoryGet(&history, levels, SystemMetricsHistoryCapacity + 1));
+        ASSERT(0 == memcmp(model + count - expect, levels, expect));
+
+        /* fewer than held: the most recent ones */
+        if (3 <= expect)
+        {
+            ASSERT(3 == SystemMetricsHistoryGet(&history, levels, 3));
+            ASSERT(0 == memcmp(model + count - 3, levels, 3));
+        }
+    }
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    SystemMetricsSampler *sampler = SystemMetricsSamplerCreate();
+    SystemMetricsSample sample;
+    SystemMetricsCost cost;
+    ASSERT(0 != sampler);
+
+    unsigned samples = 10000;
+    uint64_t t0 = TestNow();
+    for (unsigned n = 0; samples > n; n++)
+        SystemMetricsSamplerSample(sampler, &sample);
+    uint64_t t1 = TestNow();
+    SystemMetricsSamplerGetCost(sampler, &cost);
+
+    printf("sample: %.1f us wall, %.1f us CPU\n",
+        (double)(t1 - t0) / samples / 1e3, cost.time / (double)cost.count * 1e6);
+
+    SystemMetricsSamplerDelete(sampler);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(sample_test);
+    TEST(batch_test);
+    TEST(history_test);
+    TEST(bench);
+
+    return 0;
+}
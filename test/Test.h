@@ -0,0 +1,73 @@
+/**
+ * @file Test.h
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#ifndef TEST_H_INCLUDED
+#define TEST_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Minimal harness for the portable C cores: ASSERT aborts with the failing
+ * expression, TEST runs a function and reports it, and TestBench is true when
+ * the test was run with -b (benchmarks are skipped otherwise).
+ */
+#define ASSERT(x)                       \
+    do                                  \
+    {                                   \
+        if (!(x))                       \
+        {                               \
+            fprintf(stderr, "%s:%d: ASSERT(%s) failed\n", __FILE__, __LINE__, #x);\
+            abort();                    \
+        }                               \
+    } while (0)
+
+#define TEST(fn)                        \
+    do                                  \
+    {                                   \
+        fn();                           \
+        printf("%s: ok\n", #fn);        \
+    } while (0)
+
+static bool TestBench;
+
+static inline void TestInit(int argc, char *argv[])
+{
+    for (int i = 1; argc > i; i++)
+        if (0 == strcmp("-b", argv[i]))
+            TestBench = true;
+}
+
+static inline uint64_t TestNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t TestRandom(uint64_t *state)
+{
+    /* xorshift64*; deterministic so that failures reproduce */
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+#endif
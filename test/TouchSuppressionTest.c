@@ -0,0 +1,181 @@
+/**
+ * @file TouchSuppressionTest.c
+ *
+ * @copyright 2018-2019 Bill Zissimopoulos
+ */
+/*
+ * This file is part of EnergyBar.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ */
+
+#include "Test.h"
+#include "TouchSuppression.h"
+#include <math.h>
+
+/*
+ * Key down timestamps recorded from three typists (seconds since boot, as
+ * event timestamps are): a steady typist with a pause to think, a fast typist,
+ * and a hunt-and-peck typist.
+ */
+static const double SteadyKeys[] =
+{
+    5210.412, 5210.577, 5210.731, 5210.902, 5211.049, 5211.233, 5211.381, 5211.548,
+    5211.706, 5211.889, 5212.031, 5212.198, 5212.349,
+    /* thinking */
+    5214.960, 5215.121, 5215.283, 5215.429, 5215.604, 5215.752, 5215.917,
+};
+static const double FastKeys[] =
+{
+    8103.100, 8103.171, 8103.236, 8103.309, 8103.372, 8103.441, 8103.509, 8103.575,
+    8103.648, 8103.713, 8103.780, 8103.846, 8103.917, 8103.981, 8104.052, 8104.118,
+    8104.183, 8104.255, 8104.321, 8104.388, 8104.452, 8104.521, 8104.587, 8104.655,
+};
+static const double SlowKeys[] =
+{
+    9400.000, 9400.512, 9400.931, 9401.420, 9401.873, 9402.391, 9402.850, 9403.302,
+    9403.798, 9404.251,
+};
+
+#define InitialWindow                   0.3
+
+static bool near(double a, double b)
+{
+    return fabs(a - b) < 1e-9;
+}
+
+typedef struct
+{
+    double lastKey, cadence;
+    unsigned measured;
+} Model;
+
+static void replay(TouchSuppression *suppression, Model *model, const double *keys, size_t count)
+{
+    /* a model of the window next to the real thing, checked after every key */
+    for (size_t i = 0; count > i; i++)
+    {
+        double interval = keys[i] - model->lastKey;
+        if (0 != model->lastKey && 0 < interval && TouchSuppressionBurstGap > interval)
+        {
+            model->cadence = 0 == model->measured ?
+                interval : model->cadence + (interval - model->cadence) / 8;
+            model->measured++;
+        }
+        model->lastKey = keys[i];
+
+        TouchSuppressionKeyDown(suppression, keys[i]);
+
+        double window = TouchSuppressionWarmupCount > model->measured ? InitialWindow :
+            fmin(TouchSuppressionMaxWindow,
+                fmax(TouchSuppressionMinWindow, model->cadence * TouchSuppressionCadenceScale));
+        ASSERT(near(window, TouchSuppressionWindow(suppression)));
+
+        /* touches are ignored for exactly the window after each key */
+        ASSERT(TouchSuppressionActive(suppression, keys[i]));
+        ASSERT(TouchSuppressionActive(suppression, keys[i] + window - 1e-6));
+        ASSERT(!TouchSuppressionActive(suppression, keys[i] + window + 1e-6));
+    }
+}
+
+static void steady_test(void)
+{
+    TouchSuppression suppression;
+    Model model = { 0 };
+
+    TouchSuppressionInit(&suppression, InitialWindow);
+    ASSERT(InitialWindow == TouchSuppressionWindow(&suppression));
+    ASSERT(!TouchSuppressionActive(&suppression, SteadyKeys[0]));
+
+    /* the first keys use the initial window; then about twice the ~0.16s cadence */
+    replay(&suppression, &model, SteadyKeys, 13);
+    ASSERT(0.30 < TouchSuppressionWindow(&suppression) && 0.35 > TouchSuppressionWindow(&suppression));
+
+    /* a pause to think ends the burst: it is not an interval between keys */
+    double window = TouchSuppressionWindow(&suppression);
+    ASSERT(!TouchSuppressionActive(&suppression, SteadyKeys[13] - 0.001));
+    replay(&suppression, &model, SteadyKeys + 13, 1);
+    ASSERT(window == TouchSuppressionWindow(&suppression));
+
+    replay(&suppression, &model, SteadyKeys + 14,
+        sizeof SteadyKeys / sizeof SteadyKeys[0] - 14);
+}
+
+static void clamp_test(void)
+{
+    TouchSuppression suppression;
+    Model model = { 0 };
+
+    /* a fast typist is held to the minimum window */
+    TouchSuppressionInit(&suppression, InitialWindow);
+    replay(&suppression, &model, FastKeys, sizeof FastKeys / sizeof FastKeys[0]);
+    ASSERT(TouchSuppressionMinWindow == TouchSuppressionWindow(&suppression));
+
+    /* a slow one to the maximum */
+    TouchSuppressionInit(&suppression, InitialWindow);
+    model = (Model){ 0 };
+    replay(&suppression, &model, SlowKeys, sizeof SlowKeys / sizeof SlowKeys[0]);
+    ASSERT(TouchSuppressionMaxWindow == TouchSuppressionWindow(&suppression));
+
+    /* the cadence follows the typist: fast after slow comes down smoothly, not at once */
+    replay(&suppression, &model, FastKeys, 6);
+    ASSERT(TouchSuppressionMinWindow < TouchSuppressionWindow(&suppression));
+    ASSERT(TouchSuppressionMaxWindow > TouchSuppressionWindow(&suppression));
+    replay(&suppression, &model, FastKeys + 6,
+        sizeof FastKeys / sizeof FastKeys[0] - 6);
+    ASSERT(TouchSuppressionMinWindow + 0.05 > TouchSuppressionWindow(&suppression));
+}
+
+static void order_test(void)
+{
+    /* keys with the same or earlier timestamps move the deadline but not the cadence */
+    TouchSuppression suppression;
+    TouchSuppressionInit(&suppression, InitialWindow);
+
+    for (unsigned i = 0; 8 > i; i++)
+        TouchSuppressionKeyDown(&suppression, 100 + i * 0.2);
+    double window = TouchSuppressionWindow(&suppression);
+    ASSERT(near(0.4, window));
+
+    TouchSuppressionKeyDown(&suppression, 101.4);
+    TouchSuppressionKeyDown(&suppression, 101.3);
+    ASSERT(window == TouchSuppressionWindow(&suppression));
+    ASSERT(TouchSuppressionActive(&suppression, 101.3 + window - 1e-6));
+    ASSERT(!TouchSuppressionActive(&suppression, 101.3 + window + 1e-6));
+}
+
+static void bench(void)
+{
+    if (!TestBench)
+        return;
+
+    /* a key down per keystroke, a check per hit test */
+    TouchSuppression suppression;
+    TouchSuppressionInit(&suppression, InitialWindow);
+    unsigned iterations = 10000000, active = 0;
+    uint64_t t0 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        TouchSuppressionKeyDown(&suppression, 1000 + i * 0.15);
+    uint64_t t1 = TestNow();
+    for (unsigned i = 0; iterations > i; i++)
+        active += TouchSuppressionActive(&suppression, 1000 + i * 0.15);
+    uint64_t t2 = TestNow();
+    ASSERT(0 < active);
+
+    printf("key down: %.1f ns\n", (double)(t1 - t0) / iterations);
+    printf("active: %.1f ns\n", (double)(t2 - t1) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    TestInit(argc, argv);
+
+    TEST(steady_test);
+    TEST(clamp_test);
+    TEST(order_test);
+    TEST(bench);
+
+    return 0;
+}